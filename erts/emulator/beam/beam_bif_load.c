@@ -1051,9 +1051,13 @@ literal_gc:
     if (c_p->flags & F_DISABLE_GC)
 	return THE_NON_VALUE;
 
-    FLAGS(c_p) |= F_NEED_FULLSWEEP;
-
-    *redsp += erts_garbage_collect_nobump(c_p, 0, c_p->arg_reg, c_p->arity, fcalls);
+    /*
+     * Literals are moved to the old heap without a major
+     * collection; only heap fragments need to be collected
+     * away first.
+     */
+    if (c_p->mbuf || c_p->msg_frag || c_p->abandoned_heap)
+	*redsp += erts_garbage_collect_direct(c_p, 0, c_p->arg_reg, c_p->arity, fcalls);
 
     erts_garbage_collect_literals(c_p, (Eterm *) literals, lit_bsize, oh);
 
@@ -1269,8 +1273,10 @@ check_process_code(Process* rp, Module* modp, Uint flags, int *redsp, int fcalls
     while (1) {
 
 	/* Check heap, stack etc... */
-	if (check_mod_funs(rp, &rp->off_heap, mod_start, mod_size))
+	if (check_mod_funs(rp, &rp->off_heap, mod_start, mod_size)) {
+	    need_gc |= ERTS_ORDINARY_GC__;
 	    goto try_gc;
+	}
 	if (any_heap_ref_ptrs(&rp->fvalue, &rp->fvalue+1, literals, lit_bsize)) {
 	    rp->freason = EXC_NULL;
 	    rp->fvalue = NIL;
@@ -1334,8 +1340,6 @@ check_process_code(Process* rp, Module* modp, Uint flags, int *redsp, int fcalls
 	need_gc |= ERTS_LITERAL_GC__;
 
     try_gc:
-	need_gc |= ERTS_ORDINARY_GC__;
-
 	if ((done_gc & need_gc) == need_gc)
 	    return am_true;
 
@@ -1355,11 +1359,18 @@ check_process_code(Process* rp, Module* modp, Uint flags, int *redsp, int fcalls
 
 	if (need_gc & ERTS_ORDINARY_GC__) {
 	    FLAGS(rp) |= F_NEED_FULLSWEEP;
-	    *redsp += erts_garbage_collect_nobump(rp, 0, rp->arg_reg, rp->arity, fcalls);
+	    *redsp += erts_garbage_collect_direct(rp, 0, rp->arg_reg, rp->arity, fcalls);
 	    done_gc |= ERTS_ORDINARY_GC__;
 	}
 	if (need_gc & ERTS_LITERAL_GC__) {
 	    struct erl_off_heap_header* oh;
+	    /*
+	     * Literals are moved to the old heap without a major
+	     * collection; only heap fragments need to be collected
+	     * away first.
+	     */
+	    if (rp->mbuf || rp->msg_frag || rp->abandoned_heap)
+		*redsp += erts_garbage_collect_direct(rp, 0, rp->arg_reg, rp->arity, fcalls);
 	    oh = modp->old.code_hdr->literal_area->off_heap;
 	    *redsp += lit_bsize / 64; /* Need, better value... */
 	    erts_garbage_collect_literals(rp, (Eterm*)literals, lit_bsize, oh);
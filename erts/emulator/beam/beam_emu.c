@@ -285,6 +285,18 @@ void** beam_ops;
      PROCESS_MAIN_CHK_LOCKS((P));					\
      ERTS_SMP_UNREQ_PROC_MAIN_LOCK((P))
 
+/*
+ * Let erts_find_running_function() attribute the allocations of the
+ * next operation to the current function, when allocations are
+ * attributed (+Mia) or sampled (+Mip). c_p->i is otherwise stale while
+ * the process is running.
+ */
+#define SAVE_I_FOR_INSTR(P)						\
+  do {									\
+      if (erts_instr_attribution | (erts_instr_sample_interval != 0))	\
+	  (P)->i = I;							\
+  } while (0)
+
 #define db(N) (N)
 #define tb(N) (N)
 #define xb(N) (*(Eterm *) (((unsigned char *)reg) + (N)))
@@ -1952,6 +1964,75 @@ void process_main(void)
      NextPF(1, next);
  }
 
+ OpCase(i_recv_set_index): {
+     /* As i_recv_set, for the indexed loop_rec that follows */
+     if (c_p->msg.mark == (BeamInstr *) (I+1)) {
+	 c_p->msg.save = c_p->msg.saved_last;
+     }
+     I++;
+     goto loop_rec_index_start__;
+ }
+
+    /*
+     * As i_loop_rec_f, but for a receive that only matches messages
+     * containing the reference in Arg(1). Messages that cannot match
+     * are skipped using the message queue index (erl_message.c).
+     */
+ OpCase(i_loop_rec_index_fy):
+ {
+     BeamInstr *next;
+     ErtsMessage* msgp;
+
+ loop_rec_index_start__:
+
+     ASSERT(!(c_p->flags & F_DELAY_GC));
+     c_p->flags |= F_DELAY_GC;
+
+ loop_rec_index__:
+
+     PROCESS_MAIN_CHK_LOCKS(c_p);
+
+     SWAPOUT; /* erts_msgq_index_next() may decode distribution messages */
+     msgp = erts_msgq_index_next(c_p, yb(Arg(1)));
+     SWAPIN;
+
+     if (!msgp) {
+#ifdef ERTS_SMP
+	 erts_smp_proc_lock(c_p, ERTS_PROC_LOCKS_MSG_RECEIVE);
+	 /* Make sure messages wont pass exit signals... */
+	 if (ERTS_PROC_PENDING_EXIT(c_p)) {
+	     erts_smp_proc_unlock(c_p, ERTS_PROC_LOCKS_MSG_RECEIVE);
+	     SWAPOUT;
+	     c_p->flags &= ~F_DELAY_GC;
+	     goto do_schedule; /* Will be rescheduled for exit */
+	 }
+	 ERTS_SMP_MSGQ_MV_INQ2PRIVQ(c_p);
+	 if (PEEK_MESSAGE(c_p)) {
+	     erts_smp_proc_unlock(c_p, ERTS_PROC_LOCKS_MSG_RECEIVE);
+	     goto loop_rec_index__;
+	 }
+#endif
+	 c_p->flags &= ~F_DELAY_GC;
+	 SET_I((BeamInstr *) Arg(0));
+	 Goto(*I);		/* Jump to a wait or wait_timeout instruction */
+     }
+     if (is_non_value(ERL_MESSAGE_TERM(msgp))) {
+	 SWAPOUT; /* erts_decode_dist_message() may write to heap... */
+	 if (!erts_decode_dist_message(c_p, ERTS_PROC_LOCK_MAIN, msgp, 0)) {
+	     /* Corrupt distribution message; remove it as loop_rec does */
+	     ASSERT(HTOP == c_p->htop && E == c_p->stop);
+	     UNLINK_MESSAGE(c_p, msgp);
+	     msgp->next = NULL;
+	     erts_cleanup_messages(msgp);
+	     goto loop_rec_index__;
+	 }
+	 SWAPIN;
+     }
+     PreFetch(2, next);
+     r(0) = ERL_MESSAGE_TERM(msgp);
+     NextPF(2, next);
+ }
+
  /*
   * Remove a (matched) message from the message queue.
   */
@@ -2035,6 +2116,8 @@ void process_main(void)
      UNLINK_MESSAGE(c_p, msgp);
      JOIN_MESSAGE(c_p);
      CANCEL_TIMER(c_p);
+     if (MAX_MSGQ_LEN_ACTION_GET(c_p) == MAX_MSGQ_LEN_SUSPEND)
+	 erts_msgq_resume_senders(c_p, ERTS_PROC_LOCK_MAIN, 0);
 
      erts_save_message_in_proc(c_p, msgp);
      c_p->flags &= ~F_DELAY_GC;
@@ -2068,6 +2151,8 @@ void process_main(void)
      SAVE_MESSAGE(c_p);
      if (FCALLS > 0 || FCALLS > neg_o_reds) {
 	 FCALLS--;
+	 if (*I == (BeamInstr) BeamOp(op_i_loop_rec_index_fy))
+	     goto loop_rec_index__;
 	 goto loop_rec__;
      }
 
@@ -2166,8 +2251,8 @@ void process_main(void)
 	     c_p->arity = 0;
 
 	     if (!ERTS_PTMR_IS_TIMED_OUT(c_p))
-		 erts_smp_atomic32_read_band_relb(&c_p->state,
-						  ~ERTS_PSFLG_ACTIVE);
+		 erts_proc_wait_inactivate(c_p, ERTS_PROC_LOCK_MAIN
+					   | ERTS_PROC_LOCKS_MSG_RECEIVE);
 	     ASSERT(!ERTS_PROC_IS_EXITING(c_p));
 	     erts_smp_proc_unlock(c_p, ERTS_PROC_LOCKS_MSG_RECEIVE);
 	     c_p->current = NULL;
@@ -2851,6 +2936,7 @@ do {						\
 	bf = GET_BIF_ADDRESS(Arg(0));
 
 	PRE_BIF_SWAPOUT(c_p);
+	SAVE_I_FOR_INSTR(c_p);
 	ERTS_DBG_CHK_REDS(c_p, FCALLS);
 	c_p->fcalls = FCALLS - 1;
 	if (FCALLS <= 0) {
@@ -3854,6 +3940,7 @@ do {						\
 	 /*
 	  * Allocate the binary struct itself.
 	  */
+	 SAVE_I_FOR_INSTR(c_p);
 	 bptr = erts_bin_nrml_alloc(num_bytes);
 	 erts_refc_init(&bptr->refc, 1);
 	 erts_current_bin = (byte *) bptr->orig_bytes;
@@ -3949,6 +4036,7 @@ do {						\
 	 /*
 	  * Allocate the binary struct itself.
 	  */
+	 SAVE_I_FOR_INSTR(c_p);
 	 bptr = erts_bin_nrml_alloc(BsOp1);
 	 erts_refc_init(&bptr->refc, 1);
 	 erts_current_bin = (byte *) bptr->orig_bytes;
@@ -4109,6 +4197,7 @@ do {						\
      GetArg1(4, Size);
      HEAVY_SWAPOUT;
      reg[live] = x(SCRATCH_X_REG);
+     SAVE_I_FOR_INSTR(c_p);
      res = erts_bs_append(c_p, reg, live, Size, Arg(1), Arg(3));
      HEAVY_SWAPIN;
      if (is_non_value(res)) {
@@ -4126,6 +4215,7 @@ do {						\
      Eterm Size, Src;
 
      GetArg2(2, Size, Src);
+     SAVE_I_FOR_INSTR(c_p);
      res = erts_bs_private_append(c_p, Src, Size, Arg(1));
      if (is_non_value(res)) {
 	 /* c_p->freason is already set (may be either BADARG or SYSTEM_LIMIT). */
@@ -4136,6 +4226,7 @@ do {						\
 
  OpCase(bs_init_writable): {
      HEAVY_SWAPOUT;
+     SAVE_I_FOR_INSTR(c_p);
      r(0) = erts_bs_init_writable(c_p, r(0));
      HEAVY_SWAPIN;
      Next(0);
@@ -6448,7 +6539,9 @@ erts_hibernate(Process* c_p, Eterm module, Eterm function, Eterm args, Eterm* re
         ERTS_SMP_MSGQ_MV_INQ2PRIVQ(c_p);
 	if (!c_p->msg.len)
 #endif
-	    erts_smp_atomic32_read_band_relb(&c_p->state, ~ERTS_PSFLG_ACTIVE);
+	    erts_proc_wait_inactivate(c_p, (ERTS_PROC_LOCK_MAIN
+					    | ERTS_PROC_LOCK_MSGQ
+					    | ERTS_PROC_LOCK_STATUS));
 	ASSERT(!ERTS_PROC_IS_EXITING(c_p));
     }
     erts_smp_proc_unlock(c_p, ERTS_PROC_LOCK_MSGQ|ERTS_PROC_LOCK_STATUS);
@@ -5913,6 +5913,29 @@ find_function_from_pc(BeamInstr* pc)
     return fi.current;
 }
 
+/*
+ * Best guess of the function that the currently running process p is
+ * executing, for attributing resources that it creates. When called
+ * from a BIF or a binary construction instruction, this is the function
+ * executing it; with +Mia or +Mip these save I in p->i beforehand.
+ * Elsewhere p->i may be stale (e.g. in native code), and the result is
+ * then the function where the process last saved its state.
+ */
+
+BeamInstr*
+erts_find_running_function(Process* p)
+{
+    BeamInstr* mfa = NULL;
+
+    if (p->i)
+	mfa = find_function_from_pc(p->i);
+    if (!mfa && p->cp)
+	mfa = find_function_from_pc(p->cp);
+    if (!mfa)
+	mfa = p->current;
+    return mfa;
+}
+
 /*
  * Read a specific chunk from a Beam binary.
  */
@@ -54,6 +54,7 @@ static Export* await_proc_exit_trap = NULL;
 static Export* await_port_send_result_trap = NULL;
 Export* erts_format_cpu_topology_trap = NULL;
 static Export dsend_continue_trap_export;
+static Export multi_send_continue_trap_export;
 Export *erts_convert_time_unit_trap = NULL;
 
 static Export *await_msacc_mod_trap = NULL;
@@ -1011,6 +1012,8 @@ BIF_RETTYPE spawn_opt_1(BIF_ALIST_1)
     so.min_vheap_size = BIN_VH_MIN_SIZE;
     so.max_heap_size  = H_MAX_SIZE;
     so.max_heap_flags = H_MAX_FLAGS;
+    so.max_msgq_len   = 0;
+    so.max_msgq_action = MAX_MSGQ_LEN_DROP;
     so.priority       = PRIORITY_NORMAL;
     so.max_gen_gcs    = (Uint16) erts_smp_atomic32_read_nob(&erts_max_gen_gcs);
     so.scheduler      = 0;
@@ -1056,6 +1059,13 @@ BIF_RETTYPE spawn_opt_1(BIF_ALIST_1)
 		default:
 		    goto error;
 		}
+	    } else if (arg == am_adaptive_heap_size) {
+		if (val == am_true)
+		    so.flags |= SPO_ADAPTIVE_HEAP;
+		else if (val == am_false)
+		    so.flags &= ~SPO_ADAPTIVE_HEAP;
+		else
+		    goto error;
 	    } else if (arg == am_min_heap_size && is_small(val)) {
 		Sint min_heap_size = signed_val(val);
 		if (min_heap_size < 0) {
@@ -1068,6 +1078,9 @@ BIF_RETTYPE spawn_opt_1(BIF_ALIST_1)
             } else if (arg == am_max_heap_size) {
                 if (!erts_max_heap_size(val, &so.max_heap_size, &so.max_heap_flags))
                     goto error;
+            } else if (arg == am_max_message_queue_len) {
+                if (!erts_max_msgq_len(val, &so.max_msgq_len, &so.max_msgq_action))
+                    goto error;
 	    } else if (arg == am_min_bin_vheap_size && is_small(val)) {
 		Sint min_vheap_size = signed_val(val);
 		if (min_vheap_size < 0) {
@@ -1883,6 +1896,21 @@ BIF_RETTYPE process_flag_2(BIF_ALIST_2)
        MAX_HEAP_SIZE_FLAGS_SET(BIF_P, max_heap_flags);
        BIF_RET(old_value);
    }
+   else if (BIF_ARG_1 == am_max_message_queue_len) {
+       Eterm *hp;
+       Uint sz = 0, max_len, action;
+
+       if (!erts_max_msgq_len(BIF_ARG_2, &max_len, &action))
+           goto error;
+
+       erts_max_msgq_len_map(MAX_MSGQ_LEN_GET(BIF_P), MAX_MSGQ_LEN_ACTION_GET(BIF_P), NULL, &sz);
+       hp = HAlloc(BIF_P, sz);
+       old_value = erts_max_msgq_len_map(MAX_MSGQ_LEN_GET(BIF_P), MAX_MSGQ_LEN_ACTION_GET(BIF_P), &hp, NULL);
+       MAX_MSGQ_LEN_SET(BIF_P, max_len, action);
+       /* Blocked senders retry against the new limit */
+       erts_msgq_resume_senders(BIF_P, ERTS_PROC_LOCK_MAIN, 1);
+       BIF_RET(old_value);
+   }
    else if (BIF_ARG_1 == am_message_queue_data) {
        old_value = erts_change_message_queue_management(BIF_P, BIF_ARG_2);
        if (is_non_value(old_value))
@@ -2306,7 +2334,15 @@ do_send(Process *p, Eterm to, Eterm msg, Eterm *refp, ErtsSendContext* ctx)
 	    rp_locks |= ERTS_PROC_LOCK_MAIN;
 #endif
 	/* send to local process */
-	res = erts_send_message(p, rp, &rp_locks, msg, 0);
+	res = erts_send_message(p, rp, &rp_locks, msg,
+				ERTS_SND_FLG_MSGQ_LIMIT|ERTS_SND_FLG_MSGQ_SUSPEND);
+	if (res == ERTS_SEND_MSGQ_FULL) {
+	    /* Nothing has been sent */
+	    erts_smp_proc_unlock(rp, rp_locks);
+	    if (ctx->suspend)
+		erts_msgq_suspend_sender(p, rp);
+	    return SEND_YIELD;
+	}
 	if (erts_use_sender_punish)
 	    res *= 4;
 	else
@@ -2444,6 +2480,131 @@ BIF_RETTYPE send_2(BIF_ALIST_2)
     return erl_send(BIF_P, BIF_ARG_1, BIF_ARG_2);
 }
 
+/*
+ * erlang:multi_send/2
+ *
+ * Sends the same message to a list of local processes. The message
+ * is copied once into a payload shared by all receivers, each of
+ * which copies it onto its own heap when it looks at the message.
+ * Each receiver costs a reduction, and checking the list up front
+ * a reduction per MULTI_SEND_CHECK_LOOP_FACTOR receivers; when the
+ * sender runs out of reductions it traps to multi_send_continue_trap/3
+ * with the rest of the list and a magic binary keeping the payload
+ * alive.
+ */
+
+#define MULTI_SEND_CHECK_LOOP_FACTOR 16
+
+static void
+cleanup_multi_send_payload(Binary *bp)
+{
+    ErtsSharedMsgPayload **plp = ERTS_MAGIC_BIN_DATA(bp);
+    if (*plp)
+	erts_release_shared_msg_payload(*plp);
+}
+
+static BIF_RETTYPE
+multi_send(Process *p, Eterm list, Eterm msg,
+	   ErtsSharedMsgPayload *pl, Eterm pl_bin)
+{
+    Sint reds_left = ERTS_BIF_REDS_LEFT(p);
+    Sint reds = 0;
+    Eterm l;
+
+    for (l = list; is_list(l); l = CDR(list_val(l))) {
+	Eterm to = CAR(list_val(l));
+	ErtsProcLocks rp_locks = 0;
+	Process *rp;
+	Sint res;
+
+	if (reds >= reds_left) {
+	    if (is_nil(pl_bin)) {
+		Binary *mb;
+		Eterm *hp;
+		mb = erts_create_magic_binary(sizeof(ErtsSharedMsgPayload *),
+					      cleanup_multi_send_payload);
+		*((ErtsSharedMsgPayload **) ERTS_MAGIC_BIN_DATA(mb)) = pl;
+		hp = HAlloc(p, PROC_BIN_SIZE);
+		pl_bin = erts_mk_magic_binary_term(&hp, &MSO(p), mb);
+	    }
+	    BUMP_ALL_REDS(p);
+	    BIF_TRAP3(&multi_send_continue_trap_export, p, l, msg, pl_bin);
+	}
+
+	reds++;
+
+	if (IS_TRACED_FL(p, F_TRACE_SEND))
+	    trace_send(p, to, msg);
+
+	rp = erts_proc_lookup_raw(to);
+	if (!rp)
+	    continue;
+
+#ifdef ERTS_SMP
+	if (p == rp)
+	    rp_locks |= ERTS_PROC_LOCK_MAIN;
+#endif
+	if (pl && p != rp)
+	    res = erts_send_shared_message(p, rp, &rp_locks, pl);
+	else
+	    res = erts_send_message(p, rp, &rp_locks, msg,
+				    ERTS_SND_FLG_MSGQ_LIMIT);
+	if (erts_use_sender_punish)
+	    reds += res*4;
+	erts_smp_proc_unlock(rp,
+			     p == rp
+			     ? (rp_locks & ~ERTS_PROC_LOCK_MAIN)
+			     : rp_locks);
+    }
+
+    if (pl && is_nil(pl_bin))
+	erts_release_shared_msg_payload(pl);
+
+    ERTS_VBUMP_REDS(p, reds);
+    if (ERTS_IS_PROC_OUT_OF_REDS(p))
+	ERTS_BIF_YIELD_RETURN(p, am_ok);
+    BIF_RET(am_ok);
+}
+
+BIF_RETTYPE multi_send_2(BIF_ALIST_2)
+{
+    Process *p = BIF_P;
+    Eterm msg = BIF_ARG_2;
+    ErtsSharedMsgPayload *pl = NULL;
+    Sint len = 0;
+    Eterm l;
+
+    for (l = BIF_ARG_1; is_list(l); l = CDR(list_val(l))) {
+	if (is_not_internal_pid(CAR(list_val(l))))
+	    BIF_ERROR(p, BADARG);
+	if (++len % MULTI_SEND_CHECK_LOOP_FACTOR == 0)
+	    BUMP_REDS(p, 1);
+    }
+    if (is_not_nil(l))
+	BIF_ERROR(p, BADARG);
+
+    /*
+     * Sequential tracing updates the token for each receiver, so
+     * such sends are done one by one.
+     */
+    if (len > 1 && SEQ_TRACE_TOKEN(p) == NIL)
+	pl = erts_create_shared_msg_payload(msg);
+
+    if (len > 0 && ERTS_PROC_GET_SAVED_CALLS_BUF(p))
+	save_calls(p, &exp_send);
+
+    return multi_send(p, BIF_ARG_1, msg, pl, NIL);
+}
+
+static BIF_RETTYPE multi_send_continue_trap_3(BIF_ALIST_3)
+{
+    Binary *mb = ((ProcBin *) binary_val(BIF_ARG_3))->val;
+    ASSERT(ERTS_MAGIC_BIN_DESTRUCTOR(mb) == cleanup_multi_send_payload);
+    return multi_send(BIF_P, BIF_ARG_1, BIF_ARG_2,
+		      *((ErtsSharedMsgPayload **) ERTS_MAGIC_BIN_DATA(mb)),
+		      BIF_ARG_3);
+}
+
 static BIF_RETTYPE dsend_continue_trap_1(BIF_ALIST_1)
 {
     Binary* bin = ((ProcBin*) binary_val(BIF_ARG_1))->val;
@@ -3869,6 +4030,10 @@ BIF_RETTYPE garbage_collect_0(BIF_ALIST_0)
 {
     FLAGS(BIF_P) |= F_NEED_FULLSWEEP;
     erts_garbage_collect(BIF_P, 0, NULL, 0);
+    if (FLAGS(BIF_P) & F_DIRTY_GC) {
+	/* Return when the collection on the dirty scheduler is done */
+	ERTS_BIF_YIELD_RETURN(BIF_P, am_true);
+    }
     BIF_RET(am_true);
 }
 
@@ -4976,6 +5141,10 @@ void erts_init_bif(void)
 			  am_erts_internal, am_dsend_continue_trap, 1,
 			  dsend_continue_trap_1);
 
+    erts_init_trap_export(&multi_send_continue_trap_export,
+			  am_erts_internal, am_multi_send_continue_trap, 3,
+			  multi_send_continue_trap_3);
+
     flush_monitor_messages_trap = erts_export_put(am_erts_internal,
 						  am_flush_monitor_messages,
 						  3);
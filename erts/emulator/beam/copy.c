@@ -37,6 +37,8 @@
 
 static void move_one_frag(Eterm** hpp, ErlHeapFragment*, ErlOffHeap*, int);
 
+int erts_preserve_sharing = 1;
+
 /*
  *  Copy object "obj" to process p.
  */
@@ -67,10 +69,12 @@ Eterm copy_object_x(Eterm obj, Process* to, Uint extra) {
 }
 
 /*
- * Return the "flat" size of the object.
+ * Return the "flat" size of the object. The traversal is cut short
+ * as soon as the size exceeds "limit", in which case a size larger
+ * than "limit", but not the size of the object, is returned.
  */
 
-Uint size_object(Eterm obj)
+Uint size_object_x(Eterm obj, Uint limit)
 {
     Uint sum = 0;
     Eterm* ptr;
@@ -84,6 +88,10 @@ Uint size_object(Eterm obj)
     VERBOSE(DEBUG_SHCOPY, ("[pid=%T] size_object %p\n", mypid, obj));
 
     for (;;) {
+	if (sum > limit) {
+	    DESTROY_ESTACK(s);
+	    return sum;
+	}
 	switch (primary_tag(obj)) {
 	case TAG_PRIMARY_LIST:
 	    sum += 2;
@@ -596,10 +604,216 @@ cleanup:
 }
 
 
+Uint erts_bin_compact_ratio = 0;
+
+/*
+ * Returns a copy of the size bytes at bytes in bin if they are a small
+ * enough part of bin to be compacted, otherwise NULL.
+ */
+static ERTS_INLINE Binary *
+compact_binary(Binary *bin, byte *bytes, Uint size)
+{
+    Binary *res;
+
+    if (!erts_bin_compact_ratio
+	|| (bin->flags & BIN_FLAG_MAGIC)
+	|| size > bin->orig_size / erts_bin_compact_ratio)
+	return NULL;
+
+    res = erts_bin_nrml_alloc(size);
+    erts_refc_init(&res->refc, 1);
+    sys_memcpy(res->orig_bytes, bytes, size);
+    return res;
+}
+
+/*
+ * Allocates heap for the copy of an object. A copier that scans the
+ * words it has copied for terms still to be copied asks for heap to
+ * be scanned for objects that embed terms (funs).
+ */
+typedef Eterm *(*ErtsCopyAllocFPtr)(void *arg, Uint need, int scan);
+
+/*
+ * Copy a boxed object that is not a tuple or a map, that is one that
+ * does not need to be traversed by the copier except for the
+ * environment of a fun, and link it into off_heap when needed.
+ * Returns the tagged copy.
+ */
+static ERTS_FORCE_INLINE Eterm
+copy_boxed_thing(Eterm *objp, Eterm hdr, ErlOffHeap *off_heap, Uint32 flags,
+		 ErtsCopyAllocFPtr alloc, void *arg)
+{
+    Binary *bin;
+    Eterm *htop;
+    Eterm res;
+    Uint n;
+
+    switch (hdr & _TAG_HEADER_MASK) {
+    case REFC_BINARY_SUBTAG:
+	{
+	    ProcBin* pb = (ProcBin *) objp;
+
+	    if (pb->flags) {
+		erts_emasculate_writable_binary(pb);
+	    }
+	    n = thing_arityval(hdr) + 1;
+	    htop = (*alloc)(arg, n, 0);
+	    sys_memcpy(htop, objp, n * sizeof(Eterm));
+	    pb = (ProcBin*) htop;
+	    if ((flags & ERTS_COPY_COMPACT_BINS)
+		&& (bin = compact_binary(pb->val, pb->bytes, pb->size))) {
+		pb->val = bin;
+		pb->bytes = (byte *) bin->orig_bytes;
+	    }
+	    else
+		erts_refc_inc(&pb->val->refc, 2);
+	    pb->next = off_heap->first;
+	    pb->flags = 0;
+	    off_heap->first = (struct erl_off_heap_header*) pb;
+	    OH_OVERHEAD(off_heap, pb->size / sizeof(Eterm));
+	    return make_binary(htop);
+	}
+    case SUB_BINARY_SUBTAG:
+	{
+	    ErlSubBin* sb = (ErlSubBin *) objp;
+	    Eterm real_bin = sb->orig;
+	    Uint bit_offset = sb->bitoffs;
+	    Uint bit_size = sb->bitsize;
+	    Uint offset = sb->offs;
+	    size_t size = sb->size;
+	    Uint extra_bytes;
+	    Uint real_size;
+	    if ((bit_size + bit_offset) > 8) {
+		extra_bytes = 2;
+	    } else if ((bit_size + bit_offset) > 0) {
+		extra_bytes = 1;
+	    } else {
+		extra_bytes = 0;
+	    }
+	    real_size = size+extra_bytes;
+	    objp = binary_val(real_bin);
+	    if (thing_subtag(*objp) == HEAP_BINARY_SUBTAG) {
+		ErlHeapBin* from = (ErlHeapBin *) objp;
+		ErlHeapBin* to;
+		htop = (*alloc)(arg, heap_bin_size(real_size), 0);
+		to = (ErlHeapBin *) htop;
+		to->thing_word = header_heap_bin(real_size);
+		to->size = real_size;
+		sys_memcpy(to->data, ((byte *)from->data)+offset, real_size);
+	    } else {
+		ProcBin* from = (ProcBin *) objp;
+		ProcBin* to;
+
+		ASSERT(thing_subtag(*objp) == REFC_BINARY_SUBTAG);
+		if (from->flags) {
+		    erts_emasculate_writable_binary(from);
+		}
+		htop = (*alloc)(arg, PROC_BIN_SIZE, 0);
+		to = (ProcBin *) htop;
+		to->thing_word = HEADER_PROC_BIN;
+		to->size = real_size;
+		if ((flags & ERTS_COPY_COMPACT_BINS)
+		    && (bin = compact_binary(from->val,
+					     from->bytes + offset,
+					     real_size))) {
+		    to->val = bin;
+		    to->bytes = (byte *) bin->orig_bytes;
+		}
+		else {
+		    to->val = from->val;
+		    erts_refc_inc(&to->val->refc, 2);
+		    to->bytes = from->bytes + offset;
+		}
+		to->next = off_heap->first;
+		to->flags = 0;
+		off_heap->first = (struct erl_off_heap_header*) to;
+		OH_OVERHEAD(off_heap, to->size / sizeof(Eterm));
+	    }
+	    res = make_binary(htop);
+	    if (extra_bytes != 0) {
+		ErlSubBin* sub;
+		htop = (*alloc)(arg, ERL_SUB_BIN_SIZE, 0);
+		sub = (ErlSubBin *) htop;
+		sub->thing_word = HEADER_SUB_BIN;
+		sub->size = size;
+		sub->bitsize = bit_size;
+		sub->bitoffs = bit_offset;
+		sub->offs = 0;
+		sub->is_writable = 0;
+		sub->orig = res;
+		res = make_binary(htop);
+	    }
+	    return res;
+	}
+    case FUN_SUBTAG:
+	{
+	    ErlFunThing* funp = (ErlFunThing *) objp;
+
+	    n = thing_arityval(hdr) + 2 + funp->num_free;
+	    htop = (*alloc)(arg, n, 1);
+	    sys_memcpy(htop, objp, n * sizeof(Eterm));
+	    funp = (ErlFunThing *) htop;
+	    funp->next = off_heap->first;
+	    off_heap->first = (struct erl_off_heap_header*) funp;
+	    erts_refc_inc(&funp->fe->refc, 2);
+	    return make_fun(htop);
+	}
+    case EXTERNAL_PID_SUBTAG:
+    case EXTERNAL_PORT_SUBTAG:
+    case EXTERNAL_REF_SUBTAG:
+	{
+	    ExternalThing *etp;
+
+	    n = thing_arityval(hdr) + 1;
+	    htop = (*alloc)(arg, n, 0);
+	    sys_memcpy(htop, objp, n * sizeof(Eterm));
+	    etp = (ExternalThing *) htop;
+	    etp->next = off_heap->first;
+	    off_heap->first = (struct erl_off_heap_header*)etp;
+	    erts_refc_inc(&etp->node->refc, 2);
+	    return make_external(htop);
+	}
+    case BIN_MATCHSTATE_SUBTAG:
+	erts_exit(ERTS_ABORT_EXIT,
+		  "copy_struct: matchstate term not allowed");
+    default:
+	n = thing_arityval(hdr) + 1;
+	htop = (*alloc)(arg, n, 0);
+	sys_memcpy(htop, objp, n * sizeof(Eterm));
+	return make_boxed(htop);
+    }
+}
+
+typedef struct {
+    Eterm *htop;
+    Eterm *hbot;
+} ErtsCopyStructHeap;
+
+/*
+ * copy_struct_x() scans what it copies to the top of the heap, and
+ * puts objects that need no scanning at the bottom.
+ */
+static ERTS_FORCE_INLINE Eterm *
+copy_struct_alloc(void *arg, Uint need, int scan)
+{
+    ErtsCopyStructHeap *heap = (ErtsCopyStructHeap *) arg;
+    Eterm *res;
+    if (scan) {
+	res = heap->htop;
+	heap->htop += need;
+    }
+    else {
+	heap->hbot -= need;
+	res = heap->hbot;
+    }
+    return res;
+}
+
 /*
  *  Copy a structure to a heap.
  */
-Eterm copy_struct_x(Eterm obj, Uint sz, Eterm** hpp, ErlOffHeap* off_heap, Uint *bsz)
+Eterm copy_struct_x(Eterm obj, Uint sz, Eterm** hpp, ErlOffHeap* off_heap,
+		    Uint *bsz, Uint32 flags)
 {
     char* hstart;
     Uint hsize;
@@ -613,6 +827,7 @@ Eterm copy_struct_x(Eterm obj, Uint sz, Eterm** hpp, ErlOffHeap* off_heap, Uint
     Eterm* tailp;
     Eterm* argp;
     Eterm* const_tuple;
+    ErtsCopyStructHeap heap;
     Eterm hdr;
     Eterm *hend;
     int i;
@@ -726,130 +941,6 @@ Eterm copy_struct_x(Eterm obj, Uint sz, Eterm** hpp, ErlOffHeap* off_heap, Uint
 		    }
 		}
 		break;
-	    case REFC_BINARY_SUBTAG:
-		{
-		    ProcBin* pb;
-
-		    pb = (ProcBin *) objp;
-		    if (pb->flags) {
-			erts_emasculate_writable_binary(pb);
-		    }
-		    i = thing_arityval(*objp) + 1;
-		    hbot -= i;
-		    tp = hbot;
-		    while (i--)  {
-			*tp++ = *objp++;
-		    }
-		    *argp = make_binary(hbot);
-		    pb = (ProcBin*) hbot;
-		    erts_refc_inc(&pb->val->refc, 2);
-		    pb->next = off_heap->first;
-		    pb->flags = 0;
-		    off_heap->first = (struct erl_off_heap_header*) pb;
-		    OH_OVERHEAD(off_heap, pb->size / sizeof(Eterm));
-		}
-		break;
-	    case SUB_BINARY_SUBTAG:
-		{
-		    ErlSubBin* sb = (ErlSubBin *) objp;
-		    Eterm real_bin = sb->orig;
-		    Uint bit_offset = sb->bitoffs;
-		    Uint bit_size = sb -> bitsize;
-		    Uint offset = sb->offs;
-		    size_t size = sb->size;
-		    Uint extra_bytes;
-		    Uint real_size;
-		    if ((bit_size + bit_offset) > 8) {
-			extra_bytes = 2;
-		    } else if ((bit_size + bit_offset) > 0) {
-			extra_bytes = 1;
-		    } else {
-			extra_bytes = 0;
-		    } 
-		    real_size = size+extra_bytes;
-		    objp = binary_val(real_bin);
-		    if (thing_subtag(*objp) == HEAP_BINARY_SUBTAG) {
-			ErlHeapBin* from = (ErlHeapBin *) objp;
-			ErlHeapBin* to;
-			i = heap_bin_size(real_size);
-			hbot -= i;
-			to = (ErlHeapBin *) hbot;
-			to->thing_word = header_heap_bin(real_size);
-			to->size = real_size;
-			sys_memcpy(to->data, ((byte *)from->data)+offset, real_size);
-		    } else {
-			ProcBin* from = (ProcBin *) objp;
-			ProcBin* to;
-			
-			ASSERT(thing_subtag(*objp) == REFC_BINARY_SUBTAG);
-			if (from->flags) {
-			    erts_emasculate_writable_binary(from);
-			}
-			hbot -= PROC_BIN_SIZE;
-			to = (ProcBin *) hbot;
-			to->thing_word = HEADER_PROC_BIN;
-			to->size = real_size;
-			to->val = from->val;
-			erts_refc_inc(&to->val->refc, 2);
-			to->bytes = from->bytes + offset;
-			to->next = off_heap->first;
-			to->flags = 0;
-			off_heap->first = (struct erl_off_heap_header*) to;
-			OH_OVERHEAD(off_heap, to->size / sizeof(Eterm));
-		    }
-		    *argp = make_binary(hbot);
-		    if (extra_bytes != 0) {
-			ErlSubBin* res;
-			hbot -= ERL_SUB_BIN_SIZE;
-			res = (ErlSubBin *) hbot;
-			res->thing_word = HEADER_SUB_BIN;
-			res->size = size;
-			res->bitsize = bit_size;
-			res->bitoffs = bit_offset;
-			res->offs = 0;
-			res->is_writable = 0;
-			res->orig = *argp;
-			*argp = make_binary(hbot);
-		    }
-		    break;
-		}
-		break;
-	    case FUN_SUBTAG:
-		{
-		    ErlFunThing* funp = (ErlFunThing *) objp;
-
-		    i =  thing_arityval(hdr) + 2 + funp->num_free;
-		    tp = htop;
-		    while (i--)  {
-			*htop++ = *objp++;
-		    }
-		    funp = (ErlFunThing *) tp;
-		    funp->next = off_heap->first;
-		    off_heap->first = (struct erl_off_heap_header*) funp;
-		    erts_refc_inc(&funp->fe->refc, 2);
-		    *argp = make_fun(tp);
-		}
-		break;
-	    case EXTERNAL_PID_SUBTAG:
-	    case EXTERNAL_PORT_SUBTAG:
-	    case EXTERNAL_REF_SUBTAG:
-		{
-		  ExternalThing *etp = (ExternalThing *) htop;
-
-		  i  = thing_arityval(hdr) + 1;
-		  tp = htop;
-
-		  while (i--)  {
-		    *htop++ = *objp++;
-		  }
-
-		  etp->next = off_heap->first;
-		  off_heap->first = (struct erl_off_heap_header*)etp;
-		  erts_refc_inc(&etp->node->refc, 2);
-
-		  *argp = make_external(tp);
-		}
-		break;
 	    case MAP_SUBTAG:
 		tp = htop;
 		switch (MAP_HEADER_TYPE(hdr)) {
@@ -872,17 +963,13 @@ Eterm copy_struct_x(Eterm obj, Uint sz, Eterm** hpp, ErlOffHeap* off_heap, Uint
 			erts_exit(ERTS_ABORT_EXIT, "copy_struct: bad hashmap type %d\n", MAP_HEADER_TYPE(hdr));
 		}
 		break;
-	    case BIN_MATCHSTATE_SUBTAG:
-		erts_exit(ERTS_ABORT_EXIT,
-			 "copy_struct: matchstate term not allowed");
 	    default:
-		i = thing_arityval(hdr)+1;
-		hbot -= i;
-		tp = hbot;
-		*argp = make_boxed(hbot);
-		while (i--) {
-		    *tp++ = *objp++;
-		}
+		heap.htop = htop;
+		heap.hbot = hbot;
+		*argp = copy_boxed_thing(objp, hdr, off_heap, flags,
+					 copy_struct_alloc, (void *) &heap);
+		htop = heap.htop;
+		hbot = heap.hbot;
 	    }
 	    break;
 	case TAG_PRIMARY_HEADER:
@@ -917,6 +1004,309 @@ Eterm copy_struct_x(Eterm obj, Uint sz, Eterm** hpp, ErlOffHeap* off_heap, Uint
     return res;
 }
 
+/*
+ *  Copy a structure in a single pass, producing heap from a heap
+ *  factory as the copy proceeds instead of sizing the term first.
+ *  When the factory runs out of heap it grows by at least the amount
+ *  copied so far, so a large term ends up in a short chain of
+ *  fragments.
+ *
+ *  When preserving sharing, every copied cons cell, tuple, map and fun
+ *  is entered into a table mapping its address in the source to its
+ *  copy, so that further references to it are redirected to the copy.
+ *  The source is only read, so it may be read by others meanwhile, as
+ *  the term of an ETS table may. Leaf objects such as binaries and
+ *  bignums are cheap to duplicate and are never shared in the copy, so
+ *  that they may be updated in place (as ets:update_element does).
+ */
+
+#define COPY_FACTORY_MIN_XTRA 64
+
+#define COPY_FACTORY_PRODUCE(Factory, Need, Copied)			\
+    ((Copied) += (Need),						\
+     ((Factory)->hp + (Need) <= (Factory)->hp_end			\
+      ? ((Factory)->hp += (Need), (Factory)->hp - (Need))		\
+      : erts_produce_heap((Factory), (Need),				\
+			  ((Copied) > COPY_FACTORY_MIN_XTRA		\
+			   ? (Copied) : COPY_FACTORY_MIN_XTRA))))
+
+/*
+ * The table of copied objects: open addressing with linear probing
+ * over pairs of source address (zero when the slot is free) and copy,
+ * kept at most half full.
+ */
+
+#define COPY_SEEN_MIN_BITS 10
+
+typedef struct {
+    UWord *slots;
+    Uint mask;		/* Number of pairs - 1 */
+    Uint shift;		/* Word bits - log2(number of pairs) */
+    Uint used;
+} ErtsCopySeen;
+
+#if SIZEOF_VOID_P == 8
+#  define COPY_SEEN_HASH_MUL ((UWord) 0x9E3779B97F4A7C15)
+#else
+#  define COPY_SEEN_HASH_MUL ((UWord) 0x9E3779B9)
+#endif
+
+/* Fibonacci hashing, objects close to each other end up far apart */
+#define COPY_SEEN_IX(Seen, Ptr)						\
+    ((Uint) (((((UWord) (Ptr)) >> 3) * COPY_SEEN_HASH_MUL) >> (Seen)->shift))
+
+static void
+copy_seen_grow(ErtsCopySeen *seen)
+{
+    UWord *old = seen->slots;
+    Uint old_size = old ? seen->mask + 1 : 0;
+    Uint size = old ? 2*old_size : ((Uint) 1) << COPY_SEEN_MIN_BITS;
+    Uint i;
+
+    seen->slots = erts_alloc(ERTS_ALC_T_ESTACK, 2*size*sizeof(UWord));
+    sys_memzero(seen->slots, 2*size*sizeof(UWord));
+    seen->mask = size - 1;
+    seen->shift = old ? seen->shift - 1 : 8*sizeof(UWord) - COPY_SEEN_MIN_BITS;
+    for (i = 0; i < old_size; i++) {
+	if (old[2*i]) {
+	    Uint ix = COPY_SEEN_IX(seen, old[2*i]);
+	    while (seen->slots[2*ix])
+		ix = (ix + 1) & seen->mask;
+	    seen->slots[2*ix] = old[2*i];
+	    seen->slots[2*ix+1] = old[2*i+1];
+	}
+    }
+    if (old)
+	erts_free(ERTS_ALC_T_ESTACK, old);
+}
+
+/*
+ * Returns the slot of ptr: holding the copy if ptr has been copied,
+ * otherwise free, to be filled in with copy_seen_put().
+ */
+static ERTS_INLINE UWord *
+copy_seen_get(ErtsCopySeen *seen, Eterm *ptr)
+{
+    Uint ix;
+    if (seen->used >= (seen->mask + 1) / 2)
+	copy_seen_grow(seen);
+    ix = COPY_SEEN_IX(seen, ptr);
+    while (seen->slots[2*ix] && seen->slots[2*ix] != (UWord) ptr)
+	ix = (ix + 1) & seen->mask;
+    return &seen->slots[2*ix];
+}
+
+#define copy_seen_put(Seen, Slot, Ptr, Copy)				\
+    ((Slot)[0] = (UWord) (Ptr), (Slot)[1] = (UWord) (Copy), (Seen)->used++)
+
+typedef struct {
+    ErtsHeapFactory *factory;
+    Uint copied;
+} ErtsCopyFactoryHeap;
+
+static ERTS_FORCE_INLINE Eterm *
+copy_factory_alloc(void *arg, Uint need, int scan)
+{
+    ErtsCopyFactoryHeap *fa = (ErtsCopyFactoryHeap *) arg;
+    return COPY_FACTORY_PRODUCE(fa->factory, need, fa->copied);
+}
+
+static ERTS_FORCE_INLINE Eterm
+copy_factory(Eterm obj, ErtsHeapFactory *factory, int shared, Uint32 flags)
+{
+    ErlOffHeap *off_heap = factory->off_heap;
+    ErtsCopyFactoryHeap fa;
+    ErtsCopySeen seen;
+    UWord *slot = NULL;
+    Eterm *argp;
+    Eterm *objp;
+    Eterm *htop;
+    Eterm hdr;
+    Eterm elem;
+    Eterm res;
+    Uint i, n, first;
+    DECLARE_WSTACK(s);
+
+    if (IS_CONST(obj))
+	return obj;
+
+    fa.factory = factory;
+    fa.copied = 0;
+    seen.slots = NULL;
+    seen.mask = 0;
+    seen.shift = 0;
+    seen.used = 0;
+    argp = &res;
+
+    for (;;) {
+	switch (primary_tag(obj)) {
+	case TAG_PRIMARY_LIST:
+	    objp = list_val(obj);
+	    for (;;) {
+		if (shared) {
+		    slot = copy_seen_get(&seen, objp);
+		    if (slot[0]) {
+			*argp = (Eterm) slot[1];
+			goto pop_next;
+		    }
+		}
+		elem = CAR(objp);
+		htop = COPY_FACTORY_PRODUCE(factory, 2, fa.copied);
+		CAR(htop) = elem;
+		if (!IS_CONST(elem)) {
+		    WSTACK_PUSH2(s, (UWord) elem, (UWord) &CAR(htop));
+		}
+		*argp = make_list(htop);
+		argp = &CDR(htop);
+		if (shared) {
+		    copy_seen_put(&seen, slot, objp, make_list(htop));
+		}
+		obj = CDR(objp);
+		if (!is_list(obj)) {
+		    break;
+		}
+		objp = list_val(obj);
+	    }
+	    if (IS_CONST(obj)) {
+		*argp = obj;
+		goto pop_next;
+	    }
+	    continue;
+
+	case TAG_PRIMARY_BOXED:
+	    objp = boxed_val(obj);
+	    hdr = *objp;
+	    if (shared) {
+		switch (hdr & _TAG_HEADER_MASK) {
+		case ARITYVAL_SUBTAG:
+		case MAP_SUBTAG:
+		case FUN_SUBTAG:
+		    slot = copy_seen_get(&seen, objp);
+		    if (slot[0]) {
+			*argp = (Eterm) slot[1];
+			goto pop_next;
+		    }
+		    break;
+		default:
+		    slot = NULL;
+		}
+	    }
+	    switch (hdr & _TAG_HEADER_MASK) {
+	    case ARITYVAL_SUBTAG:
+		n = arityval(hdr) + 1;
+		first = 1;
+		htop = COPY_FACTORY_PRODUCE(factory, n, fa.copied);
+		*argp = make_tuple(htop);
+		goto copy_transparent;
+	    case MAP_SUBTAG:
+		switch (MAP_HEADER_TYPE(hdr)) {
+		case MAP_HEADER_TAG_FLATMAP_HEAD :
+		    n = flatmap_get_size(objp) + 3;
+		    first = 2; /* hdr + size words */
+		    htop = COPY_FACTORY_PRODUCE(factory, n, fa.copied);
+		    *argp = make_flatmap(htop);
+		    break;
+		case MAP_HEADER_TAG_HAMT_HEAD_BITMAP :
+		case MAP_HEADER_TAG_HAMT_HEAD_ARRAY :
+		case MAP_HEADER_TAG_HAMT_NODE_BITMAP :
+		    n = 1 + header_arity(hdr) + hashmap_bitcount(MAP_HEADER_VAL(hdr));
+		    first = 1 + header_arity(hdr);
+		    htop = COPY_FACTORY_PRODUCE(factory, n, fa.copied);
+		    *argp = make_hashmap(htop);
+		    break;
+		default:
+		    erts_exit(ERTS_ABORT_EXIT, "copy_struct_factory: bad hashmap type %d\n", MAP_HEADER_TYPE(hdr));
+		}
+	    copy_transparent:
+		/* Header and untagged words followed by terms; copy them
+		   all and queue the terms that need to be copied themselves. */
+		for (i = 0; i < first; i++) {
+		    htop[i] = objp[i];
+		}
+		for (; i < n; i++) {
+		    elem = objp[i];
+		    htop[i] = elem;
+		    if (!IS_CONST(elem)) {
+			WSTACK_PUSH2(s, (UWord) elem, (UWord) &htop[i]);
+		    }
+		}
+		break;
+	    default:
+		*argp = copy_boxed_thing(objp, hdr, off_heap, flags,
+					 copy_factory_alloc, (void *) &fa);
+		if (is_fun_header(hdr)) {
+		    ErlFunThing *funp = (ErlFunThing *) fun_val(*argp);
+		    for (i = 0; i < funp->num_free; i++) {
+			elem = funp->env[i];
+			if (!IS_CONST(elem)) {
+			    WSTACK_PUSH2(s, (UWord) elem, (UWord) &funp->env[i]);
+			}
+		    }
+		}
+	    }
+	    if (shared && slot) {
+		copy_seen_put(&seen, slot, objp, *argp);
+	    }
+	    break;
+
+	default:
+	    erts_exit(ERTS_ABORT_EXIT,
+		     "%s, line %d: Internal error in copy_struct_factory: 0x%08x\n",
+		     __FILE__, __LINE__, obj);
+	}
+
+    pop_next:
+	if (WSTACK_ISEMPTY(s))
+	    break;
+	argp = (Eterm *) WSTACK_POP(s);
+	obj = (Eterm) WSTACK_POP(s);
+    }
+
+    if (seen.slots)
+	erts_free(ERTS_ALC_T_ESTACK, seen.slots);
+    DESTROY_WSTACK(s);
+    return res;
+}
+
+Eterm copy_struct_factory(Eterm obj, ErtsHeapFactory *factory, Uint32 flags)
+{
+    return copy_factory(obj, factory, 0, flags);
+}
+
+Eterm copy_shared_factory(Eterm obj, ErtsHeapFactory *factory, Uint32 flags)
+{
+    return copy_factory(obj, factory, 1, flags);
+}
+
+/*
+ *  Copy *objp preserving sharing into a chain of heap fragments,
+ *  ordered so that the fragment holding the root comes first. The
+ *  chain is meant to be moved onto a heap of the size returned in
+ *  *szp with erts_move_multi_frags() and then freed.
+ */
+ErlHeapFragment *erts_copy_shared_to_frags(Eterm *objp, Uint size_hint,
+					   Uint *szp, Uint32 flags)
+{
+    ErtsHeapFactory factory;
+    ErlHeapFragment *bp, *next, *frags = NULL;
+    Uint sz = 0;
+
+    erts_factory_heap_frag_init(&factory, new_message_buffer(size_hint));
+    *objp = copy_shared_factory(*objp, &factory, flags);
+    erts_factory_close(&factory);
+
+    for (bp = factory.heap_frags; bp; bp = next) {
+	next = bp->next;
+	bp->next = frags;
+	frags = bp;
+	sz += bp->used_size;
+    }
+    *szp = sz;
+    return frags;
+}
+
+#undef COPY_FACTORY_PRODUCE
+
 
 /*
  *  Machinery for the table used by the sharing preserving copier
@@ -1351,7 +1741,7 @@ Uint copy_shared_perform(Eterm obj, Uint size, erts_shcopy_t *info,
                     *resp = obj;
                 } else {
                     Uint bsz = 0;
-                    *resp = copy_struct_x(obj, hbot - hp, &hp, off_heap, &bsz);
+                    *resp = copy_struct_x(obj, hbot - hp, &hp, off_heap, &bsz, 0);
                     hbot -= bsz;
                 }
 		goto cleanup_next;
@@ -1419,7 +1809,7 @@ Uint copy_shared_perform(Eterm obj, Uint size, erts_shcopy_t *info,
                     *resp = obj;
                 } else {
                     Uint bsz = 0;
-                    *resp = copy_struct_x(obj, hbot - hp, &hp, off_heap, &bsz);
+                    *resp = copy_struct_x(obj, hbot - hp, &hp, off_heap, &bsz, 0);
                     hbot -= bsz;
                 }
 		goto cleanup_next;
@@ -137,6 +137,9 @@ static ErtsAllocatorState_t exec_alloc_state;
 #endif
 static ErtsAllocatorState_t test_alloc_state;
 
+/* Set if wrappers put headers in front of the alloc_util blocks */
+static int wrapped_blocks;
+
 enum {
     ERTS_ALC_INFO_A_ALLOC_UTIL = ERTS_ALC_A_MAX + 1,
     ERTS_ALC_INFO_A_MSEG_ALLOC,
@@ -211,6 +214,8 @@ typedef struct {
     struct {
 	int stat;
 	int map;
+	Uint sample;
+	int attr;
 	char *mtrace;
 	char *nodename;
     } instr;
@@ -613,6 +618,19 @@ static ERTS_INLINE void
 adjust_carrier_migration_support(struct au_init *auip)
 {
 #ifdef ERTS_SMP
+    if (auip->init.util.slab) {
+	/*
+	 * Blocks in slab lists cannot follow a migrating carrier, so
+	 * slabs disable carrier migration and evacuation.
+	 */
+	auip->init.util.acul = 0;
+	auip->init.util.dcul = 0;
+    }
+    if (auip->init.util.dcul && !strategy_support_carrier_migration(auip)) {
+	/* Evacuation of carriers needs the same support */
+	auip->atype = AOFIRSTFIT;
+	auip->init.aoff.flavor = AOFF_BF;
+    }
     if (auip->init.util.acul) {
 	auip->thr_spec = -1; /* Need thread preferred */
 
@@ -628,6 +646,7 @@ adjust_carrier_migration_support(struct au_init *auip)
     }
 #else
     auip->init.util.acul = 0;
+    auip->init.util.dcul = 0;
 #endif
 }
 
@@ -659,6 +678,8 @@ erts_alloc_init(int *argc, char **argv, ErtsAllocInitOpts *eaiop)
 	= sizeof(ErtsDrvSelectDataState);
     fix_type_sizes[ERTS_ALC_FIX_TYPE_IX(ERTS_ALC_T_MSG_REF)]
 	= sizeof(ErtsMessageRef);
+    fix_type_sizes[ERTS_ALC_FIX_TYPE_IX(ERTS_ALC_T_SMALL_MSG)]
+	= sizeof(ErtsSmallFixSzMessage);
 #ifdef ERTS_SMP
     fix_type_sizes[ERTS_ALC_FIX_TYPE_IX(ERTS_ALC_T_THR_Q_EL_SL)]
 	= sizeof(ErtsThrQElement_t);
@@ -940,7 +961,10 @@ erts_alloc_init(int *argc, char **argv, ErtsAllocInitOpts *eaiop)
 		       &test_alloc_state);
 
     erts_mtrace_install_wrapper_functions();
-    extra_block_size += erts_instr_init(init.instr.stat, init.instr.map);
+    extra_block_size += erts_instr_init(init.instr.stat,
+						init.instr.map,
+						init.instr.sample,
+						init.instr.attr);
 
     init_aireq_alloc();
 
@@ -948,6 +972,7 @@ erts_alloc_init(int *argc, char **argv, ErtsAllocInitOpts *eaiop)
     extra_block_size += install_debug_functions();
 #endif
     adjust_fix_alloc_sizes(extra_block_size);
+    wrapped_blocks = extra_block_size != 0;
 }
 
 void
@@ -1337,6 +1362,20 @@ get_amount_value(char *param_end, char** argv, int* ip)
     return (Uint) tmp;
 }
 
+static Uint
+get_percent_value(char *param_end, char** argv, int* ip)
+{
+    Sint tmp;
+    char *rest;
+    char *param = argv[*ip]+1;
+    char *value = get_value(param_end, argv, ip);
+    errno = 0;
+    tmp = (Sint) ErtsStrToSint(value, &rest, 10);
+    if (errno != 0 || rest == value || tmp < 0 || 100 < tmp)
+	bad_value(param, param_end, value);
+    return (Uint) tmp;
+}
+
 static Uint
 get_acul_value(struct au_init *auip, char *param_end, char** argv, int* ip)
 {
@@ -1389,7 +1428,11 @@ handle_au_arg(struct au_init *auip,
 	}
 	else if(has_prefix("as", sub_param)) {
 	    char *alg = get_value(sub_param + 2, argv, ip);
-	    if (strcmp("bf", alg) == 0) {
+	    if (strcmp("slab", alg) == 0) {
+		/* Slabs in front of the strategy in use */
+		auip->init.util.slab = 1;
+	    }
+	    else if (strcmp("bf", alg) == 0) {
 		auip->atype = BESTFIT;
 		auip->init.bf.ao = 0;
 	    }
@@ -1424,6 +1467,25 @@ handle_au_arg(struct au_init *auip,
 	else
 	    goto bad_switch;
 	break;
+    case 'd':
+	if (has_prefix("dcul", sub_param)) {
+	    if (!auip->carrier_migration_allowed) {
+		if (!u_switch)
+		    goto bad_switch;
+		else {
+		    /* ignore */
+		    (void) get_percent_value(sub_param + 4, argv, ip);
+		    break;
+		}
+	    }
+	    auip->init.util.dcul = get_percent_value(sub_param + 4, argv, ip);
+	}
+	else if (has_prefix("dt", sub_param)) {
+	    auip->init.util.dt = get_kb_value(sub_param + 2, argv, ip);
+	}
+	else
+	    goto bad_switch;
+	break;
     case 'e': {
 	int e = get_bool_value(sub_param + 1, argv, ip);
         if (!auip->disable_allowed && !e) {
@@ -1435,6 +1497,13 @@ handle_au_arg(struct au_init *auip,
 	else auip->enable = e;
 	break;
     }
+    case 'h':
+	if (has_prefix("hp", sub_param)) {
+	    auip->init.util.hp = get_bool_value(sub_param + 2, argv, ip);
+	}
+	else
+	    goto bad_switch;
+	break;
     case 'l':
 	if (has_prefix("lmbcs", sub_param)) {
 	    auip->default_.lmbcs = 0;
@@ -1753,6 +1822,15 @@ handle_args(int *argc, char **argv, erts_alc_hndl_args_init_t *init)
 		    break;
 		case 'i':
 		    switch (argv[i][3]) {
+		    case 'a':
+			arg = get_value(argv[i]+4, argv, &i);
+			if (strcmp("true", arg) == 0)
+			    init->instr.attr = 1;
+			else if (strcmp("false", arg) == 0)
+			    init->instr.attr = 0;
+			else
+			    bad_value(param, param+3, arg);
+			break;
 		    case 's':
 			arg = get_value(argv[i]+4, argv, &i);
 			if (strcmp("true", arg) == 0)
@@ -1771,6 +1849,9 @@ handle_args(int *argc, char **argv, erts_alc_hndl_args_init_t *init)
 			else
 			    bad_value(param, param+3, arg);
 			break;
+		    case 'p':
+			init->instr.sample = get_amount_value(argv[i]+4, argv, &i);
+			break;
 		    case 't':
 			init->instr.mtrace = get_value(argv[i]+4, argv, &i);
 			break;
@@ -1954,6 +2035,124 @@ erts_alloc_fix_alloc_shrink(int ix, erts_aint32_t flgs)
     return 0;
 }
 
+static int
+discard_free_memory(Allctr_t *allctr)
+{
+    return allctr->discard_scheduled && erts_alcu_discard_free_memory(allctr);
+}
+
+void
+erts_alloc_discard_free_memory(int ix)
+{
+    ErtsAlcType_t ai;
+    int pending = 0;
+
+    /*
+     * The timeout is shared by all allocators using index ix; turn it
+     * off first so that an allocator scheduling a discard while we
+     * scan will turn it on again.
+     */
+    erts_set_aux_work_timeout(ix, ERTS_SSI_AUX_WORK_ALCU_DISCARD, 0);
+
+    for (ai = ERTS_ALC_A_MIN; ai <= ERTS_ALC_A_MAX; ai++) {
+	if (!erts_allctrs_info[ai].enabled
+	    || !erts_allctrs_info[ai].alloc_util)
+	    continue;
+#ifdef ERTS_SMP
+	if (erts_allctrs_info[ai].thr_spec) {
+	    ErtsAllocatorThrSpec_t *tspec = &erts_allctr_thr_spec[ai];
+	    if (tspec->enabled && ix < tspec->size)
+		pending |= discard_free_memory(tspec->allctr[ix]);
+	}
+	else if (ix == 0 && erts_allctrs_info[ai].extra)
+	    pending |= discard_free_memory(erts_allctrs_info[ai].extra);
+#else
+	if (ix == 1 && erts_allctrs_info[ai].extra)
+	    pending |= discard_free_memory(erts_allctrs_info[ai].extra);
+#endif
+    }
+
+    if (pending)
+	erts_set_aux_work_timeout(ix, ERTS_SSI_AUX_WORK_ALCU_DISCARD, 1);
+}
+
+#ifdef ERTS_SMP
+
+static int
+defrag(Allctr_t *allctr)
+{
+    return allctr->defrag.scheduled && erts_alcu_defrag(allctr);
+}
+
+void
+erts_alloc_defrag(int ix)
+{
+    ErtsAlcType_t ai;
+    int pending = 0;
+
+    /* See erts_alloc_discard_free_memory() */
+    erts_set_aux_work_timeout(ix, ERTS_SSI_AUX_WORK_ALCU_DEFRAG, 0);
+
+    for (ai = ERTS_ALC_A_MIN; ai <= ERTS_ALC_A_MAX; ai++) {
+	if (!erts_allctrs_info[ai].enabled
+	    || !erts_allctrs_info[ai].alloc_util)
+	    continue;
+	if (erts_allctrs_info[ai].thr_spec) {
+	    ErtsAllocatorThrSpec_t *tspec = &erts_allctr_thr_spec[ai];
+	    if (tspec->enabled && ix < tspec->size)
+		pending |= defrag(tspec->allctr[ix]);
+	}
+	else if (ix == 0 && erts_allctrs_info[ai].extra)
+	    pending |= defrag(erts_allctrs_info[ai].extra);
+    }
+
+    if (pending)
+	erts_set_aux_work_timeout(ix, ERTS_SSI_AUX_WORK_ALCU_DEFRAG, 1);
+}
+
+/*
+ * Returns non-zero if allocator alloc_no has carriers that are being
+ * evacuated. Only a hint; read without locking.
+ */
+int
+erts_alloc_is_defragmenting(ErtsAlcType_t alloc_no)
+{
+    ErtsAllocatorThrSpec_t *tspec;
+    int i;
+
+    if (!erts_allctrs_info[alloc_no].enabled
+	|| !erts_allctrs_info[alloc_no].alloc_util)
+	return 0;
+    tspec = &erts_allctr_thr_spec[alloc_no];
+    if (erts_allctrs_info[alloc_no].thr_spec && tspec->enabled) {
+	for (i = 0; i < tspec->size; i++) {
+	    if (tspec->allctr[i]
+		&& erts_alcu_evacuating_carriers(tspec->allctr[i]))
+		return 1;
+	}
+	return 0;
+    }
+    return (erts_allctrs_info[alloc_no].extra
+	    && erts_alcu_evacuating_carriers(erts_allctrs_info[alloc_no].extra));
+}
+
+/*
+ * Returns non-zero if the block p of type type should be moved by its
+ * user to help emptying a carrier.
+ */
+int
+erts_alloc_is_evacuating(ErtsAlcType_t type, void *p)
+{
+    ErtsAlcType_t ai = ERTS_ALC_T2A(type);
+    if (!erts_allctrs_info[ai].enabled
+	|| !erts_allctrs_info[ai].alloc_util
+	|| wrapped_blocks)
+	return 0;
+    return erts_alcu_is_evacuating(p);
+}
+
+#endif
+
 static void
 no_verify(Allctr_t *allctr)
 {
@@ -2863,8 +3062,11 @@ erts_allocator_info(int to, void *arg)
     erts_alcu_au_info_options(&to, arg, NULL, NULL);
 
     erts_print(to, arg, "=allocator:instr\n");
+    erts_print(to, arg, "option a: %s\n",
+	       erts_instr_attribution ? "true" : "false");
     erts_print(to, arg, "option m: %s\n",
 	       erts_instr_memory_map ? "true" : "false");
+    erts_print(to, arg, "option p: %beu\n", erts_instr_sample_interval);
     erts_print(to, arg, "option s: %s\n",
 	       erts_instr_stat ? "true" : "false");
     erts_print(to, arg, "option t: %s\n",
@@ -2972,16 +3174,20 @@ erts_allocator_options(void *proc)
                                              NULL, hpp, szp);
 #endif
     {
-	Eterm o[3], v[3];
-	o[0] = am_atom_put("m", 1);
-	v[0] = erts_instr_memory_map ? am_true : am_false;
-	o[1] = am_atom_put("s", 1);
-	v[1] = erts_instr_stat ? am_true : am_false;
-	o[2] = am_atom_put("t", 1);
-	v[2] = erts_mtrace_enabled ? am_true : am_false;
+	Eterm o[5], v[5];
+	o[0] = am_atom_put("a", 1);
+	v[0] = erts_instr_attribution ? am_true : am_false;
+	o[1] = am_atom_put("m", 1);
+	v[1] = erts_instr_memory_map ? am_true : am_false;
+	o[2] = am_atom_put("p", 1);
+	v[2] = erts_bld_uint(hpp, szp, erts_instr_sample_interval);
+	o[3] = am_atom_put("s", 1);
+	v[3] = erts_instr_stat ? am_true : am_false;
+	o[4] = am_atom_put("t", 1);
+	v[4] = erts_mtrace_enabled ? am_true : am_false;
 
 	atoms[length] = am_atom_put("instr", 5); 
-	terms[length++] = erts_bld_2tup_list(hpp, szp, 3, o, v);
+	terms[length++] = erts_bld_2tup_list(hpp, szp, 5, o, v);
     }
 
     atoms[length] = am_atom_put("lock_physical_memory", 20);
@@ -3454,6 +3660,165 @@ erts_request_alloc_info(struct process *c_p,
     return 1;
 }
 
+/*
+ * erlang:system_info({allocator_stats, Alloc}) is a cheap alternative to
+ * {allocator, Alloc} intended for frequent polling. It returns a flat
+ * list of current values per instance, read by the calling scheduler
+ * without taking any allocator locks. Values are snapshotted before the
+ * result is built, since they may change between the size and build
+ * passes.
+ */
+
+static char *alcu_stats_keys[] = {
+    "mbcs_blocks",
+    "mbcs_blocks_size",
+    "mbcs_carriers",
+    "mbcs_carriers_size",
+    "sbcs_blocks",
+    "sbcs_blocks_size",
+    "sbcs_carriers",
+    "sbcs_carriers_size",
+    /* Only present when the carrier pool is enabled */
+    "mbcs_pool_blocks",
+    "mbcs_pool_blocks_size",
+    "mbcs_pool_carriers",
+    "mbcs_pool_carriers_size"
+};
+
+#if HAVE_ERTS_MSEG
+static char *mseg_stats_keys[] = {
+    "segments",
+    "segments_size",
+    "cached_segments",
+    "cache_hits"
+};
+#endif
+
+#define ERTS_ALC_STATS_MAX_KEYS \
+    (sizeof(alcu_stats_keys)/sizeof(alcu_stats_keys[0]))
+
+typedef struct {
+    int ix;
+    int no_vals;
+    UWord vals[ERTS_ALC_STATS_MAX_KEYS];
+} ErtsAllocStatsInst;
+
+static void
+alcu_stats_vals(ErtsAlcUCrrStats_t *cs, UWord *vals)
+{
+    vals[0] = cs->blocks;
+    vals[1] = cs->blocks_size;
+    vals[2] = cs->carriers;
+    vals[3] = cs->carriers_size;
+}
+
+static Eterm
+bld_alloc_stats(Uint **hpp, Uint *szp, char **keys,
+		ErtsAllocStatsInst *inst, int no_inst)
+{
+    Eterm res = NIL;
+    int i, k;
+
+    for (i = no_inst - 1; i >= 0; i--) {
+	Eterm vals = NIL;
+	for (k = inst[i].no_vals - 1; k >= 0; k--)
+	    vals = erts_bld_cons(hpp, szp,
+				 erts_bld_tuple(hpp, szp, 2,
+						erts_bld_atom(hpp, szp, keys[k]),
+						erts_bld_uword(hpp, szp,
+							       inst[i].vals[k])),
+				 vals);
+	res = erts_bld_cons(hpp, szp,
+			    erts_bld_tuple(hpp, szp, 3,
+					   erts_bld_atom(hpp, szp, "instance"),
+					   make_small(inst[i].ix),
+					   vals),
+			    res);
+    }
+
+    return res;
+}
+
+Eterm
+erts_allocator_stats(struct process *c_p, Eterm alloc)
+{
+    ErtsAllocStatsInst *inst;
+    char **keys;
+    int ai, ix, no_inst;
+    Uint sz, *hp, *hp_end;
+    Eterm res;
+
+    if (erts_is_atom_str("mseg_alloc", alloc, 0)) {
+#if HAVE_ERTS_MSEG
+	ErtsMsegStats_t ms;
+	inst = erts_alloc(ERTS_ALC_T_TMP,
+			  (erts_no_schedulers + 1)*sizeof(ErtsAllocStatsInst));
+	for (no_inst = 0;
+	     (no_inst < erts_no_schedulers + 1
+	      && erts_mseg_stats(no_inst, &ms));
+	     no_inst++) {
+	    inst[no_inst].ix = no_inst;
+	    inst[no_inst].no_vals = 4;
+	    inst[no_inst].vals[0] = ms.segments;
+	    inst[no_inst].vals[1] = ms.segments_size;
+	    inst[no_inst].vals[2] = ms.cached_segments;
+	    inst[no_inst].vals[3] = ms.cache_hits;
+	}
+	keys = mseg_stats_keys;
+#else
+	return am_false;
+#endif
+    }
+    else {
+	Allctr_t **allctrs;
+	int size;
+
+	for (ai = ERTS_ALC_A_MIN; ai <= ERTS_ALC_A_MAX; ai++)
+	    if (erts_is_atom_str(erts_alc_a2ad[ai], alloc, 0))
+		break;
+	if (ai > ERTS_ALC_A_MAX)
+	    return THE_NON_VALUE;
+	if (!erts_allctrs_info[ai].enabled || !erts_allctrs_info[ai].alloc_util)
+	    return am_false;
+
+	if (erts_allctrs_info[ai].thr_spec) {
+	    allctrs = erts_allctr_thr_spec[ai].allctr;
+	    size = erts_allctr_thr_spec[ai].size;
+	}
+	else {
+	    allctrs = (Allctr_t **) &erts_allctrs_info[ai].extra;
+	    size = 1;
+	}
+
+	inst = erts_alloc(ERTS_ALC_T_TMP, size*sizeof(ErtsAllocStatsInst));
+	no_inst = 0;
+	for (ix = 0; ix < size; ix++) {
+	    ErtsAlcUStats_t as;
+	    if (!allctrs[ix])
+		continue;
+	    erts_alcu_stats(allctrs[ix], &as);
+	    inst[no_inst].ix = ix;
+	    inst[no_inst].no_vals = as.cpool ? 12 : 8;
+	    alcu_stats_vals(&as.mbcs, &inst[no_inst].vals[0]);
+	    alcu_stats_vals(&as.sbcs, &inst[no_inst].vals[4]);
+	    alcu_stats_vals(&as.mbcs_pool, &inst[no_inst].vals[8]);
+	    no_inst++;
+	}
+	keys = alcu_stats_keys;
+    }
+
+    sz = 0;
+    (void) bld_alloc_stats(NULL, &sz, keys, inst, no_inst);
+    hp = HAlloc(c_p, sz);
+    hp_end = hp + sz;
+    res = bld_alloc_stats(&hp, NULL, keys, inst, no_inst);
+    ASSERT(hp == hp_end); (void) hp_end;
+
+    erts_free(ERTS_ALC_T_TMP, inst);
+
+    return res;
+}
+
 /* 
  * The allocator wrapper prelocking stuff below is about the locking order.
  * It only affects wrappers (erl_mtrace.c and erl_instrument.c) that keep locks
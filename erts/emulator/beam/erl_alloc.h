@@ -80,6 +80,7 @@ struct process;
 
 int erts_request_alloc_info(struct process *c_p, Eterm ref, Eterm allocs,
 			    int only_sz, int internal);
+Eterm erts_allocator_stats(struct process *c_p, Eterm alloc);
 
 #define ERTS_ALLOC_INIT_DEF_OPTS_INITER {0}
 typedef struct {
@@ -161,6 +162,12 @@ void erts_alloc_scheduler_handle_delayed_dealloc(void *vesdp,
 						 int *more_work);
 #endif
 erts_aint32_t erts_alloc_fix_alloc_shrink(int ix, erts_aint32_t flgs);
+void erts_alloc_discard_free_memory(int ix);
+#ifdef ERTS_SMP
+void erts_alloc_defrag(int ix);
+int erts_alloc_is_defragmenting(ErtsAlcType_t alloc_no);
+int erts_alloc_is_evacuating(ErtsAlcType_t type, void *p);
+#endif
 
 __decl_noreturn void erts_alloc_enomem(ErtsAlcType_t,Uint)		
      __noreturn;
@@ -69,6 +69,7 @@
 
 /* Fix alloc limit */
 #define ERTS_ALCU_FIX_MAX_LIST_SZ 1000
+#define ERTS_ALCU_SLAB_SZ 4096
 #define ERTS_ALC_FIX_MAX_SHRINK_OPS 30
 
 #define ALLOC_ZERO_EQ_NULL 0
@@ -720,6 +721,7 @@ static void make_name_atoms(Allctr_t *allctr);
 static Block_t *create_carrier(Allctr_t *, Uint, UWord);
 static void destroy_carrier(Allctr_t *, Block_t *, Carrier_t **);
 static void mbc_free(Allctr_t *allctr, void *p, Carrier_t **busy_pcrr_pp);
+static void slab_free(Allctr_t *allctr, void *p, Carrier_t **busy_pcrr_pp);
 static void dealloc_block(Allctr_t *, void *, ErtsAlcFixList_t *, int);
 
 /* internal data... */
@@ -2196,6 +2198,9 @@ check_abandon_carrier(Allctr_t *allctr, Block_t *fblk, Carrier_t **busy_pcrr_pp)
     if (allctr->main_carrier == crr)
 	return;
 
+    if (crr->cpool.evacuating)
+	return;
+
     if (crr->cpool.blocks_size > crr->cpool.abandon_limit)
 	return;
 
@@ -2247,9 +2252,13 @@ dealloc_block(Allctr_t *allctr, void *ptr, ErtsAlcFixList_t *fix, int dec_cc_on_
 #endif
     }
 #ifndef ERTS_SMP
+    else if (allctr->slab)
+	slab_free(allctr, ptr, NULL);
     else
 	mbc_free(allctr, ptr, NULL);
 #else
+    else if (allctr->slab)
+	slab_free(allctr, ptr, NULL);
     else if (!ERTS_ALC_IS_CPOOL_ENABLED(allctr))
 	mbc_free(allctr, ptr, NULL);
     else {
@@ -2282,6 +2291,308 @@ dealloc_block(Allctr_t *allctr, void *ptr, ErtsAlcFixList_t *fix, int dec_cc_on_
 #endif
 }
 
+/*
+ * Discarding of free memory ("dt").
+ *
+ * The page aligned interior of free blocks of at least
+ * allctr->discard_threshold bytes in multiblock carriers is given back
+ * to the OS, while the carrier stays mapped. Freeing such a block only
+ * stamps it and marks its carrier; the discard itself is done lazily
+ * as aux work by erts_alcu_discard_free_memory(), and only for blocks
+ * that have stayed free for discard_delay scans. Allocations out of
+ * discarded blocks are counted as re-faults; when they make up a large
+ * part of what was discarded since the last scan the delay is doubled,
+ * and it is lowered again when no re-faults are seen.
+ *
+ * The stamp is two words following the part of the free block used by
+ * the allocation strategy: DISCARD_FREED(blk) and the scan generation
+ * when freed, or DISCARD_DONE(blk) once discarded.
+ */
+
+#define DISCARD_CARRIER_HDR_FLAG	(((UWord) 1) << 2)
+
+#define IS_DISCARD_CARRIER(C) \
+  ((C)->chdr & DISCARD_CARRIER_HDR_FLAG)
+#define IS_DISCARD_ENABLED(AP) \
+  ((AP)->discard_threshold != ~((UWord) 0))
+
+#define DISCARD_INFO(AP, B) \
+  ((UWord *) (((char *) (B)) + (AP)->min_block_size))
+#define DISCARD_FREED(B) (((UWord) (B)) | 1)
+#define DISCARD_DONE(B) (((UWord) (B)) | 2)
+
+#define ERTS_ALCU_MIN_DISCARD_SZ	(16*1024)
+#define ERTS_ALCU_MAX_DISCARD_DELAY	64
+
+static ERTS_INLINE void
+discard_stamp_free_block(Allctr_t *allctr, Block_t *blk, Carrier_t *crr)
+{
+    UWord *info = DISCARD_INFO(allctr, blk);
+
+    info[0] = DISCARD_FREED(blk);
+    info[1] = allctr->discard_gen;
+    crr->chdr |= DISCARD_CARRIER_HDR_FLAG;
+    if (!allctr->discard_scheduled) {
+	allctr->discard_scheduled = 1;
+	erts_set_aux_work_timeout(allctr->ix,
+				  ERTS_SSI_AUX_WORK_ALCU_DISCARD,
+				  1);
+    }
+}
+
+static ERTS_INLINE void
+discard_check_refault(Allctr_t *allctr, Block_t *blk, Uint blk_sz)
+{
+    if (DISCARD_INFO(allctr, blk)[0] == DISCARD_DONE(blk)) {
+	allctr->discarded.refaults++;
+	allctr->discarded.refaults_size += blk_sz;
+	allctr->discard_window.refaults_size += blk_sz;
+    }
+}
+
+/*
+ * Returns non-zero if the block should be looked at again by a
+ * later scan.
+ */
+static int
+discard_free_block(Allctr_t *allctr, Block_t *blk, Uint blk_sz, int force)
+{
+    UWord *info = DISCARD_INFO(allctr, blk);
+
+    if (info[0] == DISCARD_DONE(blk))
+	return 0;
+
+    if (!force) {
+	if (info[0] != DISCARD_FREED(blk)) {
+	    /* Not stamped; e.g. what is left of a split free block */
+	    info[0] = DISCARD_FREED(blk);
+	    info[1] = allctr->discard_gen;
+	    return 1;
+	}
+	if (allctr->discard_gen - info[1] < allctr->discard_delay)
+	    return 1;
+    }
+
+#ifdef ERTS_HAVE_OS_MEMORY_DISCARD
+    {
+	UWord start = ERTS_PAGEALIGNED_CEILING(&info[2]);
+	UWord end = ERTS_PAGEALIGNED_FLOOR(((char *) blk)
+					   + blk_sz
+					   - FBLK_FTR_SZ);
+	if (start < end) {
+	    erts_mmap_discard((void *) start, end - start);
+	    allctr->discarded.calls++;
+	    allctr->discarded.size += end - start;
+	    allctr->discard_window.size += end - start;
+	}
+    }
+#endif
+
+    info[0] = DISCARD_DONE(blk);
+    return 0;
+}
+
+static int
+discard_carrier(Allctr_t *allctr, Carrier_t *crr, int force)
+{
+    Block_t *blk = MBC_TO_FIRST_BLK(allctr, crr);
+    int pending = 0;
+
+    while (1) {
+	Uint blk_sz;
+	if (IS_FREE_BLK(blk)) {
+	    blk_sz = MBC_FBLK_SZ(blk);
+	    if (blk_sz >= allctr->discard_threshold
+		&& discard_free_block(allctr, blk, blk_sz, force))
+		pending = 1;
+	}
+	else
+	    blk_sz = MBC_ABLK_SZ(blk);
+	if (IS_LAST_BLK(blk))
+	    break;
+	blk = BLK_AFTER(blk, blk_sz);
+    }
+
+    if (!pending)
+	crr->chdr &= ~DISCARD_CARRIER_HDR_FLAG;
+    return pending;
+}
+
+/*
+ * Called as aux work by the thread with index allctr->ix. Returns
+ * non-zero if there still are free blocks waiting to be discarded.
+ */
+int
+erts_alcu_discard_free_memory(Allctr_t *allctr)
+{
+    Carrier_t *crr;
+    int pending = 0;
+
+#ifdef USE_THREADS
+    if (allctr->thread_safe)
+	erts_mtx_lock(&allctr->mutex);
+#endif
+
+    if (allctr->discard_scheduled) {
+	for (crr = allctr->mbc_list.first; crr; crr = crr->next) {
+	    if (IS_DISCARD_CARRIER(crr) && discard_carrier(allctr, crr, 0))
+		pending = 1;
+	}
+
+	if (2*allctr->discard_window.refaults_size
+	    > allctr->discard_window.size) {
+	    if (allctr->discard_delay < ERTS_ALCU_MAX_DISCARD_DELAY)
+		allctr->discard_delay *= 2;
+	}
+	else if (allctr->discard_window.refaults_size == 0
+		 && allctr->discard_delay > 1)
+	    allctr->discard_delay--;
+	allctr->discard_window.size = 0;
+	allctr->discard_window.refaults_size = 0;
+
+	allctr->discard_gen++;
+	allctr->discard_scheduled = pending;
+    }
+
+#ifdef USE_THREADS
+    if (allctr->thread_safe)
+	erts_mtx_unlock(&allctr->mutex);
+#endif
+
+    return pending;
+}
+
+#ifdef ERTS_SMP
+
+/*
+ * Evacuation of sparse multiblock carriers ("dcul").
+ *
+ * A carrier whose utilization has dropped below
+ * allctr->defrag.util_limit percent is taken out of the allocation
+ * strategy (remove_mbc()), as long as the free space in the other
+ * carriers can hold what is left in it. No new blocks are placed in an
+ * evacuating carrier, reallocations of blocks in it always move, and
+ * users that can relocate their data (see erts_alcu_is_evacuating())
+ * move it out, so that the carrier eventually becomes empty and is
+ * destroyed. If the allocator runs out of free blocks while carriers
+ * are evacuating, they are put back into use before a new carrier is
+ * created, and no evacuation is started for a while.
+ *
+ * Only used with strategies supporting carrier migration, since these
+ * keep the free blocks of a carrier out of reach when the carrier is
+ * removed.
+ */
+
+#define ERTS_ALCU_DEFRAG_BACKOFF 16
+
+static ERTS_INLINE void
+sched_defrag(Allctr_t *allctr)
+{
+    if (!allctr->defrag.scheduled) {
+	allctr->defrag.scheduled = 1;
+	erts_set_aux_work_timeout(allctr->ix,
+				  ERTS_SSI_AUX_WORK_ALCU_DEFRAG,
+				  1);
+    }
+}
+
+static void
+defrag_restore(Allctr_t *allctr)
+{
+    Carrier_t *crr;
+
+    for (crr = allctr->mbc_list.first; crr; crr = crr->next) {
+	if (crr->cpool.evacuating) {
+	    crr->cpool.evacuating = 0;
+	    allctr->add_mbc(allctr, crr);
+	    allctr->defrag.stat.restored++;
+	}
+    }
+    allctr->defrag.evacuating = 0;
+    allctr->defrag.backoff = ERTS_ALCU_DEFRAG_BACKOFF;
+    sched_defrag(allctr);
+}
+
+/*
+ * Called as aux work by the thread with index allctr->ix. Returns
+ * non-zero if it wants to be called again.
+ */
+int
+erts_alcu_defrag(Allctr_t *allctr)
+{
+    Carrier_t *crr;
+    UWord avail;
+    int pending;
+
+#ifdef USE_THREADS
+    if (allctr->thread_safe)
+	erts_mtx_lock(&allctr->mutex);
+#endif
+
+    if (allctr->defrag.backoff) {
+	allctr->defrag.backoff--;
+	pending = 1;
+	goto done;
+    }
+
+    avail = 0;
+    for (crr = allctr->mbc_list.first; crr; crr = crr->next) {
+	if (!crr->cpool.evacuating)
+	    avail += CARRIER_SZ(crr) - crr->cpool.blocks_size;
+    }
+
+    for (crr = allctr->mbc_list.first; crr; crr = crr->next) {
+	UWord unused;
+	if (crr->cpool.evacuating
+	    || crr == allctr->main_carrier
+	    || crr->cpool.blocks_size >= crr->cpool.defrag_limit)
+	    continue;
+	unused = CARRIER_SZ(crr) - crr->cpool.blocks_size;
+	if (avail - unused < crr->cpool.blocks_size)
+	    continue;
+	avail -= unused;
+	crr->cpool.evacuating = 1;
+	allctr->remove_mbc(allctr, crr);
+	allctr->defrag.evacuating++;
+	allctr->defrag.stat.evacuated++;
+    }
+
+    pending = allctr->defrag.evacuating != 0;
+
+done:
+    allctr->defrag.scheduled = pending;
+
+#ifdef USE_THREADS
+    if (allctr->thread_safe)
+	erts_mtx_unlock(&allctr->mutex);
+#endif
+
+    return pending;
+}
+
+UWord
+erts_alcu_evacuating_carriers(Allctr_t *allctr)
+{
+    return allctr->defrag.evacuating;
+}
+
+/*
+ * Returns non-zero if the block at p should be moved by its user.
+ * May be called without holding the allocator, since the answer is
+ * only a hint.
+ */
+int
+erts_alcu_is_evacuating(void *p)
+{
+    Block_t *blk = UMEM2BLK(p);
+
+    if (IS_SBC_BLK(blk))
+	return 0;
+    return ABLK_TO_MBC(blk)->cpool.evacuating;
+}
+
+#endif /* ERTS_SMP */
+
 /* Multi block carrier alloc/realloc/free ... */
 
 /* NOTE! mbc_alloc() may in case of memory shortage place the requested
@@ -2300,6 +2611,13 @@ mbc_alloc_block(Allctr_t *allctr, Uint size, Uint *blk_szp)
 
     blk = (*allctr->get_free_block)(allctr, get_blk_sz, NULL, 0);
 
+#ifdef ERTS_SMP
+    if (!blk && allctr->defrag.evacuating) {
+	defrag_restore(allctr);
+	blk = (*allctr->get_free_block)(allctr, get_blk_sz, NULL, 0);
+    }
+#endif
+
     if (!blk) {
 	blk = create_carrier(allctr, get_blk_sz, CFLG_MBC);
 #if !ERTS_SUPER_ALIGNED_MSEG_ONLY
@@ -2343,6 +2661,9 @@ mbc_alloc_finalize(Allctr_t *allctr,
     ASSERT(org_blk_sz >= want_blk_sz);
     ASSERT(blk);
 
+    if (valid_blk_info && org_blk_sz >= allctr->discard_threshold)
+	discard_check_refault(allctr, blk, want_blk_sz);
+
 #ifdef DEBUG
     nxt_blk = NULL;
 #endif
@@ -2527,12 +2848,142 @@ mbc_free(Allctr_t *allctr, void *p, Carrier_t **busy_pcrr_pp)
     else {
 	(*allctr->link_free_block)(allctr, blk);
 	HARD_CHECK_BLK_CARRIER(allctr, blk);
+	if (blk_sz >= allctr->discard_threshold
+	    && !(busy_pcrr_pp && *busy_pcrr_pp))
+	    discard_stamp_free_block(allctr, blk, crr);
 #ifdef ERTS_SMP
+	if (crr->cpool.blocks_size < crr->cpool.defrag_limit
+	    && !crr->cpool.evacuating
+	    && crr != allctr->main_carrier
+	    && !(busy_pcrr_pp && *busy_pcrr_pp))
+	    sched_defrag(allctr);
 	check_abandon_carrier(allctr, blk, busy_pcrr_pp);
 #endif
     }
 }
 
+/*
+ * Size class slabs ("as slab").
+ *
+ * Blocks up to ERTS_ALCU_SLAB_MAX_BLK_SZ bytes are kept on free lists
+ * per block size in front of the allocation strategy, so that the
+ * common small allocations and deallocations are a list operation. An
+ * empty list is refilled by allocating one ERTS_ALCU_SLAB_SZ slab from
+ * the strategy and splitting it into blocks of the wanted size.
+ *
+ * Blocks on the lists are allocated blocks as far as the strategy and
+ * the carriers are concerned; they keep their ordinary header, so they
+ * can be handled by any other code path (realloc, delayed dealloc,
+ * carrier destruction). A list holds at most one slab worth of blocks;
+ * beyond that blocks are freed to the strategy as usual. Slabs are not
+ * used together with carrier migration.
+ */
+
+#define SLAB_IX(BSZ) ((BSZ)/sizeof(Unit_t) - 1)
+
+static void *
+slab_refill(Allctr_t *allctr, ErtsAlcSlabList_t *sl, Uint blk_sz)
+{
+    Uint n = ERTS_ALCU_SLAB_SZ / blk_sz;
+    Uint slab_sz, i;
+    UWord flags;
+    Block_t *blk;
+    Carrier_t *crr;
+    void *res;
+
+    ASSERT(n > 1);
+
+    res = mbc_alloc(allctr, n*blk_sz - ABLK_HDR_SZ);
+    if (!res)
+	return NULL;
+    blk = UMEM2BLK(res);
+    if (IS_SBC_BLK(blk))
+	return res; /* Emergency; see mbc_alloc_block() */
+
+    slab_sz = MBC_ABLK_SZ(blk);
+    flags = GET_BLK_HDR_FLGS(blk);
+    crr = ABLK_TO_MBC(blk);
+    ASSERT(slab_sz >= n*blk_sz);
+
+    /*
+     * The first n-1 blocks go on the list; the last one, which also
+     * gets any excess of the slab, is returned.
+     */
+    for (i = 0; i < n - 1; i++) {
+	SET_MBC_ABLK_HDR(blk, blk_sz, i == 0 ? flags & PREV_FREE_BLK_HDR_FLG : 0, crr);
+	*((void **) BLK2UMEM(blk)) = sl->list;
+	sl->list = BLK2UMEM(blk);
+	blk = BLK_AFTER(blk, blk_sz);
+	STAT_MBC_BLK_ALLOC(allctr, crr, 0, 0);
+    }
+    SET_MBC_ABLK_HDR(blk, slab_sz - (n-1)*blk_sz, flags & LAST_BLK_HDR_FLG, crr);
+    sl->list_size += n - 1;
+    allctr->slab_blocks += n - 1;
+    allctr->slab_size += (n - 1)*blk_sz;
+
+    HARD_CHECK_BLK_CARRIER(allctr, blk);
+    return BLK2UMEM(blk);
+}
+
+static ERTS_INLINE void *
+slab_alloc(Allctr_t *allctr, Uint size)
+{
+    Uint blk_sz = UMEMSZ2BLKSZ(allctr, size);
+    ErtsAlcSlabList_t *sl;
+    void *res;
+
+    if (blk_sz > ERTS_ALCU_SLAB_MAX_BLK_SZ)
+	return mbc_alloc(allctr, size);
+
+    sl = &allctr->slab_list[SLAB_IX(blk_sz)];
+    res = sl->list;
+    if (!res)
+	return slab_refill(allctr, sl, blk_sz);
+
+    sl->list = *((void **) res);
+    sl->list_size--;
+    allctr->slab_blocks--;
+    allctr->slab_size -= blk_sz;
+    return res;
+}
+
+static void
+slab_free(Allctr_t *allctr, void *p, Carrier_t **busy_pcrr_pp)
+{
+    Uint blk_sz = MBC_ABLK_SZ(UMEM2BLK(p));
+
+    if (blk_sz <= ERTS_ALCU_SLAB_MAX_BLK_SZ) {
+	ErtsAlcSlabList_t *sl = &allctr->slab_list[SLAB_IX(blk_sz)];
+	if (sl->list_size < ERTS_ALCU_SLAB_SZ / blk_sz) {
+	    *((void **) p) = sl->list;
+	    sl->list = p;
+	    sl->list_size++;
+	    allctr->slab_blocks++;
+	    allctr->slab_size += blk_sz;
+	    return;
+	}
+    }
+    mbc_free(allctr, p, busy_pcrr_pp);
+}
+
+static void
+slab_flush(Allctr_t *allctr)
+{
+    int ix;
+
+    for (ix = 0; ix < ERTS_ALCU_SLAB_CLASSES; ix++) {
+	ErtsAlcSlabList_t *sl = &allctr->slab_list[ix];
+	while (sl->list) {
+	    void *p = sl->list;
+	    sl->list = *((void **) p);
+	    mbc_free(allctr, p, NULL);
+	}
+	sl->list_size = 0;
+    }
+    allctr->slab_blocks = 0;
+    allctr->slab_size = 0;
+}
+
 static void *
 mbc_realloc(Allctr_t *allctr, void *p, Uint size, Uint32 alcu_flgs,
 	    Carrier_t **busy_pcrr_pp)
@@ -2566,6 +3017,9 @@ mbc_realloc(Allctr_t *allctr, void *p, Uint size, Uint32 alcu_flgs,
 #ifdef ERTS_SMP
     if (busy_pcrr_pp && *busy_pcrr_pp)
 	goto realloc_move; /* Don't want to use carrier in pool */
+    if (ABLK_TO_MBC(blk)->cpool.evacuating
+	&& !(alcu_flgs & ERTS_ALCU_FLG_FAIL_REALLOC_MOVE))
+	goto realloc_move; /* Carrier is being emptied */
 #endif
 
     get_blk_sz = blk_sz = UMEMSZ2BLKSZ(allctr, size);
@@ -3599,6 +4053,8 @@ cpool_init_carrier_data(Allctr_t *allctr, Carrier_t *crr)
 	    limit = (csz/100)*allctr->cpool.util_limit;
 	crr->cpool.abandon_limit = limit;
     }
+    crr->cpool.defrag_limit = (CARRIER_SZ(crr)/100)*allctr->defrag.util_limit;
+    crr->cpool.evacuating = 0;
     crr->cpool.abandoned.next = NULL;
     crr->cpool.abandoned.prev = NULL;
 }
@@ -3640,6 +4096,10 @@ abandon_carrier(Allctr_t *allctr, Carrier_t *crr)
     max_size = (erts_aint_t) allctr->largest_fblk_in_mbc(allctr, crr);
     erts_atomic_set_nob(&crr->cpool.max_size, max_size);
 
+    /* Nobody will scan it while pooled; discard what we can now */
+    if (IS_DISCARD_CARRIER(crr))
+	(void) discard_carrier(allctr, crr, 1);
+
     cpool_insert(allctr, crr);
 
     set_new_allctr_abandon_limit(allctr);
@@ -4174,6 +4634,14 @@ destroy_carrier(Allctr_t *allctr, Block_t *blk, Carrier_t **busy_pcrr_pp)
 	else
 #endif
 	{
+#ifdef ERTS_SMP
+	    if (crr->cpool.evacuating) {
+		ASSERT(allctr->defrag.evacuating > 0);
+		allctr->defrag.evacuating--;
+		allctr->defrag.stat.carriers++;
+		allctr->defrag.stat.carriers_size += crr_sz;
+	    }
+#endif
 	    unlink_carrier(&allctr->mbc_list, crr);
 #if HAVE_ERTS_MSEG
 	    if (IS_MSEG_CARRIER(crr)) {
@@ -4240,6 +4708,10 @@ static struct {
     Eterm smbcs;
     Eterm mbcgs;
     Eterm acul;
+    Eterm slab;
+    Eterm hp;
+    Eterm dt;
+    Eterm dcul;
 
 #if HAVE_ERTS_MSEG
     Eterm mmc;
@@ -4254,6 +4726,17 @@ static struct {
     Eterm mbcs_pool;
 #endif
     Eterm sbcs;
+    Eterm slabs;
+    Eterm discarded;
+    Eterm refaults;
+    Eterm refaults_size;
+    Eterm delay;
+#ifdef ERTS_SMP
+    Eterm defrag;
+    Eterm evacuating;
+    Eterm evacuated;
+    Eterm restored;
+#endif
 
     Eterm sys_alloc_carriers_size;
 #if HAVE_ERTS_MSEG
@@ -4330,6 +4813,10 @@ init_atoms(Allctr_t *allctr)
 	AM_INIT(smbcs);
 	AM_INIT(mbcgs);
 	AM_INIT(acul);
+	AM_INIT(slab);
+	AM_INIT(hp);
+	AM_INIT(dt);
+	AM_INIT(dcul);
 
 #if HAVE_ERTS_MSEG
 	AM_INIT(mmc);
@@ -4342,6 +4829,17 @@ init_atoms(Allctr_t *allctr)
 	AM_INIT(mbcs);
 #ifdef ERTS_SMP
 	AM_INIT(mbcs_pool);
+#endif
+	AM_INIT(slabs);
+	AM_INIT(discarded);
+	AM_INIT(refaults);
+	AM_INIT(refaults_size);
+	AM_INIT(delay);
+#ifdef ERTS_SMP
+	AM_INIT(defrag);
+	AM_INIT(evacuating);
+	AM_INIT(evacuated);
+	AM_INIT(restored);
 #endif
 	AM_INIT(sbcs);
 
@@ -4763,6 +5261,135 @@ info_carriers(Allctr_t *allctr,
     return res;
 }
 
+static Eterm
+info_slabs(Allctr_t *allctr,
+	   int *print_to_p,
+	   void *print_to_arg,
+	   Uint **hpp,
+	   Uint *szp)
+{
+    Eterm res = THE_NON_VALUE;
+
+    if (print_to_p) {
+	erts_print(*print_to_p,
+		   print_to_arg,
+		   "slabs blocks: %bpu\n",
+		   allctr->slab_blocks);
+	erts_print(*print_to_p,
+		   print_to_arg,
+		   "slabs blocks size: %bpu\n",
+		   allctr->slab_size);
+    }
+
+    if (hpp || szp) {
+	res = NIL;
+	add_2tup(hpp, szp, &res,
+		 am.blocks_size,
+		 bld_unstable_uint(hpp, szp, allctr->slab_size));
+	add_2tup(hpp, szp, &res,
+		 am.blocks,
+		 bld_unstable_uint(hpp, szp, allctr->slab_blocks));
+    }
+
+    return res;
+}
+
+static Eterm
+info_discarded(Allctr_t *allctr,
+	       int *print_to_p,
+	       void *print_to_arg,
+	       Uint **hpp,
+	       Uint *szp)
+{
+    Eterm res = THE_NON_VALUE;
+
+    if (print_to_p) {
+	int to = *print_to_p;
+	void *arg = print_to_arg;
+	erts_print(to, arg, "discarded calls: %bpu\n",
+		   allctr->discarded.calls);
+	erts_print(to, arg, "discarded size: %bpu\n",
+		   allctr->discarded.size);
+	erts_print(to, arg, "discarded refaults: %bpu\n",
+		   allctr->discarded.refaults);
+	erts_print(to, arg, "discarded refaults size: %bpu\n",
+		   allctr->discarded.refaults_size);
+	erts_print(to, arg, "discarded delay: %bpu\n",
+		   allctr->discard_delay);
+    }
+
+    if (hpp || szp) {
+	res = NIL;
+	add_2tup(hpp, szp, &res,
+		 am.delay,
+		 bld_unstable_uint(hpp, szp, allctr->discard_delay));
+	add_2tup(hpp, szp, &res,
+		 am.refaults_size,
+		 bld_unstable_uint(hpp, szp, allctr->discarded.refaults_size));
+	add_2tup(hpp, szp, &res,
+		 am.refaults,
+		 bld_unstable_uint(hpp, szp, allctr->discarded.refaults));
+	add_2tup(hpp, szp, &res,
+		 am_size,
+		 bld_unstable_uint(hpp, szp, allctr->discarded.size));
+	add_2tup(hpp, szp, &res,
+		 am.calls,
+		 bld_unstable_uint(hpp, szp, allctr->discarded.calls));
+    }
+
+    return res;
+}
+
+#ifdef ERTS_SMP
+
+static Eterm
+info_defrag(Allctr_t *allctr,
+	    int *print_to_p,
+	    void *print_to_arg,
+	    Uint **hpp,
+	    Uint *szp)
+{
+    Eterm res = THE_NON_VALUE;
+
+    if (print_to_p) {
+	int to = *print_to_p;
+	void *arg = print_to_arg;
+	erts_print(to, arg, "defrag evacuating: %bpu\n",
+		   allctr->defrag.evacuating);
+	erts_print(to, arg, "defrag evacuated: %bpu\n",
+		   allctr->defrag.stat.evacuated);
+	erts_print(to, arg, "defrag restored: %bpu\n",
+		   allctr->defrag.stat.restored);
+	erts_print(to, arg, "defrag carriers: %bpu\n",
+		   allctr->defrag.stat.carriers);
+	erts_print(to, arg, "defrag carriers size: %bpu\n",
+		   allctr->defrag.stat.carriers_size);
+    }
+
+    if (hpp || szp) {
+	res = NIL;
+	add_2tup(hpp, szp, &res,
+		 am.carriers_size,
+		 bld_unstable_uint(hpp, szp, allctr->defrag.stat.carriers_size));
+	add_2tup(hpp, szp, &res,
+		 am.carriers,
+		 bld_unstable_uint(hpp, szp, allctr->defrag.stat.carriers));
+	add_2tup(hpp, szp, &res,
+		 am.restored,
+		 bld_unstable_uint(hpp, szp, allctr->defrag.stat.restored));
+	add_2tup(hpp, szp, &res,
+		 am.evacuated,
+		 bld_unstable_uint(hpp, szp, allctr->defrag.stat.evacuated));
+	add_2tup(hpp, szp, &res,
+		 am.evacuating,
+		 bld_unstable_uint(hpp, szp, allctr->defrag.evacuating));
+    }
+
+    return res;
+}
+
+#endif
+
 static void
 make_name_atoms(Allctr_t *allctr)
 {
@@ -4889,7 +5516,8 @@ info_options(Allctr_t *allctr,
 	     Uint *szp)
 {
     Eterm res = THE_NON_VALUE;
-    int acul;
+    int acul, dcul, huge_pages;
+    UWord discard_threshold;
 
     if (!allctr) {
 	if (print_to_p)
@@ -4903,10 +5531,22 @@ info_options(Allctr_t *allctr,
 
 #ifdef ERTS_SMP
     acul = allctr->cpool.util_limit;
+    dcul = allctr->defrag.util_limit;
 #else
     acul = 0;
+    dcul = 0;
+#endif
+
+#if HAVE_ERTS_MSEG
+    huge_pages = allctr->mseg_opt.huge_pages;
+#else
+    huge_pages = 0;
 #endif
 
+    discard_threshold = (IS_DISCARD_ENABLED(allctr)
+			 ? allctr->discard_threshold
+			 : 0);
+
     if (print_to_p) {
 	char topt[21]; /* Enough for any 64-bit integer */
 	if (allctr->t)
@@ -4933,7 +5573,11 @@ info_options(Allctr_t *allctr,
 		   "option lmbcs: %beu\n"
 		   "option smbcs: %beu\n"
 		   "option mbcgs: %beu\n"
-		   "option acul: %d\n",
+		   "option acul: %d\n"
+		   "option dcul: %d\n"
+		   "option slab: %s\n"
+		   "option hp: %s\n"
+		   "option dt: %beu\n",
 		   topt,
 		   allctr->ramv ? "true" : "false",
 		   allctr->sbc_threshold,
@@ -4951,13 +5595,25 @@ info_options(Allctr_t *allctr,
 		   allctr->largest_mbc_size,
 		   allctr->smallest_mbc_size,
 		   allctr->mbc_growth_stages,
-		   acul);
+		   acul,
+		   dcul,
+		   allctr->slab ? "true" : "false",
+		   huge_pages ? "true" : "false",
+		   discard_threshold);
     }
 
     res = (*allctr->info_options)(allctr, "option ", print_to_p, print_to_arg,
 				  hpp, szp);
 
     if (hpp || szp) {
+	add_2tup(hpp, szp, &res,
+		 am.dt,
+		 bld_uint(hpp, szp, discard_threshold));
+	add_2tup(hpp, szp, &res, am.hp, huge_pages ? am_true : am_false);
+	add_2tup(hpp, szp, &res, am.slab, allctr->slab ? am_true : am_false);
+	add_2tup(hpp, szp, &res,
+		 am.dcul,
+		 bld_uint(hpp, szp, (UWord) dcul));
 	add_2tup(hpp, szp, &res,
 		 am.acul,
 		 bld_uint(hpp, szp, (UWord) acul));
@@ -5202,8 +5858,9 @@ erts_alcu_info(Allctr_t *allctr,
 	       Uint *szp)
 {
     Eterm res, sett, mbcs, sbcs, calls, fix = THE_NON_VALUE;
+    Eterm slabs = THE_NON_VALUE, discarded = THE_NON_VALUE;
 #ifdef ERTS_SMP
-    Eterm mbcs_pool;
+    Eterm mbcs_pool, defrag = THE_NON_VALUE;
 #endif
 
     res  = THE_NON_VALUE;
@@ -5258,12 +5915,28 @@ erts_alcu_info(Allctr_t *allctr,
 #endif
     sbcs = info_carriers(allctr, &allctr->sbcs, "sbcs ", print_to_p,
 			 print_to_arg, hpp, szp);
+    if (allctr->slab)
+	slabs = info_slabs(allctr, print_to_p, print_to_arg, hpp, szp);
+    if (IS_DISCARD_ENABLED(allctr))
+	discarded = info_discarded(allctr, print_to_p, print_to_arg, hpp, szp);
+#ifdef ERTS_SMP
+    if (allctr->defrag.util_limit)
+	defrag = info_defrag(allctr, print_to_p, print_to_arg, hpp, szp);
+#endif
     calls = info_calls(allctr, print_to_p, print_to_arg, hpp, szp);
 
     if (hpp || szp) {
 	res = NIL;
 
 	add_2tup(hpp, szp, &res, am.calls, calls);
+	if (allctr->slab)
+	    add_2tup(hpp, szp, &res, am.slabs, slabs);
+	if (IS_DISCARD_ENABLED(allctr))
+	    add_2tup(hpp, szp, &res, am.discarded, discarded);
+#ifdef ERTS_SMP
+	if (allctr->defrag.util_limit)
+	    add_2tup(hpp, szp, &res, am.defrag, defrag);
+#endif
 	add_2tup(hpp, szp, &res, am.sbcs, sbcs);
 #ifdef ERTS_SMP
 	if (ERTS_ALC_IS_CPOOL_ENABLED(allctr))
@@ -5295,6 +5968,59 @@ erts_alcu_info(Allctr_t *allctr,
 }
 
 
+/*
+ * Statistics read without the allocator lock. The counters are single
+ * words only written by the owner of the lock, so each read value is
+ * valid, but values read together may be from different points in time.
+ */
+#define ERTS_ALCU_UNLOCKED_READ(X) (*((volatile UWord *) &(X)))
+
+void
+erts_alcu_stats(Allctr_t *allctr, ErtsAlcUStats_t *stats)
+{
+    CarriersStats_t *cs;
+    UWord slab_blocks, slab_size;
+
+    cs = &allctr->mbcs;
+    slab_blocks = ERTS_ALCU_UNLOCKED_READ(allctr->slab_blocks);
+    slab_size = ERTS_ALCU_UNLOCKED_READ(allctr->slab_size);
+    stats->mbcs.blocks = ERTS_ALCU_UNLOCKED_READ(cs->blocks.curr.no);
+    stats->mbcs.blocks_size = ERTS_ALCU_UNLOCKED_READ(cs->blocks.curr.size);
+    /* Blocks held in slab lists are free from the user's point of view */
+    stats->mbcs.blocks -= MIN(slab_blocks, stats->mbcs.blocks);
+    stats->mbcs.blocks_size -= MIN(slab_size, stats->mbcs.blocks_size);
+    stats->mbcs.carriers = (ERTS_ALCU_UNLOCKED_READ(cs->curr.norm.mseg.no)
+			    + ERTS_ALCU_UNLOCKED_READ(cs->curr.norm.sys_alloc.no));
+    stats->mbcs.carriers_size
+	= (ERTS_ALCU_UNLOCKED_READ(cs->curr.norm.mseg.size)
+	   + ERTS_ALCU_UNLOCKED_READ(cs->curr.norm.sys_alloc.size));
+
+    /* A singleblock carrier holds exactly one block */
+    cs = &allctr->sbcs;
+    stats->sbcs.carriers = (ERTS_ALCU_UNLOCKED_READ(cs->curr.norm.mseg.no)
+			    + ERTS_ALCU_UNLOCKED_READ(cs->curr.norm.sys_alloc.no));
+    stats->sbcs.carriers_size
+	= (ERTS_ALCU_UNLOCKED_READ(cs->curr.norm.mseg.size)
+	   + ERTS_ALCU_UNLOCKED_READ(cs->curr.norm.sys_alloc.size));
+    stats->sbcs.blocks = stats->sbcs.carriers;
+    stats->sbcs.blocks_size = ERTS_ALCU_UNLOCKED_READ(cs->blocks.curr.size);
+
+#ifdef ERTS_SMP
+    stats->cpool = ERTS_ALC_IS_CPOOL_ENABLED(allctr);
+    if (stats->cpool)
+	cpool_read_stat(allctr,
+			&stats->mbcs_pool.carriers,
+			&stats->mbcs_pool.carriers_size,
+			&stats->mbcs_pool.blocks,
+			&stats->mbcs_pool.blocks_size);
+    else
+#endif
+    {
+	stats->cpool = 0;
+	sys_memzero((void *) &stats->mbcs_pool, sizeof(ErtsAlcUCrrStats_t));
+    }
+}
+
 void
 erts_alcu_current_size(Allctr_t *allctr, AllctrSize_t *size, ErtsAlcUFixInfo_t *fi, int fisz)
 {
@@ -5309,7 +6035,7 @@ erts_alcu_current_size(Allctr_t *allctr, AllctrSize_t *size, ErtsAlcUFixInfo_t *
     size->carriers += allctr->sbcs.curr.norm.mseg.size;
     size->carriers += allctr->sbcs.curr.norm.sys_alloc.size;
 
-    size->blocks = allctr->mbcs.blocks.curr.size;
+    size->blocks = allctr->mbcs.blocks.curr.size - allctr->slab_size;
     size->blocks += allctr->sbcs.blocks.curr.size;
 
 #ifdef ERTS_SMP
@@ -5383,6 +6109,8 @@ do_erts_alcu_alloc(ErtsAlcType_t type, void *extra, Uint size)
 	blk = create_carrier(allctr, size, CFLG_SBC);
 	res = blk ? BLK2UMEM(blk) : NULL;
     }
+    else if (allctr->slab)
+	res = slab_alloc(allctr, size);
     else
 	res = mbc_alloc(allctr, size);
 
@@ -5518,6 +6246,8 @@ do_erts_alcu_free(ErtsAlcType_t type, void *extra, void *p,
 	    Block_t *blk = UMEM2BLK(p);
 	    if (IS_SBC_BLK(blk))
 		destroy_carrier(allctr, blk, NULL);
+	    else if (allctr->slab)
+		slab_free(allctr, p, busy_pcrr_pp);
 	    else
 		mbc_free(allctr, p, busy_pcrr_pp);
 	}
@@ -5709,6 +6439,18 @@ do_erts_alcu_realloc(ErtsAlcType_t type,
     return res;
 }
 
+/*
+ * A block in a single-block carrier that stays above the sbc threshold
+ * is resized in place by resizing its carrier (mremap() for mseg
+ * carriers). Moving it would copy the whole payload without reducing
+ * fragmentation, so the "realloc always moves" variants skip it.
+ */
+static ERTS_INLINE int
+sbc_resize_in_place(Allctr_t *allctr, void *p, Uint size)
+{
+    return p && IS_SBC_BLK(UMEM2BLK(p)) && size >= allctr->sbc_threshold;
+}
+
 void *
 erts_alcu_realloc(ErtsAlcType_t type, void *extra, void *p, Uint size)
 {
@@ -5722,6 +6464,8 @@ void *
 erts_alcu_realloc_mv(ErtsAlcType_t type, void *extra, void *p, Uint size)
 {
     void *res;
+    if (sbc_resize_in_place((Allctr_t *) extra, p, size))
+	return erts_alcu_realloc(type, extra, p, size);
     res = do_erts_alcu_alloc(type, extra, size);
     if (!res)
 	res = erts_alcu_realloc(type, extra, p, size);
@@ -5760,6 +6504,8 @@ erts_alcu_realloc_mv_ts(ErtsAlcType_t type, void *extra, void *p, Uint size)
 {
     Allctr_t *allctr = (Allctr_t *) extra;
     void *res;
+    if (sbc_resize_in_place(allctr, p, size))
+	return erts_alcu_realloc_ts(type, extra, p, size);
     erts_mtx_lock(&allctr->mutex);
     res = do_erts_alcu_alloc(type, extra, size);
     if (!res)
@@ -5825,6 +6571,9 @@ erts_alcu_realloc_mv_thr_spec(ErtsAlcType_t type, void *extra,
 
     allctr = tspec->allctr[ix];
 
+    if (sbc_resize_in_place(allctr, ptr, size))
+	return erts_alcu_realloc_thr_spec(type, extra, ptr, size);
+
     if (allctr->thread_safe)
 	erts_mtx_lock(&allctr->mutex);
 
@@ -5861,6 +6610,7 @@ realloc_thr_pref(ErtsAlcType_t type, void *extra, void *p, Uint size,
     Allctr_t *pref_allctr, *used_allctr;
     UWord old_user_size;
     Carrier_t *busy_pcrr_p;
+    int sbc_resize;
 #ifdef ERTS_SMP
     int retried;
 #endif
@@ -5885,7 +6635,9 @@ restart:
 
     ASSERT(used_allctr && pref_allctr);
 
-    if (!force_move && used_allctr == pref_allctr) {
+    sbc_resize = sbc_resize_in_place(used_allctr, p, size);
+
+    if ((!force_move || sbc_resize) && used_allctr == pref_allctr) {
 	ERTS_ALCU_DBG_CHK_THR_ACCESS(used_allctr);
 	res = do_erts_alcu_realloc(type,
 				   used_allctr,
@@ -5904,6 +6656,28 @@ restart:
 	if (pref_allctr->thread_safe)
 	    erts_mtx_unlock(&pref_allctr->mutex);
     }
+    else if (sbc_resize && used_allctr->thread_safe) {
+	/*
+	 * Single-block carriers never migrate, so the owner is stable;
+	 * when the owner can be locked, resize the carrier under its
+	 * lock rather than copying it into a new block of our own. An
+	 * owner that is not thread safe may only be operated on by its
+	 * own thread, so then we copy and hand the old block back.
+	 */
+	ASSERT(!busy_pcrr_p);
+	if (pref_allctr->thread_safe)
+	    erts_mtx_unlock(&pref_allctr->mutex);
+	if (used_allctr->thread_safe)
+	    erts_mtx_lock(&used_allctr->mutex);
+	res = do_erts_alcu_realloc(type,
+				   used_allctr,
+				   p,
+				   size,
+				   0,
+				   NULL);
+	if (used_allctr->thread_safe)
+	    erts_mtx_unlock(&used_allctr->mutex);
+    }
     else {
 	res = do_erts_alcu_alloc(type, pref_allctr, size);
 	if (!res)
@@ -6014,6 +6788,9 @@ erts_alcu_start(Allctr_t *allctr, AllctrInit_t *init)
 #if HAVE_ERTS_MSEG
     allctr->mseg_opt.abs_shrink_th	= init->asbcst;
     allctr->mseg_opt.rel_shrink_th	= init->rsbcst;
+#ifdef ERTS_HAVE_OS_HUGE_PAGE_ADVICE
+    allctr->mseg_opt.huge_pages		= init->hp;
+#endif
 #endif
     allctr->sbc_move_threshold		= init->rsbcmt;
     allctr->mbc_move_threshold		= init->rmbcmt;
@@ -6035,6 +6812,14 @@ erts_alcu_start(Allctr_t *allctr, AllctrInit_t *init)
     allctr->smallest_mbc_size		= init->smbcs;
     allctr->mbc_growth_stages		= MAX(1, init->mbcgs);
 
+#ifdef ERTS_HAVE_OS_MEMORY_DISCARD
+    if (init->dt)
+	allctr->discard_threshold	= MAX(init->dt, ERTS_ALCU_MIN_DISCARD_SZ);
+    else
+#endif
+	allctr->discard_threshold	= ~((UWord) 0);
+    allctr->discard_delay		= 1;
+
     if (allctr->min_block_size < ABLK_HDR_SZ)
 	goto error;
     allctr->min_block_size		= UNIT_CEILING(allctr->min_block_size
@@ -6063,6 +6848,8 @@ erts_alcu_start(Allctr_t *allctr, AllctrInit_t *init)
     erts_atomic_init_nob(&allctr->cpool.stat.no_carriers, 0);
     allctr->cpool.check_limit_count = ERTS_ALC_CPOOL_CHECK_LIMIT_COUNT;
     allctr->cpool.util_limit = init->ts ? 0 : init->acul;
+    if (allctr->add_mbc && allctr->remove_mbc && !init->slab)
+	allctr->defrag.util_limit = init->dcul;
 #endif
 
     allctr->sbc_threshold		= init->sbct;
@@ -6195,6 +6982,13 @@ erts_alcu_start(Allctr_t *allctr, AllctrInit_t *init)
 
     }
 
+    /* Slabs are refilled from multiblock carriers and cannot follow
+       carriers that migrate */
+    allctr->slab = (init->slab
+		    && !init->fix
+		    && !ERTS_ALC_IS_CPOOL_ENABLED(allctr)
+		    && allctr->sbc_threshold > ERTS_ALCU_SLAB_SZ);
+
     if (init->fix) {
 	int i;
 	allctr->fix = init->fix;
@@ -6241,6 +7035,9 @@ erts_alcu_stop(Allctr_t *allctr)
 {
     allctr->stopped = 1;
 
+    if (allctr->slab)
+	slab_flush(allctr);
+
     while (allctr->sbc_list.first)
 	destroy_carrier(allctr, SBC2BLK(allctr, allctr->sbc_list.first), NULL);
     while (allctr->mbc_list.first)
@@ -6395,11 +7192,11 @@ erts_alcu_verify_unused(Allctr_t *allctr)
 
     no = allctr->sbcs.curr.norm.mseg.no;
     no += allctr->sbcs.curr.norm.sys_alloc.no;
-    no += allctr->mbcs.blocks.curr.no;
+    no += allctr->mbcs.blocks.curr.no - allctr->slab_blocks;
 
     if (no) {
 	UWord sz = allctr->sbcs.blocks.curr.size;
-	sz += allctr->mbcs.blocks.curr.size;
+	sz += allctr->mbcs.blocks.curr.size - allctr->slab_size;
 	erts_exit(ERTS_ABORT_EXIT,
 		 "%salloc() used when expected to be unused!\n"
 		 "Total amount of blocks allocated: %bpu\n"
@@ -64,6 +64,10 @@ typedef struct {
     UWord smbcs;
     UWord mbcgs;
     int acul;
+    int slab;
+    int hp;
+    UWord dt;
+    int dcul;
 
     void *fix;
     size_t *fix_type_size;
@@ -89,6 +93,20 @@ typedef struct {
     UWord used;
 } ErtsAlcUFixInfo_t;
 
+typedef struct {
+    UWord blocks;
+    UWord blocks_size;
+    UWord carriers;
+    UWord carriers_size;
+} ErtsAlcUCrrStats_t;
+
+typedef struct {
+    ErtsAlcUCrrStats_t mbcs;
+    ErtsAlcUCrrStats_t sbcs;
+    int cpool;
+    ErtsAlcUCrrStats_t mbcs_pool;
+} ErtsAlcUStats_t;
+
 #ifndef SMALL_MEMORY
 
 #define ERTS_DEFAULT_ALCU_INIT {                                           \
@@ -118,6 +136,10 @@ typedef struct {
     1024*1024,		/* (bytes)  smbcs:  smallest mbc size            */\
     10,			/* (amount) mbcgs:  mbc growth stages            */\
     0,			/* (%)      acul:  abandon carrier utilization limit */\
+    0,			/* (bool)   slab:   size class slabs             */\
+    0,			/* (bool)   hp:     huge page carriers           */\
+    0,			/* (bytes)  dt:     free memory discard threshold */\
+    0,			/* (%)      dcul:  defrag carrier utilization limit */\
     /* --- Data not options -------------------------------------------- */\
     NULL,		/* (ptr)    fix                                  */\
     NULL		/* (ptr)    fix_type_size                        */\
@@ -151,6 +173,10 @@ typedef struct {
     128*1024,		/* (bytes)  smbcs:  smallest mbc size            */\
     10,			/* (amount) mbcgs:  mbc growth stages            */\
     0,			/* (%)      acul:  abandon carrier utilization limit */\
+    0,			/* (bool)   slab:   size class slabs             */\
+    0,			/* (bool)   hp:     huge page carriers           */\
+    0,			/* (bytes)  dt:     free memory discard threshold */\
+    0,			/* (%)      dcul:  defrag carrier utilization limit */\
     /* --- Data not options -------------------------------------------- */\
     NULL,		/* (ptr)    fix                                  */\
     NULL		/* (ptr)    fix_type_size                        */\
@@ -185,10 +211,17 @@ Eterm	erts_alcu_info(Allctr_t *, int, int, int *, void *, Uint **, Uint *);
 void	erts_alcu_init(AlcUInit_t *);
 void    erts_alcu_current_size(Allctr_t *, AllctrSize_t *,
 			       ErtsAlcUFixInfo_t *, int);
+void	erts_alcu_stats(Allctr_t *, ErtsAlcUStats_t *);
 #ifdef ERTS_SMP
 void    erts_alcu_check_delayed_dealloc(Allctr_t *, int, int *, ErtsThrPrgrVal *, int *);
 #endif
 erts_aint32_t erts_alcu_fix_alloc_shrink(Allctr_t *, erts_aint32_t);
+int	erts_alcu_discard_free_memory(Allctr_t *);
+#ifdef ERTS_SMP
+int	erts_alcu_defrag(Allctr_t *);
+UWord	erts_alcu_evacuating_carriers(Allctr_t *);
+int	erts_alcu_is_evacuating(void *);
+#endif
 
 #ifdef ARCH_32
 extern UWord erts_literal_vspace_map[];
@@ -319,6 +352,8 @@ typedef struct {
     ErtsThrPrgrVal thr_prgr;
     erts_atomic_t max_size;
     UWord abandon_limit;
+    UWord defrag_limit;
+    int evacuating;
     UWord blocks;
     UWord blocks_size;
     ErtsDoubleLink_t abandoned; /* node in pooled_list or traitor_list */
@@ -496,6 +531,15 @@ typedef struct {
     } u;
 } ErtsAlcFixList_t;
 
+/* Blocks up to this size are kept in size class slabs ("as slab") */
+#define ERTS_ALCU_SLAB_MAX_BLK_SZ 256
+#define ERTS_ALCU_SLAB_CLASSES (ERTS_ALCU_SLAB_MAX_BLK_SZ/sizeof(Unit_t))
+
+typedef struct {
+    Uint list_size;
+    void *list;
+} ErtsAlcSlabList_t;
+
 struct Allctr_t_ {
 #ifdef ERTS_SMP
     struct {
@@ -576,6 +620,20 @@ struct Allctr_t_ {
 	    erts_atomic_t	no_carriers;
 	} stat;
     } cpool;
+
+    /* Evacuation of sparse multiblock carriers */
+    struct {
+	int		util_limit;
+	int		scheduled;
+	int		backoff;
+	UWord		evacuating;
+	struct {
+	    UWord	evacuated;
+	    UWord	restored;
+	    UWord	carriers;
+	    UWord	carriers_size;
+	} stat;
+    } defrag;
 #endif
 
     /* Main carrier (if there is one) */
@@ -619,6 +677,27 @@ struct Allctr_t_ {
     int			fix_shrink_scheduled;
     ErtsAlcFixList_t	*fix;
 
+    int			slab;
+    UWord		slab_blocks;
+    UWord		slab_size;
+    ErtsAlcSlabList_t	slab_list[ERTS_ALCU_SLAB_CLASSES];
+
+    /* Discarding of free memory in multiblock carriers */
+    UWord		discard_threshold;
+    int			discard_scheduled;
+    UWord		discard_gen;
+    UWord		discard_delay;
+    struct {
+	UWord		calls;
+	UWord		size;
+	UWord		refaults;
+	UWord		refaults_size;
+    } discarded;
+    struct {
+	UWord		size;
+	UWord		refaults_size;
+    } discard_window;
+
 #ifdef USE_THREADS
     /* Mutex for this allocator */
     erts_mtx_t		mutex;
@@ -610,7 +610,9 @@ static Eterm pi_args[] = {
     am_current_location,
     am_current_stacktrace,
     am_message_queue_data,
-    am_garbage_collection_info
+    am_garbage_collection_info,
+    am_garbage_collection_stats,
+    am_max_message_queue_len
 };
 
 #define ERTS_PI_ARGS ((int) (sizeof(pi_args)/sizeof(Eterm)))
@@ -661,6 +663,8 @@ pi_arg2ix(Eterm arg)
     case am_current_stacktrace:			return 31;
     case am_message_queue_data:			return 32;
     case am_garbage_collection_info:		return 33;
+    case am_garbage_collection_stats:		return 34;
+    case am_max_message_queue_len:		return 35;
     default:					return -1;
     }
 }
@@ -1386,6 +1390,18 @@ process_info_aux(Process *BIF_P,
 	break;
     }
 
+    case am_max_message_queue_len: {
+	Uint hsz = 3;
+	(void) erts_max_msgq_len_map(MAX_MSGQ_LEN_GET(rp),
+				     MAX_MSGQ_LEN_ACTION_GET(rp),
+				     NULL, &hsz);
+	hp = HAlloc(BIF_P, hsz);
+	res = erts_max_msgq_len_map(MAX_MSGQ_LEN_GET(rp),
+				    MAX_MSGQ_LEN_ACTION_GET(rp),
+				    &hp, NULL);
+	break;
+    }
+
     case am_total_heap_size: {
 	ErtsMessage *mp;
 	Uint total_heap_size;
@@ -1453,6 +1469,15 @@ process_info_aux(Process *BIF_P,
 	break;
     }
 
+    case am_garbage_collection_stats: {
+        Uint sz = 0;
+
+        erts_process_gc_stats(rp, &sz, NULL);
+        hp = HAlloc(BIF_P, sz + 3);
+        res = erts_process_gc_stats(rp, NULL, &hp);
+        break;
+    }
+
     case am_garbage_collection_info: {
         Uint sz = 0, actual_sz = 0;
 
@@ -1758,6 +1783,12 @@ info_1_tuple(Process* BIF_P,	/* Pointer to current process. */
 	    goto badarg;
 	}
     }
+    else if (sel == am_allocator_stats && arity == 2) {
+	ret = erts_allocator_stats(BIF_P, *tp);
+	if (is_non_value(ret))
+	    goto badarg;
+	return ret;
+    }
     else if (sel == am_wordsize && arity == 2) {
 	if (tp[0] == am_internal) {
 	    return make_small(sizeof(Eterm));
@@ -1767,7 +1798,11 @@ info_1_tuple(Process* BIF_P,	/* Pointer to current process. */
 	}
 	goto badarg;
     } else if (sel == am_allocated) {
-	if (arity == 2) {
+	if (arity == 2 && tp[0] == am_samples)
+	    return erts_instr_get_samples(BIF_P);
+	else if (arity == 2 && tp[0] == am_attribution)
+	    return erts_instr_get_attribution(BIF_P);
+	else if (arity == 2) {
 	    Eterm res = THE_NON_VALUE;
 	    char *buf;
 	    Sint len = is_string(*tp);
@@ -3439,6 +3474,8 @@ BIF_RETTYPE statistics_1(BIF_ALIST_1)
 	if (is_non_value(res))
 	    BIF_RET(am_undefined);
 	BIF_TRAP1(gather_gc_info_res_trap, BIF_P, res);
+    } else if (BIF_ARG_1 == am_garbage_collection_pauses) {
+	BIF_RET(erts_gc_pause_histogram(BIF_P));
     } else if (BIF_ARG_1 == am_reductions) {
 	Uint reds;
 	Uint diff;
@@ -4255,6 +4292,90 @@ BIF_RETTYPE erts_debug_set_internal_state_2(BIF_ALIST_2)
 	    BIF_ERROR(BIF_P,  EXC_NOTSUP);
 #endif
 	}
+	else if (ERTS_IS_ATOM_STR("single_pass_send", BIF_ARG_1)) {
+	    int old_single_pass, single_pass;
+	    switch (BIF_ARG_2) {
+	    case am_true:
+		single_pass = 1;
+		break;
+	    case am_false:
+		single_pass = 0;
+		break;
+	    default:
+		BIF_ERROR(BIF_P, BADARG);
+	    }
+
+	    erts_smp_proc_unlock(BIF_P, ERTS_PROC_LOCK_MAIN);
+	    erts_smp_thr_progress_block();
+	    old_single_pass = erts_send_single_pass;
+	    erts_send_single_pass = single_pass;
+	    erts_smp_thr_progress_unblock();
+	    erts_smp_proc_lock(BIF_P, ERTS_PROC_LOCK_MAIN);
+	    BIF_RET(old_single_pass ? am_true : am_false);
+	}
+	else if (ERTS_IS_ATOM_STR("preserve_sharing", BIF_ARG_1)) {
+	    int old_preserve, preserve;
+	    switch (BIF_ARG_2) {
+	    case am_true:
+		preserve = 1;
+		break;
+	    case am_false:
+		preserve = 0;
+		break;
+	    default:
+		BIF_ERROR(BIF_P, BADARG);
+	    }
+
+	    erts_smp_proc_unlock(BIF_P, ERTS_PROC_LOCK_MAIN);
+	    erts_smp_thr_progress_block();
+	    old_preserve = erts_preserve_sharing;
+	    erts_preserve_sharing = preserve;
+	    erts_smp_thr_progress_unblock();
+	    erts_smp_proc_lock(BIF_P, ERTS_PROC_LOCK_MAIN);
+	    BIF_RET(old_preserve ? am_true : am_false);
+	}
+	else if (ERTS_IS_ATOM_STR("msgq_index", BIF_ARG_1)) {
+	    int old_enabled, enabled;
+	    switch (BIF_ARG_2) {
+	    case am_true:
+		enabled = 1;
+		break;
+	    case am_false:
+		enabled = 0;
+		break;
+	    default:
+		BIF_ERROR(BIF_P, BADARG);
+	    }
+
+	    erts_smp_proc_unlock(BIF_P, ERTS_PROC_LOCK_MAIN);
+	    erts_smp_thr_progress_block();
+	    old_enabled = erts_msgq_index_enabled;
+	    erts_msgq_index_enabled = enabled;
+	    erts_smp_thr_progress_unblock();
+	    erts_smp_proc_lock(BIF_P, ERTS_PROC_LOCK_MAIN);
+	    BIF_RET(old_enabled ? am_true : am_false);
+	}
+	else if (ERTS_IS_ATOM_STR("small_message_pool", BIF_ARG_1)) {
+	    int old_enabled, enabled;
+	    switch (BIF_ARG_2) {
+	    case am_true:
+		enabled = 1;
+		break;
+	    case am_false:
+		enabled = 0;
+		break;
+	    default:
+		BIF_ERROR(BIF_P, BADARG);
+	    }
+
+	    erts_smp_proc_unlock(BIF_P, ERTS_PROC_LOCK_MAIN);
+	    erts_smp_thr_progress_block();
+	    old_enabled = erts_small_message_pool;
+	    erts_small_message_pool = enabled;
+	    erts_smp_thr_progress_unblock();
+	    erts_smp_proc_lock(BIF_P, ERTS_PROC_LOCK_MAIN);
+	    BIF_RET(old_enabled ? am_true : am_false);
+	}
 	else if (ERTS_IS_ATOM_STR("wait", BIF_ARG_1)) {
 	    if (ERTS_IS_ATOM_STR("deallocations", BIF_ARG_2)) {
 		int flag = ERTS_DEBUG_WAIT_COMPLETED_DEALLOCATIONS;
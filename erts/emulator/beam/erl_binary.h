@@ -23,6 +23,7 @@
 
 #include "erl_threads.h"
 #include "bif.h"
+#include "erl_instrument.h"
 
 /*
  * Maximum number of bytes to place in a heap binary.
@@ -182,6 +183,10 @@ BIF_RETTYPE erts_binary_part(Process *p, Eterm binary, Eterm epos, Eterm elen);
 ERTS_GLB_INLINE byte* erts_get_aligned_binary_bytes(Eterm bin, byte** base_ptr);
 ERTS_GLB_INLINE void erts_free_aligned_binary_bytes(byte* buf);
 ERTS_GLB_INLINE void erts_free_aligned_binary_bytes_extra(byte* buf, ErtsAlcType_t);
+ERTS_GLB_INLINE void *erts_bin_mem_alloc_fnf(ErtsAlcType_t type, Uint size);
+ERTS_GLB_INLINE void *erts_bin_mem_realloc_fnf(ErtsAlcType_t type, void *ptr,
+					       Uint size);
+ERTS_GLB_INLINE void erts_bin_mem_free(ErtsAlcType_t type, void *ptr);
 ERTS_GLB_INLINE Binary *erts_bin_drv_alloc_fnf(Uint size);
 ERTS_GLB_INLINE Binary *erts_bin_drv_alloc(Uint size);
 ERTS_GLB_INLINE Binary *erts_bin_nrml_alloc(Uint size);
@@ -228,6 +233,35 @@ erts_free_aligned_binary_bytes(byte* buf)
 #  define CHICKEN_PAD (sizeof(void*) - 1)
 #endif
 
+/*
+ * All memory for Binary structures goes through these, so that the
+ * binaries can be attributed to their creators (+Mia true).
+ */
+ERTS_GLB_INLINE void *
+erts_bin_mem_alloc_fnf(ErtsAlcType_t type, Uint size)
+{
+    if (erts_instr_attribution)
+	return erts_instr_bin_alloc_fnf(type, size);
+    return erts_alloc_fnf(type, size);
+}
+
+ERTS_GLB_INLINE void *
+erts_bin_mem_realloc_fnf(ErtsAlcType_t type, void *ptr, Uint size)
+{
+    if (erts_instr_attribution)
+	return erts_instr_bin_realloc_fnf(type, ptr, size);
+    return erts_realloc_fnf(type, ptr, size);
+}
+
+ERTS_GLB_INLINE void
+erts_bin_mem_free(ErtsAlcType_t type, void *ptr)
+{
+    if (erts_instr_attribution)
+	erts_instr_bin_free(type, ptr);
+    else
+	erts_free(type, ptr);
+}
+
 /* Caller must initialize 'refc'
 */
 ERTS_GLB_INLINE Binary *
@@ -238,7 +272,7 @@ erts_bin_drv_alloc_fnf(Uint size)
 
     if (bsize < size) /* overflow */
 	return NULL;
-    res = erts_alloc_fnf(ERTS_ALC_T_DRV_BINARY, bsize);
+    res = erts_bin_mem_alloc_fnf(ERTS_ALC_T_DRV_BINARY, bsize);
     ERTS_CHK_BIN_ALIGNMENT(res);
     if (res) {
 	res->orig_size = size;
@@ -257,7 +291,9 @@ erts_bin_drv_alloc(Uint size)
 
     if (bsize < size) /* overflow */
 	erts_alloc_enomem(ERTS_ALC_T_DRV_BINARY, size);
-    res = erts_alloc(ERTS_ALC_T_DRV_BINARY, bsize);
+    res = erts_bin_mem_alloc_fnf(ERTS_ALC_T_DRV_BINARY, bsize);
+    if (!res)
+	erts_alloc_enomem(ERTS_ALC_T_DRV_BINARY, bsize);
     ERTS_CHK_BIN_ALIGNMENT(res);
     res->orig_size = size;
     res->flags = BIN_FLAG_DRV;
@@ -275,7 +311,9 @@ erts_bin_nrml_alloc(Uint size)
 
     if (bsize < size) /* overflow */
 	erts_alloc_enomem(ERTS_ALC_T_BINARY, size);
-    res = erts_alloc(ERTS_ALC_T_BINARY, bsize);
+    res = erts_bin_mem_alloc_fnf(ERTS_ALC_T_BINARY, bsize);
+    if (!res)
+	erts_alloc_enomem(ERTS_ALC_T_BINARY, bsize);
     ERTS_CHK_BIN_ALIGNMENT(res);
     res->orig_size = size;
     res->flags = 0;
@@ -292,7 +330,7 @@ erts_bin_realloc_fnf(Binary *bp, Uint size)
     ASSERT((bp->flags & BIN_FLAG_MAGIC) == 0);
     if (bsize < size) /* overflow */
 	return NULL;
-    nbp = erts_realloc_fnf(type, (void *) bp, bsize);
+    nbp = erts_bin_mem_realloc_fnf(type, (void *) bp, bsize);
     ERTS_CHK_BIN_ALIGNMENT(nbp);
     if (nbp)
 	nbp->orig_size = size;
@@ -309,7 +347,7 @@ erts_bin_realloc(Binary *bp, Uint size)
     ASSERT((bp->flags & BIN_FLAG_MAGIC) == 0);
     if (bsize < size) /* overflow */
 	erts_realloc_enomem(type, bp, size);
-    nbp = erts_realloc_fnf(type, (void *) bp, bsize);
+    nbp = erts_bin_mem_realloc_fnf(type, (void *) bp, bsize);
     if (!nbp)
 	erts_realloc_enomem(type, bp, bsize);
     ERTS_CHK_BIN_ALIGNMENT(nbp);
@@ -323,9 +361,9 @@ erts_bin_free(Binary *bp)
     if (bp->flags & BIN_FLAG_MAGIC)
 	ERTS_MAGIC_BIN_DESTRUCTOR(bp)(bp);
     if (bp->flags & BIN_FLAG_DRV)
-	erts_free(ERTS_ALC_T_DRV_BINARY, (void *) bp);
+	erts_bin_mem_free(ERTS_ALC_T_DRV_BINARY, (void *) bp);
     else
-	erts_free(ERTS_ALC_T_BINARY, (void *) bp);
+	erts_bin_mem_free(ERTS_ALC_T_BINARY, (void *) bp);
 }
 
 ERTS_GLB_INLINE Binary *
@@ -334,7 +372,7 @@ erts_create_magic_binary_x(Uint size, void (*destructor)(Binary *),
 {
     Uint bsize = unaligned ? ERTS_MAGIC_BIN_UNALIGNED_SIZE(size)
                            : ERTS_MAGIC_BIN_SIZE(size);
-    Binary* bptr = erts_alloc_fnf(ERTS_ALC_T_BINARY, bsize);
+    Binary* bptr = erts_bin_mem_alloc_fnf(ERTS_ALC_T_BINARY, bsize);
     ASSERT(bsize > size);
     if (!bptr)
 	erts_alloc_n_enomem(ERTS_ALC_T2N(ERTS_ALC_T_BINARY), bsize);
@@ -1254,6 +1254,22 @@ erts_new_bs_put_string(ERL_BITS_PROTO_2(byte* iptr, Uint num_bytes))
     erts_bin_offset += num_bytes*8;
 }
 
+/*
+ * Number of bytes to reserve for a writable binary that must hold at
+ * least 'used' bytes. The reserve grows geometrically so that repeated
+ * appends cost amortized constant time per byte. Once a binary is large
+ * enough to get its own single-block carrier, the allocators grow it by
+ * remapping the carrier instead of copying the payload.
+ */
+static ERTS_INLINE Uint
+bs_append_reserve(Uint used)
+{
+    Uint size = 2*used;
+    if (size < used)
+	return used;		/* Overflow; reserve exactly what is needed */
+    return size < 256 ? 256 : size;
+}
+
 Eterm
 erts_bs_append(Process* c_p, Eterm* reg, Uint live, Eterm build_size_term,
 	    Uint extra_words, Uint unit)
@@ -1334,7 +1350,7 @@ erts_bs_append(Process* c_p, Eterm* reg, Uint live, Eterm build_size_term,
      */
     binp = pb->val;
     if (binp->orig_size < pb->size) {
-	Uint new_size = 2*pb->size;
+	Uint new_size = bs_append_reserve(pb->size);
 	binp = erts_bin_realloc(binp, new_size);
 	pb->val = binp;
 	pb->bytes = (byte *) binp->orig_bytes;
@@ -1400,8 +1416,7 @@ erts_bs_append(Process* c_p, Eterm* reg, Uint live, Eterm build_size_term,
 	}
 	used_size_in_bits = erts_bin_offset + build_size_in_bits;
 	used_size_in_bytes = NBYTES(used_size_in_bits);
-	bin_size = 2*used_size_in_bytes;
-	bin_size = (bin_size < 256) ? 256 : bin_size;
+	bin_size = bs_append_reserve(used_size_in_bytes);
 
 	/*
 	 * Allocate the binary data struct itself.
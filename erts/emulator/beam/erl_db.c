@@ -181,6 +181,11 @@ int user_requested_db_max_tabs;
 int erts_ets_realloc_always_moves;
 int erts_ets_always_compress;
 static int db_max_tabs;
+#ifdef ERTS_SMP
+static erts_smp_atomic32_t db_defrag_busy;
+static int db_defrag_slot;
+static int db_defrag_ix;
+#endif
 static DbTable *meta_pid_to_tab; /* Pid mapped to owned tables */
 static DbTable *meta_pid_to_fixed_tab; /* Pid mapped to fixed tables */
 static Eterm ms_delete_all;
@@ -1492,6 +1497,17 @@ BIF_RETTYPE ets_new_2(BIF_ALIST_2)
 		 "db_tab", "db_tab_fix");
     tb->common.keypos = keypos;
     tb->common.owner = BIF_P->common.id;
+    tb->common.creator = BIF_P->common.id;
+    {
+	BeamInstr *mfa = erts_find_running_function(BIF_P);
+	if (!mfa)
+	    tb->common.creator_mfa[0] = THE_NON_VALUE;
+	else {
+	    tb->common.creator_mfa[0] = (Eterm) mfa[0];
+	    tb->common.creator_mfa[1] = (Eterm) mfa[1];
+	    tb->common.creator_mfa[2] = (Eterm) mfa[2];
+	}
+    }
     set_heir(BIF_P, tb, heir, heir_data);
 
     erts_smp_atomic_init_nob(&tb->common.nitems, 0);
@@ -2925,6 +2941,9 @@ void init_db(ErtsDbSpinCount db_spin_count)
 #endif
 
     erts_smp_atomic_init_nob(&erts_ets_misc_mem_size, 0);
+#ifdef ERTS_SMP
+    erts_smp_atomic32_init_nob(&db_defrag_busy, 0);
+#endif
     db_initialize_util();
 
     if (user_requested_db_max_tabs < DB_DEF_MAX_TABS)
@@ -3931,6 +3950,33 @@ erts_db_foreach_table(void (*func)(DbTable *, void *), void *arg)
     ASSERT(j == meta_main_tab_cnt);
 }
 
+/*
+ * Call func with the creator and memory size of each table. Unlike
+ * erts_db_foreach_table() this may be called without blocking the
+ * system; func is called with a meta table lock held.
+ */
+void
+erts_db_foreach_creator(void (*func)(Eterm, Eterm *, Uint, void *),
+			void *arg)
+{
+    int slot, top;
+
+    erts_smp_spin_lock(&meta_main_tab_main_lock);
+    top = meta_main_tab_top;
+    erts_smp_spin_unlock(&meta_main_tab_main_lock);
+
+    for (slot = 0; slot < top; slot++) {
+	erts_smp_rwmtx_t *mmtl = get_meta_main_tab_lock(slot);
+	erts_smp_rwmtx_rlock(mmtl);
+	if (IS_SLOT_ALIVE(slot)) {
+	    DbTable *tb = meta_main_tab[slot].u.tb;
+	    Uint size = (Uint) erts_smp_atomic_read_nob(&tb->common.memory_size);
+	    (*func)(tb->common.creator, tb->common.creator_mfa, size, arg);
+	}
+	erts_smp_rwmtx_runlock(mmtl);
+    }
+}
+
 /* SMP Note: May only be used when system is locked */
 void
 erts_db_foreach_offheap(DbTable *tb,
@@ -3940,6 +3986,90 @@ erts_db_foreach_offheap(DbTable *tb,
     tb->common.meth->db_foreach_offheap(tb, func, arg);
 }
 
+#ifdef ERTS_SMP
+
+/*
+ * Called from scheduler aux work while ets_alloc has carriers that
+ * are being evacuated (see the +M<S>dcul option). Hash table objects
+ * located in such carriers are copied into new blocks so the carriers
+ * can empty out and be released. Only a bounded number of objects are
+ * scanned per call and busy tables are skipped; the scan continues
+ * where it left off on the next call. Returns non-zero if the current
+ * pass over the tables is not yet complete. Tree tables and compressed
+ * tables are left alone.
+ */
+
+#define ERTS_DB_DEFRAG_BUDGET 4000
+
+int
+erts_db_defrag(void)
+{
+    int budget = ERTS_DB_DEFRAG_BUDGET;
+    int top, more;
+
+    if (erts_smp_atomic32_cmpxchg_acqb(&db_defrag_busy, 1, 0) != 0)
+	return 0; /* Another scheduler is at it */
+
+    erts_smp_spin_lock(&meta_main_tab_main_lock);
+    top = meta_main_tab_top;
+    erts_smp_spin_unlock(&meta_main_tab_main_lock);
+
+    while (budget > 0 && db_defrag_slot < top) {
+	erts_smp_rwmtx_t *mmtl = get_meta_main_tab_lock(db_defrag_slot);
+	DbTable *tb = NULL;
+
+	erts_smp_rwmtx_rlock(mmtl);
+	if (IS_SLOT_ALIVE(db_defrag_slot))
+	    tb = meta_main_tab[db_defrag_slot].u.tb;
+	erts_smp_rwmtx_runlock(mmtl);
+
+	/*
+	 * The table structure is not deallocated until thread progress
+	 * has been made, so we may look at it after releasing the meta
+	 * lock.
+	 */
+	if (tb
+	    && IS_HASH_TABLE(tb->common.status)
+	    && !tb->common.compress
+	    && erts_smp_rwmtx_tryrwlock(&tb->common.rwlock) != EBUSY) {
+	    if (tb->common.type & DB_FINE_LOCKED)
+		tb->common.is_thread_safe = 1;
+	    if (!(tb->common.status & DB_DELETE))
+		budget -= db_defrag_hash(tb, &db_defrag_ix, budget);
+	    else
+		db_defrag_ix = 0;
+	    if (tb->common.type & DB_FINE_LOCKED)
+		tb->common.is_thread_safe = 0;
+	    erts_smp_rwmtx_rwunlock(&tb->common.rwlock);
+	    if (db_defrag_ix != 0)
+		break; /* Continue in this table next time */
+	}
+	else
+	    db_defrag_ix = 0;
+	db_defrag_slot++;
+    }
+
+    more = db_defrag_slot < top;
+    if (!more)
+	db_defrag_slot = 0;
+
+    erts_smp_atomic32_set_relb(&db_defrag_busy, 0);
+    return more;
+}
+
+#endif /* ERTS_SMP */
+
+/* retrieve current number of ets tables */
+Uint
+erts_db_no_tables(void)
+{
+    int cnt;
+    erts_smp_spin_lock(&meta_main_tab_main_lock);
+    cnt = meta_main_tab_cnt;
+    erts_smp_spin_unlock(&meta_main_tab_main_lock);
+    return (Uint) cnt;
+}
+
 /* retrieve max number of ets tables */
 Uint
 erts_db_get_max_tabs()
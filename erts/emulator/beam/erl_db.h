@@ -76,6 +76,7 @@ void init_db(ErtsDbSpinCount);
 int erts_db_process_exiting(Process *, ErtsProcLocks);
 void db_info(int, void *, int);
 void erts_db_foreach_table(void (*)(DbTable *, void *), void *);
+void erts_db_foreach_creator(void (*)(Eterm, Eterm *, Uint, void *), void *);
 void erts_db_foreach_offheap(DbTable *,
 			     void (*func)(ErlOffHeap *, void *),
 			     void *);
@@ -92,6 +93,10 @@ extern erts_smp_atomic_t erts_ets_misc_mem_size;
 Eterm erts_ets_colliding_names(Process*, Eterm name, Uint cnt);
 
 Uint erts_db_get_max_tabs(void);
+Uint erts_db_no_tables(void);
+#ifdef ERTS_SMP
+int erts_db_defrag(void);
+#endif
 
 #endif
 
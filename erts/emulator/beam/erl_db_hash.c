@@ -2982,6 +2982,44 @@ void db_foreach_offheap_hash(DbTable *tbl,
     }
 }
 
+#ifdef ERTS_SMP
+/*
+ * Move objects out of ets_alloc carriers that are being evacuated,
+ * see erts_db_defrag(). The table must be write locked. Scans at most
+ * budget objects starting at bucket *ixp and returns the number of
+ * objects scanned. *ixp is set to the bucket to continue from, or to
+ * zero when the end of the table was reached.
+ */
+int db_defrag_hash(DbTable *tbl, int *ixp, int budget)
+{
+    DbTableHash *tb = &tbl->hash;
+    int nactive = NACTIVE(tb);
+    int scanned = 0;
+    int ix;
+
+    ASSERT(!tb->common.compress);
+
+    for (ix = *ixp; ix < nactive && scanned < budget; ix++) {
+	HashDbTerm **bp = &BUCKET(tb, ix);
+	HashDbTerm *b;
+	while ((b = *bp) != NULL) {
+	    scanned++;
+	    if (erts_alloc_is_evacuating(ERTS_ALC_T_DB_TERM, b)) {
+		HashDbTerm *nb = new_dbterm(tb, make_tuple(b->dbterm.tpl));
+		nb->next = b->next;
+		nb->hvalue = b->hvalue;
+		*bp = nb;
+		free_term(tb, b);
+		b = nb;
+	    }
+	    bp = &b->next;
+	}
+    }
+    *ixp = ix < nactive ? ix : 0;
+    return scanned;
+}
+#endif
+
 void db_calc_stats_hash(DbTableHash* tb, DbHashStats* stats)
 {
     HashDbTerm* b;
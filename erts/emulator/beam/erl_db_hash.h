@@ -109,5 +109,8 @@ typedef struct {
 }DbHashStats;
 
 void db_calc_stats_hash(DbTableHash* tb, DbHashStats*);
+#ifdef ERTS_SMP
+int db_defrag_hash(DbTable *tbl, int *ixp, int budget);
+#endif
 
 #endif /* _DB_HASH_H */
@@ -2160,13 +2160,17 @@ restart:
 	    if (in_flags & ERTS_PAM_COPY_RESULT) {
 		Uint sz;
 		Eterm* top;
-		sz = size_object(term);
-		top = HAllocX(build_proc, sz, HEAP_XTRA);
 		if (in_flags & ERTS_PAM_CONTIGUOUS_TUPLE) {
+		    /* Size of the whole DbTerm, which may share subterms */
 		    ASSERT(is_tuple(term));
+		    sz = ((DbTerm *) (((char *) tuple_val(term))
+				      - offsetof(DbTerm, tpl)))->size;
+		    top = HAllocX(build_proc, sz, HEAP_XTRA);
 		    *esp++ = copy_shallow(tuple_val(term), sz, &top, &MSO(build_proc));
 		}
 		else {
+		    sz = size_object(term);
+		    top = HAllocX(build_proc, sz, HEAP_XTRA);
 		    *esp++ = copy_struct(term, sz, &top, &MSO(build_proc));
 		}
 	    }
@@ -2738,10 +2742,8 @@ void db_do_update_element(DbUpdateHandle* handle,
 				    sys_memcpy(oldp, newp, newval_sz*sizeof(Eterm));
 				return;
 			    }
-			    goto both_size_set;
 			}
 		    }
-		    goto new_size_set;
 		}
 	    }
 	}
@@ -2749,13 +2751,13 @@ void db_do_update_element(DbUpdateHandle* handle,
     /* Not possible for simple memcpy or dbterm is already non-contiguous, */
     /* need to realloc... */
 
-    newval_sz = is_immed(newval) ? 0 : size_object(newval);
-new_size_set:
-
-    oldval_sz = is_immed(oldval) ? 0 : size_object(oldval);
-both_size_set:
-
-    handle->new_size = handle->new_size - oldval_sz + newval_sz;
+    if (handle->tb->common.compress) {
+	/* Compressed terms are flat; other terms may share subterms
+	   and are sized by db_finalize_resize() */
+	newval_sz = is_immed(newval) ? 0 : size_object(newval);
+	oldval_sz = is_immed(oldval) ? 0 : size_object(oldval);
+	handle->new_size = handle->new_size - oldval_sz + newval_sz;
+    }
 
     /* write new value in old dbterm, finalize will make a flat copy */
     handle->dbterm->tpl[position] = newval;
@@ -2885,6 +2887,45 @@ static void* copy_to_comp(DbTableCommon* tb, Eterm obj, DbTerm* dest,
     return top.cp;
 }
 
+/*
+** Size of the term *objp when stored in a DbTerm. A term too large to
+** be sized flat is first copied into heap fragments preserving sharing,
+** in which case *objp is set to the copy and *fragsp to the fragments.
+*/
+static Uint db_size_term(Eterm* objp, ErlHeapFragment** fragsp)
+{
+    Uint limit = ERTS_COPY_SHARED_LIMIT();
+    Uint size = size_object_x(*objp, limit);
+
+    *fragsp = NULL;
+    if (size > limit) {
+	*fragsp = erts_copy_shared_to_frags(objp, size, &size, 0);
+    }
+    return size;
+}
+
+/*
+** Copy a term sized by db_size_term() into the DbTerm newp.
+*/
+static void db_copy_term(Eterm obj, ErlHeapFragment* frags, DbTerm* newp)
+{
+    Eterm* top = newp->tpl;
+    ErlOffHeap tmp_offheap;
+
+    tmp_offheap.first = NULL;
+    if (frags) {
+	tmp_offheap.overhead = 0;
+	erts_move_multi_frags(&top, &tmp_offheap, frags, &obj, 1, 0);
+	free_message_buffer(frags);
+	ASSERT(obj == make_tuple(newp->tpl));
+    }
+    else {
+	copy_struct(obj, newp->size, &top, &tmp_offheap);
+    }
+    ASSERT(top == newp->tpl + newp->size);
+    newp->first_oh = tmp_offheap.first;
+}
+
 /*
 ** Copy the object into a possibly new DbTerm, 
 ** offset is the offset of the DbTerm from the start
@@ -2896,8 +2937,8 @@ void* db_store_term(DbTableCommon *tb, DbTerm* old, Uint offset, Eterm obj)
 {
     byte* basep;
     DbTerm* newp;
-    Eterm* top;
-    int size = size_object(obj);
+    ErlHeapFragment* frags;
+    Uint size = db_size_term(&obj, &frags);
     ErlOffHeap tmp_offheap;
 
     if (old != 0) {
@@ -2922,10 +2963,7 @@ void* db_store_term(DbTableCommon *tb, DbTerm* old, Uint offset, Eterm obj)
 	newp = (DbTerm*) (basep + offset);
     }
     newp->size = size;
-    top = newp->tpl;
-    tmp_offheap.first  = NULL;
-    copy_struct(obj, size, &top, &tmp_offheap);
-    newp->first_oh = tmp_offheap.first;
+    db_copy_term(obj, frags, newp);
 #ifdef DEBUG_CLONE
     newp->debug_clone = NULL;
 #endif
@@ -2978,13 +3016,21 @@ void db_finalize_resize(DbUpdateHandle* handle, Uint offset)
 {
     DbTable* tbl = handle->tb;
     DbTerm* newDbTerm;
-    Uint alloc_sz = offset +
-	(tbl->common.compress ?
-	 db_size_dbterm_comp(&tbl->common, make_tuple(handle->dbterm->tpl)) :
-	 sizeof(DbTerm)+sizeof(Eterm)*(handle->new_size-1));
-    byte* newp = erts_db_alloc(ERTS_ALC_T_DB_TERM, tbl, alloc_sz);
+    Eterm obj = make_tuple(handle->dbterm->tpl);
+    ErlHeapFragment* frags = NULL;
+    Uint alloc_sz;
+    byte* newp;
     byte* oldp = *(handle->bp);
 
+    if (tbl->common.compress) {
+	alloc_sz = offset + db_size_dbterm_comp(&tbl->common, obj);
+    }
+    else {
+	handle->new_size = db_size_term(&obj, &frags);
+	alloc_sz = offset + sizeof(DbTerm)+sizeof(Eterm)*(handle->new_size-1);
+    }
+    newp = erts_db_alloc(ERTS_ALC_T_DB_TERM, tbl, alloc_sz);
+
     sys_memcpy(newp, oldp, offset);  /* copy only hash/tree header */
     *(handle->bp) = newp;
     newDbTerm = (DbTerm*) (newp + offset);
@@ -3001,17 +3047,7 @@ void db_finalize_resize(DbUpdateHandle* handle, Uint offset)
 	db_free_tmp_uncompressed(handle->dbterm);
     }
     else {
-	ErlOffHeap tmp_offheap;
-	Eterm* tpl = handle->dbterm->tpl;
-	Eterm* top = newDbTerm->tpl;
-
-	tmp_offheap.first = NULL;
-
-	{
-	    copy_struct(make_tuple(tpl), handle->new_size, &top, &tmp_offheap);
-	    newDbTerm->first_oh = tmp_offheap.first;
-	    ASSERT((byte*)top == (newp + alloc_sz));
-	}
+	db_copy_term(obj, frags, newDbTerm);
     }
 }
 
@@ -219,6 +219,9 @@ typedef struct db_table_common {
     Uint32 type;              /* table type, *read only* after creation */
 #endif
     Eterm owner;              /* Pid of the creator */
+    Eterm creator;            /* Pid of the creator, kept on give_away */
+    Eterm creator_mfa[3];     /* Function that created the table, or
+				 THE_NON_VALUE if unknown */
     Eterm heir;               /* Pid of the heir */
     UWord heir_data;          /* To send in ETS-TRANSFER (is_immed or (DbTerm*) */
     Uint64 heir_started_interval;  /* To further identify the heir */
@@ -42,12 +42,20 @@
 #include "dtrace-wrapper.h"
 #include "erl_bif_unique.h"
 #include "dist.h"
+#include "safe_hash.h"
 
 #define ERTS_INACT_WR_PB_LEAVE_MUCH_LIMIT 1
 #define ERTS_INACT_WR_PB_LEAVE_MUCH_PERCENTAGE 20
 #define ERTS_INACT_WR_PB_LEAVE_LIMIT 10
 #define ERTS_INACT_WR_PB_LEAVE_PERCENTAGE 10
 
+#if defined(ERTS_SMP) \
+    && ((ETHR_SIZEOF_PTR == 8 && defined(ETHR_HAVE_NATIVE_ATOMIC64)) \
+	|| (ETHR_SIZEOF_PTR == 4 && defined(ETHR_HAVE_NATIVE_ATOMIC32)))
+/* Parallel fullsweep claims heap words using word sized atomics */
+#  define ERTS_PARALLEL_GC
+#endif
+
 #if defined(DEBUG) || 0
 #define ERTS_GC_DEBUG
 #else
@@ -115,9 +123,11 @@ static Eterm *full_sweep_heaps(Process *p,
 			       int hibernate,
 			       Eterm *n_heap, Eterm* n_htop,
 			       char *oh, Uint oh_size,
-			       Eterm *objv, int nobj);
+			       Eterm *objv, int nobj,
+			       Eterm *pgc_limit);
 static int garbage_collect(Process* p, ErlHeapFragment *live_hf_end,
-			   int need, Eterm* objv, int nobj, int fcalls);
+			   int need, Eterm* objv, int nobj, int fcalls,
+			   int direct);
 static int major_collection(Process* p, ErlHeapFragment *live_hf_end,
 			    int need, Eterm* objv, int nobj, Uint *recl);
 static int minor_collection(Process* p, ErlHeapFragment *live_hf_end,
@@ -139,6 +149,7 @@ static Eterm* collect_live_heap_frags(Process* p, ErlHeapFragment *live_hf_end,
 static int adjust_after_fullsweep(Process *p, int need, Eterm *objv, int nobj);
 static void shrink_new_heap(Process *p, Uint new_sz, Eterm *objv, int nobj);
 static void grow_new_heap(Process *p, Uint new_sz, Eterm* objv, int nobj);
+static void grow_old_heap(Process *p, Uint new_sz, Eterm* objv, int nobj);
 static void sweep_off_heap(Process *p, int fullsweep);
 static void offset_heap(Eterm* hp, Uint sz, Sint offs, char* area, Uint area_size);
 static void offset_heap_ptr(Eterm* hp, Uint sz, Sint offs, char* area, Uint area_size);
@@ -157,6 +168,13 @@ static void disallow_heap_frag_ref_in_heap(Process* p);
 static void disallow_heap_frag_ref_in_old_heap(Process* p);
 #endif
 
+#ifdef ERTS_PARALLEL_GC
+static void init_parallel_gc(void);
+static Uint pgc_begin(Uint size);
+static void pgc_end(void);
+static Eterm *parallel_sweep_heaps(Eterm *n_hp, Eterm *n_htop, Eterm *limit);
+#endif
+
 #if defined(ARCH_64)
 # define MAX_HEAP_SIZES 154
 #else
@@ -167,6 +185,22 @@ static Sint heap_sizes[MAX_HEAP_SIZES];	/* Suitable heap sizes. */
 static int num_heap_sizes;	/* Number of heap sizes. */
 
 Uint erts_test_long_gc_sleep; /* Only used for testing... */
+Uint erts_dirty_gc_limit;     /* Heap size (words) above which gc is done dirty */
+Uint erts_parallel_gc_limit;  /* Heap size (words) above which fullsweeps are parallel */
+Uint erts_parallel_gc_threads; /* Threads taking part in a parallel fullsweep */
+
+static void init_heap_prediction(void);
+
+#ifdef ERTS_DIRTY_SCHEDULERS
+/*
+ * Garbage collections executed on dirty schedulers are not
+ * accounted in the scheduler specific gc_info since dirty
+ * schedulers do not take part in gc info requests...
+ */
+static erts_atomic64_t dirty_gc_reclaimed;
+static erts_atomic64_t dirty_garbage_cols;
+static erts_atomic_t dirty_gc_pause_hist[ERTS_GC_PAUSE_HIST_SIZE];
+#endif
 
 typedef struct {
     Process *proc;
@@ -215,6 +249,19 @@ erts_init_gc(void)
 
     erts_test_long_gc_sleep = 0;
 
+#ifdef ERTS_DIRTY_SCHEDULERS
+    erts_atomic64_init_nob(&dirty_gc_reclaimed, 0);
+    erts_atomic64_init_nob(&dirty_garbage_cols, 0);
+    for (i = 0; i < ERTS_GC_PAUSE_HIST_SIZE; i++)
+	erts_atomic_init_nob(&dirty_gc_pause_hist[i], 0);
+#endif
+
+#ifdef ERTS_PARALLEL_GC
+    init_parallel_gc();
+#endif
+
+    init_heap_prediction();
+
     /*
      * Heap sizes start growing in a Fibonacci sequence.
      *
@@ -257,6 +304,8 @@ erts_init_gc(void)
     for (ix = 0; ix < erts_no_schedulers; ix++) {
       ErtsSchedulerData *esdp = ERTS_SCHEDULER_IX(ix);
       init_gc_info(&esdp->gc_info);
+      for (i = 0; i < ERTS_GC_PAUSE_HIST_SIZE; i++)
+	  erts_smp_atomic_init_nob(&esdp->gc_pause_hist[i], 0);
     }
 
     init_gcireq_alloc();
@@ -400,15 +449,15 @@ erts_gc_after_bif_call_lhf(Process* p, ErlHeapFragment *live_hf_end,
 		regs = erts_proc_sched_data(p)->x_reg_array;
 	    }
 	  #endif
-	    cost = garbage_collect(p, live_hf_end, 0, regs, p->arity, p->fcalls);
+	    cost = garbage_collect(p, live_hf_end, 0, regs, p->arity, p->fcalls, 0);
 	} else {
-	    cost = garbage_collect(p, live_hf_end, 0, regs, arity, p->fcalls);
+	    cost = garbage_collect(p, live_hf_end, 0, regs, arity, p->fcalls, 0);
 	}
     } else {
 	Eterm val[1];
 
 	val[0] = result;
-	cost = garbage_collect(p, live_hf_end, 0, val, 1, p->fcalls);
+	cost = garbage_collect(p, live_hf_end, 0, val, 1, p->fcalls, 0);
 	result = val[0];
     }
     BUMP_REDS(p, cost);
@@ -529,6 +578,66 @@ delay_garbage_collection(Process *p, ErlHeapFragment *live_hf_end, int need, int
     return reds_left;
 }
 
+#ifdef ERTS_DIRTY_SCHEDULERS
+
+/*
+ * Garbage collections of large heaps are moved to dirty cpu
+ * schedulers in order not to block the run queue of the normal
+ * scheduler while collecting. The heap need is satisfied in a
+ * heap fragment exactly as when gc is delayed, and the process
+ * then yields. The actual collection is performed by
+ * erts_execute_dirty_gc() once a dirty cpu scheduler has picked
+ * up the process.
+ */
+
+static ERTS_INLINE int
+dirty_gc_wanted(Process *p)
+{
+    Uint hsz;
+
+    if (!erts_dirty_gc_limit)
+	return 0;
+
+    hsz = p->heap_sz + p->mbuf_sz;
+    if (GEN_GCS(p) >= MAX_GEN_GCS(p) || (p->flags & F_NEED_FULLSWEEP))
+	hsz += OLD_HEND(p) - OLD_HEAP(p);
+
+    return hsz > erts_dirty_gc_limit;
+}
+
+static int
+delay_dirty_garbage_collection(Process *p, ErlHeapFragment *live_hf_end,
+			       int need, int fcalls)
+{
+    int reds_left;
+
+    if (!(p->flags & F_DIRTY_GC)) {
+	p->flags |= F_DIRTY_GC;
+	erts_smp_atomic32_read_bor_nob(&p->state, ERTS_PSFLG_DIRTY_ACTIVE_SYS);
+    }
+
+    if (need)
+	return delay_garbage_collection(p, live_hf_end, need, fcalls);
+
+    /*
+     * Nothing is needed right now, but we still want to be
+     * scheduled out as soon as possible so that the collection
+     * is done before we grow any further...
+     */
+    p->flags |= F_FORCE_GC;
+    reds_left = ERTS_REDS_LEFT(p, fcalls);
+
+    if (reds_left > ERTS_ABANDON_HEAP_COST) {
+	int vreds = reds_left - ERTS_ABANDON_HEAP_COST;
+	erts_proc_sched_data((p))->virtual_reds += vreds;
+    }
+
+    ASSERT(CONTEXT_REDS >= erts_proc_sched_data(p)->virtual_reds);
+    return reds_left;
+}
+
+#endif /* ERTS_DIRTY_SCHEDULERS */
+
 static ERTS_FORCE_INLINE Uint
 young_gen_usage(Process *p)
 {
@@ -587,6 +696,58 @@ young_gen_usage(Process *p)
 	}							\
     } while (0)
 
+/* Microseconds since start of a garbage collection */
+static ERTS_INLINE Uint
+gc_pause_time(ErtsSchedulerData *esdp, ErtsMonotonicTime start_time)
+{
+    ErtsMonotonicTime now = erts_get_monotonic_time(esdp);
+    return (Uint) ERTS_MONOTONIC_TO_USEC(now - start_time);
+}
+
+/*
+ * Account a finished collection in the statistics of the process
+ * and in the pause time histogram. The histogram buckets of a
+ * scheduler are only written by that scheduler; collections made
+ * on dirty schedulers share a common set of buckets.
+ */
+static void
+update_gc_stats(Process *p, ErtsSchedulerData *esdp, int major,
+		ErtsMonotonicTime gc_time, Uint old_used_before,
+		Uint heap_size_before)
+{
+    ErtsProcGCStats *stats = &p->gc_stats;
+    Uint copied = HEAP_TOP(p) - HEAP_START(p);
+    Uint pause = (Uint) ERTS_MONOTONIC_TO_USEC(gc_time);
+    int ix;
+
+    if (major) {
+	stats->major_gcs++;
+	stats->major_gc_time += gc_time;
+    } else {
+	Uint promoted = (OLD_HEAP(p) ? OLD_HTOP(p) - OLD_HEAP(p) : 0);
+	promoted -= old_used_before;
+	stats->minor_gcs++;
+	stats->minor_gc_time += gc_time;
+	stats->words_promoted += promoted;
+	copied += promoted;
+    }
+    stats->words_copied += copied;
+    if (HEAP_SIZE(p) > heap_size_before)
+	stats->heap_grows++;
+
+    ix = pause ? erts_fit_in_bits_uint(pause) : 0;
+    if (ix >= ERTS_GC_PAUSE_HIST_SIZE)
+	ix = ERTS_GC_PAUSE_HIST_SIZE - 1;
+
+#ifdef ERTS_DIRTY_SCHEDULERS
+    if (ERTS_SCHEDULER_IS_DIRTY(esdp))
+	erts_atomic_inc_nob(&dirty_gc_pause_hist[ix]);
+    else
+#endif
+	erts_smp_atomic_set_nob(&esdp->gc_pause_hist[ix],
+				erts_smp_atomic_read_nob(&esdp->gc_pause_hist[ix]) + 1);
+}
+
 /*
  * Garbage collect a process.
  *
@@ -594,15 +755,19 @@ young_gen_usage(Process *p)
  * need: Number of Eterm words needed on the heap.
  * objv: Array of terms to add to rootset; that is to preserve.
  * nobj: Number of objects in objv.
+ * direct: Collect now on the current scheduler; never move
+ *         the collection to a dirty scheduler.
  */
 static int
 garbage_collect(Process* p, ErlHeapFragment *live_hf_end,
-		int need, Eterm* objv, int nobj, int fcalls)
+		int need, Eterm* objv, int nobj, int fcalls,
+		int direct)
 {
     Uint reclaimed_now = 0;
     Eterm gc_trace_end_tag;
     int reds;
-    ErtsMonotonicTime start_time = 0; /* Shut up faulty warning... */
+    ErtsMonotonicTime start_time, gc_time;
+    Uint old_used_before, heap_size_before;
     ErtsSchedulerData *esdp;
     erts_aint32_t state;
     ERTS_MSACC_PUSH_STATE_M();
@@ -620,6 +785,16 @@ garbage_collect(Process* p, ErlHeapFragment *live_hf_end,
     if (p->flags & (F_DISABLE_GC|F_DELAY_GC) || state & ERTS_PSFLG_EXITING)
 	return delay_garbage_collection(p, live_hf_end, need, fcalls);
 
+    esdp = erts_get_scheduler_data();
+
+#ifdef ERTS_DIRTY_SCHEDULERS
+    if (!direct && !ERTS_SCHEDULER_IS_DIRTY(esdp)
+	&& ((p->flags & F_DIRTY_GC) || dirty_gc_wanted(p))) {
+	return delay_dirty_garbage_collection(p, live_hf_end, need, fcalls);
+    }
+    p->flags &= ~F_DIRTY_GC;
+#endif
+
     if (p->abandoned_heap)
 	live_hf_end = ERTS_INVALID_HFRAG_PTR;
     else if (p->live_hf_end != ERTS_INVALID_HFRAG_PTR)
@@ -627,11 +802,10 @@ garbage_collect(Process* p, ErlHeapFragment *live_hf_end,
 
     ERTS_MSACC_SET_STATE_CACHED_M(ERTS_MSACC_STATE_GC);
 
-    esdp = erts_get_scheduler_data();
-
     erts_smp_atomic32_read_bor_nob(&p->state, ERTS_PSFLG_GC);
-    if (erts_system_monitor_long_gc != 0)
-	start_time = erts_get_monotonic_time(esdp);
+    start_time = erts_get_monotonic_time(esdp);
+    old_used_before = OLD_HEAP(p) ? OLD_HTOP(p) - OLD_HEAP(p) : 0;
+    heap_size_before = HEAP_SIZE(p);
 
     ERTS_CHK_OFFHEAP(p);
 
@@ -652,14 +826,15 @@ garbage_collect(Process* p, ErlHeapFragment *live_hf_end,
 
     if (GEN_GCS(p) < MAX_GEN_GCS(p) && !(FLAGS(p) & F_NEED_FULLSWEEP)) {
         if (IS_TRACED_FL(p, F_TRACE_GC)) {
-            trace_gc(p, am_gc_minor_start, need, THE_NON_VALUE);
+            trace_gc(p, am_gc_minor_start, need, THE_NON_VALUE, 0);
         }
         DTRACE2(gc_minor_start, pidbuf, need);
         reds = minor_collection(p, live_hf_end, need, objv, nobj, &reclaimed_now);
         DTRACE2(gc_minor_end, pidbuf, reclaimed_now);
         if (reds == -1) {
             if (IS_TRACED_FL(p, F_TRACE_GC)) {
-                trace_gc(p, am_gc_minor_end, reclaimed_now, THE_NON_VALUE);
+                trace_gc(p, am_gc_minor_end, reclaimed_now, THE_NON_VALUE,
+                         gc_pause_time(esdp, start_time));
             }
             goto do_major_collection;
         }
@@ -668,7 +843,7 @@ garbage_collect(Process* p, ErlHeapFragment *live_hf_end,
 do_major_collection:
         ERTS_MSACC_SET_STATE_CACHED_M_X(ERTS_MSACC_STATE_GC_FULL);
         if (IS_TRACED_FL(p, F_TRACE_GC)) {
-            trace_gc(p, am_gc_major_start, need, THE_NON_VALUE);
+            trace_gc(p, am_gc_major_start, need, THE_NON_VALUE, 0);
         }
         DTRACE2(gc_major_start, pidbuf, need);
         reds = major_collection(p, live_hf_end, need, objv, nobj, &reclaimed_now);
@@ -713,8 +888,13 @@ do_major_collection:
 
     erts_smp_atomic32_read_band_nob(&p->state, ~ERTS_PSFLG_GC);
 
+    gc_time = erts_get_monotonic_time(esdp) - start_time;
+    update_gc_stats(p, esdp, gc_trace_end_tag == am_gc_major_end,
+		    gc_time, old_used_before, heap_size_before);
+
     if (IS_TRACED_FL(p, F_TRACE_GC)) {
-        trace_gc(p, gc_trace_end_tag, reclaimed_now, THE_NON_VALUE);
+        trace_gc(p, gc_trace_end_tag, reclaimed_now, THE_NON_VALUE,
+                 (Uint) ERTS_MONOTONIC_TO_USEC(gc_time));
     }
 
     if (erts_system_monitor_long_gc != 0) {
@@ -735,8 +915,18 @@ do_major_collection:
 	    monitor_large_heap(p);
     }
 
-    esdp->gc_info.garbage_cols++;
-    esdp->gc_info.reclaimed += reclaimed_now;
+#ifdef ERTS_DIRTY_SCHEDULERS
+    if (ERTS_SCHEDULER_IS_DIRTY(esdp)) {
+	erts_atomic64_inc_nob(&dirty_garbage_cols);
+	erts_atomic64_add_nob(&dirty_gc_reclaimed,
+			      (erts_aint64_t) reclaimed_now);
+    }
+    else
+#endif
+    {
+	esdp->gc_info.garbage_cols++;
+	esdp->gc_info.reclaimed += reclaimed_now;
+    }
     
     FLAGS(p) &= ~F_FORCE_GC;
     p->live_hf_end = ERTS_INVALID_HFRAG_PTR;
@@ -772,7 +962,7 @@ do_major_collection:
 int
 erts_garbage_collect_nobump(Process* p, int need, Eterm* objv, int nobj, int fcalls)
 {
-    int reds = garbage_collect(p, ERTS_INVALID_HFRAG_PTR, need, objv, nobj, fcalls);
+    int reds = garbage_collect(p, ERTS_INVALID_HFRAG_PTR, need, objv, nobj, fcalls, 0);
     int reds_left = ERTS_REDS_LEFT(p, fcalls);
     if (reds > reds_left)
 	reds = reds_left;
@@ -780,10 +970,50 @@ erts_garbage_collect_nobump(Process* p, int need, Eterm* objv, int nobj, int fca
     return reds;
 }
 
+/*
+ * Same as erts_garbage_collect_nobump(), but the collection is
+ * always performed immediately on the current scheduler. Used
+ * when the caller depends on the result of the collection.
+ */
+int
+erts_garbage_collect_direct(Process* p, int need, Eterm* objv, int nobj, int fcalls)
+{
+    int reds = garbage_collect(p, ERTS_INVALID_HFRAG_PTR, need, objv, nobj, fcalls, 1);
+    int reds_left = ERTS_REDS_LEFT(p, fcalls);
+    if (reds > reds_left)
+	reds = reds_left;
+    ASSERT(CONTEXT_REDS - (reds_left - reds) >= erts_proc_sched_data(p)->virtual_reds);
+    return reds;
+}
+
+#ifdef ERTS_DIRTY_SCHEDULERS
+
+/*
+ * Perform a garbage collection previously moved to a dirty
+ * scheduler by garbage_collect(). Called by the dirty cpu
+ * scheduler executing the process.
+ */
+int
+erts_execute_dirty_gc(Process *p, int fcalls)
+{
+    ASSERT(ERTS_SCHEDULER_IS_DIRTY_CPU(erts_get_scheduler_data()));
+
+    if (p->flags & (F_DISABLE_GC|F_DELAY_GC)) {
+	/*
+	 * Will be collected (possibly dirty again) when gc
+	 * is enabled; F_FORCE_GC is still set...
+	 */
+	return 0;
+    }
+    return erts_garbage_collect_nobump(p, 0, p->arg_reg, p->arity, fcalls);
+}
+
+#endif
+
 void
 erts_garbage_collect(Process* p, int need, Eterm* objv, int nobj)
 {
-    int reds = garbage_collect(p, ERTS_INVALID_HFRAG_PTR, need, objv, nobj, p->fcalls);
+    int reds = garbage_collect(p, ERTS_INVALID_HFRAG_PTR, need, objv, nobj, p->fcalls, 0);
     BUMP_REDS(p, reds);
     ASSERT(CONTEXT_REDS - ERTS_BIF_REDS_LEFT(p)
 	   >= erts_proc_sched_data(p)->virtual_reds);
@@ -833,7 +1063,8 @@ erts_garbage_collect_hibernate(Process* p)
 			    (char *) p->old_heap,
 			    (char *) p->old_htop - (char *) p->old_heap,
 			    p->arg_reg,
-			    p->arity);
+			    p->arity,
+			    NULL);
 
     ERTS_HEAP_FREE(ERTS_ALC_T_HEAP,
 		   (p->abandoned_heap
@@ -968,7 +1199,6 @@ erts_garbage_collect_literals(Process* p, Eterm* literals,
 			      struct erl_off_heap_header* oh)
 {
     Uint lit_size = byte_lit_size / sizeof(Eterm);
-    Uint old_heap_size;
     Eterm* temp_lit;
     Sint offs;
     Rootset rootset;            /* Rootset for GC (stack, dictionary, etc). */
@@ -987,17 +1217,27 @@ erts_garbage_collect_literals(Process* p, Eterm* literals,
     erts_smp_atomic32_read_bor_nob(&p->state, ERTS_PSFLG_GC);
 
     /*
-     * We assume that the caller has already done a major collection
-     * (which has discarded the old heap), so that we don't have to cope
-     * with pointer to literals on the old heap. We will now allocate
-     * an old heap to contain the literals.
+     * The referenced literals are copied to the old heap. There is no
+     * need for a major collection first; the young and the old heap
+     * are left as they are, only references to the literals are
+     * updated. The caller must however have collected away all heap
+     * fragments, since we do not look for literals in them.
+     *
+     * Make sure there is room for all literals at the top of the old
+     * heap, allocating or growing it as needed.
      */
-    
-    ASSERT(p->old_heap == 0);	/* Must NOT have an old heap yet. */
-    old_heap_size = erts_next_heap_size(lit_size, 0);
-    p->old_heap = p->old_htop = (Eterm*) ERTS_HEAP_ALLOC(ERTS_ALC_T_OLD_HEAP,
-							 sizeof(Eterm)*old_heap_size);
-    p->old_hend = p->old_heap + old_heap_size;
+
+    ASSERT(!MBUF(p) && !p->msg_frag && !p->abandoned_heap);
+    if (!p->old_heap) {
+	Uint old_heap_size = erts_next_heap_size(lit_size, 0);
+	p->old_heap = p->old_htop = (Eterm*) ERTS_HEAP_ALLOC(ERTS_ALC_T_OLD_HEAP,
+							     sizeof(Eterm)*old_heap_size);
+	p->old_hend = p->old_heap + old_heap_size;
+    } else if (p->old_hend - p->old_htop < lit_size) {
+	grow_old_heap(p,
+		      erts_next_heap_size(p->old_htop - p->old_heap + lit_size, 0),
+		      p->arg_reg, p->arity);
+    }
 
     /*
      * We soon want to garbage collect the literals. But since a GC is
@@ -1009,6 +1249,7 @@ erts_garbage_collect_literals(Process* p, Eterm* literals,
     offs = temp_lit - literals;
     offset_heap(temp_lit, lit_size, offs, (char *) literals, byte_lit_size);
     offset_heap(p->heap, p->htop - p->heap, offs, (char *) literals, byte_lit_size);
+    offset_heap(p->old_heap, p->old_htop - p->old_heap, offs, (char *) literals, byte_lit_size);
     offset_rootset(p, offs, (char *) literals, byte_lit_size, p->arg_reg, p->arity);
     if (oh) {
 	oh = (struct erl_off_heap_header *) ((Eterm *)(void *) oh + offs);
@@ -1076,7 +1317,8 @@ erts_garbage_collect_literals(Process* p, Eterm* literals,
 
     old_htop = sweep_literals_to_old_heap(p->heap, p->htop, old_htop, area, area_size);
     old_htop = sweep_literal_area(p->old_heap, old_htop,
-				  (char *) p->old_heap, sizeof(Eterm)*old_heap_size,
+				  (char *) p->old_heap,
+				  (char *) p->old_hend - (char *) p->old_heap,
 				  area, area_size);
     ASSERT(p->old_htop <= old_htop && old_htop <= p->old_hend);
     p->old_htop = old_htop;
@@ -1129,6 +1371,10 @@ erts_garbage_collect_literals(Process* p, Eterm* literals,
      */
     erts_free(ERTS_ALC_T_TMP, (void *) temp_lit);
 
+#ifdef DEBUG
+    p->last_old_htop = NULL;	/* The old heap may have moved */
+#endif
+
     /*
      * Restore status.
      */
@@ -1526,6 +1772,7 @@ major_collection(Process* p, ErlHeapFragment *live_hf_end,
     char* oh = (char *) OLD_HEAP(p);
     Uint oh_size = (char *) OLD_HTOP(p) - oh;
     Uint new_sz, stk_sz;
+    Uint pgc_slack = 0;
     int adjusted;
 
     VERBOSE(DEBUG_SHCOPY, ("[pid=%T] MAJOR GC: %p %p %p %p\n", p->common.id,
@@ -1570,6 +1817,17 @@ major_collection(Process* p, ErlHeapFragment *live_hf_end,
     }
 
     FLAGS(p) &= ~(F_HEAP_GROW|F_NEED_FULLSWEEP);
+
+#ifdef ERTS_PARALLEL_GC
+    /*
+     * A parallel sweep leaves some unused words in the new
+     * heap, so it needs to be somewhat larger...
+     */
+    pgc_slack = pgc_begin(size_before);
+    if (pgc_slack && new_sz < stack_size + size_before + pgc_slack)
+	new_sz = next_heap_size(p, stack_size + size_before + pgc_slack, 0);
+#endif
+
     n_htop = n_heap = (Eterm *) ERTS_HEAP_ALLOC(ERTS_ALC_T_HEAP,
 						sizeof(Eterm)*new_sz);
 
@@ -1582,7 +1840,15 @@ major_collection(Process* p, ErlHeapFragment *live_hf_end,
 					 objv, nobj);
     }
 
-    n_htop = full_sweep_heaps(p, 0, n_heap, n_htop, oh, oh_size, objv, nobj);
+    n_htop = full_sweep_heaps(p, 0, n_heap, n_htop, oh, oh_size, objv, nobj,
+			      (pgc_slack
+			       ? n_heap + new_sz - stack_size
+			       : NULL));
+
+#ifdef ERTS_PARALLEL_GC
+    if (pgc_slack)
+	pgc_end();
+#endif
 
     /* Move the stack to the end of the heap */
     stk_sz = HEAP_END(p) - p->stop;
@@ -1638,7 +1904,8 @@ full_sweep_heaps(Process *p,
 		 int hibernate,
 		 Eterm *n_heap, Eterm* n_htop,
 		 char *oh, Uint oh_size,
-		 Eterm *objv, int nobj)
+		 Eterm *objv, int nobj,
+		 Eterm *pgc_limit)
 {
     Rootset rootset;
     Roots *roots;
@@ -1715,7 +1982,12 @@ full_sweep_heaps(Process *p,
      * until all is copied.
      */
 
-    n_htop = sweep_heaps(n_heap, n_htop, oh, oh_size);
+#ifdef ERTS_PARALLEL_GC
+    if (pgc_limit)
+	n_htop = parallel_sweep_heaps(n_heap, n_htop, pgc_limit);
+    else
+#endif
+	n_htop = sweep_heaps(n_heap, n_htop, oh, oh_size);
 
     if (MSO(p).first) {
 	sweep_off_heap(p, 1);
@@ -2029,6 +2301,602 @@ sweep_literal_area(Eterm *n_hp, Eterm *n_htop,
 		 src, src_size);
 }
 
+#ifdef ERTS_PARALLEL_GC
+
+/*
+ * Parallel fullsweep
+ *
+ * When the data to collect in a fullsweep is larger than
+ * erts_parallel_gc_limit words, the sweep of the new heap is
+ * performed by the collecting scheduler together with a pool of
+ * helper threads. The rootset is still copied by the collecting
+ * scheduler alone; the parallel phase starts from the new heap
+ * built that far.
+ *
+ * Each thread allocates copies in private chunks of the new heap,
+ * and scans its current chunk Cheney style. The unscanned (grey)
+ * part of a chunk that is retired, as well as large objects, are
+ * handed out as ranges through per-thread work queues that idle
+ * threads steal from. Objects are claimed by compare and swap on
+ * the header (cons cells on the car) before being copied, so that
+ * each object is copied once even when reached by several threads.
+ * Unused parts of retired chunks are filled with dummy bignum
+ * headers so that the new heap still can be walked word by word.
+ */
+
+#define ERTS_PGC_CHUNK_SZ (4*1024)
+#define ERTS_PGC_DIRECT_SZ (ERTS_PGC_CHUNK_SZ/16)
+#define ERTS_PGC_WORKQ_INIT_SZ 64
+
+/* Claim markers; neither a valid header nor a valid car... */
+#define ERTS_PGC_BOXED_BUSY NIL
+#define ERTS_PGC_CONS_BUSY make_pos_bignum_header(0)
+
+typedef struct {
+    Eterm *start;
+    Eterm *end;
+} ErtsPGCRange;
+
+typedef struct {
+    erts_mtx_t mtx;
+    ErtsPGCRange *items;
+    Uint head;
+    Uint tail;
+    Uint size;
+} ErtsPGCWorkQ;
+
+typedef struct {
+    ErtsPGCWorkQ q;
+    Eterm *scan;	/* First unscanned word in current chunk */
+    Eterm *top;		/* Allocation pointer in current chunk */
+    Eterm *end;		/* End of current chunk */
+    int ix;
+} ErtsPGCThread;
+
+typedef union {
+    ErtsPGCThread data;
+    char align__[ERTS_ALC_CACHE_LINE_ALIGN_SIZE(sizeof(ErtsPGCThread))];
+} ErtsAlgnPGCThread;
+
+static struct {
+    erts_mtx_t mtx;
+    erts_cnd_t job_cnd;
+    erts_cnd_t done_cnd;
+    int no_threads;		/* Collecting scheduler + helpers */
+    int no_helpers;		/* Helpers created so far */
+    int no_done;		/* Helpers done with current job */
+    Uint generation;
+    erts_atomic32_t busy;	/* Parallel fullsweep in progress */
+    erts_atomic32_t active;	/* Threads currently having work */
+    erts_atomic_t htop;		/* Shared allocation pointer */
+    Eterm *hlimit;
+    ErtsAlgnPGCThread *threads;
+} pgc;
+
+static void *pgc_helper_main(void *arg);
+
+static void
+init_parallel_gc(void)
+{
+    int i;
+
+    pgc.no_threads = (int) erts_parallel_gc_threads;
+    if (pgc.no_threads <= 0)
+	pgc.no_threads = (erts_no_schedulers < H_DEFAULT_PARALLEL_GC_THREADS
+			  ? erts_no_schedulers
+			  : H_DEFAULT_PARALLEL_GC_THREADS);
+    if (!erts_parallel_gc_limit)
+	pgc.no_threads = 1;
+    pgc.no_helpers = 0;
+    pgc.no_done = 0;
+    pgc.generation = 0;
+    erts_atomic32_init_nob(&pgc.busy, 0);
+    erts_atomic32_init_nob(&pgc.active, 0);
+    erts_atomic_init_nob(&pgc.htop, (erts_aint_t) NULL);
+    pgc.hlimit = NULL;
+    pgc.threads = NULL;
+
+    if (pgc.no_threads < 2)
+	return;
+
+    erts_mtx_init(&pgc.mtx, "parallel_gc");
+    erts_cnd_init(&pgc.job_cnd);
+    erts_cnd_init(&pgc.done_cnd);
+
+    pgc.threads = erts_alloc_permanent_cache_aligned(
+	ERTS_ALC_T_PGC_DATA,
+	sizeof(ErtsAlgnPGCThread)*pgc.no_threads);
+    for (i = 0; i < pgc.no_threads; i++) {
+	ErtsPGCThread *ts = &pgc.threads[i].data;
+	erts_mtx_init_x(&ts->q.mtx, "parallel_gc_workq",
+			make_small(i), 1);
+	ts->q.items = erts_alloc(ERTS_ALC_T_PGC_WORK,
+				 sizeof(ErtsPGCRange)*ERTS_PGC_WORKQ_INIT_SZ);
+	ts->q.size = ERTS_PGC_WORKQ_INIT_SZ;
+	ts->q.head = ts->q.tail = 0;
+	ts->scan = ts->top = ts->end = NULL;
+	ts->ix = i;
+    }
+}
+
+/*
+ * Reserve the helper pool for a fullsweep of 'size' words. Helper
+ * threads are created on first use. Returns the number of words
+ * the new heap needs on top of the live data, or 0 if the
+ * collection should be done sequentially.
+ */
+static Uint
+pgc_begin(Uint size)
+{
+    if (pgc.no_threads < 2 || size <= erts_parallel_gc_limit)
+	return 0;
+    if (erts_atomic32_cmpxchg_acqb(&pgc.busy, 1, 0) != 0)
+	return 0; /* Someone else is using the helpers... */
+
+    if (pgc.no_helpers != pgc.no_threads - 1) {
+	erts_thr_opts_t thr_opts = ERTS_THR_OPTS_DEFAULT_INITER;
+	char thr_name[16];
+	thr_opts.detached = 1;
+	thr_opts.name = thr_name;
+	while (pgc.no_helpers < pgc.no_threads - 1) {
+	    erts_tid_t tid;
+	    int ix = ++pgc.no_helpers;
+	    erts_snprintf(thr_opts.name, 16, "gc_%d", ix);
+	    erts_thr_create(&tid, pgc_helper_main, (void *) (SWord) ix,
+			    &thr_opts);
+	}
+    }
+
+    /*
+     * Each retired chunk has less than ERTS_PGC_DIRECT_SZ unused
+     * words and each thread may leave one partially used chunk.
+     */
+    return (size / (ERTS_PGC_CHUNK_SZ/ERTS_PGC_DIRECT_SZ - 1)
+	    + (pgc.no_threads + 1) * ERTS_PGC_CHUNK_SZ);
+}
+
+static void
+pgc_end(void)
+{
+    erts_atomic32_set_relb(&pgc.busy, 0);
+}
+
+static ERTS_INLINE void
+pgc_fill(Eterm *hp, Uint sz)
+{
+    if (sz)
+	*hp = make_pos_bignum_header(sz - 1);
+}
+
+static ERTS_INLINE Uint
+pgc_unit_size(Eterm *hp)
+{
+    Eterm val = *hp;
+    if (is_header(val) && header_is_thing(val))
+	return thing_arityval(val) + 1;
+    return 1;
+}
+
+static void
+pgc_push(ErtsPGCThread *ts, Eterm *start, Eterm *end)
+{
+    ErtsPGCWorkQ *q = &ts->q;
+
+    erts_mtx_lock(&q->mtx);
+    if (q->head == q->tail)
+	q->head = q->tail = 0;
+    if (q->tail == q->size) {
+	Uint used = q->tail - q->head;
+	/*
+	 * Other threads steal from the queue, and the collecting
+	 * scheduler fills all queues with the initial work, so the
+	 * queue is compacted or grown under its lock. The lock is
+	 * ordered before the allocator locks.
+	 */
+	if (used <= q->size/2)
+	    sys_memmove(q->items, &q->items[q->head],
+			sizeof(ErtsPGCRange)*used);
+	else {
+	    ErtsPGCRange *items;
+	    items = erts_alloc(ERTS_ALC_T_PGC_WORK,
+			       sizeof(ErtsPGCRange)*q->size*2);
+	    sys_memcpy(items, &q->items[q->head], sizeof(ErtsPGCRange)*used);
+	    erts_free(ERTS_ALC_T_PGC_WORK, q->items);
+	    q->items = items;
+	    q->size *= 2;
+	}
+	q->head = 0;
+	q->tail = used;
+    }
+    q->items[q->tail].start = start;
+    q->items[q->tail].end = end;
+    q->tail++;
+    erts_mtx_unlock(&q->mtx);
+}
+
+/* Push a copied object, split in pieces at word boundaries if large */
+static void
+pgc_push_object(ErtsPGCThread *ts, Eterm *hp, Uint sz)
+{
+    Eterm *end = hp + sz;
+    Eterm *first = hp + pgc_unit_size(hp);
+
+    while (hp < end) {
+	Eterm *stop = hp + ERTS_PGC_CHUNK_SZ;
+	if (stop < first)
+	    stop = first;
+	if (stop > end)
+	    stop = end;
+	pgc_push(ts, hp, stop);
+	hp = stop;
+    }
+}
+
+/* Owner takes newest work, thieves take oldest work */
+static int
+pgc_pop(ErtsPGCThread *ts, ErtsPGCRange *rp)
+{
+    ErtsPGCWorkQ *q = &ts->q;
+    int res = 0;
+
+    erts_mtx_lock(&q->mtx);
+    if (q->head != q->tail) {
+	*rp = q->items[--q->tail];
+	res = 1;
+    }
+    erts_mtx_unlock(&q->mtx);
+    return res;
+}
+
+static int
+pgc_steal(ErtsPGCThread *ts, ErtsPGCRange *rp)
+{
+    int i;
+
+    for (i = 1; i < pgc.no_threads; i++) {
+	ErtsPGCWorkQ *q = &pgc.threads[(ts->ix + i) % pgc.no_threads].data.q;
+	if (q->head == q->tail)
+	    continue; /* Racy peek; checked again under lock */
+	erts_mtx_lock(&q->mtx);
+	if (q->head != q->tail) {
+	    *rp = q->items[q->head++];
+	    erts_mtx_unlock(&q->mtx);
+	    return 1;
+	}
+	erts_mtx_unlock(&q->mtx);
+    }
+    return 0;
+}
+
+static int
+pgc_work_available(void)
+{
+    int i;
+    for (i = 0; i < pgc.no_threads; i++) {
+	ErtsPGCWorkQ *q = &pgc.threads[i].data.q;
+	if (q->head != q->tail)
+	    return 1;
+    }
+    return 0;
+}
+
+/*
+ * Allocate at least 'need' and at most 'want' words from the
+ * shared part of the new heap.
+ */
+static Eterm *
+pgc_heap_alloc(Uint need, Uint *szp)
+{
+    erts_aint_t top = erts_atomic_read_nob(&pgc.htop);
+
+    while (1) {
+	erts_aint_t new_top, act;
+	Uint sz = *szp;
+	if ((Uint) (pgc.hlimit - (Eterm *) top) < sz)
+	    sz = pgc.hlimit - (Eterm *) top;
+	if (sz < need)
+	    erts_exit(ERTS_ABORT_EXIT,
+		      "%s, line %d: parallel gc overran new heap\n",
+		      __FILE__, __LINE__);
+	new_top = (erts_aint_t) (((Eterm *) top) + sz);
+	act = erts_atomic_cmpxchg_nob(&pgc.htop, new_top, top);
+	if (act == top) {
+	    *szp = sz;
+	    return (Eterm *) top;
+	}
+	top = act;
+    }
+}
+
+static void
+pgc_new_chunk(ErtsPGCThread *ts, Uint need)
+{
+    Uint sz = ERTS_PGC_CHUNK_SZ;
+
+    if (ts->scan < ts->top)
+	pgc_push(ts, ts->scan, ts->top);
+    pgc_fill(ts->top, ts->end - ts->top);
+    ts->top = ts->scan = pgc_heap_alloc(need, &sz);
+    ts->end = ts->top + sz;
+}
+
+static ERTS_INLINE Eterm *
+pgc_alloc(ErtsPGCThread *ts, Uint sz)
+{
+    Eterm *hp;
+    if (sz >= ERTS_PGC_DIRECT_SZ) {
+	Uint asz = sz;
+	return pgc_heap_alloc(sz, &asz);
+    }
+    if ((Uint) (ts->end - ts->top) < sz)
+	pgc_new_chunk(ts, sz);
+    hp = ts->top;
+    ts->top += sz;
+    return hp;
+}
+
+static ERTS_INLINE Eterm
+pgc_wait_claimed(erts_atomic_t *ap, Eterm busy)
+{
+    Eterm val;
+    int spins = 0;
+    while ((val = (Eterm) erts_atomic_read_acqb(ap)) == busy) {
+	if (++spins < 1000)
+	    ERTS_SPIN_BODY;
+	else {
+	    spins = 0;
+	    erts_thr_yield();
+	}
+    }
+    return val;
+}
+
+static Eterm
+pgc_move_boxed(ErtsPGCThread *ts, Eterm *ptr)
+{
+    erts_atomic_t *hdrp = (erts_atomic_t *) ptr;
+    Eterm hdr, gval;
+    Eterm *htop;
+    Sint nelts;
+    Uint sz;
+
+    hdr = (Eterm) erts_atomic_read_acqb(hdrp);
+    while (1) {
+	Eterm act;
+	if (hdr == ERTS_PGC_BOXED_BUSY)
+	    hdr = pgc_wait_claimed(hdrp, ERTS_PGC_BOXED_BUSY);
+	if (IS_MOVED_BOXED(hdr))
+	    return hdr;
+	act = (Eterm) erts_atomic_cmpxchg_acqb(hdrp,
+					       (erts_aint_t) ERTS_PGC_BOXED_BUSY,
+					       (erts_aint_t) hdr);
+	if (act == hdr)
+	    break;
+	hdr = act;
+    }
+
+    /* Claimed; same size calculation as MOVE_BOXED() */
+    nelts = header_arity(hdr);
+    switch (hdr & _HEADER_SUBTAG_MASK) {
+    case SUB_BINARY_SUBTAG: nelts++; break;
+    case MAP_SUBTAG:
+	if (is_flatmap_header(hdr)) nelts += flatmap_get_size(ptr) + 1;
+	else nelts += hashmap_bitcount(MAP_HEADER_VAL(hdr));
+	break;
+    case FUN_SUBTAG: nelts += ((ErlFunThing*)(ptr))->num_free+1; break;
+    }
+    sz = nelts + 1;
+
+    htop = pgc_alloc(ts, sz);
+    htop[0] = hdr;
+    sys_memcpy(htop+1, ptr+1, nelts*sizeof(Eterm));
+    gval = make_boxed(htop);
+    erts_atomic_set_relb(hdrp, (erts_aint_t) gval);
+
+    if (sz >= ERTS_PGC_DIRECT_SZ)
+	pgc_push_object(ts, htop, sz);
+
+    return gval;
+}
+
+static Eterm
+pgc_move_cons(ErtsPGCThread *ts, Eterm *ptr)
+{
+    erts_atomic_t *carp = (erts_atomic_t *) ptr;
+    Eterm car, gval;
+    Eterm *htop;
+
+    car = (Eterm) erts_atomic_read_acqb(carp);
+    while (1) {
+	Eterm act;
+	if (car == ERTS_PGC_CONS_BUSY)
+	    car = pgc_wait_claimed(carp, ERTS_PGC_CONS_BUSY);
+	if (IS_MOVED_CONS(car))
+	    return ptr[1];
+	act = (Eterm) erts_atomic_cmpxchg_acqb(carp,
+					       (erts_aint_t) ERTS_PGC_CONS_BUSY,
+					       (erts_aint_t) car);
+	if (act == car)
+	    break;
+	car = act;
+    }
+
+    htop = pgc_alloc(ts, 2);
+    htop[0] = car;
+    htop[1] = ptr[1];
+    gval = make_list(htop);
+    ptr[1] = gval;
+    erts_atomic_set_relb(carp, (erts_aint_t) THE_NON_VALUE);
+    return gval;
+}
+
+/*
+ * Scan one unit (a word, or a whole thing) of the new heap. The
+ * caller has already moved its scan pointer past the unit.
+ */
+static ERTS_INLINE void
+pgc_scan_unit(ErtsPGCThread *ts, Eterm *hp)
+{
+    Eterm gval = *hp;
+    Eterm *ptr;
+
+    switch (primary_tag(gval)) {
+    case TAG_PRIMARY_BOXED:
+	ptr = boxed_val(gval);
+	if (!erts_is_literal(gval, ptr))
+	    *hp = pgc_move_boxed(ts, ptr);
+	break;
+    case TAG_PRIMARY_LIST:
+	ptr = list_val(gval);
+	if (!erts_is_literal(gval, ptr))
+	    *hp = pgc_move_cons(ts, ptr);
+	break;
+    case TAG_PRIMARY_HEADER:
+	if (header_is_bin_matchstate(gval)) {
+	    ErlBinMatchState *ms = (ErlBinMatchState*) hp;
+	    ErlBinMatchBuffer *mb = &(ms->mb);
+	    ptr = boxed_val(mb->orig);
+	    if (!erts_is_literal(mb->orig, ptr)) {
+		mb->orig = pgc_move_boxed(ts, ptr);
+		mb->base = binary_bytes(mb->orig);
+	    }
+	}
+	break;
+    default:
+	break;
+    }
+}
+
+static void
+pgc_scan_range(ErtsPGCThread *ts, Eterm *hp, Eterm *end)
+{
+    while (hp < end) {
+	Eterm *unit = hp;
+	hp += pgc_unit_size(hp);
+	pgc_scan_unit(ts, unit);
+    }
+}
+
+static void
+pgc_scan_chunk(ErtsPGCThread *ts)
+{
+    /* Note that pgc_scan_unit() may retire the chunk... */
+    while (ts->scan < ts->top) {
+	Eterm *unit = ts->scan;
+	ts->scan += pgc_unit_size(unit);
+	pgc_scan_unit(ts, unit);
+    }
+}
+
+static void
+pgc_work(ErtsPGCThread *ts)
+{
+    ErtsPGCRange r;
+
+    while (1) {
+	pgc_scan_chunk(ts);
+	if (pgc_pop(ts, &r) || pgc_steal(ts, &r)) {
+	    pgc_scan_range(ts, r.start, r.end);
+	    continue;
+	}
+
+	/*
+	 * Out of work. While the collection runs, a queue is only
+	 * pushed to by the thread owning it (the initial work is
+	 * pushed before any thread is started), so a thread only
+	 * goes idle with an empty work queue, and only active
+	 * threads push work. When no thread is active all work has
+	 * been done.
+	 */
+	erts_atomic32_dec_mb(&pgc.active);
+	while (1) {
+	    if (pgc_work_available()) {
+		erts_atomic32_inc_mb(&pgc.active);
+		if (pgc_steal(ts, &r)) {
+		    pgc_scan_range(ts, r.start, r.end);
+		    break;
+		}
+		erts_atomic32_dec_mb(&pgc.active);
+	    }
+	    if (erts_atomic32_read_mb(&pgc.active) == 0)
+		goto done;
+	    erts_thr_yield();
+	}
+    }
+
+done:
+    ASSERT(ts->scan == ts->top);
+    pgc_fill(ts->top, ts->end - ts->top);
+    ts->scan = ts->top = ts->end = NULL;
+}
+
+static void *
+pgc_helper_main(void *arg)
+{
+    ErtsPGCThread *ts = &pgc.threads[(int) (SWord) arg].data;
+    Uint generation = 0;
+
+    erts_mtx_lock(&pgc.mtx);
+    while (1) {
+	while (pgc.generation == generation)
+	    erts_cnd_wait(&pgc.job_cnd, &pgc.mtx);
+	generation = pgc.generation;
+	erts_mtx_unlock(&pgc.mtx);
+
+	pgc_work(ts);
+
+	erts_mtx_lock(&pgc.mtx);
+	if (++pgc.no_done == pgc.no_threads - 1)
+	    erts_cnd_signal(&pgc.done_cnd);
+    }
+    return NULL;
+}
+
+/*
+ * Parallel counterpart of sweep_heaps(). [n_hp, n_htop) has been
+ * copied by the caller but not yet scanned; the result may be
+ * allocated up to 'limit'.
+ */
+static Eterm *
+parallel_sweep_heaps(Eterm *n_hp, Eterm *n_htop, Eterm *limit)
+{
+    Eterm *start;
+    int i = 0;
+
+    erts_atomic_set_nob(&pgc.htop, (erts_aint_t) n_htop);
+    pgc.hlimit = limit;
+
+    /* Spread the initial work over all threads */
+    start = n_hp;
+    while (n_hp < n_htop) {
+	n_hp += pgc_unit_size(n_hp);
+	if (n_hp - start >= ERTS_PGC_CHUNK_SZ || n_hp == n_htop) {
+	    pgc_push(&pgc.threads[i].data, start, n_hp);
+	    i = (i + 1) % pgc.no_threads;
+	    start = n_hp;
+	}
+    }
+
+    erts_atomic32_set_nob(&pgc.active, (erts_aint32_t) pgc.no_threads);
+
+    erts_mtx_lock(&pgc.mtx);
+    pgc.no_done = 0;
+    pgc.generation++;
+    erts_cnd_broadcast(&pgc.job_cnd);
+    erts_mtx_unlock(&pgc.mtx);
+
+    pgc_work(&pgc.threads[0].data);
+
+    erts_mtx_lock(&pgc.mtx);
+    while (pgc.no_done != pgc.no_threads - 1)
+	erts_cnd_wait(&pgc.done_cnd, &pgc.mtx);
+    erts_mtx_unlock(&pgc.mtx);
+
+    return (Eterm *) erts_atomic_read_nob(&pgc.htop);
+}
+
+#endif /* ERTS_PARALLEL_GC */
+
 static Eterm*
 sweep_literals_to_old_heap(Eterm* heap_ptr, Eterm* heap_end, Eterm* htop,
 			   char* src, Uint src_size)
@@ -2504,6 +3372,41 @@ grow_new_heap(Process *p, Uint new_sz, Eterm* objv, int nobj)
     HEAP_SIZE(p) = new_sz;
 }
 
+/*
+ * Grow the old heap in place, without a garbage collection. All
+ * pointers into the old heap are updated if it moves. There must be
+ * no heap fragments.
+ */
+static void
+grow_old_heap(Process *p, Uint new_sz, Eterm* objv, int nobj)
+{
+    Eterm* new_old_heap;
+    Uint old_heap_size = OLD_HTOP(p) - OLD_HEAP(p);
+    Sint offs;
+
+    ASSERT(!MBUF(p) && !p->msg_frag);
+    ASSERT(OLD_HEND(p) - OLD_HEAP(p) < new_sz);
+    new_old_heap = (Eterm *) ERTS_HEAP_REALLOC(ERTS_ALC_T_OLD_HEAP,
+					       (void *) OLD_HEAP(p),
+					       (sizeof(Eterm)
+						* (OLD_HEND(p) - OLD_HEAP(p))),
+					       sizeof(Eterm)*new_sz);
+
+    if ((offs = new_old_heap - OLD_HEAP(p)) != 0) {
+	char* area = (char *) OLD_HEAP(p);
+	Uint area_size = (char *) OLD_HTOP(p) - area;
+
+	offset_heap(new_old_heap, old_heap_size, offs, area, area_size);
+	offset_heap(HEAP_START(p), HEAP_TOP(p) - HEAP_START(p),
+		    offs, area, area_size);
+	offset_rootset(p, offs, area, area_size, objv, nobj);
+    }
+
+    OLD_HEAP(p) = new_old_heap;
+    OLD_HTOP(p) = new_old_heap + old_heap_size;
+    OLD_HEND(p) = new_old_heap + new_sz;
+}
+
 static void
 shrink_new_heap(Process *p, Uint new_sz, Eterm *objv, int nobj)
 {
@@ -3006,6 +3909,13 @@ reply_gc_info(void *vgcirp)
 
     reclaimed = esdp->gc_info.reclaimed;
     garbage_cols = esdp->gc_info.garbage_cols;
+#ifdef ERTS_DIRTY_SCHEDULERS
+    if (esdp->no == 1) {
+	/* Scheduler 1 also reports collections made on dirty schedulers */
+	reclaimed += (Uint64) erts_atomic64_read_nob(&dirty_gc_reclaimed);
+	garbage_cols += (Uint64) erts_atomic64_read_nob(&dirty_garbage_cols);
+    }
+#endif
 
     sz = 0;
     hpp = NULL;
@@ -3153,6 +4063,95 @@ erts_process_gc_info(Process *p, Uint *sizep, Eterm **hpp,
     return res;
 }
 
+Eterm
+erts_process_gc_stats(Process *p, Uint *sizep, Eterm **hpp)
+{
+    ErtsProcGCStats *stats = &p->gc_stats;
+    Eterm tags[] = {
+        am_minor_gcs,
+        am_major_gcs,
+        am_minor_gc_time,
+        am_major_gc_time,
+        am_words_copied,
+        am_words_promoted,
+        am_heap_grows
+    };
+    UWord values[] = {
+        stats->minor_gcs,
+        stats->major_gcs,
+        (UWord) ERTS_MONOTONIC_TO_USEC(stats->minor_gc_time),
+        (UWord) ERTS_MONOTONIC_TO_USEC(stats->major_gc_time),
+        stats->words_copied,
+        stats->words_promoted,
+        stats->heap_grows
+    };
+
+    ERTS_CT_ASSERT(sizeof(values)/sizeof(*values) == sizeof(tags)/sizeof(*tags));
+    ERTS_CT_ASSERT(sizeof(values)/sizeof(*values) == ERTS_PROCESS_GC_STATS_TERMS);
+
+    return erts_bld_atom_uword_2tup_list(hpp,
+                                         sizep,
+                                         sizeof(values)/sizeof(*values),
+                                         tags,
+                                         values);
+}
+
+/*
+ * Return the pause time histogram summed over all schedulers as a
+ * list of {Limit, Count}, where Limit is the exclusive upper limit
+ * of the bucket in microseconds, or infinity for the last bucket.
+ */
+Eterm
+erts_gc_pause_histogram(Process *c_p)
+{
+    Uint counts[ERTS_GC_PAUSE_HIST_SIZE];
+    Eterm res, *hp;
+#ifdef DEBUG
+    Eterm *hp_end;
+#endif
+    Uint sz;
+    int i, ix;
+
+    for (i = 0; i < ERTS_GC_PAUSE_HIST_SIZE; i++) {
+#ifdef ERTS_DIRTY_SCHEDULERS
+	counts[i] = (Uint) erts_atomic_read_nob(&dirty_gc_pause_hist[i]);
+#else
+	counts[i] = 0;
+#endif
+	for (ix = 0; ix < erts_no_schedulers; ix++) {
+	    ErtsSchedulerData *esdp = ERTS_SCHEDULER_IX(ix);
+	    counts[i] += (Uint) erts_smp_atomic_read_nob(&esdp->gc_pause_hist[i]);
+	}
+    }
+
+    sz = 0;
+    for (i = 0; i < ERTS_GC_PAUSE_HIST_SIZE; i++) {
+	sz += 2 + 3;
+	erts_bld_uint(NULL, &sz, counts[i]);
+	if (i < ERTS_GC_PAUSE_HIST_SIZE - 1)
+	    erts_bld_uint(NULL, &sz, ((Uint) 1) << i);
+    }
+
+    hp = HAlloc(c_p, sz);
+#ifdef DEBUG
+    hp_end = hp + sz;
+#endif
+    res = NIL;
+    for (i = ERTS_GC_PAUSE_HIST_SIZE - 1; i >= 0; i--) {
+	Eterm limit = (i < ERTS_GC_PAUSE_HIST_SIZE - 1
+		       ? erts_bld_uint(&hp, NULL, ((Uint) 1) << i)
+		       : am_infinity);
+	Eterm count = erts_bld_uint(&hp, NULL, counts[i]);
+	Eterm tpl = TUPLE2(hp, limit, count);
+	hp += 3;
+	res = CONS(hp, tpl, res);
+	hp += 2;
+    }
+    ASSERT(hp == hp_end);
+
+    return res;
+}
+
 static int
 reached_max_heap_size(Process *p, Uint total_heap_size,
                       Uint extra_heap_size, Uint extra_old_heap_size)
@@ -3202,7 +4201,7 @@ reached_max_heap_size(Process *p, Uint total_heap_size,
         }
 
         if (IS_TRACED_FL(p, F_TRACE_GC))
-            trace_gc(p, am_gc_max_heap_size, 0, msg);
+            trace_gc(p, am_gc_max_heap_size, 0, msg, 0);
 
         erts_free(ERTS_ALC_T_TMP, o_hp);
     }
@@ -3277,6 +4276,245 @@ erts_max_heap_size(Eterm arg, Uint *max_heap_size, Uint *max_heap_flags)
     return 1;
 }
 
+/*
+ * Heap size prediction.
+ *
+ * Processes spawned with the adaptive_heap_size option record the
+ * amount of heap they use when they exit, keyed on the MFA they were
+ * spawned with (or the fun, when spawned via erlang:apply/2). New
+ * processes spawned from the same MFA start out with a heap of the
+ * predicted size instead of growing towards it through a number of
+ * garbage collections.
+ *
+ * The prediction is an exponential moving average of the heap sizes
+ * seen. Updates are not atomic with respect to each other; a lost
+ * sample now and then does not matter.
+ *
+ * The table holds at most ERTS_HEAP_PRED_MAX_ENTRIES entries. When it
+ * is full, spawning from an unknown spawn site triggers a sweep (at
+ * most once per ERTS_HEAP_PRED_SWEEP_MISSES such spawns) that erases
+ * the entries that no live process is attached to and that have not
+ * been used since the previous sweep. This way entries of purged
+ * modules and spawn sites no longer in use age out, and new spawn
+ * sites are learned again. Lookups and the sweep are serialized by
+ * heap_pred_rwmtx; lookups only take it for reading.
+ */
+
+#define ERTS_HEAP_PRED_TAB_SIZE 256
+#define ERTS_HEAP_PRED_MAX_ENTRIES (16*1024)
+#define ERTS_HEAP_PRED_SWEEP_MISSES (ERTS_HEAP_PRED_MAX_ENTRIES/16)
+
+struct erts_heap_pred {
+    SafeHashBucket bucket;	/* MUST BE LOCATED AT TOP OF STRUCT!!! */
+    Eterm module;
+    Eterm function;		/* Function name, or fun index */
+    Uint arity;			/* Arity, or fun uniq */
+    erts_smp_atomic_t size;	/* Predicted heap size (words) */
+    erts_refc_t refc;		/* Live processes attached */
+    erts_smp_atomic32_t gen;	/* Sweep generation of last use */
+};
+
+static SafeHash heap_pred_tab;
+static erts_smp_rwmtx_t heap_pred_rwmtx;
+static erts_smp_atomic32_t heap_pred_gen;
+static erts_smp_atomic32_t heap_pred_misses;
+
+static SafeHashValue
+heap_pred_hash(void *vhp)
+{
+    struct erts_heap_pred *hp = (struct erts_heap_pred *) vhp;
+    return (SafeHashValue) ((hp->module * 31 + hp->function) * 31
+			    + hp->arity);
+}
+
+static int
+heap_pred_cmp(void *vhp1, void *vhp2)
+{
+    struct erts_heap_pred *hp1 = (struct erts_heap_pred *) vhp1;
+    struct erts_heap_pred *hp2 = (struct erts_heap_pred *) vhp2;
+    return !(hp1->module == hp2->module
+	     && hp1->function == hp2->function
+	     && hp1->arity == hp2->arity);
+}
+
+static void *
+heap_pred_alloc(void *vtmpl)
+{
+    struct erts_heap_pred *tmpl = (struct erts_heap_pred *) vtmpl;
+    struct erts_heap_pred *hp = erts_alloc(ERTS_ALC_T_HEAP_PRED,
+					   sizeof(struct erts_heap_pred));
+    hp->module = tmpl->module;
+    hp->function = tmpl->function;
+    hp->arity = tmpl->arity;
+    erts_smp_atomic_init_nob(&hp->size, 0);
+    erts_refc_init(&hp->refc, 0);
+    erts_smp_atomic32_init_nob(&hp->gen,
+			       erts_smp_atomic32_read_nob(&heap_pred_gen));
+    return (void *) hp;
+}
+
+static void
+heap_pred_free(void *vhp)
+{
+    erts_free(ERTS_ALC_T_HEAP_PRED, vhp);
+}
+
+static void
+init_heap_prediction(void)
+{
+    SafeHashFunctions hf;
+    erts_smp_rwmtx_opt_t rwmtx_opt = ERTS_SMP_RWMTX_OPT_DEFAULT_INITER;
+    rwmtx_opt.type = ERTS_SMP_RWMTX_TYPE_FREQUENT_READ;
+    rwmtx_opt.lived = ERTS_SMP_RWMTX_LONG_LIVED;
+    erts_smp_rwmtx_init_opt(&heap_pred_rwmtx, &rwmtx_opt, "heap_pred");
+    erts_smp_atomic32_init_nob(&heap_pred_gen, 0);
+    erts_smp_atomic32_init_nob(&heap_pred_misses, 0);
+
+    hf.hash = heap_pred_hash;
+    hf.cmp = heap_pred_cmp;
+    hf.alloc = heap_pred_alloc;
+    hf.free = heap_pred_free;
+    safe_hash_init(ERTS_ALC_T_HEAP_PRED, &heap_pred_tab, "heap_pred_tab",
+		   ERTS_HEAP_PRED_TAB_SIZE, hf);
+}
+
+typedef struct {
+    erts_aint32_t gen;
+    Uint n;
+    struct erts_heap_pred **vec;
+} ErtsHeapPredSweep;
+
+static void
+heap_pred_collect_stale(void *vhp, void *vsweep)
+{
+    struct erts_heap_pred *hp = (struct erts_heap_pred *) vhp;
+    ErtsHeapPredSweep *sweep = (ErtsHeapPredSweep *) vsweep;
+    if (erts_refc_read(&hp->refc, 0) == 0
+	&& erts_smp_atomic32_read_nob(&hp->gen) != sweep->gen)
+	sweep->vec[sweep->n++] = hp;
+}
+
+/*
+ * Erase unattached entries not used since the previous sweep, and
+ * start a new generation. Called with heap_pred_rwmtx write locked,
+ * so nothing is inserted into or looked up in the table meanwhile.
+ */
+static void
+heap_pred_sweep(void)
+{
+    ErtsHeapPredSweep sweep;
+    Uint i;
+
+    sweep.gen = erts_smp_atomic32_read_nob(&heap_pred_gen);
+    sweep.n = 0;
+    sweep.vec = erts_alloc(ERTS_ALC_T_TMP,
+			   (sizeof(struct erts_heap_pred *)
+			    * erts_smp_atomic_read_nob(&heap_pred_tab.nitems)));
+    safe_hash_for_each(&heap_pred_tab, heap_pred_collect_stale, &sweep);
+    for (i = 0; i < sweep.n; i++)
+	safe_hash_erase(&heap_pred_tab, sweep.vec[i]);
+    erts_free(ERTS_ALC_T_TMP, sweep.vec);
+
+    erts_smp_atomic32_set_nob(&heap_pred_gen, sweep.gen + 1);
+    erts_smp_atomic32_set_nob(&heap_pred_misses, 0);
+}
+
+/*
+ * Look up the prediction for a process about to be spawned and
+ * attach it to the process. Returns the predicted heap size, or
+ * zero if nothing has been learned yet.
+ */
+Uint
+erts_heap_prediction(Process *p, Eterm mod, Eterm func, Eterm args)
+{
+    struct erts_heap_pred tmpl, *hp;
+    erts_aint32_t gen;
+
+    tmpl.module = mod;
+    tmpl.function = func;
+    tmpl.arity = (Uint) p->u.initial[INITIAL_ARI];
+
+    if (mod == am_erlang && func == am_apply && is_list(args)) {
+	Eterm fun = CAR(list_val(args));
+	if (is_fun(fun)) {
+	    ErlFunEntry *fe = ((ErlFunThing *) fun_val(fun))->fe;
+	    tmpl.module = fe->module;
+	    tmpl.function = make_small(fe->index);
+	    tmpl.arity = (Uint) fe->old_uniq;
+	} else if (is_export(fun)) {
+	    Export *ep = *((Export **) (export_val(fun) + 1));
+	    tmpl.module = ep->code[0];
+	    tmpl.function = ep->code[1];
+	    tmpl.arity = ep->code[2];
+	}
+    }
+
+    erts_smp_rwmtx_rlock(&heap_pred_rwmtx);
+    hp = (struct erts_heap_pred *) safe_hash_get(&heap_pred_tab, &tmpl);
+    if (!hp) {
+	if (erts_smp_atomic_read_nob(&heap_pred_tab.nitems)
+	    >= ERTS_HEAP_PRED_MAX_ENTRIES) {
+	    int sweep = (erts_smp_atomic32_inc_read_nob(&heap_pred_misses)
+			 == ERTS_HEAP_PRED_SWEEP_MISSES);
+	    erts_smp_rwmtx_runlock(&heap_pred_rwmtx);
+	    if (!sweep)
+		return 0;
+	    erts_smp_rwmtx_rwlock(&heap_pred_rwmtx);
+	    heap_pred_sweep();
+	    erts_smp_rwmtx_rwunlock(&heap_pred_rwmtx);
+	    erts_smp_rwmtx_rlock(&heap_pred_rwmtx);
+	    if (erts_smp_atomic_read_nob(&heap_pred_tab.nitems)
+		>= ERTS_HEAP_PRED_MAX_ENTRIES) {
+		erts_smp_rwmtx_runlock(&heap_pred_rwmtx);
+		return 0;
+	    }
+	}
+	hp = (struct erts_heap_pred *) safe_hash_put(&heap_pred_tab, &tmpl);
+    }
+    erts_refc_inc(&hp->refc, 1);
+    gen = erts_smp_atomic32_read_nob(&heap_pred_gen);
+    if (erts_smp_atomic32_read_nob(&hp->gen) != gen)
+	erts_smp_atomic32_set_nob(&hp->gen, gen);
+    erts_smp_rwmtx_runlock(&heap_pred_rwmtx);
+
+    p->heap_pred = hp;
+    return (Uint) erts_smp_atomic_read_nob(&hp->size);
+}
+
+/*
+ * Feed the amount of heap used by an exiting process into the
+ * prediction of its spawn site. The amount used, rather than the
+ * heap size, is sampled so that a prediction that turned out too
+ * large decays again. The entry cannot be erased while the process
+ * is attached to it.
+ */
+void
+erts_update_heap_prediction(Process *p)
+{
+    struct erts_heap_pred *hp = p->heap_pred;
+    Uint sample, pred;
+
+    ASSERT(hp);
+    p->heap_pred = NULL;
+
+    if (!p->abandoned_heap) { /* Not exiting in the middle of a delayed gc */
+	sample = ((HEAP_TOP(p) - HEAP_START(p))
+		  + (STACK_START(p) - STACK_TOP(p)));
+	if (OLD_HEAP(p))
+	    sample += OLD_HTOP(p) - OLD_HEAP(p);
+	sample += p->mbuf_sz;
+
+	pred = (Uint) erts_smp_atomic_read_nob(&hp->size);
+	if (pred)
+	    pred = pred - pred/4 + sample/4;
+	else
+	    pred = sample;
+	erts_smp_atomic_set_nob(&hp->size, (erts_aint_t) pred);
+    }
+
+    erts_refc_dec(&hp->refc, 0);
+}
+
 #if defined(DEBUG) || defined(ERTS_OFFHEAP_DEBUG)
 
 static int
@@ -126,20 +126,51 @@ ERTS_GLB_INLINE Eterm follow_moved(Eterm term, Eterm xptr_tag)
     ERTS_FORCE_GC_INTERNAL((Proc), (Proc)->fcalls)
 
 extern Uint erts_test_long_gc_sleep;
+extern Uint erts_dirty_gc_limit;
+extern Uint erts_parallel_gc_limit;
+extern Uint erts_parallel_gc_threads;
 
 typedef struct {
   Uint64 reclaimed;
   Uint64 garbage_cols;
 } ErtsGCInfo;
 
+/*
+ * Cumulative garbage collection statistics of a process.
+ * Times are in monotonic time units.
+ */
+typedef struct {
+    Uint minor_gcs;
+    Uint major_gcs;
+    Sint64 minor_gc_time;
+    Sint64 major_gc_time;
+    Uint words_copied;		/* Live words copied */
+    Uint words_promoted;	/* Live words copied to the old heap */
+    Uint heap_grows;		/* Collections growing the young heap */
+} ErtsProcGCStats;
+
+/*
+ * Log2 histogram of garbage collection pause times. Bucket N holds
+ * pauses shorter than 2^N microseconds (but not shorter than 2^(N-1));
+ * the last bucket holds all longer pauses.
+ */
+#define ERTS_GC_PAUSE_HIST_SIZE 24
+
 #define ERTS_PROCESS_GC_INFO_MAX_TERMS (11)  /* number of elements in process_gc_info*/
 #define ERTS_PROCESS_GC_INFO_MAX_SIZE                                   \
     (ERTS_PROCESS_GC_INFO_MAX_TERMS * (2/*cons*/ + 3/*2-tuple*/ + BIG_UINT_HEAP_SIZE))
 Eterm erts_process_gc_info(struct process*, Uint *, Eterm **, Uint, Uint);
+#define ERTS_PROCESS_GC_STATS_TERMS 7
+Eterm erts_process_gc_stats(struct process*, Uint *, Eterm **);
+Eterm erts_gc_pause_histogram(struct process*);
 
 void erts_gc_info(ErtsGCInfo *gcip);
 void erts_init_gc(void);
 int erts_garbage_collect_nobump(struct process*, int, Eterm*, int, int);
+int erts_garbage_collect_direct(struct process*, int, Eterm*, int, int);
+#ifdef ERTS_DIRTY_SCHEDULERS
+int erts_execute_dirty_gc(struct process*, int);
+#endif
 void erts_garbage_collect(struct process*, int, Eterm*, int);
 void erts_garbage_collect_hibernate(struct process* p);
 Eterm erts_gc_after_bif_call_lhf(struct process* p, ErlHeapFragment *live_hf_end,
@@ -157,5 +188,7 @@ void erts_offset_heap(Eterm*, Uint, Sint, Eterm*, Eterm*);
 void erts_free_heap_frags(struct process* p);
 Eterm erts_max_heap_size_map(Sint, Uint, Eterm **, Uint *);
 int erts_max_heap_size(Eterm, Uint *, Uint *);
+Uint erts_heap_prediction(struct process*, Eterm, Eterm, Eterm);
+void erts_update_heap_prediction(struct process*);
 
 #endif /* __ERL_GC_H__ */
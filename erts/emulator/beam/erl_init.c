@@ -583,6 +583,19 @@ void erts_usage(void)
     erts_fprintf(stderr, "-hmaxel bool   enable or disable error_logger report at max heap size (default true)\n");
     erts_fprintf(stderr, "-hpds size     initial process dictionary size (default %d)\n",
 	       erts_pd_initial_size);
+    erts_fprintf(stderr, "-hdgc size     heap size in words from which garbage collections\n");
+    erts_fprintf(stderr, "               are done on dirty schedulers, 0 disables (default %d)\n",
+	       H_DEFAULT_DIRTY_GC_LIMIT);
+    erts_fprintf(stderr, "-hpgc size     heap size in words from which fullsweep garbage\n");
+    erts_fprintf(stderr, "               collections are parallel, 0 disables (default %d)\n",
+	       H_DEFAULT_PARALLEL_GC_LIMIT);
+    erts_fprintf(stderr, "-hpgct number  number of threads in a parallel garbage collection\n");
+    erts_fprintf(stderr, "               (default: schedulers, at most %d)\n",
+	       H_DEFAULT_PARALLEL_GC_THREADS);
+    erts_fprintf(stderr, "-hsbc ratio    copy binaries in sent messages that refer to at most\n");
+    erts_fprintf(stderr, "               1/ratio of their binary, 0 disables (default 0)\n");
+    erts_fprintf(stderr, "-hahs bool     enable or disable adaptive heap sizing of spawned\n");
+    erts_fprintf(stderr, "               processes by default (default false)\n");
     erts_fprintf(stderr, "-hmqd  val     set default message queue data flag for processes,\n");
     erts_fprintf(stderr, "               valid values are: off_heap | on_heap\n");
 
@@ -766,6 +779,9 @@ early_init(int *argc, char **argv) /*
     BIN_VH_MIN_SIZE = VH_DEFAULT_SIZE;
     H_MAX_SIZE = H_DEFAULT_MAX_SIZE;
     H_MAX_FLAGS = MAX_HEAP_SIZE_KILL|MAX_HEAP_SIZE_LOG;
+    erts_dirty_gc_limit = H_DEFAULT_DIRTY_GC_LIMIT;
+    erts_parallel_gc_limit = H_DEFAULT_PARALLEL_GC_LIMIT;
+    erts_parallel_gc_threads = 0;
 
     erts_initialized = 0;
 
@@ -1495,6 +1511,11 @@ erl_start(int argc, char **argv)
 	     * h|mbs   - min_bin_vheap_size
 	     * h|pds   - erts_pd_initial_size
 	     * h|mqd   - message_queue_data
+	     * h|ahs   - adaptive_heap_size
+	     * h|dgc   - erts_dirty_gc_limit
+	     * h|pgc   - erts_parallel_gc_limit
+	     * h|pgct  - erts_parallel_gc_threads
+	     * h|sbc   - erts_bin_compact_ratio
              * h|max   - max_heap_size
              * h|maxk  - max_heap_kill
              * h|maxel - max_heap_error_logger
@@ -1523,6 +1544,53 @@ erl_start(int argc, char **argv)
 		}
 		VERBOSE(DEBUG_SYSTEM, ("using initial process dictionary size %d\n",
 			    erts_pd_initial_size));
+            } else if (has_prefix("dgc", sub_param)) {
+		arg = get_arg(sub_param+3, argv[i+1], &i);
+		if (atoi(arg) < 0) {
+		    erts_fprintf(stderr, "bad dirty gc heap size %s\n", arg);
+		    erts_usage();
+		}
+		erts_dirty_gc_limit = (Uint) atoi(arg);
+		VERBOSE(DEBUG_SYSTEM, ("using dirty gc heap size %beu\n",
+				       erts_dirty_gc_limit));
+            } else if (has_prefix("pgct", sub_param)) {
+		arg = get_arg(sub_param+4, argv[i+1], &i);
+		if (atoi(arg) < 1 || atoi(arg) > H_MAX_PARALLEL_GC_THREADS) {
+		    erts_fprintf(stderr, "bad number of parallel gc threads %s\n",
+				 arg);
+		    erts_usage();
+		}
+		erts_parallel_gc_threads = (Uint) atoi(arg);
+		VERBOSE(DEBUG_SYSTEM, ("using %beu parallel gc threads\n",
+				       erts_parallel_gc_threads));
+            } else if (has_prefix("pgc", sub_param)) {
+		arg = get_arg(sub_param+3, argv[i+1], &i);
+		if (atoi(arg) < 0) {
+		    erts_fprintf(stderr, "bad parallel gc heap size %s\n", arg);
+		    erts_usage();
+		}
+		erts_parallel_gc_limit = (Uint) atoi(arg);
+		VERBOSE(DEBUG_SYSTEM, ("using parallel gc heap size %beu\n",
+				       erts_parallel_gc_limit));
+            } else if (has_prefix("sbc", sub_param)) {
+		arg = get_arg(sub_param+3, argv[i+1], &i);
+		if (atoi(arg) < 0 || atoi(arg) == 1) {
+		    erts_fprintf(stderr, "bad binary compaction ratio %s\n", arg);
+		    erts_usage();
+		}
+		erts_bin_compact_ratio = (Uint) atoi(arg);
+		VERBOSE(DEBUG_SYSTEM, ("using binary compaction ratio %beu\n",
+				       erts_bin_compact_ratio));
+            } else if (has_prefix("ahs", sub_param)) {
+		arg = get_arg(sub_param+3, argv[i+1], &i);
+		if (sys_strcmp(arg, "true") == 0)
+		    erts_default_spo_flags |= SPO_ADAPTIVE_HEAP;
+		else if (sys_strcmp(arg, "false") == 0)
+		    erts_default_spo_flags &= ~SPO_ADAPTIVE_HEAP;
+		else {
+		    erts_fprintf(stderr, "bad adaptive heap size flag %s\n", arg);
+		    erts_usage();
+		}
             } else if (has_prefix("mqd", sub_param)) {
 		arg = get_arg(sub_param+3, argv[i+1], &i);
 		if (sys_strcmp(arg, "on_heap") == 0) {
@@ -26,6 +26,7 @@
 #include "big.h"
 #include "erl_instrument.h"
 #include "erl_threads.h"
+#include "erl_db.h"
 
 typedef union { long l; double d; } Align_t;
 
@@ -44,6 +45,7 @@ struct MapStatBlock_t_ {
     Uint size;
     ErtsAlcType_t type_no;
     Eterm pid;
+    Uint shard;
     MapStatBlock_t *prev;
     MapStatBlock_t *next;
     Align_t mem[1];
@@ -51,6 +53,20 @@ struct MapStatBlock_t_ {
 
 #define MAP_STAT_BLOCK_HEADER_SIZE (sizeof(MapStatBlock_t) - sizeof(Align_t))
 
+typedef struct BinAttrBlock_t_ BinAttrBlock_t;
+struct BinAttrBlock_t_ {
+    BinAttrBlock_t *prev;
+    BinAttrBlock_t *next;
+    Uint shard;
+    Uint size;
+    Eterm pid;
+    Eterm module;
+    Eterm function;
+    Uint arity;
+};
+
+#define BIN_ATTR_BLOCK_HEADER_SIZE sizeof(BinAttrBlock_t)
+
 typedef struct {
     Uint size;
     Uint max_size;
@@ -61,11 +77,73 @@ typedef struct {
     Uint max_blocks_ever;
 } Stat_t;
 
+/*
+ * Allocations are accounted in one shard per scheduler, and a shared
+ * shard (index 0) for all other threads. The counters of a shard are
+ * only updated by the threads using it, so they do not bounce between
+ * caches; since a block may be freed by another thread than the one
+ * that allocated it, the counters of a single shard may go negative.
+ * The current values are the sums over all shards, and the maximum
+ * values are updated from these sums when the statistics are read.
+ *
+ * In memory map mode each shard also keeps a list of the blocks
+ * allocated by its threads, protected by the mutex of the shard. A
+ * block stays in the list of the shard that allocated it.
+ *
+ * When sampling is enabled, a sample of the allocation type, size,
+ * and current process and function is recorded each time the number
+ * of bytes allocated by the threads of a shard passes a multiple of
+ * the sample interval. The last ERTS_INSTR_SAMPLES samples of each
+ * shard are kept. Samples of a scheduler shard are only written by its
+ * scheduler; the shared shard may be written by several threads at
+ * once, so its writers are serialized by instr_sample_lock.
+ *
+ * When attribution is enabled, each refc binary is preceded by a
+ * header identifying the process and function that created it, and
+ * is linked into a list of the shard that created it. The lists are
+ * protected by the shard mutexes, which are never held while calling
+ * the allocator, so this can be combined with memory map mode.
+ */
+
+#define ERTS_INSTR_SAMPLES 1024
+
+typedef struct {
+    erts_atomic_t size;
+    erts_atomic_t blocks;
+} StatCounters_t;
+
+typedef struct {
+    erts_atomic_t seq;
+    ErtsAlcType_t type_no;
+    Uint size;
+    Eterm pid;
+    Eterm module;
+    Eterm function;
+    Uint arity;
+} Sample_t;
+
+typedef struct {
+    erts_mtx_t mtx;
+    MapStatBlock_t *mem_anchor;
+    BinAttrBlock_t *bin_anchor;
+    StatCounters_t *n;
+    erts_atomic_t sample_countdown;
+    erts_atomic_t sample_ix;
+    Sample_t *samples;
+} InstrShard_t;
+
+typedef union {
+    InstrShard_t shard;
+    char align__[ERTS_ALC_CACHE_LINE_ALIGN_SIZE(sizeof(InstrShard_t))];
+} InstrShardAligned_t;
+
 static erts_mtx_t instr_mutex;
-static erts_mtx_t instr_x_mutex;
+static erts_spinlock_t instr_sample_lock;
 
 int erts_instr_memory_map;
 int erts_instr_stat;
+Uint erts_instr_sample_interval;
+int erts_instr_attribution;
 
 static ErtsAllocatorFunctions_t real_allctrs[ERTS_ALC_A_MAX+1];
 
@@ -79,7 +157,8 @@ struct stats_ {
 
 static struct stats_ *stats;
 
-static MapStatBlock_t *mem_anchor;
+static InstrShardAligned_t *shards;
+static int no_shards;
 
 static Eterm *am_tot;
 static Eterm *am_n;
@@ -184,105 +263,141 @@ init_am_a(void)
 
 }
 
-static ERTS_INLINE void
-stat_upd_alloc(ErtsAlcType_t n, Uint size)
+static ERTS_INLINE Uint
+get_shard_ix(void)
 {
-    ErtsAlcType_t t = ERTS_ALC_N2T(n);
-    ErtsAlcType_t a = ERTS_ALC_T2A(t);
-    ErtsAlcType_t c = ERTS_ALC_T2C(t);
-
-    stats->ap[a]->size += size;
-    if (stats->ap[a]->max_size < stats->ap[a]->size)
-	stats->ap[a]->max_size = stats->ap[a]->size;
-
-    stats->c[c].size += size;
-    if (stats->c[c].max_size < stats->c[c].size)
-	stats->c[c].max_size = stats->c[c].size;
-
-    stats->n[n].size += size;
-    if (stats->n[n].max_size < stats->n[n].size)
-	stats->n[n].max_size = stats->n[n].size;
-
-    stats->tot.size += size;
-    if (stats->tot.max_size < stats->tot.size)
-	stats->tot.max_size = stats->tot.size;
-
-    stats->ap[a]->blocks++;
-    if (stats->ap[a]->max_blocks < stats->ap[a]->blocks)
-	stats->ap[a]->max_blocks = stats->ap[a]->blocks;
-
-    stats->c[c].blocks++;
-    if (stats->c[c].max_blocks < stats->c[c].blocks)
-	stats->c[c].max_blocks = stats->c[c].blocks;
-
-    stats->n[n].blocks++;
-    if (stats->n[n].max_blocks < stats->n[n].blocks)
-	stats->n[n].max_blocks = stats->n[n].blocks;
-
-    stats->tot.blocks++;
-    if (stats->tot.max_blocks < stats->tot.blocks)
-	stats->tot.max_blocks = stats->tot.blocks;
-
+    ErtsSchedulerData *esdp = erts_get_scheduler_data();
+    if (esdp && !ERTS_SCHEDULER_IS_DIRTY(esdp)) {
+	ASSERT(0 < esdp->no && esdp->no < no_shards);
+	return (Uint) esdp->no;
+    }
+    return 0;
 }
 
-
 static ERTS_INLINE void
-stat_upd_free(ErtsAlcType_t n, Uint size)
+stat_upd_alloc(InstrShard_t *sh, ErtsAlcType_t n, Uint size)
 {
-    ErtsAlcType_t t = ERTS_ALC_N2T(n);
-    ErtsAlcType_t a = ERTS_ALC_T2A(t);
-    ErtsAlcType_t c = ERTS_ALC_T2C(t);
-
-    ASSERT(stats->ap[a]->size >= size);
-    stats->ap[a]->size -= size;
-
-    ASSERT(stats->c[c].size >= size);
-    stats->c[c].size -= size;
-
-    ASSERT(stats->n[n].size >= size);
-    stats->n[n].size -= size;
-
-    ASSERT(stats->tot.size >= size);
-    stats->tot.size -= size;
-
-    ASSERT(stats->ap[a]->blocks > 0);
-    stats->ap[a]->blocks--;
+    erts_atomic_add_nob(&sh->n[n].size, (erts_aint_t) size);
+    erts_atomic_inc_nob(&sh->n[n].blocks);
+}
 
-    ASSERT(stats->c[c].blocks > 0);
-    stats->c[c].blocks--;
+static ERTS_INLINE void
+stat_upd_free(InstrShard_t *sh, ErtsAlcType_t n, Uint size)
+{
+    erts_atomic_add_nob(&sh->n[n].size, -((erts_aint_t) size));
+    erts_atomic_dec_nob(&sh->n[n].blocks);
+}
 
-    ASSERT(stats->n[n].blocks > 0);
-    stats->n[n].blocks--;
+static ERTS_INLINE void
+stat_upd_realloc(InstrShard_t *sh, ErtsAlcType_t n, Uint size, Uint old_size)
+{
+    if (old_size)
+	stat_upd_free(sh, n, old_size);
+    stat_upd_alloc(sh, n, size);
+}
 
-    ASSERT(stats->tot.blocks > 0);
-    stats->tot.blocks--;
+/*
+ * Allocation sampling
+ */
 
+static ERTS_INLINE void
+get_creator(Eterm *pidp, Eterm *modp, Eterm *funcp, Uint *arityp)
+{
+    Process *proc = erts_get_current_process();
+    if (!proc) {
+	*pidp = THE_NON_VALUE;
+	*modp = THE_NON_VALUE;
+    }
+    else {
+	BeamInstr *mfa = erts_find_running_function(proc);
+	*pidp = proc->common.id;
+	if (!mfa)
+	    *modp = THE_NON_VALUE;
+	else {
+	    *modp = (Eterm) mfa[0];
+	    *funcp = (Eterm) mfa[1];
+	    *arityp = (Uint) mfa[2];
+	}
+    }
 }
 
+static void
+record_sample(InstrShard_t *sh, ErtsAlcType_t n, Uint size,
+	      erts_aint_t countdown)
+{
+    Uint interval = erts_instr_sample_interval;
+    int shared = sh == &shards[0].shard;
+    Sample_t *sp;
+
+    if (shared)
+	erts_spin_lock(&instr_sample_lock);
+
+    /* Keep the phase, also when one block covered several intervals */
+    erts_atomic_set_nob(&sh->sample_countdown,
+			(erts_aint_t) (interval
+				       - ((Uint) -countdown) % interval));
+
+    sp = &sh->samples[erts_atomic_inc_read_nob(&sh->sample_ix)
+		      % ERTS_INSTR_SAMPLES];
+
+    /* Odd sequence number while the sample is being written */
+    erts_atomic_inc_wb(&sp->seq);
+    sp->type_no = n;
+    sp->size = size;
+    get_creator(&sp->pid, &sp->module, &sp->function, &sp->arity);
+    erts_atomic_inc_relb(&sp->seq);
+
+    if (shared)
+	erts_spin_unlock(&instr_sample_lock);
+}
 
 static ERTS_INLINE void
-stat_upd_realloc(ErtsAlcType_t n, Uint size, Uint old_size)
+sample_alloc(InstrShard_t *sh, ErtsAlcType_t n, Uint size)
 {
-    if (old_size)
-	stat_upd_free(n, old_size);
-    stat_upd_alloc(n, size);
+    if (erts_instr_sample_interval) {
+	erts_aint_t countdown;
+	countdown = erts_atomic_add_read_nob(&sh->sample_countdown,
+					     -((erts_aint_t) size));
+	if (countdown <= 0)
+	    record_sample(sh, n, size, countdown);
+    }
 }
 
 /*
- * stat instrumentation callback functions
+ * sample instrumentation callback functions; used when sampling is
+ * enabled without stat or map stat instrumentation.
  */
 
-static void stat_pre_lock(void)
+static void *
+sample_alloc_fn(ErtsAlcType_t n, void *extra, Uint size)
 {
-    erts_mtx_lock(&instr_mutex);
+    ErtsAllocatorFunctions_t *real_af = (ErtsAllocatorFunctions_t *) extra;
+    void *res = (*real_af->alloc)(n, real_af->extra, size);
+    if (res)
+	sample_alloc(&shards[get_shard_ix()].shard, n, size);
+    return res;
 }
 
-static void stat_pre_unlock(void)
+static void *
+sample_realloc_fn(ErtsAlcType_t n, void *extra, void *ptr, Uint size)
 {
-    erts_mtx_unlock(&instr_mutex);
+    ErtsAllocatorFunctions_t *real_af = (ErtsAllocatorFunctions_t *) extra;
+    void *res = (*real_af->realloc)(n, real_af->extra, ptr, size);
+    if (res)
+	sample_alloc(&shards[get_shard_ix()].shard, n, size);
+    return res;
 }
 
-static ErtsAllocatorWrapper_t instr_wrapper;
+static void
+sample_free_fn(ErtsAlcType_t n, void *extra, void *ptr)
+{
+    ErtsAllocatorFunctions_t *real_af = (ErtsAllocatorFunctions_t *) extra;
+    (*real_af->free)(n, real_af->extra, ptr);
+}
+
+/*
+ * stat instrumentation callback functions
+ */
 
 static void *
 stat_alloc(ErtsAlcType_t n, void *extra, Uint size)
@@ -291,14 +406,12 @@ stat_alloc(ErtsAlcType_t n, void *extra, Uint size)
     Uint ssize;
     void *res;
 
-    if (!erts_is_allctr_wrapper_prelocked()) {
-	erts_mtx_lock(&instr_mutex);
-    }
-
     ssize = size + STAT_BLOCK_HEADER_SIZE;
     res = (*real_af->alloc)(n, real_af->extra, ssize);
     if (res) {
-	stat_upd_alloc(n, size);
+	InstrShard_t *sh = &shards[get_shard_ix()].shard;
+	stat_upd_alloc(sh, n, size);
+	sample_alloc(sh, n, size);
 	((StatBlock_t *) res)->size = size;
 #ifdef VALGRIND
 	/* Suppress "possibly leaks" by storing an actual dummy pointer
@@ -308,10 +421,6 @@ stat_alloc(ErtsAlcType_t n, void *extra, Uint size)
 	res = (void *) ((StatBlock_t *) res)->mem;
     }
 
-    if (!erts_is_allctr_wrapper_prelocked()) {
-	erts_mtx_unlock(&instr_mutex);
-    }
-
     return res;
 }
 
@@ -324,10 +433,6 @@ stat_realloc(ErtsAlcType_t n, void *extra, void *ptr, Uint size)
     void *sptr;
     void *res;
 
-    if (!erts_is_allctr_wrapper_prelocked()) {
-	erts_mtx_lock(&instr_mutex);
-    }
-
     if (ptr) {
 	sptr = (void *) (((char *) ptr) - STAT_BLOCK_HEADER_SIZE);
 	old_size = ((StatBlock_t *) sptr)->size;
@@ -340,7 +445,9 @@ stat_realloc(ErtsAlcType_t n, void *extra, void *ptr, Uint size)
     ssize = size + STAT_BLOCK_HEADER_SIZE;
     res = (*real_af->realloc)(n, real_af->extra, sptr, ssize);
     if (res) {
-	stat_upd_realloc(n, size, old_size);
+	InstrShard_t *sh = &shards[get_shard_ix()].shard;
+	stat_upd_realloc(sh, n, size, old_size);
+	sample_alloc(sh, n, size);
 	((StatBlock_t *) res)->size = size;
 #ifdef VALGRIND
 	((StatBlock_t *) res)->valgrind_leak_suppressor = res;
@@ -348,10 +455,6 @@ stat_realloc(ErtsAlcType_t n, void *extra, void *ptr, Uint size)
 	res = (void *) ((StatBlock_t *) res)->mem;
     }
 
-    if (!erts_is_allctr_wrapper_prelocked()) {
-	erts_mtx_unlock(&instr_mutex);
-    }
-
     return res;
 }
 
@@ -361,75 +464,161 @@ stat_free(ErtsAlcType_t n, void *extra, void *ptr)
     ErtsAllocatorFunctions_t *real_af = (ErtsAllocatorFunctions_t *) extra;
     void *sptr;
 
-    if (!erts_is_allctr_wrapper_prelocked()) {
-	erts_mtx_lock(&instr_mutex);
-    }
-
     if (ptr) {
 	sptr = (void *) (((char *) ptr) - STAT_BLOCK_HEADER_SIZE);
-	stat_upd_free(n, ((StatBlock_t *) sptr)->size);
+	stat_upd_free(&shards[get_shard_ix()].shard,
+		      n, ((StatBlock_t *) sptr)->size);
     }
     else {
 	sptr = NULL;
     }
 
     (*real_af->free)(n, real_af->extra, sptr);
-
-    if (!erts_is_allctr_wrapper_prelocked()) {
-	erts_mtx_unlock(&instr_mutex);
-    }
-
 }
 
 /*
  * map stat instrumentation callback functions
  */
 
-static void map_stat_pre_lock(void)
+/*
+ * Binary attribution; called by the binary allocation functions in
+ * erl_binary.h when attribution is enabled.
+ */
+
+static ERTS_INLINE void
+bin_attr_link(BinAttrBlock_t *bp)
+{
+    InstrShard_t *sh = &shards[bp->shard].shard;
+    erts_mtx_lock(&sh->mtx);
+    bp->prev = NULL;
+    bp->next = sh->bin_anchor;
+    if (sh->bin_anchor)
+	sh->bin_anchor->prev = bp;
+    sh->bin_anchor = bp;
+    erts_mtx_unlock(&sh->mtx);
+}
+
+static ERTS_INLINE void
+bin_attr_unlink(BinAttrBlock_t *bp)
 {
-    erts_mtx_lock(&instr_x_mutex);
-    erts_mtx_lock(&instr_mutex);
+    InstrShard_t *sh = &shards[bp->shard].shard;
+    erts_mtx_lock(&sh->mtx);
+    if (bp->next)
+	bp->next->prev = bp->prev;
+    if (bp->prev)
+	bp->prev->next = bp->next;
+    else {
+	ASSERT(sh->bin_anchor == bp);
+	sh->bin_anchor = bp->next;
+    }
+    erts_mtx_unlock(&sh->mtx);
 }
 
-static void map_stat_pre_unlock(void)
+void *
+erts_instr_bin_alloc_fnf(ErtsAlcType_t type, Uint size)
 {
-    erts_mtx_unlock(&instr_mutex);
-    erts_mtx_unlock(&instr_x_mutex);
+    BinAttrBlock_t *bp;
+    Uint bsize = size + BIN_ATTR_BLOCK_HEADER_SIZE;
+
+    if (bsize < size) /* overflow */
+	return NULL;
+    bp = (BinAttrBlock_t *) erts_alloc_fnf(type, bsize);
+    if (!bp)
+	return NULL;
+
+    bp->shard = get_shard_ix();
+    bp->size = size;
+    get_creator(&bp->pid, &bp->module, &bp->function, &bp->arity);
+    bin_attr_link(bp);
+
+    return (void *) (((char *) bp) + BIN_ATTR_BLOCK_HEADER_SIZE);
+}
+
+void *
+erts_instr_bin_realloc_fnf(ErtsAlcType_t type, void *ptr, Uint size)
+{
+    BinAttrBlock_t *bp, *nbp;
+    Uint bsize = size + BIN_ATTR_BLOCK_HEADER_SIZE;
+
+    if (bsize < size) /* overflow */
+	return NULL;
+
+    bp = (BinAttrBlock_t *) (((char *) ptr) - BIN_ATTR_BLOCK_HEADER_SIZE);
+
+    /* The block may move; keep it out of the list meanwhile */
+    bin_attr_unlink(bp);
+    nbp = (BinAttrBlock_t *) erts_realloc_fnf(type, (void *) bp, bsize);
+    if (!nbp) {
+	bin_attr_link(bp);
+	return NULL;
+    }
+    nbp->size = size;
+    bin_attr_link(nbp);
+
+    return (void *) (((char *) nbp) + BIN_ATTR_BLOCK_HEADER_SIZE);
+}
+
+void
+erts_instr_bin_free(ErtsAlcType_t type, void *ptr)
+{
+    BinAttrBlock_t *bp;
+    bp = (BinAttrBlock_t *) (((char *) ptr) - BIN_ATTR_BLOCK_HEADER_SIZE);
+    bin_attr_unlink(bp);
+    erts_free(type, (void *) bp);
+}
+
+static ErtsAllocatorWrapper_t instr_wrapper;
+
+static void map_stat_lock_all(void)
+{
+    int i;
+    for (i = 0; i < no_shards; i++)
+	erts_mtx_lock(&shards[i].shard.mtx);
+}
+
+static void map_stat_unlock_all(void)
+{
+    int i;
+    for (i = no_shards - 1; i >= 0; i--)
+	erts_mtx_unlock(&shards[i].shard.mtx);
 }
 
 static void *
 map_stat_alloc(ErtsAlcType_t n, void *extra, Uint size)
 {
     ErtsAllocatorFunctions_t *real_af = (ErtsAllocatorFunctions_t *) extra;
+    Uint ix = get_shard_ix();
+    InstrShard_t *sh = &shards[ix].shard;
+    int prelocked = erts_is_allctr_wrapper_prelocked();
     Uint msize;
     void *res;
 
-    if (!erts_is_allctr_wrapper_prelocked()) {
-	erts_mtx_lock(&instr_mutex);
-    }
+    if (!prelocked)
+	erts_mtx_lock(&sh->mtx);
 
     msize = size + MAP_STAT_BLOCK_HEADER_SIZE;
     res = (*real_af->alloc)(n, real_af->extra, msize);
     if (res) {
 	MapStatBlock_t *mb = (MapStatBlock_t *) res;
-	stat_upd_alloc(n, size);
+	stat_upd_alloc(sh, n, size);
+	sample_alloc(sh, n, size);
 
 	mb->size = size;
 	mb->type_no = n;
 	mb->pid = erts_get_current_pid();
+	mb->shard = ix;
 
 	mb->prev = NULL;
-	mb->next = mem_anchor;
-	if (mem_anchor)
-	    mem_anchor->prev = mb;
-	mem_anchor = mb;
+	mb->next = sh->mem_anchor;
+	if (sh->mem_anchor)
+	    sh->mem_anchor->prev = mb;
+	sh->mem_anchor = mb;
 
 	res = (void *) mb->mem;
     }
 
-    if (!erts_is_allctr_wrapper_prelocked()) {
-	erts_mtx_unlock(&instr_mutex);
-    }
+    if (!prelocked)
+	erts_mtx_unlock(&sh->mtx);
 
     return res;
 }
@@ -438,35 +627,42 @@ static void *
 map_stat_realloc(ErtsAlcType_t n, void *extra, void *ptr, Uint size)
 {
     ErtsAllocatorFunctions_t *real_af = (ErtsAllocatorFunctions_t *) extra;
+    int prelocked = erts_is_allctr_wrapper_prelocked();
+    InstrShard_t *sh;
     Uint old_size;
     Uint msize;
+    Uint ix;
     void *mptr;
     void *res;
 
-    if (!erts_is_allctr_wrapper_prelocked()) {
-	erts_mtx_lock(&instr_x_mutex);
-	erts_mtx_lock(&instr_mutex);
-    }
-
     if (ptr) {
 	mptr = (void *) (((char *) ptr) - MAP_STAT_BLOCK_HEADER_SIZE);
+	ix = ((MapStatBlock_t *) mptr)->shard;
 	old_size = ((MapStatBlock_t *) mptr)->size;
     }
     else {
 	mptr = NULL;
+	ix = get_shard_ix();
 	old_size = 0;
     }
+    sh = &shards[ix].shard;
+
+    if (!prelocked)
+	erts_mtx_lock(&sh->mtx);
 
     msize = size + MAP_STAT_BLOCK_HEADER_SIZE;
     res = (*real_af->realloc)(n, real_af->extra, mptr, msize);
     if (res) {
 	MapStatBlock_t *mb = (MapStatBlock_t *) res;
+	InstrShard_t *ush = &shards[get_shard_ix()].shard;
 
 	mb->size = size;
 	mb->type_no = n;
 	mb->pid = erts_get_current_pid();
+	mb->shard = ix;
 
-	stat_upd_realloc(n, size, old_size);
+	stat_upd_realloc(ush, n, size, old_size);
+	sample_alloc(ush, n, size);
 
 	if (mptr != res) {
 
@@ -474,28 +670,27 @@ map_stat_realloc(ErtsAlcType_t n, void *extra, void *ptr, Uint size)
 		if (mb->prev)
 		    mb->prev->next = mb;
 		else {
-		    ASSERT(mem_anchor == (MapStatBlock_t *) mptr);
-		    mem_anchor = mb;
+		    ASSERT(sh->mem_anchor == (MapStatBlock_t *) mptr);
+		    sh->mem_anchor = mb;
 		}
 		if (mb->next)
 		    mb->next->prev = mb;
 	    }
 	    else {
 		mb->prev = NULL;
-		mb->next = mem_anchor;
-		if (mem_anchor)
-		    mem_anchor->prev = mb;
-		mem_anchor = mb;
+		mb->next = sh->mem_anchor;
+		if (sh->mem_anchor)
+		    sh->mem_anchor->prev = mb;
+		sh->mem_anchor = mb;
 	    }
 
 	}
 
 	res = (void *) mb->mem;
     }
-    if (!erts_is_allctr_wrapper_prelocked()) {
-	erts_mtx_unlock(&instr_mutex);
-	erts_mtx_unlock(&instr_x_mutex);
-    }
+
+    if (!prelocked)
+	erts_mtx_unlock(&sh->mtx);
 
     return res;
 }
@@ -504,49 +699,64 @@ static void
 map_stat_free(ErtsAlcType_t n, void *extra, void *ptr)
 {
     ErtsAllocatorFunctions_t *real_af = (ErtsAllocatorFunctions_t *) extra;
+    int prelocked = erts_is_allctr_wrapper_prelocked();
+    InstrShard_t *sh;
+    MapStatBlock_t *mb;
     void *mptr;
 
-    if (!erts_is_allctr_wrapper_prelocked()) {
-	erts_mtx_lock(&instr_x_mutex);
-	erts_mtx_lock(&instr_mutex);
+    if (!ptr) {
+	(*real_af->free)(n, real_af->extra, NULL);
+	return;
     }
 
-    if (ptr) {
-	MapStatBlock_t *mb;
+    mptr = (void *) (((char *) ptr) - MAP_STAT_BLOCK_HEADER_SIZE);
+    mb = (MapStatBlock_t *) mptr;
+    sh = &shards[mb->shard].shard;
 
-	mptr = (void *) (((char *) ptr) - MAP_STAT_BLOCK_HEADER_SIZE);
-	mb = (MapStatBlock_t *) mptr;
+    if (!prelocked)
+	erts_mtx_lock(&sh->mtx);
 
-	stat_upd_free(n, mb->size);
+    stat_upd_free(&shards[get_shard_ix()].shard, n, mb->size);
 
-	if (mb->prev)
-	    mb->prev->next = mb->next;
-	else
-	    mem_anchor = mb->next;
-	if (mb->next)
-	    mb->next->prev = mb->prev;
-    }
-    else {
-	mptr = NULL;
-    }
+    if (mb->prev)
+	mb->prev->next = mb->next;
+    else
+	sh->mem_anchor = mb->next;
+    if (mb->next)
+	mb->next->prev = mb->prev;
 
     (*real_af->free)(n, real_af->extra, mptr);
 
-    if (!erts_is_allctr_wrapper_prelocked()) {
-	erts_mtx_unlock(&instr_mutex);
-	erts_mtx_unlock(&instr_x_mutex);
-    }
+    if (!prelocked)
+	erts_mtx_unlock(&sh->mtx);
 
 }
 
+static void collect_stats(void);
+
+/*
+ * No map operation can be in progress while all shards are locked, so
+ * the counters then agree exactly with the map. Take the opportunity
+ * to update the maximum values, so that they never fall below the sum
+ * of a map. instr_mutex must be locked.
+ */
+static void
+lock_map_and_collect_stats(void)
+{
+    map_stat_lock_all();
+    collect_stats();
+}
+
 static void dump_memory_map_to_stream(FILE *fp)
 {
     ErtsAlcType_t n;
     MapStatBlock_t *bp;
+    int i;
     int lock = !ERTS_IS_CRASH_DUMPING;
     if (lock) {
 	ASSERT(!erts_is_allctr_wrapper_prelocked());
 	erts_mtx_lock(&instr_mutex);
+	lock_map_and_collect_stats();
     }
 
     /* Write header */
@@ -586,26 +796,30 @@ static void dump_memory_map_to_stream(FILE *fp)
     fprintf(fp, "}}.\n");
 
     /* Write memory data */
-    for (bp = mem_anchor; bp; bp = bp->next) {
-	if (is_internal_pid(bp->pid))
-	    fprintf(fp,
-		    "{%lu, %lu, %lu, {%lu,%lu,%lu}}.\n",
-		    (UWord) bp->type_no,
-		    (UWord) bp->mem,
-		    (UWord) bp->size,
-		    (UWord) pid_channel_no(bp->pid),
-		    (UWord) pid_number(bp->pid),
-		    (UWord) pid_serial(bp->pid));
-	else
-	    fprintf(fp,
-		    "{%lu, %lu, %lu, undefined}.\n",
-		    (UWord) bp->type_no,
-		    (UWord) bp->mem,
-		    (UWord) bp->size);
+    for (i = 0; i < no_shards; i++) {
+	for (bp = shards[i].shard.mem_anchor; bp; bp = bp->next) {
+	    if (is_internal_pid(bp->pid))
+		fprintf(fp,
+			"{%lu, %lu, %lu, {%lu,%lu,%lu}}.\n",
+			(UWord) bp->type_no,
+			(UWord) bp->mem,
+			(UWord) bp->size,
+			(UWord) pid_channel_no(bp->pid),
+			(UWord) pid_number(bp->pid),
+			(UWord) pid_serial(bp->pid));
+	    else
+		fprintf(fp,
+			"{%lu, %lu, %lu, undefined}.\n",
+			(UWord) bp->type_no,
+			(UWord) bp->mem,
+			(UWord) bp->size);
+	}
     }
 
-    if (lock)
+    if (lock) {
+	map_stat_unlock_all();
 	erts_mtx_unlock(&instr_mutex);
+    }
 }
 
 int erts_instr_dump_memory_map_to_fd(int fd)
@@ -645,17 +859,47 @@ int erts_instr_dump_memory_map(const char *name)
     return 1;
 }
 
+static Uint
+memory_map_data_heap_size(void)
+{
+    MapStatBlock_t *bp;
+    Uint hsz = 0;
+    int i;
+
+    for (i = 0; i < no_shards; i++) {
+	for (bp = shards[i].shard.mem_anchor; bp; bp = bp->next) {
+	    if (is_internal_pid(bp->pid)) {
+#if (_PID_NUM_SIZE - 1 > MAX_SMALL)
+		if (internal_pid_number(bp->pid) > MAX_SMALL)
+		    hsz += BIG_UINT_HEAP_SIZE;
+#endif
+#if (_PID_SER_SIZE - 1 > MAX_SMALL)
+		if (internal_pid_serial(bp->pid) > MAX_SMALL)
+		    hsz += BIG_UINT_HEAP_SIZE;
+#endif
+		hsz += 4;
+	    }
+
+	    if ((UWord) bp->mem > MAX_SMALL)
+		hsz += BIG_UINT_HEAP_SIZE;
+	    if (bp->size > MAX_SMALL)
+		hsz += BIG_UINT_HEAP_SIZE;
+
+	    hsz += 5 + 2;
+	}
+    }
+
+    return hsz;
+}
+
 Eterm erts_instr_get_memory_map(Process *proc)
 {
-    MapStatBlock_t *org_mem_anchor;
     Eterm hdr_tuple, md_list, res;
-    Eterm *hp;
-    Uint hsz;
+    Eterm *hp, *hp_start, *hp_end;
+    Uint hsz, dsz;
     MapStatBlock_t *bp;
-#ifdef DEBUG
-    Eterm *end_hp;
-#endif
-    
+    int i;
+
     if (!erts_instr_memory_map)
 	return am_false;
 
@@ -668,48 +912,30 @@ Eterm erts_instr_get_memory_map(Process *proc)
     if (!am_a)
 	init_am_a();
 
-    erts_mtx_lock(&instr_x_mutex);
-    erts_mtx_lock(&instr_mutex);
-
-    /* Header size */
-    hsz = 5 + 1 + (ERTS_ALC_N_MAX+1-ERTS_ALC_N_MIN)*(1 + 4);
-
-    /* Memory data list */
-    for (bp = mem_anchor; bp; bp = bp->next) {
-	if (is_internal_pid(bp->pid)) {
-#if (_PID_NUM_SIZE - 1 > MAX_SMALL)
-	    if (internal_pid_number(bp->pid) > MAX_SMALL)
-		hsz += BIG_UINT_HEAP_SIZE;
-#endif
-#if (_PID_SER_SIZE - 1 > MAX_SMALL)
-	    if (internal_pid_serial(bp->pid) > MAX_SMALL)
-		hsz += BIG_UINT_HEAP_SIZE;
-#endif
-	    hsz += 4;
-	}
-
-	if ((UWord) bp->mem > MAX_SMALL)
-	    hsz += BIG_UINT_HEAP_SIZE;
-	if (bp->size > MAX_SMALL)
-	    hsz += BIG_UINT_HEAP_SIZE;
-
-	hsz += 5 + 2;
-    }
-
-    hsz += 3; /* Root tuple */
-
-    org_mem_anchor = mem_anchor;
-    mem_anchor = NULL;
-
-    erts_mtx_unlock(&instr_mutex);
-
-    hp = HAlloc(proc, hsz); /* May end up calling map_stat_alloc() */
+    /* Header size and root tuple */
+    hsz = 5 + 1 + (ERTS_ALC_N_MAX+1-ERTS_ALC_N_MIN)*(1 + 4) + 3;
 
+    /*
+     * We cannot allocate the heap while holding the shard locks, since
+     * the allocation itself goes through map_stat_alloc(). Allocate
+     * with some slack and retry if the map grew too much meanwhile.
+     */
     erts_mtx_lock(&instr_mutex);
+    map_stat_lock_all();
+    dsz = memory_map_data_heap_size();
+    while (1) {
+	Uint asz = hsz + dsz + dsz/8;
+	map_stat_unlock_all();
+	hp_start = HAlloc(proc, asz); /* May end up calling map_stat_alloc() */
+	hp_end = hp_start + asz;
+	lock_map_and_collect_stats();
+	dsz = memory_map_data_heap_size();
+	if (hsz + dsz <= asz)
+	    break;
+	HRelease(proc, hp_end, hp_start);
+    }
 
-#ifdef DEBUG
-    end_hp = hp + hsz;
-#endif
+    hp = hp_start;
 
     {	/* Build header */
 	ErtsAlcType_t n;
@@ -753,90 +979,84 @@ Eterm erts_instr_get_memory_map(Process *proc)
 
     /* Build memory data list */
 
-    for (md_list = NIL, bp = org_mem_anchor; bp; bp = bp->next) {
-	Eterm tuple;
-	Eterm type;
-	Eterm ptr;
-	Eterm size;
-	Eterm pid;
-
-	if (is_not_internal_pid(bp->pid))
-	    pid = am_undefined;
-	else {
-	    Eterm c;
-	    Eterm n;
-	    Eterm s;
+    md_list = NIL;
+    for (i = no_shards - 1; i >= 0; i--) {
+	for (bp = shards[i].shard.mem_anchor; bp; bp = bp->next) {
+	    Eterm tuple;
+	    Eterm type;
+	    Eterm ptr;
+	    Eterm size;
+	    Eterm pid;
+
+	    if (is_not_internal_pid(bp->pid))
+		pid = am_undefined;
+	    else {
+		Eterm c;
+		Eterm n;
+		Eterm s;
 
 #if (ERST_INTERNAL_CHANNEL_NO > MAX_SMALL)
 #error Oversized internal channel number
 #endif
-	    c = make_small(ERST_INTERNAL_CHANNEL_NO);
+		c = make_small(ERST_INTERNAL_CHANNEL_NO);
 
 #if (_PID_NUM_SIZE - 1 > MAX_SMALL)
-	    if (internal_pid_number(bp->pid) > MAX_SMALL) {
-		n = uint_to_big(internal_pid_number(bp->pid), hp);
-		hp += BIG_UINT_HEAP_SIZE;
-	    }
-	    else
+		if (internal_pid_number(bp->pid) > MAX_SMALL) {
+		    n = uint_to_big(internal_pid_number(bp->pid), hp);
+		    hp += BIG_UINT_HEAP_SIZE;
+		}
+		else
 #endif
-		n = make_small(internal_pid_number(bp->pid));
+		    n = make_small(internal_pid_number(bp->pid));
 
 #if (_PID_SER_SIZE - 1 > MAX_SMALL)
-	    if (internal_pid_serial(bp->pid) > MAX_SMALL) {
-		s = uint_to_big(internal_pid_serial(bp->pid), hp);
-		hp += BIG_UINT_HEAP_SIZE;
-	    }
-	    else
+		if (internal_pid_serial(bp->pid) > MAX_SMALL) {
+		    s = uint_to_big(internal_pid_serial(bp->pid), hp);
+		    hp += BIG_UINT_HEAP_SIZE;
+		}
+		else
 #endif
-		s = make_small(internal_pid_serial(bp->pid));
-	    pid = TUPLE3(hp, c, n, s);
-	    hp += 4;
-	}
+		    s = make_small(internal_pid_serial(bp->pid));
+		pid = TUPLE3(hp, c, n, s);
+		hp += 4;
+	    }
 
 
 #if ERTS_ALC_N_MAX > MAX_SMALL
 #error Oversized memory type number
 #endif
-	type = make_small(bp->type_no);
+	    type = make_small(bp->type_no);
 
-	if ((UWord) bp->mem > MAX_SMALL) {
-	    ptr = uint_to_big((UWord) bp->mem, hp);
-	    hp += BIG_UINT_HEAP_SIZE;
-	}
-	else
-	    ptr = make_small((UWord) bp->mem);
+	    if ((UWord) bp->mem > MAX_SMALL) {
+		ptr = uint_to_big((UWord) bp->mem, hp);
+		hp += BIG_UINT_HEAP_SIZE;
+	    }
+	    else
+		ptr = make_small((UWord) bp->mem);
 
-	if (bp->size > MAX_SMALL) {
-	    size = uint_to_big(bp->size, hp);
-	    hp += BIG_UINT_HEAP_SIZE;
-	}
-	else
-	    size = make_small(bp->size);
+	    if (bp->size > MAX_SMALL) {
+		size = uint_to_big(bp->size, hp);
+		hp += BIG_UINT_HEAP_SIZE;
+	    }
+	    else
+		size = make_small(bp->size);
 
-	tuple = TUPLE4(hp, type, ptr, size, pid);
-	hp += 5;
+	    tuple = TUPLE4(hp, type, ptr, size, pid);
+	    hp += 5;
 
-	md_list = CONS(hp, tuple, md_list);
-	hp += 2;
+	    md_list = CONS(hp, tuple, md_list);
+	    hp += 2;
+	}
     }
 
     res = TUPLE2(hp, hdr_tuple, md_list);
-    
-    ASSERT(hp + 3 == end_hp);
-
-    if (mem_anchor) {
-	for (bp = mem_anchor; bp->next; bp = bp->next)
-	    ;
-	ASSERT(org_mem_anchor);
-	org_mem_anchor->prev = bp; 
-	bp->next = org_mem_anchor;
-    }
-    else {
-	mem_anchor = org_mem_anchor;
-    }
+    hp += 3;
 
+    map_stat_unlock_all();
     erts_mtx_unlock(&instr_mutex);
-    erts_mtx_unlock(&instr_x_mutex);
+
+    ASSERT(hp <= hp_end);
+    HRelease(proc, hp_end, hp);
 
     return res;
 }
@@ -863,6 +1083,69 @@ update_max_ever_values(Stat_t *stat, int min, int max)
     }
 }
 
+static ERTS_INLINE void
+update_max_values(Stat_t *stat, int min, int max)
+{
+    int i;
+    for (i = min; i <= max; i++) {
+	if (stat[i].max_size < stat[i].size)
+	    stat[i].max_size = stat[i].size;
+	if (stat[i].max_blocks < stat[i].blocks)
+	    stat[i].max_blocks = stat[i].blocks;
+    }
+}
+
+static ERTS_INLINE Uint
+sum_shards(int n, int blocks)
+{
+    erts_aint_t sum = 0;
+    int i;
+    for (i = 0; i < no_shards; i++) {
+	StatCounters_t *cp = &shards[i].shard.n[n];
+	sum += erts_atomic_read_nob(blocks ? &cp->blocks : &cp->size);
+    }
+    /* A block freed while we are summing may make us end up below zero */
+    return sum < 0 ? 0 : (Uint) sum;
+}
+
+/*
+ * Sum up the current values of all shards into stats. instr_mutex
+ * must be locked.
+ */
+static void
+collect_stats(void)
+{
+    ErtsAlcType_t i;
+
+    stats->tot.size = stats->tot.blocks = 0;
+    for (i = ERTS_ALC_A_MIN; i <= ERTS_ALC_A_MAX; i++)
+	stats->a[i].size = stats->a[i].blocks = 0;
+    for (i = ERTS_ALC_C_MIN; i <= ERTS_ALC_C_MAX; i++)
+	stats->c[i].size = stats->c[i].blocks = 0;
+
+    for (i = ERTS_ALC_N_MIN; i <= ERTS_ALC_N_MAX; i++) {
+	ErtsAlcType_t t = ERTS_ALC_N2T(i);
+	ErtsAlcType_t a = ERTS_ALC_T2A(t);
+	ErtsAlcType_t c = ERTS_ALC_T2C(t);
+	Uint size = sum_shards(i, 0);
+	Uint blocks = sum_shards(i, 1);
+
+	stats->n[i].size = size;
+	stats->n[i].blocks = blocks;
+	stats->ap[a]->size += size;
+	stats->ap[a]->blocks += blocks;
+	stats->c[c].size += size;
+	stats->c[c].blocks += blocks;
+	stats->tot.size += size;
+	stats->tot.blocks += blocks;
+    }
+
+    update_max_values(&stats->tot, 0, 0);
+    update_max_values(stats->a, ERTS_ALC_A_MIN, ERTS_ALC_A_MAX);
+    update_max_values(stats->c, ERTS_ALC_C_MIN, ERTS_ALC_C_MAX);
+    update_max_values(stats->n, ERTS_ALC_N_MIN, ERTS_ALC_N_MAX);
+}
+
 #define bld_string	erts_bld_string
 #define bld_tuple	erts_bld_tuple
 #define bld_tuplev	erts_bld_tuplev
@@ -939,6 +1222,7 @@ erts_instr_get_stat(Process *proc, Eterm what, int begin_max_period)
 
     erts_mtx_lock(&instr_mutex);
 
+    collect_stats();
     update_max_ever_values(stat_src, min, max);
 
     sys_memcpy((void *) stat, (void *) stat_src, stat_size);
@@ -1004,6 +1288,8 @@ dump_stat_to_stream(FILE *fp, int begin_max_period)
 
     erts_mtx_lock(&instr_mutex);
 
+    collect_stats();
+
     fprintf(fp,
 	    "{instr_vsn,%lu}.\n",
 	    (unsigned long) ERTS_INSTR_VSN);
@@ -1136,17 +1422,31 @@ int erts_instr_dump_stat(const char *name, int begin_max_period)
 Uint
 erts_instr_get_total(void)
 {
-    return erts_instr_stat ? stats->tot.size : 0;
+    Uint total = 0;
+    ErtsAlcType_t n;
+
+    if (!erts_instr_stat)
+	return 0;
+    for (n = ERTS_ALC_N_MIN; n <= ERTS_ALC_N_MAX; n++)
+	total += sum_shards(n, 0);
+    return total;
 }
 
 Uint
 erts_instr_get_max_total(void)
 {
+    Uint res = 0;
     if (erts_instr_stat) {
+	int lock = !ERTS_IS_CRASH_DUMPING;
+	if (lock)
+	    erts_mtx_lock(&instr_mutex);
+	collect_stats();
 	update_max_ever_values(&stats->tot, 0, 0);
-	return stats->tot.max_size_ever;
+	res = stats->tot.max_size_ever;
+	if (lock)
+	    erts_mtx_unlock(&instr_mutex);
     }
-    return 0;
+    return res;
 }
 
 Eterm
@@ -1202,8 +1502,289 @@ erts_instr_get_type_info(Process *proc)
     return res;
 }
 
+Eterm
+erts_instr_get_samples(Process *proc)
+{
+    Eterm res, *tpls;
+    Uint hsz, *hszp, *hp, **hpp;
+    Sample_t *snap;
+    int i, j, no;
+
+    if (!erts_instr_sample_interval)
+	return am_false;
+
+    if (!am_n)
+	init_am_n();
+
+    /*
+     * Take a snapshot of the samples before building the result, since
+     * the heap allocation itself may record new samples.
+     */
+    snap = (Sample_t *) erts_alloc(ERTS_ALC_T_TMP,
+				   (sizeof(Sample_t)
+				    * ERTS_INSTR_SAMPLES * no_shards));
+    no = 0;
+    for (i = 0; i < no_shards; i++) {
+	Sample_t *samples = shards[i].shard.samples;
+	for (j = 0; j < ERTS_INSTR_SAMPLES; j++) {
+	    erts_aint_t seq = erts_atomic_read_acqb(&samples[j].seq);
+	    if (seq == 0 || (seq & 1))
+		continue; /* Unused, or being written */
+	    snap[no].type_no = samples[j].type_no;
+	    snap[no].size = samples[j].size;
+	    snap[no].pid = samples[j].pid;
+	    snap[no].module = samples[j].module;
+	    snap[no].function = samples[j].function;
+	    snap[no].arity = samples[j].arity;
+	    ERTS_THR_READ_MEMORY_BARRIER;
+	    if (erts_atomic_read_nob(&samples[j].seq) == seq)
+		no++;
+	}
+    }
+
+    tpls = (Eterm *) erts_alloc(ERTS_ALC_T_TMP, sizeof(Eterm) * (no + 1));
+    hsz = 0;
+    hszp = &hsz;
+    hpp = NULL;
+
+ restart_bld:
+
+    for (i = 0; i < no; i++) {
+	Sample_t *sp = &snap[i];
+	Eterm pid, mfa;
+
+	if (is_internal_pid(sp->pid))
+	    pid = sp->pid;
+	else
+	    pid = am_undefined;
+
+	if (is_atom(sp->module))
+	    mfa = bld_tuple(hpp, hszp, 3, sp->module, sp->function,
+			    make_small(sp->arity));
+	else
+	    mfa = am_undefined;
+
+	tpls[i] = bld_tuple(hpp, hszp, 4,
+			    am_n[sp->type_no],
+			    bld_uint(hpp, hszp, sp->size),
+			    pid,
+			    mfa);
+    }
+
+    res = bld_tuple(hpp, hszp, 2,
+		    bld_uint(hpp, hszp, erts_instr_sample_interval),
+		    bld_list(hpp, hszp, no, tpls));
+
+    if (!hpp) {
+	hp = HAlloc(proc, hsz);
+	hszp = NULL;
+	hpp = &hp;
+	goto restart_bld;
+    }
+
+    erts_free(ERTS_ALC_T_TMP, tpls);
+    erts_free(ERTS_ALC_T_TMP, snap);
+
+    return res;
+}
+
+/*
+ * Attribution of binaries and ETS tables to their creators
+ */
+
+typedef struct {
+    Eterm kind;
+    Eterm pid;
+    Eterm module;
+    Eterm function;
+    Uint arity;
+    Uint count;
+    Uint size;
+} AttrRec_t;
+
+typedef struct {
+    AttrRec_t *recs;
+    Uint no;
+    Uint sz;
+} AttrRecs_t;
+
+static void
+attr_recs_reserve(AttrRecs_t *ap, Uint more)
+{
+    if (ap->no + more > ap->sz) {
+	ap->sz = ap->no + more + ap->sz/2 + 16;
+	if (!ap->recs)
+	    ap->recs = erts_alloc(ERTS_ALC_T_TMP, sizeof(AttrRec_t)*ap->sz);
+	else
+	    ap->recs = erts_realloc(ERTS_ALC_T_TMP, (void *) ap->recs,
+				    sizeof(AttrRec_t)*ap->sz);
+    }
+}
+
+static ERTS_INLINE void
+attr_rec_init(AttrRec_t *rp, Eterm kind, Eterm pid, Eterm module,
+	      Eterm function, Uint arity, Uint size)
+{
+    rp->kind = kind;
+    rp->pid = is_internal_pid(pid) ? pid : am_undefined;
+    if (is_atom(module)) {
+	rp->module = module;
+	rp->function = function;
+	rp->arity = arity;
+    }
+    else {
+	rp->module = am_undefined;
+	rp->function = am_undefined;
+	rp->arity = 0;
+    }
+    rp->count = 1;
+    rp->size = size;
+}
+
+static void
+attr_add_table(Eterm creator, Eterm *mfa, Uint size, void *vap)
+{
+    AttrRecs_t *ap = (AttrRecs_t *) vap;
+    /*
+     * Called with a meta table lock held, so we may not call the
+     * allocator; room has been made beforehand. Tables created after
+     * that are skipped.
+     */
+    if (ap->no < ap->sz)
+	attr_rec_init(&ap->recs[ap->no++], am_ets, creator,
+		      mfa[0], mfa[1], (Uint) mfa[2], size);
+}
+
+static void
+attr_add_binaries(AttrRecs_t *ap, InstrShard_t *sh)
+{
+    BinAttrBlock_t *bp;
+    Uint n = 0, room;
+
+    /*
+     * We may not call the allocator while holding the shard lock,
+     * so make room first. Binaries created after that are skipped.
+     */
+    erts_mtx_lock(&sh->mtx);
+    for (bp = sh->bin_anchor; bp; bp = bp->next)
+	n++;
+    erts_mtx_unlock(&sh->mtx);
+
+    attr_recs_reserve(ap, n);
+    room = ap->sz - ap->no;
+
+    erts_mtx_lock(&sh->mtx);
+    for (bp = sh->bin_anchor; bp && room > 0; bp = bp->next, room--)
+	attr_rec_init(&ap->recs[ap->no++], am_binary, bp->pid,
+		      bp->module, bp->function, bp->arity, bp->size);
+    erts_mtx_unlock(&sh->mtx);
+}
+
+static int
+attr_rec_key_cmp(const void *vx, const void *vy)
+{
+    const AttrRec_t *x = (const AttrRec_t *) vx;
+    const AttrRec_t *y = (const AttrRec_t *) vy;
+    if (x->kind != y->kind)
+	return x->kind < y->kind ? -1 : 1;
+    if (x->pid != y->pid)
+	return x->pid < y->pid ? -1 : 1;
+    if (x->module != y->module)
+	return x->module < y->module ? -1 : 1;
+    if (x->function != y->function)
+	return x->function < y->function ? -1 : 1;
+    if (x->arity != y->arity)
+	return x->arity < y->arity ? -1 : 1;
+    return 0;
+}
+
+static int
+attr_rec_size_cmp(const void *vx, const void *vy)
+{
+    const AttrRec_t *x = (const AttrRec_t *) vx;
+    const AttrRec_t *y = (const AttrRec_t *) vy;
+    if (x->size != y->size)
+	return x->size > y->size ? -1 : 1;
+    return attr_rec_key_cmp(vx, vy);
+}
+
+Eterm
+erts_instr_get_attribution(Process *proc)
+{
+    AttrRecs_t recs;
+    Eterm res, *tpls;
+    Uint hsz, *hszp, *hp, **hpp;
+    Uint i, j;
+
+    if (!erts_instr_attribution)
+	return am_false;
+
+    recs.no = 0;
+    recs.sz = 0;
+    recs.recs = NULL;
+    attr_recs_reserve(&recs, 64);
+
+    for (i = 0; i < no_shards; i++)
+	attr_add_binaries(&recs, &shards[i].shard);
+    attr_recs_reserve(&recs, erts_db_no_tables());
+    erts_db_foreach_creator(attr_add_table, (void *) &recs);
+
+    /* Aggregate by creator, largest first */
+    qsort((void *) recs.recs, recs.no, sizeof(AttrRec_t), attr_rec_key_cmp);
+    for (i = 0, j = 0; i < recs.no; i++) {
+	if (j > 0 && attr_rec_key_cmp(&recs.recs[j-1], &recs.recs[i]) == 0) {
+	    recs.recs[j-1].count++;
+	    recs.recs[j-1].size += recs.recs[i].size;
+	}
+	else
+	    recs.recs[j++] = recs.recs[i];
+    }
+    recs.no = j;
+    qsort((void *) recs.recs, recs.no, sizeof(AttrRec_t), attr_rec_size_cmp);
+
+    tpls = (Eterm *) erts_alloc(ERTS_ALC_T_TMP, sizeof(Eterm) * (recs.no + 1));
+    hsz = 0;
+    hszp = &hsz;
+    hpp = NULL;
+
+ restart_bld:
+
+    for (i = 0; i < recs.no; i++) {
+	AttrRec_t *rp = &recs.recs[i];
+	Eterm mfa;
+
+	if (rp->module == am_undefined)
+	    mfa = am_undefined;
+	else
+	    mfa = bld_tuple(hpp, hszp, 3, rp->module, rp->function,
+			    make_small(rp->arity));
+
+	tpls[i] = bld_tuple(hpp, hszp, 5,
+			    rp->kind,
+			    rp->pid,
+			    mfa,
+			    bld_uint(hpp, hszp, rp->count),
+			    bld_uint(hpp, hszp, rp->size));
+    }
+
+    res = bld_list(hpp, hszp, recs.no, tpls);
+
+    if (!hpp) {
+	hp = HAlloc(proc, hsz);
+	hszp = NULL;
+	hpp = &hp;
+	goto restart_bld;
+    }
+
+    erts_free(ERTS_ALC_T_TMP, tpls);
+    erts_free(ERTS_ALC_T_TMP, recs.recs);
+
+    return res;
+}
+
 Uint
-erts_instr_init(int stat, int map_stat)
+erts_instr_init(int stat, int map_stat, Uint sample_interval,
+		int attribution)
 {
     Uint extra_sz;
     int i;
@@ -1215,22 +1796,72 @@ erts_instr_init(int stat, int map_stat)
 
     erts_instr_memory_map = 0;
     erts_instr_stat = 0;
+    erts_instr_sample_interval = 0;
+    erts_instr_attribution = 0;
     atoms_initialized = 0;
 
-    if (!stat && !map_stat)
+    if (!stat && !map_stat && !sample_interval && !attribution)
 	return 0;
 
-    stats = erts_alloc(ERTS_ALC_T_INSTR_INFO, sizeof(struct stats_));
-
-    erts_mtx_init(&instr_mutex, "instr");
+    erts_spinlock_init(&instr_sample_lock, "instr_sample");
+
+    no_shards = (int) erts_no_schedulers + 1;
+    shards = erts_alloc_permanent_cache_aligned(ERTS_ALC_T_INSTR_INFO,
+						(sizeof(InstrShardAligned_t)
+						 * no_shards));
+    for (i = 0; i < no_shards; i++) {
+	InstrShard_t *sh = &shards[i].shard;
+	int n;
+
+	erts_mtx_init_x(&sh->mtx, "instr", make_small(i), 1);
+	sh->mem_anchor = NULL;
+	sh->bin_anchor = NULL;
+	sh->n = erts_alloc_permanent_cache_aligned(ERTS_ALC_T_INSTR_INFO,
+						   (sizeof(StatCounters_t)
+						    * (ERTS_ALC_N_MAX+1)));
+	for (n = 0; n <= ERTS_ALC_N_MAX; n++) {
+	    erts_atomic_init_nob(&sh->n[n].size, 0);
+	    erts_atomic_init_nob(&sh->n[n].blocks, 0);
+	}
+	erts_atomic_init_nob(&sh->sample_countdown,
+			     (erts_aint_t) sample_interval);
+	erts_atomic_init_nob(&sh->sample_ix, 0);
+	if (!sample_interval)
+	    sh->samples = NULL;
+	else {
+	    sh->samples = erts_alloc(ERTS_ALC_T_INSTR_INFO,
+				     sizeof(Sample_t)*ERTS_INSTR_SAMPLES);
+	    for (n = 0; n < ERTS_INSTR_SAMPLES; n++) {
+		erts_atomic_init_nob(&sh->samples[n].seq, 0);
+		sh->samples[n].type_no = 0;
+	    }
+	}
+    }
 
-    mem_anchor = NULL;
+    erts_instr_sample_interval = sample_interval;
+    erts_instr_attribution = attribution;
 
     /* Install instrumentation functions */
     ERTS_CT_ASSERT(sizeof(erts_allctrs) == sizeof(real_allctrs));
 
     sys_memcpy((void *)real_allctrs,(void *)erts_allctrs,sizeof(erts_allctrs));
 
+    if (!stat && !map_stat) {
+	if (!sample_interval)
+	    return 0;
+	for (i = ERTS_ALC_A_MIN; i <= ERTS_ALC_A_MAX; i++) {
+	    erts_allctrs[i].alloc	= sample_alloc_fn;
+	    erts_allctrs[i].realloc	= sample_realloc_fn;
+	    erts_allctrs[i].free	= sample_free_fn;
+	    erts_allctrs[i].extra	= (void *) &real_allctrs[i];
+	}
+	return 0;
+    }
+
+    stats = erts_alloc(ERTS_ALC_T_INSTR_INFO, sizeof(struct stats_));
+
+    erts_mtx_init(&instr_mutex, "instr_stat");
+
     sys_memzero((void *) &stats->tot, sizeof(Stat_t));
     sys_memzero((void *) stats->a, sizeof(Stat_t)*(ERTS_ALC_A_MAX+1));
     sys_memzero((void *) stats->c, sizeof(Stat_t)*(ERTS_ALC_C_MAX+1));
@@ -1244,9 +1875,6 @@ erts_instr_init(int stat, int map_stat)
     }
 
     if (map_stat) {
-
-	erts_mtx_init(&instr_x_mutex, "instr_x");
-
 	erts_instr_memory_map = 1;
 	erts_instr_stat = 1;
 	for (i = ERTS_ALC_A_MIN; i <= ERTS_ALC_A_MAX; i++) {
@@ -1255,11 +1883,13 @@ erts_instr_init(int stat, int map_stat)
 	    erts_allctrs[i].free	= map_stat_free;
 	    erts_allctrs[i].extra	= (void *) &real_allctrs[i];
 	}
-	instr_wrapper.lock = map_stat_pre_lock;
-	instr_wrapper.unlock = map_stat_pre_unlock;
+	instr_wrapper.lock = map_stat_lock_all;
+	instr_wrapper.unlock = map_stat_unlock_all;
+	erts_allctr_wrapper_prelock_init(&instr_wrapper);
 	extra_sz = MAP_STAT_BLOCK_HEADER_SIZE;
     }
     else {
+	/* No locks to take, so no need for a pre-lock wrapper */
 	erts_instr_stat = 1;
 	for (i = ERTS_ALC_A_MIN; i <= ERTS_ALC_A_MAX; i++) {
 	    erts_allctrs[i].alloc	= stat_alloc;
@@ -1267,11 +1897,7 @@ erts_instr_init(int stat, int map_stat)
 	    erts_allctrs[i].free	= stat_free;
 	    erts_allctrs[i].extra	= (void *) &real_allctrs[i];
 	}
-	instr_wrapper.lock = stat_pre_lock;
-	instr_wrapper.unlock = stat_pre_unlock;
 	extra_sz = STAT_BLOCK_HEADER_SIZE;
     }
-    erts_allctr_wrapper_prelock_init(&instr_wrapper);
     return extra_sz;
 }
-
@@ -27,8 +27,11 @@
 
 extern int erts_instr_memory_map;
 extern int erts_instr_stat;
+extern Uint erts_instr_sample_interval;
+extern int erts_instr_attribution;
 
-Uint  erts_instr_init(int stat, int map_stat);
+Uint  erts_instr_init(int stat, int map_stat, Uint sample_interval,
+		      int attribution);
 int   erts_instr_dump_memory_map_to_fd(int fd);
 int   erts_instr_dump_memory_map(const char *name);
 Eterm erts_instr_get_memory_map(Process *process);
@@ -36,6 +39,11 @@ int   erts_instr_dump_stat_to_fd(int fd, int begin_max_period);
 int   erts_instr_dump_stat(const char *name, int begin_max_period);
 Eterm erts_instr_get_stat(Process *proc, Eterm what, int begin_max_period);
 Eterm erts_instr_get_type_info(Process *proc);
+Eterm erts_instr_get_samples(Process *proc);
+Eterm erts_instr_get_attribution(Process *proc);
+void *erts_instr_bin_alloc_fnf(ErtsAlcType_t type, Uint size);
+void *erts_instr_bin_realloc_fnf(ErtsAlcType_t type, void *ptr, Uint size);
+void  erts_instr_bin_free(ErtsAlcType_t type, void *ptr);
 Uint  erts_instr_get_total(void);
 Uint  erts_instr_get_max_total(void);
 
@@ -113,6 +113,7 @@ static erts_lc_lock_order_t erts_lock_order[] = {
     {	"export_tab",				NULL			},
     {	"fun_tab",				NULL			},
     {	"environ",				NULL			},
+    {	"heap_pred",				NULL			},
 #ifdef ERTS_NEW_PURGE_STRATEGY
     {	"release_literal_areas",		NULL			},
 #endif
@@ -132,6 +133,10 @@ static erts_lc_lock_order_t erts_lock_order[] = {
 #endif
     {	"process_table",			NULL			},
     {	"cpu_info",				NULL			},
+#ifdef ERTS_SMP
+    {	"parallel_gc",				NULL			},
+    {	"parallel_gc_workq",			"index"			},
+#endif
     {	"pollset",				"address"		},
 #ifdef __WIN32__
     {	"pollwaiter",				"address"		},
@@ -157,8 +162,8 @@ static erts_lc_lock_order_t erts_lock_order[] = {
     {   "port_table",                           NULL                    },
 #endif
     {	"mtrace_op",				NULL			},
-    {	"instr_x",				NULL			},
-    {	"instr",				NULL			},
+    {	"instr_stat",				NULL			},
+    {	"instr",				"index"			},
     {	"alcu_allocator",			"index"			},
     {	"mseg",					NULL			},
 #ifdef ERTS_SMP
@@ -186,6 +191,7 @@ static erts_lc_lock_order_t erts_lock_order[] = {
     {   "efile_drv dtrace mutex",               NULL                    },
 #endif
     {	"mtrace_buf",				NULL			},
+    {	"instr_sample",				NULL			},
 #ifdef ERTS_SMP
     {	"os_monotonic_time",			NULL			},
 #endif
@@ -31,6 +31,7 @@
 #include "erl_message.h"
 #include "erl_process.h"
 #include "erl_binary.h"
+#include "erl_map.h"
 #include "dtrace-wrapper.h"
 #include "beam_bp.h"
 
@@ -39,16 +40,37 @@ ERTS_SCHED_PREF_QUICK_ALLOC_IMPL(message_ref,
 				 ERL_MESSAGE_BUF_SZ,
 				 ERTS_ALC_T_MSG_REF)
 
+ERTS_SCHED_PREF_QUICK_ALLOC_IMPL(small_message,
+				 ErtsSmallFixSzMessage,
+				 ERTS_SMALL_MSG_BUF_SZ,
+				 ERTS_ALC_T_SMALL_MSG)
+
 #if defined(DEBUG) && 0
 #define HARD_DEBUG
 #else
 #undef HARD_DEBUG
 #endif
 
+/*
+ * Messages larger than ERTS_COPY_FLAT_LIMIT are not sized before
+ * they are copied; they are instead copied in a single pass into heap
+ * produced on demand, preserving sharing unless disabled. Smaller
+ * messages are still sized first, since both passes then hit the
+ * cache and the exact size avoids trimming.
+ */
+int erts_send_single_pass = 1;
+
+/*
+ * Small messages are taken from the preallocated blocks of the
+ * scheduler unless disabled; they are then plain fixed size blocks.
+ */
+int erts_small_message_pool = 1;
+
 void
 init_message(void)
 {
     init_message_ref_alloc();
+    init_small_message_alloc();
 }
 
 void *erts_alloc_message_ref(void)
@@ -61,6 +83,18 @@ void erts_free_message_ref(void *mp)
     message_ref_free((ErtsMessageRef *) mp);
 }
 
+void *erts_alloc_small_message(void)
+{
+    if (erts_small_message_pool)
+	return (void *) small_message_alloc();
+    return erts_alloc(ERTS_ALC_T_SMALL_MSG, sizeof(ErtsSmallFixSzMessage));
+}
+
+void erts_free_small_message(void *mp)
+{
+    small_message_free((ErtsSmallFixSzMessage *) mp);
+}
+
 /* Allocate message buffer (size in words) */
 ErlHeapFragment*
 new_message_buffer(Uint size)
@@ -205,7 +239,9 @@ erts_cleanup_messages(ErtsMessage *msgp)
     while (mp) {
 	ErtsMessage *fmp;
 	ErlHeapFragment *bp;
-	if (is_non_value(ERL_MESSAGE_TERM(mp))) {
+	if (ERTS_MSG_IS_SHARED(mp))
+	    erts_release_shared_msg_payload(ERTS_MSG_SHARED_PAYLOAD(mp));
+	else if (is_non_value(ERL_MESSAGE_TERM(mp))) {
 	    if (is_not_immed(ERL_MESSAGE_TOKEN(mp))) {
 		bp = (ErlHeapFragment *) mp->data.dist_ext->ext_endp;
 		erts_cleanup_offheap(&bp->off_heap);
@@ -232,8 +268,20 @@ erts_cleanup_messages(ErtsMessage *msgp)
 ErtsMessage *
 erts_realloc_shrink_message(ErtsMessage *mp, Uint sz, Eterm *brefs, Uint brefs_size)
 {
-    ErtsMessage *nmp = erts_realloc(ERTS_ALC_T_MSG, mp,
-				    sizeof(ErtsMessage) + (sz - 1)*sizeof(Eterm));
+    ErtsMessage *nmp;
+
+    ASSERT(mp->hfrag.alloc_size > ERTS_SMALL_FIX_MSG_SZ);
+
+    if (sz > ERTS_SMALL_FIX_MSG_SZ)
+	nmp = erts_realloc(ERTS_ALC_T_MSG, mp,
+			   sizeof(ErtsMessage) + (sz - 1)*sizeof(Eterm));
+    else {
+	/* Small enough to be moved into a small message */
+	nmp = erts_alloc_small_message();
+	sys_memcpy((void *) nmp, (void *) mp,
+		   sizeof(ErtsMessage) + (sz - 1)*sizeof(Eterm));
+    }
+
     if (nmp != mp) {
 	Eterm *sp = &mp->hfrag.mem[0];
 	Eterm *ep = sp + sz;
@@ -242,6 +290,8 @@ erts_realloc_shrink_message(ErtsMessage *mp, Uint sz, Eterm *brefs, Uint brefs_s
 	erts_offset_heap(&nmp->hfrag.mem[0], sz, offs, sp, ep);
 	if (brefs && brefs_size)
 	    erts_offset_heap_ptr(brefs, brefs_size, offs, sp, ep);
+	if (sz <= ERTS_SMALL_FIX_MSG_SZ)
+	    erts_free(ERTS_ALC_T_MSG, mp);
     }
 
     nmp->hfrag.used_size = sz;
@@ -381,10 +431,12 @@ queue_messages(Process* receiver,
 {
     ErtsTracingEvent* te;
     Sint res;
+    Uint i;
     int locked_msgq = 0;
+    int traced = IS_TRACED_FL(receiver, F_TRACE_RECEIVE);
     erts_aint32_t state;
 
-    ASSERT(is_value(ERL_MESSAGE_TERM(first)));
+    ASSERT(is_value(ERL_MESSAGE_TERM(first)) || ERTS_MSG_IS_SHARED(first));
     ASSERT(ERL_MESSAGE_TOKEN(first) == am_undefined ||
            ERL_MESSAGE_TOKEN(first) == NIL ||
            is_tuple(ERL_MESSAGE_TOKEN(first)));
@@ -395,7 +447,15 @@ queue_messages(Process* receiver,
                        receiver_locks == erts_proc_lc_my_proc_locks(receiver));
 #endif
 
-    if (!(receiver_locks & ERTS_PROC_LOCK_MSGQ)) {
+    /*
+     * Messages are pushed onto the 'in queue' without locking. The
+     * message queue lock is only needed when we move the 'in queue'
+     * to the private queue, and when the receive trace has to look
+     * at the messages after they have been enqueued; the receiver
+     * fetches the 'in queue' under the same lock.
+     */
+    if (!(receiver_locks & ERTS_PROC_LOCK_MSGQ)
+        && ((receiver_locks & ERTS_PROC_LOCK_MAIN) || traced)) {
 	if (erts_smp_proc_trylock(receiver, ERTS_PROC_LOCK_MSGQ) == EBUSY) {
             ErtsProcLocks need_locks;
 
@@ -431,28 +491,7 @@ queue_messages(Process* receiver,
 	return 0;
     }
 
-    res = receiver->msg.len;
-#ifdef ERTS_SMP
-    if (receiver_locks & ERTS_PROC_LOCK_MAIN) {
-	/*
-	 * We move 'in queue' to 'private queue' and place
-	 * message at the end of 'private queue' in order
-	 * to ensure that the 'in queue' doesn't contain
-	 * references into the heap. By ensuring this,
-	 * we don't need to include the 'in queue' in
-	 * the root set when garbage collecting.
-	 */
-	res += receiver->msg_inq.len;
-	ERTS_SMP_MSGQ_MV_INQ2PRIVQ(receiver);
-        LINK_MESSAGE_PRIVQ(receiver, first, last, len);
-    }
-    else
-#endif
-    {
-	LINK_MESSAGE(receiver, first, last, len);
-    }
-
-    if (IS_TRACED_FL(receiver, F_TRACE_RECEIVE)
+    if (traced
         && (te = &erts_receive_tracing[erts_active_bp_ix()],
             te->on)) {
 
@@ -478,12 +517,51 @@ queue_messages(Process* receiver,
                     tok_label, tok_lastcnt, tok_serial);
         }
 #endif
-        while (msg) {
-            trace_receive(receiver, from, ERL_MESSAGE_TERM(msg), te);
+        /*
+         * Trace before linking; once pushed onto the 'in queue' the
+         * chain may have been relinked newest first and joined with
+         * messages already there.
+         */
+        for (i = 0; i < len; i++) {
+            Eterm term = ERL_MESSAGE_TERM(msg);
+            /* The receiver cannot release a shared payload while we
+               hold the message queue lock (or its main lock) */
+            if (is_non_value(term))
+                term = ERTS_MSG_SHARED_PAYLOAD(msg)->term;
+            trace_receive(receiver, from, term, te);
             msg = msg->next;
         }
 
     }
+
+    res = receiver->msg.len;
+#ifdef ERTS_SMP
+    if (receiver_locks & ERTS_PROC_LOCK_MAIN) {
+	/*
+	 * We move 'in queue' to 'private queue' and place
+	 * message at the end of 'private queue' in order
+	 * to ensure that the 'in queue' doesn't contain
+	 * references into the heap. By ensuring this,
+	 * we don't need to include the 'in queue' in
+	 * the root set when garbage collecting.
+	 */
+	res += erts_msg_inq_len(&receiver->msg_inq);
+	ERTS_SMP_MSGQ_MV_INQ2PRIVQ(receiver);
+        LINK_MESSAGE_PRIVQ(receiver, first, last, len);
+    }
+    else {
+	res += erts_msg_inq_len(&receiver->msg_inq);
+	if (!LINK_MESSAGE(receiver, first, last, len)) {
+	    /* Receiver closed its 'in queue' while exiting */
+	    if (locked_msgq)
+		erts_smp_proc_unlock(receiver, ERTS_PROC_LOCK_MSGQ);
+	    return 0;
+	}
+    }
+#else
+    LINK_MESSAGE(receiver, first, last, len);
+#endif
+
     if (locked_msgq) {
 	erts_smp_proc_unlock(receiver, ERTS_PROC_LOCK_MSGQ);
     }
@@ -669,6 +747,202 @@ erts_try_alloc_message_on_heap(Process *pp,
     return mp;
 }
 
+/*
+ * Message queue length limit.
+ *
+ * A process can limit the length of its message queue with
+ * process_flag(max_message_queue_len, ...). Sends from erlang:send/2,3
+ * and erlang:multi_send/2 compare the receiver's queue length with the
+ * limit before the message is copied. When the queue is full the
+ * message is dropped, the receiver is killed, or the sender is
+ * suspended until the receiver has made room, much as when sending to
+ * a busy port. The length is read without the receiver's locks, so the
+ * limit is not exact when there are several senders.
+ *
+ * Suspended senders are kept in the receiver's msgq_blocked list. A
+ * sender puts itself in the list and then checks the queue length
+ * again; the receiver removes a message and then looks at the list.
+ * The memory barriers on both sides make sure that at least one of
+ * them sees the other, so a sender is never left suspended on a queue
+ * that has room.
+ */
+
+#define ERTS_MSGQ_LIMIT_SEND	0
+#define ERTS_MSGQ_LIMIT_DROP	1
+#define ERTS_MSGQ_LIMIT_YIELD	2
+
+static ERTS_INLINE int
+msgq_full(Process *p)
+{
+    Uint max_len = MAX_MSGQ_LEN_GET(p);
+    Sint len;
+
+    if (!max_len)
+	return 0;
+    len = p->msg.len;
+#ifdef ERTS_SMP
+    len += erts_msg_inq_len(&p->msg_inq);
+#endif
+    return len >= (Sint) max_len;
+}
+
+static int
+msgq_limit(Process *sender, Process *receiver,
+	   ErtsProcLocks *receiver_locks, unsigned flags)
+{
+    if (sender == receiver || !msgq_full(receiver))
+	return ERTS_MSGQ_LIMIT_SEND;
+
+    switch (MAX_MSGQ_LEN_ACTION_GET(receiver)) {
+    case MAX_MSGQ_LEN_SUSPEND:
+	if (flags & ERTS_SND_FLG_MSGQ_SUSPEND)
+	    return ERTS_MSGQ_LIMIT_YIELD;
+	break;
+    case MAX_MSGQ_LEN_KILL:
+#ifdef ERTS_SMP
+	if (!(*receiver_locks & ERTS_PROC_LOCKS_XSIG_SEND)) {
+	    erts_smp_proc_lock(receiver, ERTS_PROC_LOCKS_XSIG_SEND);
+	    *receiver_locks |= ERTS_PROC_LOCKS_XSIG_SEND;
+	}
+#endif
+	erts_send_exit_signal(sender, sender->common.id, receiver,
+			      receiver_locks, am_kill, NIL, NULL, 0);
+	break;
+    default:
+	break;
+    }
+    return ERTS_MSGQ_LIMIT_DROP;
+}
+
+/*
+ * Suspend the current process, which found the message queue of
+ * receiver full. The sender is suspended before it is put in the list
+ * of blocked senders, and resumes itself if the queue has room once it
+ * is there. Either way the send has to be retried after a yield.
+ */
+void
+erts_msgq_suspend_sender(Process *c_p, Process *receiver)
+{
+    ErtsProcList *plp = erts_proclist_create(c_p);
+    int resume;
+
+    erts_suspend(c_p, ERTS_PROC_LOCK_MAIN, NULL);
+
+    erts_smp_proc_lock(receiver, ERTS_PROC_LOCK_MSGQ);
+    erts_proclist_store_last(&receiver->msgq_blocked, plp);
+    ERTS_SMP_MEMORY_BARRIER;
+    resume = (MAX_MSGQ_LEN_ACTION_GET(receiver) != MAX_MSGQ_LEN_SUSPEND
+	      || !msgq_full(receiver)
+	      || (erts_smp_atomic32_read_nob(&receiver->state)
+		  & ERTS_PSFLG_EXITING));
+    if (resume)
+	erts_proclist_remove(&receiver->msgq_blocked, plp);
+    erts_smp_proc_unlock(receiver, ERTS_PROC_LOCK_MSGQ);
+
+    if (resume) {
+	erts_resume(c_p, ERTS_PROC_LOCK_MAIN);
+	erts_proclist_destroy(plp);
+    }
+}
+
+/*
+ * Resume the senders suspended on the message queue of c_p. Called
+ * when c_p has removed a message from its queue, in which case nothing
+ * is done unless the queue has room, and with force set when the limit
+ * is changed or c_p exits.
+ */
+void
+erts_msgq_resume_senders(Process *c_p, ErtsProcLocks c_p_locks, int force)
+{
+    ErtsProcList *plp;
+
+    if (!force) {
+	ERTS_SMP_MEMORY_BARRIER;
+	if (!c_p->msgq_blocked || msgq_full(c_p))
+	    return;
+    }
+
+    erts_smp_proc_lock(c_p, ERTS_PROC_LOCK_MSGQ);
+    plp = c_p->msgq_blocked;
+    c_p->msgq_blocked = NULL;
+    erts_smp_proc_unlock(c_p, ERTS_PROC_LOCK_MSGQ);
+
+    if (!erts_proclist_fetch(&plp, NULL))
+	return;
+
+    while (plp) {
+	ErtsProcList *fplp = plp;
+	Process *sp = erts_pid2proc(c_p, c_p_locks, plp->pid,
+				    ERTS_PROC_LOCK_STATUS);
+	if (sp) {
+	    if (erts_proclist_same(plp, sp))
+		erts_resume(sp, ERTS_PROC_LOCK_STATUS);
+	    erts_smp_proc_unlock(sp, ERTS_PROC_LOCK_STATUS);
+	}
+	plp = plp->next;
+	erts_proclist_destroy(fplp);
+    }
+}
+
+int
+erts_max_msgq_len(Eterm arg, Uint *len, Uint *action)
+{
+    Eterm len_term;
+
+    *action = MAX_MSGQ_LEN_DROP;
+    if (is_small(arg)) {
+	len_term = arg;
+    } else if (is_map(arg)) {
+	const Eterm *lenp = erts_maps_get(am_len, arg);
+	const Eterm *actionp = erts_maps_get(am_action, arg);
+	if (!lenp) {
+	    /* len is mandatory */
+	    return 0;
+	}
+	len_term = *lenp;
+	if (actionp) {
+	    switch (*actionp) {
+	    case am_drop:    *action = MAX_MSGQ_LEN_DROP; break;
+	    case am_kill:    *action = MAX_MSGQ_LEN_KILL; break;
+	    case am_suspend: *action = MAX_MSGQ_LEN_SUSPEND; break;
+	    default:         return 0;
+	    }
+	}
+    } else
+	return 0;
+    if (!is_small(len_term) || signed_val(len_term) < 0)
+	return 0;
+    *len = signed_val(len_term);
+    return 1;
+}
+
+Eterm
+erts_max_msgq_len_map(Uint len, Uint action, Eterm **hpp, Uint *sz)
+{
+    if (!hpp) {
+	*sz += (3 + 2 + MAP_HEADER_FLATMAP_SZ);
+	return THE_NON_VALUE;
+    } else {
+	Eterm *hp = *hpp;
+	Eterm keys = TUPLE2(hp, am_action, am_len);
+	flatmap_t *mp;
+	hp += 3;
+	mp = (flatmap_t*) hp;
+	mp->thing_word = MAP_HEADER_FLATMAP;
+	mp->size = 2;
+	mp->keys = keys;
+	hp += MAP_HEADER_FLATMAP_SZ;
+	switch (action) {
+	case MAX_MSGQ_LEN_KILL:    *hp++ = am_kill; break;
+	case MAX_MSGQ_LEN_SUSPEND: *hp++ = am_suspend; break;
+	default:                   *hp++ = am_drop; break;
+	}
+	*hp++ = make_small(len);
+	*hpp = hp;
+	return make_flatmap(mp);
+    }
+}
+
 /*
  * Send a local message when sender & receiver processes are known.
  */
@@ -708,6 +982,17 @@ erts_send_message(Process* sender,
     }
 #endif
 
+    if (flags & ERTS_SND_FLG_MSGQ_LIMIT) {
+	switch (msgq_limit(sender, receiver, receiver_locks, flags)) {
+	case ERTS_MSGQ_LIMIT_DROP:
+	    return 0;
+	case ERTS_MSGQ_LIMIT_YIELD:
+	    return ERTS_SEND_MSGQ_FULL;
+	default:
+	    break;
+	}
+    }
+
     receiver_state = erts_smp_atomic32_read_nob(&receiver->state);
 
     if (SEQ_TRACE_TOKEN(sender) != NIL && !(flags & ERTS_SND_FLG_NO_SEQ_TRACE)) {
@@ -760,7 +1045,7 @@ erts_send_message(Process* sender,
         DESTROY_SHCOPY(info);
 #else
 	if (is_not_immed(message))
-            message = copy_struct(message, msize, &hp, ohp);
+            message = copy_struct_send(message, msize, &hp, ohp);
 #endif
 	if (is_immed(stoken))
 	    token = stoken;
@@ -795,22 +1080,47 @@ erts_send_message(Process* sender,
 #ifdef SHCOPY_SEND
             INITIALIZE_SHCOPY(info);
             msize = copy_shared_calculate(message, &info);
-#else
-            msize = size_object(message);
-#endif
 	    mp = erts_alloc_message_heap_state(receiver,
 					       &receiver_state,
 					       receiver_locks,
 					       msize,
 					       &hp,
 					       &ohp);
-#ifdef SHCOPY_SEND
             if (is_not_immed(message))
                 message = copy_shared_perform(message, msize, &info, &hp, ohp);
             DESTROY_SHCOPY(info);
 #else
-            if (is_not_immed(message))
-                message = copy_struct(message, msize, &hp, ohp);
+            Uint limit = (erts_send_single_pass
+                          ? ERTS_COPY_FLAT_LIMIT
+                          : ~((Uint) 0));
+            msize = size_object_x(message, limit);
+            if (msize > limit) {
+                ErtsHeapFactory factory;
+                /* msize is a lower bound of the size of the message */
+                mp = erts_factory_message_create(&factory,
+                                                 receiver,
+                                                 receiver_locks,
+                                                 msize);
+                if (erts_preserve_sharing)
+                    message = copy_shared_factory(message, &factory,
+                                                  ERTS_COPY_COMPACT_BINS);
+                else
+                    message = copy_struct_factory(message, &factory,
+                                                  ERTS_COPY_COMPACT_BINS);
+                erts_factory_trim_and_close(&factory, &message, 1);
+                mp = factory.message;
+                receiver_state = erts_smp_atomic32_read_nob(&receiver->state);
+            }
+            else {
+                mp = erts_alloc_message_heap_state(receiver,
+                                                   &receiver_state,
+                                                   receiver_locks,
+                                                   msize,
+                                                   &hp,
+                                                   &ohp);
+                if (is_not_immed(message))
+                    message = copy_struct_send(message, msize, &hp, ohp);
+            }
 #endif
 	}
 #ifdef USE_VM_PROBES
@@ -833,6 +1143,95 @@ erts_send_message(Process* sender,
 }
 
 
+/*
+ * Copy a message into a payload that can be shared by the messages
+ * of several receivers. Returns NULL if the message is not worth
+ * sharing, or holds external identifiers that would have to be
+ * accounted for in the node tables. As with other sends, a large
+ * message is copied preserving sharing, and is then also copied
+ * preserving sharing onto the heap of each receiver.
+ */
+
+ErtsSharedMsgPayload *
+erts_create_shared_msg_payload(Eterm msg)
+{
+    ErtsSharedMsgPayload *pl;
+    struct erl_off_heap_header *ohh;
+    ErlHeapFragment *frags = NULL;
+    Eterm *hp;
+    Uint sz;
+
+    if (is_immed(msg))
+	return NULL;
+
+    sz = size_object_x(msg, ERTS_COPY_SHARED_LIMIT());
+    if (sz > ERTS_COPY_SHARED_LIMIT())
+	frags = erts_copy_shared_to_frags(&msg, sz, &sz,
+					  ERTS_COPY_COMPACT_BINS);
+    pl = erts_alloc(ERTS_ALC_T_SHARED_MSG,
+		    sizeof(ErtsSharedMsgPayload) + (sz - 1)*sizeof(Eterm));
+    erts_refc_init(&pl->refc, 1);
+    ERTS_INIT_OFF_HEAP(&pl->off_heap);
+    hp = &pl->heap[0];
+    if (frags) {
+	pl->term = msg;
+	erts_move_multi_frags(&hp, &pl->off_heap, frags, &pl->term, 1, 0);
+	free_message_buffer(frags);
+    }
+    else
+	pl->term = copy_struct_send(msg, sz, &hp, &pl->off_heap);
+    pl->size = sz;
+    pl->shared = !!frags;
+
+    for (ohh = pl->off_heap.first; ohh; ohh = ohh->next) {
+	if (is_external_header(ohh->thing_word)) {
+	    erts_release_shared_msg_payload(pl);
+	    return NULL;
+	}
+    }
+
+    return pl;
+}
+
+void
+erts_release_shared_msg_payload(ErtsSharedMsgPayload *pl)
+{
+    if (erts_refc_dectest(&pl->refc, 0) == 0) {
+	erts_cleanup_offheap(&pl->off_heap);
+	erts_free(ERTS_ALC_T_SHARED_MSG, (void *) pl);
+    }
+}
+
+/*
+ * Send a message referring to a shared payload. The payload is
+ * copied onto the heap of the receiver by erts_decode_dist_message()
+ * when the receiver first looks at the message. The receiver's
+ * message queue limit applies, but the sender never yields; the
+ * message is dropped instead.
+ */
+
+Sint
+erts_send_shared_message(Process *sender,
+			 Process *receiver,
+			 ErtsProcLocks *receiver_locks,
+			 ErtsSharedMsgPayload *pl)
+{
+    ErtsMessage *mp;
+
+    ASSERT(SEQ_TRACE_TOKEN(sender) == NIL);
+
+    if (msgq_limit(sender, receiver, receiver_locks,
+		   ERTS_SND_FLG_MSGQ_LIMIT) != ERTS_MSGQ_LIMIT_SEND)
+	return 0;
+
+    mp = erts_alloc_message(0, NULL);
+    erts_refc_inc(&pl->refc, 2);
+    mp->data.attached = (void *) (((UWord) pl) | ERTS_MSG_SHARED_TAG);
+
+    return queue_messages(receiver, NULL, *receiver_locks,
+			  mp, &mp->next, 1, sender->common.id);
+}
+
 /*
  * This function delivers an EXIT message to a process
  * which is trapping EXITs.
@@ -1195,6 +1594,28 @@ erts_decode_dist_message(Process *proc, ErtsProcLocks proc_locks,
 			   || !(proc_locks & ERTS_PROC_LOCK_MAIN)
 			   || (proc->flags & F_OFF_HEAP_MSGQ));
 
+    if (ERTS_MSG_IS_SHARED(msgp)) {
+	ErtsSharedMsgPayload *pl = ERTS_MSG_SHARED_PAYLOAD(msgp);
+
+	if (decode_in_heap_frag)
+	    erts_factory_heap_frag_init(&factory, new_message_buffer(pl->size));
+	else
+	    erts_factory_proc_prealloc_init(&factory, proc, pl->size);
+
+	if (pl->shared)
+	    ERL_MESSAGE_TERM(msgp) = copy_shared_factory(pl->term, &factory, 0);
+	else
+	    ERL_MESSAGE_TERM(msgp) = copy_struct(pl->term, pl->size,
+						 &factory.hp, factory.off_heap);
+	erts_factory_close(&factory);
+	msgp->data.attached = NULL;
+	if (decode_in_heap_frag)
+	    msgp->data.heap_frag = factory.heap_frags;
+
+	erts_release_shared_msg_payload(pl);
+	return 1;
+    }
+
     if (msgp->data.dist_ext->heap_size >= 0)
 	need = msgp->data.dist_ext->heap_size;
     else {
@@ -1388,6 +1809,435 @@ erts_prep_msgq_for_inspection(Process *c_p, Process *rp,
     return tot_heap_size;
 }
 
+/*
+ * Message queue index.
+ *
+ * A receive whose clauses all compare a certain reference with the
+ * message, or with one of its first ERTS_MSGQ_INDEX_TUPLE_ELEMS tuple
+ * elements, is marked by the compiler (recv_index) and executed by
+ * i_loop_rec_index. When the private queue is long, such a receive
+ * looks up the messages containing the reference in an index instead
+ * of scanning the whole queue from the save pointer.
+ *
+ * The index covers the queue up to 'end' and is extended lazily by
+ * the next indexed receive. Messages are numbered ('seq') in queue
+ * order as they are indexed. Each entry records the link pointing to
+ * its message, and entries of the same key are kept in seq order.
+ * 'cursor_save' is a link in the queue whose following messages all
+ * have a seq of at least 'cursor_seq', and all preceding ones a lower
+ * one; it lets a receive continue after a candidate that did not
+ * match. Every change of a link in the queue is reported through
+ * UNLINK_MESSAGE(), erts_msgq_update_internal_pointers() and
+ * erts_msgq_replace_msg_ref().
+ *
+ * Only the process itself, holding its main lock, touches the index.
+ */
+
+int erts_msgq_index_enabled = 1;
+
+typedef struct {
+    Uint32 hval;
+    Uint32 len;
+    Uint32 num[ERTS_MAX_REF_NUMBERS];
+} ErtsMsgQIndexKey;
+
+typedef struct ErtsMsgQIndexEntry_ ErtsMsgQIndexEntry;
+struct ErtsMsgQIndexEntry_ {
+    ErtsMsgQIndexEntry *key_next;	/* In key bucket, ascending seq */
+    ErtsMsgQIndexEntry *msg_next;	/* In message bucket */
+    ErtsMessage *msgp;
+    ErtsMessage **prevp;		/* Link pointing to msgp */
+    Uint seq;
+    ErtsMsgQIndexKey key;
+};
+
+#define ERTS_MSGQ_INDEX_INIT_SIZE 256
+#define ERTS_MSGQ_INDEX_CHUNK_ENTRIES 128
+
+typedef struct ErtsMsgQIndexChunk_ ErtsMsgQIndexChunk;
+struct ErtsMsgQIndexChunk_ {
+    ErtsMsgQIndexChunk *next;
+    ErtsMsgQIndexEntry entry[ERTS_MSGQ_INDEX_CHUNK_ENTRIES];
+};
+
+struct ErtsMsgQIndex_ {
+    Uint size;				/* Buckets per table; power of 2 */
+    Uint entries;
+    ErtsMsgQIndexEntry **key_head;
+    ErtsMsgQIndexEntry **key_tail;
+    ErtsMsgQIndexEntry **msg_head;
+    ErtsMsgQIndexEntry *free;
+    ErtsMsgQIndexChunk *chunks;
+    ErtsMessage **end;			/* Link to first message not indexed */
+    Uint next_seq;
+    ErtsMessage **cursor_save;		/* Link to first message with seq... */
+    Uint cursor_seq;			/* ...at least cursor_seq */
+};
+
+#define MSGQ_INDEX_KEY_IX(IDX, KP) ((KP)->hval & ((IDX)->size - 1))
+#define MSGQ_INDEX_MSG_IX(IDX, MP)					\
+    ((((UWord) (MP)) >> 4 ^ ((UWord) (MP)) >> 12) & ((IDX)->size - 1))
+
+static ERTS_INLINE void
+msgq_index_make_key(Eterm ref, ErtsMsgQIndexKey *kp)
+{
+    Uint32 *num = internal_ref_numbers(ref);
+    Uint32 len = (Uint32) internal_ref_no_of_numbers(ref);
+    Uint32 hval = len;
+    int i;
+
+    ASSERT(len <= ERTS_MAX_REF_NUMBERS);
+    kp->len = len;
+    for (i = 0; i < ERTS_MAX_REF_NUMBERS; i++) {
+	kp->num[i] = i < len ? num[i] : 0;
+	hval = hval * 268440163 + kp->num[i];
+    }
+    kp->hval = hval ^ (hval >> 15);
+}
+
+static ERTS_INLINE int
+msgq_index_key_eq(ErtsMsgQIndexKey *k1, ErtsMsgQIndexKey *k2)
+{
+    return (k1->hval == k2->hval
+	    && k1->len == k2->len
+	    && sys_memcmp((void *) k1->num, (void *) k2->num,
+			  sizeof(k1->num)) == 0);
+}
+
+static void
+msgq_index_alloc_tables(ErtsMsgQIndex *idx, Uint size)
+{
+    ErtsMsgQIndexEntry **tabs;
+    Uint i;
+    tabs = erts_alloc(ERTS_ALC_T_MSGQ_INDEX,
+		      3*size*sizeof(ErtsMsgQIndexEntry *));
+    for (i = 0; i < 3*size; i++)
+	tabs[i] = NULL;
+    idx->size = size;
+    idx->key_head = tabs;
+    idx->key_tail = tabs + size;
+    idx->msg_head = tabs + 2*size;
+}
+
+static void
+msgq_index_grow(ErtsMsgQIndex *idx)
+{
+    ErtsMsgQIndexEntry **old_key_head = idx->key_head;
+    Uint i, old_size = idx->size;
+
+    msgq_index_alloc_tables(idx, 2*old_size);
+
+    /*
+     * An old key bucket is split in two new ones; appending in
+     * chain order keeps each new chain in ascending seq order.
+     */
+    for (i = 0; i < old_size; i++) {
+	ErtsMsgQIndexEntry *ep = old_key_head[i];
+	while (ep) {
+	    ErtsMsgQIndexEntry *next = ep->key_next;
+	    Uint kix = MSGQ_INDEX_KEY_IX(idx, &ep->key);
+	    Uint mix = MSGQ_INDEX_MSG_IX(idx, ep->msgp);
+	    ep->key_next = NULL;
+	    if (idx->key_tail[kix])
+		idx->key_tail[kix]->key_next = ep;
+	    else
+		idx->key_head[kix] = ep;
+	    idx->key_tail[kix] = ep;
+	    ep->msg_next = idx->msg_head[mix];
+	    idx->msg_head[mix] = ep;
+	    ep = next;
+	}
+    }
+
+    erts_free(ERTS_ALC_T_MSGQ_INDEX, old_key_head);
+}
+
+static void
+msgq_index_insert(ErtsMsgQIndex *idx, ErtsMessage *mp, ErtsMessage **mpp,
+		  Eterm ref)
+{
+    ErtsMsgQIndexEntry *ep;
+    Uint kix, mix;
+
+    if (!idx->free) {
+	ErtsMsgQIndexChunk *cp;
+	int i;
+	cp = erts_alloc(ERTS_ALC_T_MSGQ_INDEX, sizeof(ErtsMsgQIndexChunk));
+	cp->next = idx->chunks;
+	idx->chunks = cp;
+	for (i = ERTS_MSGQ_INDEX_CHUNK_ENTRIES - 1; i >= 0; i--) {
+	    cp->entry[i].key_next = idx->free;
+	    idx->free = &cp->entry[i];
+	}
+    }
+
+    if (++idx->entries > idx->size)
+	msgq_index_grow(idx);
+
+    ep = idx->free;
+    idx->free = ep->key_next;
+
+    msgq_index_make_key(ref, &ep->key);
+    ep->msgp = mp;
+    ep->prevp = mpp;
+    ep->seq = idx->next_seq;
+
+    /* Messages are indexed in queue order; append to the key bucket */
+    kix = MSGQ_INDEX_KEY_IX(idx, &ep->key);
+    ep->key_next = NULL;
+    if (idx->key_tail[kix])
+	idx->key_tail[kix]->key_next = ep;
+    else
+	idx->key_head[kix] = ep;
+    idx->key_tail[kix] = ep;
+
+    mix = MSGQ_INDEX_MSG_IX(idx, mp);
+    ep->msg_next = idx->msg_head[mix];
+    idx->msg_head[mix] = ep;
+}
+
+static void
+msgq_index_remove_from_key_bucket(ErtsMsgQIndex *idx, ErtsMsgQIndexEntry *ep)
+{
+    Uint kix = MSGQ_INDEX_KEY_IX(idx, &ep->key);
+    ErtsMsgQIndexEntry *prev = NULL, *tmp = idx->key_head[kix];
+
+    while (tmp != ep) {
+	ASSERT(tmp);
+	prev = tmp;
+	tmp = tmp->key_next;
+    }
+    if (prev)
+	prev->key_next = ep->key_next;
+    else
+	idx->key_head[kix] = ep->key_next;
+    if (idx->key_tail[kix] == ep)
+	idx->key_tail[kix] = prev;
+}
+
+static ERTS_INLINE void
+msgq_index_move_entries(ErtsMsgQIndex *idx, ErtsMessage *mp,
+			ErtsMessage **newpp, ErtsMessage **oldpp)
+{
+    ErtsMsgQIndexEntry *ep = idx->msg_head[MSGQ_INDEX_MSG_IX(idx, mp)];
+    for (; ep; ep = ep->msg_next) {
+	if (ep->msgp == mp && ep->prevp == oldpp)
+	    ep->prevp = newpp;
+    }
+}
+
+static void
+msgq_index_extend(Process *c_p, ErtsMsgQIndex *idx)
+{
+    ErtsMessage **mpp = idx->end;
+    ErtsMessage *mp;
+
+    while ((mp = *mpp) != NULL) {
+	Eterm msg = ERL_MESSAGE_TERM(mp);
+
+	if (is_non_value(msg)) {
+	    if (!erts_decode_dist_message(c_p, ERTS_PROC_LOCK_MAIN, mp, 0)) {
+		/*
+		 * Bad distribution message; remove it from the
+		 * queue as loop_rec would have...
+		 */
+		ErtsMessage **save = c_p->msg.save;
+		if (save == &mp->next)
+		    save = mpp;
+		c_p->msg.save = mpp;
+		UNLINK_MESSAGE(c_p, mp);
+		c_p->msg.save = save;
+		mp->next = NULL;
+		erts_cleanup_messages(mp);
+		continue;
+	    }
+	    msg = ERL_MESSAGE_TERM(mp);
+	}
+
+	if (is_internal_ref(msg))
+	    msgq_index_insert(idx, mp, mpp, msg);
+	else if (is_tuple(msg)) {
+	    Eterm *tp = tuple_val(msg);
+	    Uint i, arity = arityval(*tp);
+	    if (arity > ERTS_MSGQ_INDEX_TUPLE_ELEMS)
+		arity = ERTS_MSGQ_INDEX_TUPLE_ELEMS;
+	    for (i = 1; i <= arity; i++) {
+		if (is_internal_ref(tp[i]))
+		    msgq_index_insert(idx, mp, mpp, tp[i]);
+	    }
+	}
+
+	idx->next_seq++;
+	mpp = &mp->next;
+    }
+
+    idx->end = mpp;
+}
+
+/*
+ * Return the next message at or after the save pointer that may
+ * match a receive only accepting messages containing the reference
+ * 'key', or NULL if there is none. On return the save pointer points
+ * to the link to the returned message, or is the last pointer of the
+ * queue.
+ */
+ErtsMessage *
+erts_msgq_index_next(Process *c_p, Eterm key)
+{
+    ErlMessageQueue *msgq = &c_p->msg;
+    ErtsMsgQIndex *idx = msgq->index;
+    ErtsMsgQIndexKey k;
+    ErtsMsgQIndexEntry *ep;
+
+    ERTS_SMP_LC_ASSERT(ERTS_PROC_LOCK_MAIN & erts_proc_lc_my_proc_locks(c_p));
+
+    if (idx && (!erts_msgq_index_enabled
+		|| msgq->len < ERTS_MSGQ_INDEX_MIN_LEN/4)) {
+	erts_msgq_index_destroy(msgq);
+	idx = NULL;
+    }
+
+    if (!is_internal_ref(key)
+	|| (!idx && (!erts_msgq_index_enabled
+		     || msgq->len < ERTS_MSGQ_INDEX_MIN_LEN)))
+	return *msgq->save;
+
+    if (msgq->save != &msgq->first
+	&& (!idx || msgq->save != idx->cursor_save)) {
+	/*
+	 * The save pointer has been moved by other means than this
+	 * function (recv_set) and we cannot tell which messages
+	 * before it have been examined; scan plainly.
+	 */
+	return *msgq->save;
+    }
+
+    if (!idx) {
+	idx = erts_alloc(ERTS_ALC_T_MSGQ_INDEX, sizeof(ErtsMsgQIndex));
+	msgq_index_alloc_tables(idx, ERTS_MSGQ_INDEX_INIT_SIZE);
+	idx->entries = 0;
+	idx->free = NULL;
+	idx->chunks = NULL;
+	idx->end = &msgq->first;
+	idx->next_seq = 0;
+	idx->cursor_save = NULL;
+	msgq->index = idx;
+    }
+
+    if (msgq->save != idx->cursor_save) {
+	idx->cursor_save = &msgq->first;
+	idx->cursor_seq = 0;
+    }
+
+    msgq_index_make_key(key, &k);
+    msgq_index_extend(c_p, idx);
+
+    for (ep = idx->key_head[MSGQ_INDEX_KEY_IX(idx, &k)]; ep; ep = ep->key_next) {
+	if (ep->seq >= idx->cursor_seq && msgq_index_key_eq(&ep->key, &k))
+	    break;
+    }
+
+    if (!ep) {
+	msgq->save = msgq->last;
+	idx->cursor_save = msgq->last;
+	idx->cursor_seq = idx->next_seq;
+	return NULL;
+    }
+
+    ASSERT(*ep->prevp == ep->msgp);
+    msgq->save = ep->prevp;
+    idx->cursor_save = &ep->msgp->next;
+    idx->cursor_seq = ep->seq + 1;
+    return ep->msgp;
+}
+
+void
+erts_msgq_index_unlink(ErlMessageQueue *msgq, ErtsMessage *mp)
+{
+    ErtsMsgQIndex *idx = msgq->index;
+    ErtsMessage **savep = msgq->save;
+    ErtsMsgQIndexEntry **epp;
+
+    ASSERT(*savep == mp);
+
+    epp = &idx->msg_head[MSGQ_INDEX_MSG_IX(idx, mp)];
+    while (*epp) {
+	ErtsMsgQIndexEntry *ep = *epp;
+	if (ep->msgp != mp)
+	    epp = &ep->msg_next;
+	else {
+	    *epp = ep->msg_next;
+	    msgq_index_remove_from_key_bucket(idx, ep);
+	    ep->key_next = idx->free;
+	    idx->free = ep;
+	    idx->entries--;
+	}
+    }
+
+    if (mp->next)
+	msgq_index_move_entries(idx, mp->next, savep, &mp->next);
+    if (idx->end == &mp->next)
+	idx->end = savep;
+    if (idx->cursor_save == &mp->next)
+	idx->cursor_save = NULL;
+}
+
+void
+erts_msgq_index_move_link(ErtsMsgQIndex *idx, ErtsMessage **newpp,
+			  ErtsMessage **oldpp)
+{
+    if (*oldpp)
+	msgq_index_move_entries(idx, *oldpp, newpp, oldpp);
+    if (idx->end == oldpp)
+	idx->end = newpp;
+    if (idx->cursor_save == oldpp)
+	idx->cursor_save = newpp;
+}
+
+void
+erts_msgq_index_replace(ErtsMsgQIndex *idx, ErtsMessage *newp,
+			ErtsMessage *oldp)
+{
+    ErtsMsgQIndexEntry **epp, *moved = NULL;
+
+    epp = &idx->msg_head[MSGQ_INDEX_MSG_IX(idx, oldp)];
+    while (*epp) {
+	ErtsMsgQIndexEntry *ep = *epp;
+	if (ep->msgp != oldp)
+	    epp = &ep->msg_next;
+	else {
+	    *epp = ep->msg_next;
+	    ep->msgp = newp;
+	    ep->msg_next = moved;
+	    moved = ep;
+	}
+    }
+
+    while (moved) {
+	ErtsMsgQIndexEntry *ep = moved;
+	Uint mix = MSGQ_INDEX_MSG_IX(idx, newp);
+	moved = ep->msg_next;
+	ep->msg_next = idx->msg_head[mix];
+	idx->msg_head[mix] = ep;
+    }
+}
+
+void
+erts_msgq_index_destroy(ErlMessageQueue *msgq)
+{
+    ErtsMsgQIndex *idx = msgq->index;
+    ErtsMsgQIndexChunk *cp = idx->chunks;
+
+    while (cp) {
+	ErtsMsgQIndexChunk *next = cp->next;
+	erts_free(ERTS_ALC_T_MSGQ_INDEX, cp);
+	cp = next;
+    }
+    erts_free(ERTS_ALC_T_MSGQ_INDEX, idx->key_head);
+    erts_free(ERTS_ALC_T_MSGQ_INDEX, idx);
+    msgq->index = NULL;
+}
+
 void erts_factory_proc_init(ErtsHeapFactory* factory,
 			    Process* p)
 {
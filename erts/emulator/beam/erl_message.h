@@ -160,6 +160,9 @@ struct erl_mesg {
 /* Size of default message buffer (erl_message.c) */
 #define ERL_MESSAGE_BUF_SZ 500
 
+/* Index of references in the private queue (erl_message.c) */
+typedef struct ErtsMsgQIndex_ ErtsMsgQIndex;
+
 typedef struct {
     ErtsMessage* first;
     ErtsMessage** last;  /* point to the last next pointer */
@@ -172,16 +175,30 @@ typedef struct {
      */
     BeamInstr* mark;		/* address to rec_loop/2 instruction */
     ErtsMessage** saved_last;	/* saved last pointer */
+
+    /*
+     * Built by indexed receives (i_loop_rec_index) when the queue
+     * grows long; NULL otherwise.
+     */
+    ErtsMsgQIndex *index;
 } ErlMessageQueue;
 
 #ifdef ERTS_SMP
 
+/*
+ * The 'in queue' is a lock-free stack of messages, newest first.
+ * Senders push onto it without taking any process lock. The
+ * receiver fetches the whole stack at once while holding the
+ * message queue lock, and reverses it into arrival order. An
+ * exiting process closes the queue, after which pushes fail.
+ */
 typedef struct {
-    ErtsMessage* first;
-    ErtsMessage** last;  /* point to the last next pointer */
-    Sint len;            /* queue length */
+    erts_smp_atomic_t head;  /* ErtsMessage *, newest first */
+    erts_smp_atomic_t len;   /* approximate queue length */
 } ErlMessageInQueue;
 
+#define ERTS_MSG_INQ_CLOSED ((erts_aint_t) 1)
+
 typedef struct erl_trace_message_queue__ {
     struct erl_trace_message_queue__ *next; /* point to the next receiver */
     Eterm receiver;
@@ -215,21 +232,20 @@ typedef struct erl_trace_message_queue__ {
         LINK_MESSAGE_IMPL(p, first_msg, last_msg, len, msg);            \
     } while (0)
 
-/* Add message last_msg in message queue */
-#define LINK_MESSAGE(p, first_msg, last_msg, len)       \
-    LINK_MESSAGE_IMPL(p, first_msg, last_msg, len, msg_inq)
+/*
+ * Add messages last in 'in queue'. Returns zero, and frees the
+ * messages, if the queue has been closed.
+ */
+#define LINK_MESSAGE(p, first_msg, last_msg, len)                       \
+    erts_msg_inq_push(&(p)->msg_inq, first_msg, last_msg, len)
 
-#define ERTS_SMP_MSGQ_MV_INQ2PRIVQ(p)                   \
-    do {                                                \
-        if (p->msg_inq.first) {                         \
-            *p->msg.last = p->msg_inq.first;            \
-            p->msg.last = p->msg_inq.last;              \
-            p->msg.len += p->msg_inq.len;               \
-            p->msg_inq.first = NULL;                    \
-            p->msg_inq.last = &p->msg_inq.first;        \
-            p->msg_inq.len = 0;                         \
-        }                                               \
-    } while (0)
+/* Move 'in queue' last in private message queue (msgq lock held) */
+#define ERTS_SMP_MSGQ_MV_INQ2PRIVQ(p)                                   \
+    ((void) erts_msg_inq_fetch(&(p)->msg_inq, &(p)->msg, 0))
+
+/* As above and refuse further messages (all locks held when exiting) */
+#define ERTS_SMP_MSGQ_CLOSE_INQ2PRIVQ(p)                                \
+    ((void) erts_msg_inq_fetch(&(p)->msg_inq, &(p)->msg, 1))
 
 #else
 
@@ -246,6 +262,8 @@ typedef struct erl_trace_message_queue__ {
 /* Unlink current message */
 #define UNLINK_MESSAGE(p,msgp) do { \
      ErtsMessage* __mp = (msgp)->next; \
+     if ((p)->msg.index) \
+         erts_msgq_index_unlink(&(p)->msg, (msgp)); \
      *(p)->msg.save = __mp; \
      (p)->msg.len--; \
      if (__mp == NULL) \
@@ -262,6 +280,16 @@ typedef struct erl_trace_message_queue__ {
      (p)->msg.save = &(*(p)->msg.save)->next
 
 #define ERTS_SND_FLG_NO_SEQ_TRACE		(((unsigned) 1) << 0)
+/* Enforce the receiver's max_message_queue_len */
+#define ERTS_SND_FLG_MSGQ_LIMIT			(((unsigned) 1) << 1)
+/* The sender may yield and be suspended when the receiver's queue is full */
+#define ERTS_SND_FLG_MSGQ_SUSPEND		(((unsigned) 1) << 2)
+
+/*
+ * Returned by erts_send_message() when nothing was sent since the
+ * receiver's message queue is full and the sender should yield.
+ */
+#define ERTS_SEND_MSGQ_FULL			((Sint) -1)
 
 #define ERTS_HEAP_FRAG_SIZE(DATA_WORDS) \
    (sizeof(ErlHeapFragment) - sizeof(Eterm) + (DATA_WORDS)*sizeof(Eterm))
@@ -315,6 +343,32 @@ int erts_decode_dist_message(Process *, ErtsProcLocks, ErtsMessage *, int);
 
 void erts_cleanup_messages(ErtsMessage *mp);
 
+int erts_max_msgq_len(Eterm arg, Uint *len, Uint *action);
+void erts_msgq_suspend_sender(Process *c_p, Process *receiver);
+void erts_msgq_resume_senders(Process *c_p, ErtsProcLocks c_p_locks,
+			      int force);
+Eterm erts_max_msgq_len_map(Uint len, Uint action, Eterm **hpp, Uint *sz);
+
+/*
+ * Receives whose every clause compares a reference with the message
+ * or one of its first ERTS_MSGQ_INDEX_TUPLE_ELEMS tuple elements
+ * are marked by the compiler (recv_index), and look up candidate
+ * messages in an index keyed by the references in the messages.
+ */
+#define ERTS_MSGQ_INDEX_TUPLE_ELEMS 4
+/* Queue length from which an index is built */
+#define ERTS_MSGQ_INDEX_MIN_LEN 256
+
+extern int erts_msgq_index_enabled;
+
+ErtsMessage *erts_msgq_index_next(Process *c_p, Eterm key);
+void erts_msgq_index_unlink(ErlMessageQueue *msgq, ErtsMessage *mp);
+void erts_msgq_index_move_link(ErtsMsgQIndex *idx, ErtsMessage **newpp,
+			       ErtsMessage **oldpp);
+void erts_msgq_index_replace(ErtsMsgQIndex *idx, ErtsMessage *newp,
+			     ErtsMessage *oldp);
+void erts_msgq_index_destroy(ErlMessageQueue *msgq);
+
 typedef struct {
     Uint size;
     ErtsMessage *msgp;
@@ -328,10 +382,23 @@ Uint erts_prep_msgq_for_inspection(Process *c_p,
 void *erts_alloc_message_ref(void);
 void erts_free_message_ref(void *);
 
+extern int erts_send_single_pass;
+
+/*
+ * Messages with at most ERTS_SMALL_FIX_MSG_SZ words of heap in the
+ * message itself are allocated as fixed size blocks, preallocated
+ * per scheduler. They are recognized by the alloc_size of their
+ * heap fragment, which is never above ERTS_SMALL_FIX_MSG_SZ.
+ */
 #define ERTS_SMALL_FIX_MSG_SZ 10
 #define ERTS_MEDIUM_FIX_MSG_SZ 20
 #define ERTS_LARGE_FIX_MSG_SZ 30
 
+/* Number of small messages preallocated per scheduler (erl_message.c) */
+#define ERTS_SMALL_MSG_BUF_SZ 500
+
+extern int erts_small_message_pool;
+
 void *erts_alloc_small_message(void);
 void erts_free_small_message(void *mp);
 
@@ -372,9 +439,50 @@ ERTS_GLB_INLINE void erts_msgq_update_internal_pointers(ErlMessageQueue *msgq,
 ERTS_GLB_INLINE void erts_msgq_replace_msg_ref(ErlMessageQueue *msgq,
 					       ErtsMessage *newp,
 					       ErtsMessage **oldpp);
+#ifdef ERTS_SMP
+ERTS_GLB_INLINE void erts_msg_inq_init(ErlMessageInQueue *inq);
+ERTS_GLB_INLINE int erts_msg_inq_push(ErlMessageInQueue *inq,
+				      ErtsMessage *first,
+				      ErtsMessage **last,
+				      Sint len);
+ERTS_GLB_INLINE Sint erts_msg_inq_fetch(ErlMessageInQueue *inq,
+					ErlMessageQueue *privq,
+					int close);
+ERTS_GLB_INLINE ErtsMessage *erts_msg_inq_peek(ErlMessageInQueue *inq);
+ERTS_GLB_INLINE Sint erts_msg_inq_len(ErlMessageInQueue *inq);
+#endif
 
 #define ERTS_MSG_COMBINED_HFRAG ((void *) 0x1)
 
+/*
+ * Payload of erlang:multi_send/2, copied once and shared by the
+ * messages of all receivers. Such a message has no term until the
+ * receiver copies the payload onto its heap, which is done where
+ * distribution messages are decoded.
+ */
+typedef struct {
+    erts_refc_t refc;
+    ErlOffHeap off_heap;
+    Eterm term;
+    Uint size;
+    int shared;			/* Copied preserving sharing */
+    Eterm heap[1];
+} ErtsSharedMsgPayload;
+
+#define ERTS_MSG_SHARED_TAG ((UWord) 0x2)
+
+#define ERTS_MSG_IS_SHARED(MP) \
+    (((UWord) (MP)->data.attached) & ERTS_MSG_SHARED_TAG)
+#define ERTS_MSG_SHARED_PAYLOAD(MP) \
+    ((ErtsSharedMsgPayload *) (((UWord) (MP)->data.attached) \
+                               & ~ERTS_MSG_SHARED_TAG))
+
+ErtsSharedMsgPayload *erts_create_shared_msg_payload(Eterm msg);
+void erts_release_shared_msg_payload(ErtsSharedMsgPayload *pl);
+Sint erts_send_shared_message(Process *sender, Process *receiver,
+                              ErtsProcLocks *receiver_locks,
+                              ErtsSharedMsgPayload *pl);
+
 #define erts_message_to_heap_frag(MP)                   \
     (((MP)->data.attached == ERTS_MSG_COMBINED_HFRAG) ? \
         &(MP)->hfrag : (MP)->data.heap_frag)
@@ -393,8 +501,11 @@ ERTS_GLB_FORCE_INLINE ErtsMessage *erts_alloc_message(Uint sz, Eterm **hpp)
 	return mp;
     }
 
-    mp = erts_alloc(ERTS_ALC_T_MSG,
-		    sizeof(ErtsMessage) + (sz - 1)*sizeof(Eterm));
+    if (sz <= ERTS_SMALL_FIX_MSG_SZ)
+	mp = erts_alloc_small_message();
+    else
+	mp = erts_alloc(ERTS_ALC_T_MSG,
+			sizeof(ErtsMessage) + (sz - 1)*sizeof(Eterm));
 
     ERTS_INIT_MESSAGE(mp);
     mp->data.attached = ERTS_MSG_COMBINED_HFRAG;
@@ -422,14 +533,15 @@ erts_shrink_message(ErtsMessage *mp, Uint sz, Eterm *brefs, Uint brefs_size)
 		ASSERT(is_non_value(brefs[i]) || is_immed(brefs[i]));
 	}
 #endif
-	erts_free(ERTS_ALC_T_MSG, mp);
+	erts_free_message(mp);
 	return nmp;
     }
 
     ASSERT(mp->data.attached == ERTS_MSG_COMBINED_HFRAG);
     ASSERT(mp->hfrag.used_size >= sz);
 
-    if (sz >= (mp->hfrag.alloc_size - mp->hfrag.alloc_size / 16)) {
+    if (mp->hfrag.alloc_size <= ERTS_SMALL_FIX_MSG_SZ
+	|| sz >= (mp->hfrag.alloc_size - mp->hfrag.alloc_size / 16)) {
 	mp->hfrag.used_size = sz;
 	return mp;
     }
@@ -441,6 +553,8 @@ ERTS_GLB_FORCE_INLINE void erts_free_message(ErtsMessage *mp)
 {
     if (mp->data.attached != ERTS_MSG_COMBINED_HFRAG)
 	erts_free_message_ref(mp);
+    else if (mp->hfrag.alloc_size <= ERTS_SMALL_FIX_MSG_SZ)
+	erts_free_small_message(mp);
     else
 	erts_free(ERTS_ALC_T_MSG, mp);
 }
@@ -462,6 +576,8 @@ ERTS_GLB_INLINE Uint erts_msg_attached_data_size(ErtsMessage *msg)
         bp = erts_message_to_heap_frag(msg);
 	return erts_used_frag_sz(bp);
     }
+    else if (ERTS_MSG_IS_SHARED(msg))
+	return ERTS_MSG_SHARED_PAYLOAD(msg)->size;
     else if (msg->data.dist_ext->heap_size < 0)
 	return erts_msg_attached_data_size_aux(msg);
     else {
@@ -486,6 +602,8 @@ erts_msgq_update_internal_pointers(ErlMessageQueue *msgq,
 	msgq->last = newpp;
     if (msgq->saved_last == oldpp)
 	msgq->saved_last = newpp;
+    if (msgq->index)
+	erts_msgq_index_move_link(msgq->index, newpp, oldpp);
 }
 
 ERTS_GLB_INLINE void
@@ -494,9 +612,114 @@ erts_msgq_replace_msg_ref(ErlMessageQueue *msgq, ErtsMessage *newp, ErtsMessage
     ErtsMessage *oldp = *oldpp;
     newp->next = oldp->next;
     erts_msgq_update_internal_pointers(msgq, &newp->next, &oldp->next);
+    if (msgq->index)
+	erts_msgq_index_replace(msgq->index, newp, oldp);
     *oldpp = newp;
 }
 
+#ifdef ERTS_SMP
+
+ERTS_GLB_INLINE void
+erts_msg_inq_init(ErlMessageInQueue *inq)
+{
+    erts_smp_atomic_init_nob(&inq->head, (erts_aint_t) NULL);
+    erts_smp_atomic_init_nob(&inq->len, 0);
+}
+
+ERTS_GLB_INLINE int
+erts_msg_inq_push(ErlMessageInQueue *inq, ErtsMessage *first,
+		  ErtsMessage **last, Sint len)
+{
+    ErtsMessage *top, *bottom = first;
+    erts_aint_t head, exp;
+
+    ASSERT(*last == NULL);
+    if (len == 1)
+	top = first;
+    else {
+	/* The stack is newest first; reverse the chain */
+	ErtsMessage *mp = first;
+	top = NULL;
+	while (mp) {
+	    ErtsMessage *next = mp->next;
+	    mp->next = top;
+	    top = mp;
+	    mp = next;
+	}
+    }
+
+    head = erts_smp_atomic_read_nob(&inq->head);
+    do {
+	if (head == ERTS_MSG_INQ_CLOSED) {
+	    bottom->next = NULL;
+	    erts_cleanup_messages(top);
+	    return 0;
+	}
+	bottom->next = (ErtsMessage *) head;
+	exp = head;
+	head = erts_smp_atomic_cmpxchg_mb(&inq->head, (erts_aint_t) top, exp);
+    } while (head != exp);
+
+    erts_smp_atomic_add_nob(&inq->len, (erts_aint_t) len);
+    return 1;
+}
+
+ERTS_GLB_INLINE Sint
+erts_msg_inq_fetch(ErlMessageInQueue *inq, ErlMessageQueue *privq, int close)
+{
+    ErtsMessage *mp, *first, *last;
+    erts_aint_t head;
+    Sint len;
+
+    head = erts_smp_atomic_read_nob(&inq->head);
+    if (head == ERTS_MSG_INQ_CLOSED || (!head && !close))
+	return 0;
+    head = erts_smp_atomic_xchg_mb(&inq->head,
+				   close ? ERTS_MSG_INQ_CLOSED : (erts_aint_t) NULL);
+    ASSERT(head != ERTS_MSG_INQ_CLOSED);
+    if (!head)
+	return 0;
+
+    /* Reverse into arrival order */
+    mp = (ErtsMessage *) head;
+    last = mp;
+    first = NULL;
+    len = 0;
+    while (mp) {
+	ErtsMessage *next = mp->next;
+	mp->next = first;
+	first = mp;
+	mp = next;
+	len++;
+    }
+
+    *privq->last = first;
+    privq->last = &last->next;
+    privq->len += len;
+    erts_smp_atomic_add_nob(&inq->len, (erts_aint_t) -len);
+    return len;
+}
+
+/* Newest message in 'in queue'; only safe when senders are blocked */
+ERTS_GLB_INLINE ErtsMessage *
+erts_msg_inq_peek(ErlMessageInQueue *inq)
+{
+    erts_aint_t head = erts_smp_atomic_read_acqb(&inq->head);
+    if (head == ERTS_MSG_INQ_CLOSED)
+	return NULL;
+    return (ErtsMessage *) head;
+}
+
+ERTS_GLB_INLINE Sint
+erts_msg_inq_len(ErlMessageInQueue *inq)
+{
+    /* May transiently be negative while a push is completing */
+    Sint len = (Sint) erts_smp_atomic_read_nob(&inq->len);
+    return len < 0 ? 0 : len;
+}
+
+#endif /* ERTS_SMP */
+
 #endif
 
 Uint erts_mbuf_size(Process *p);
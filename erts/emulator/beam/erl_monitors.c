@@ -30,6 +30,11 @@
  * monitor it is.
  * A monitor is removed either explicitly by reference or all monitors are 
  * removed when the process exits. No need to access the monitor by pid.
+ *
+ * When a monitor tree grows deep it is split into a hash table of
+ * trees, indexed by a hash of the reference (see ErtsMonitorHash
+ * below). The root of the table is stored where the root of the tree
+ * was, so owners of monitors do not know about it.
  **************************************************************************/ 
 
 #ifdef HAVE_CONFIG_H
@@ -79,7 +84,13 @@ static ERTS_INLINE int cmp_mon_ref(Eterm ref1, Eterm ref2)
     b2 = boxed_val(ref2);
     if (is_ref_thing_header(*b1)) {
 	if (is_ref_thing_header(*b2)) {
-	    return memcmp(b1+1,b2+1,ERTS_REF_WORDS*sizeof(Uint));
+	    /* The first data word holds the fastest changing number */
+	    int i;
+	    for (i = 1; i <= ERTS_REF_WORDS; i++) {
+		if (b1[i] != b2[i])
+		    return b1[i] < b2[i] ? -1 : 1;
+	    }
+	    return 0;
 	}
 	return -1;
     }
@@ -109,6 +120,60 @@ do {								\
     }								\
 } while (0)
 
+/*
+ * Hash table of monitor trees.
+ *
+ * A plain monitor tree is replaced by a hash table of trees when an
+ * insertion goes deeper than ERTS_MON_HASH_DEPTH. The table is doubled
+ * when an insertion into a bucket goes deeper than
+ * ERTS_MON_BUCKET_DEPTH while there are more than ERTS_MON_BUCKET_LOAD
+ * monitors per bucket, and it is turned back into a plain tree when
+ * fewer than ERTS_MON_HASH_MIN_COUNT monitors remain. Monitors are
+ * moved between trees by relinking them; they are never reallocated.
+ *
+ * The table starts out like a monitor, so that its type can be told
+ * apart from the type of the root of a plain tree.
+ */
+
+#define MON_HASH 15
+
+#define ERTS_MON_HASH_DEPTH	12
+#define ERTS_MON_HASH_INIT_SIZE	256
+#define ERTS_MON_BUCKET_DEPTH	6
+#define ERTS_MON_BUCKET_LOAD	4
+#define ERTS_MON_HASH_MIN_COUNT	64
+
+typedef struct {
+    ErtsMonitor *left, *right;	/* Always NULL */
+    Sint16 balance;
+    Uint16 type;		/* MON_HASH */
+    Uint count;			/* Number of monitors in the table */
+    Uint size;			/* Number of buckets, a power of two */
+    ErtsMonitor *bucket[1];	/* Larger in reality */
+} ErtsMonitorHash;
+
+#define IS_MON_HASH(Root) ((Root) != NULL && (Root)->type == MON_HASH)
+#define MON_HASH_BUCKET(MH, Ref) \
+    (&(MH)->bucket[mon_ref_hash((Ref)) & ((MH)->size - 1)])
+#define MON_HASH_ALLOC_SIZE(Size) \
+    (sizeof(ErtsMonitorHash) + ((Size) - 1)*sizeof(ErtsMonitor *))
+
+static ERTS_INLINE Uint mon_ref_hash(Eterm ref)
+{
+    Uint32 *num;
+    Uint n;
+
+    if (is_internal_ref(ref)) {
+	num = internal_ref_numbers(ref);
+	n = internal_ref_no_of_numbers(ref);
+    } else {
+	num = external_ref_numbers(ref);
+	n = external_ref_no_of_numbers(ref);
+    }
+    /* Successive references differ in the first number */
+    return (Uint) (num[0] ^ (n > 1 ? num[1] * 0x9e3779b9U : 0));
+}
+
 static ErtsMonitor *create_monitor(Uint type, Eterm ref, Eterm pid, Eterm name)
 {
      Uint mon_size = ERTS_MONITOR_SIZE;
@@ -329,8 +394,8 @@ static void insertion_rotation(int dstack[], int dpos,
     }
 }
 
-void erts_add_monitor(ErtsMonitor **root, Uint type, Eterm ref, Eterm pid, 
-		      Eterm name)
+/* Inserts a monitor in a tree and returns the depth it was inserted at */
+static int insert_monitor(ErtsMonitor **root, ErtsMonitor *mon)
 {
     void *tstack[STACK_NEED];
     int tpos = 0;
@@ -338,13 +403,14 @@ void erts_add_monitor(ErtsMonitor **root, Uint type, Eterm ref, Eterm pid,
     int dpos = 1;
     int state = 0;
     ErtsMonitor **this = root;
+    Eterm ref = mon->ref;
     Sint c;
   
     dstack[0] = DIR_END;
     for (;;) {
 	if (!*this) { /* Found our place */
 	    state = 1;
-	    *this = create_monitor(type,ref,pid,name);
+	    *this = mon;
 	    break;
 	} else if ((c = CMP_MON_REF(ref,(*this)->ref)) < 0) { 
 	    /* go left */
@@ -361,6 +427,88 @@ void erts_add_monitor(ErtsMonitor **root, Uint type, Eterm ref, Eterm pid,
 	}
     }
     insertion_rotation(dstack, dpos, tstack, tpos, state);
+    return tpos;
+}
+
+static void sweep_monitor_tree(ErtsMonitor *root,
+			       void (*doit)(ErtsMonitor *, void *),
+			       void *context);
+
+typedef struct {
+    ErtsMonitorHash *mh;	/* New table, or NULL for a plain tree */
+    ErtsMonitor *tree;		/* New plain tree */
+    Uint count;
+} RehashMonitorsContext;
+
+static void rehash_one_monitor(ErtsMonitor *mon, void *vctx)
+{
+    RehashMonitorsContext *ctx = vctx;
+
+    mon->left = mon->right = NULL;
+    mon->balance = 0;
+    if (ctx->mh)
+	(void) insert_monitor(MON_HASH_BUCKET(ctx->mh, mon->ref), mon);
+    else
+	(void) insert_monitor(&ctx->tree, mon);
+    ctx->count++;
+}
+
+/*
+ * Moves all monitors under *root into a new hash table with size
+ * buckets, or into a plain tree if size is zero.
+ */
+static void rehash_monitors(ErtsMonitor **root, Uint size)
+{
+    RehashMonitorsContext ctx;
+    ErtsMonitorHash *old = IS_MON_HASH(*root) ? (ErtsMonitorHash *) *root : NULL;
+
+    ctx.tree = NULL;
+    ctx.count = 0;
+    if (size) {
+	Uint i;
+	ctx.mh = erts_alloc(ERTS_ALC_T_MONITOR_LH, MON_HASH_ALLOC_SIZE(size));
+	erts_smp_atomic_add_nob(&tot_link_lh_size, MON_HASH_ALLOC_SIZE(size));
+	ctx.mh->left = ctx.mh->right = NULL;
+	ctx.mh->balance = 0;
+	ctx.mh->type = MON_HASH;
+	ctx.mh->size = size;
+	for (i = 0; i < size; i++)
+	    ctx.mh->bucket[i] = NULL;
+    } else
+	ctx.mh = NULL;
+
+    if (old) {
+	Uint i;
+	for (i = 0; i < old->size; i++)
+	    sweep_monitor_tree(old->bucket[i], &rehash_one_monitor, &ctx);
+	ASSERT(ctx.count == old->count);
+	erts_smp_atomic_add_nob(&tot_link_lh_size,
+				-1*MON_HASH_ALLOC_SIZE(old->size));
+	erts_free(ERTS_ALC_T_MONITOR_LH, old);
+    } else
+	sweep_monitor_tree(*root, &rehash_one_monitor, &ctx);
+
+    if (ctx.mh) {
+	ctx.mh->count = ctx.count;
+	*root = (ErtsMonitor *) ctx.mh;
+    } else
+	*root = ctx.tree;
+}
+
+void erts_add_monitor(ErtsMonitor **root, Uint type, Eterm ref, Eterm pid, 
+		      Eterm name)
+{
+    ErtsMonitor *mon = create_monitor(type,ref,pid,name);
+
+    if (IS_MON_HASH(*root)) {
+	ErtsMonitorHash *mh = (ErtsMonitorHash *) *root;
+	int depth = insert_monitor(MON_HASH_BUCKET(mh, ref), mon);
+	mh->count++;
+	if (depth > ERTS_MON_BUCKET_DEPTH
+	    && mh->count > ERTS_MON_BUCKET_LOAD*mh->size)
+	    rehash_monitors(root, 2*mh->size);
+    } else if (insert_monitor(root, mon) > ERTS_MON_HASH_DEPTH)
+	rehash_monitors(root, ERTS_MON_HASH_INIT_SIZE);
 }
 
 
@@ -597,7 +745,7 @@ static int delsub(ErtsMonitorOrLink **this)
     return h;
 }
 
-ErtsMonitor *erts_remove_monitor(ErtsMonitor **root, Eterm ref) 
+static ErtsMonitor *remove_monitor(ErtsMonitor **root, Eterm ref) 
 {
     ErtsMonitor **tstack[STACK_NEED];
     int tpos = 0;
@@ -648,6 +796,21 @@ ErtsMonitor *erts_remove_monitor(ErtsMonitor **root, Eterm ref)
     return q;
 }
 
+ErtsMonitor *erts_remove_monitor(ErtsMonitor **root, Eterm ref) 
+{
+    ErtsMonitorHash *mh;
+    ErtsMonitor *mon;
+
+    if (!IS_MON_HASH(*root))
+	return remove_monitor(root, ref);
+
+    mh = (ErtsMonitorHash *) *root;
+    mon = remove_monitor(MON_HASH_BUCKET(mh, ref), ref);
+    if (mon && --mh->count < ERTS_MON_HASH_MIN_COUNT)
+	rehash_monitors(root, 0);
+    return mon;
+}
+
 ErtsLink *erts_remove_link(ErtsLink **root, Eterm pid) 
 {
     ErtsLink **tstack[STACK_NEED];
@@ -756,6 +919,9 @@ ErtsMonitor *erts_lookup_monitor(ErtsMonitor *root, Eterm ref)
 {
     Sint c;
 
+    if (IS_MON_HASH(root))
+	root = *MON_HASH_BUCKET((ErtsMonitorHash *) root, ref);
+
     for (;;) {
 	if (root == NULL || (c = CMP_MON_REF(ref,root->ref)) == 0) {
 	    return root;
@@ -801,6 +967,42 @@ erts_lookup_suspend_monitor(ErtsSuspendMonitor *root, Eterm pid)
 void erts_sweep_monitors(ErtsMonitor *root, 
 			 void (*doit)(ErtsMonitor *, void *),
 			 void *context) 
+{
+    if (IS_MON_HASH(root)) {
+	ErtsMonitorHash *mh = (ErtsMonitorHash *) root;
+	Uint i;
+	for (i = 0; i < mh->size; i++)
+	    sweep_monitor_tree(mh->bucket[i], doit, context);
+    } else
+	sweep_monitor_tree(root, doit, context);
+}
+
+/*
+ * Sweeps monitors detached from an owner that is going away, doit
+ * is expected to destroy each monitor. The hash table, if any, is
+ * freed as well.
+ */
+void erts_sweep_detached_monitors(ErtsMonitor *root,
+				  void (*doit)(ErtsMonitor *, void *),
+				  void *context)
+{
+    if (IS_MON_HASH(root)) {
+	ErtsMonitorHash *mh = (ErtsMonitorHash *) root;
+	Uint i;
+	for (i = 0; i < mh->size; i++) {
+	    if (mh->bucket[i])
+		sweep_monitor_tree(mh->bucket[i], doit, context);
+	}
+	erts_smp_atomic_add_nob(&tot_link_lh_size,
+				-1*MON_HASH_ALLOC_SIZE(mh->size));
+	erts_free(ERTS_ALC_T_MONITOR_LH, mh);
+    } else
+	sweep_monitor_tree(root, doit, context);
+}
+
+static void sweep_monitor_tree(ErtsMonitor *root,
+			       void (*doit)(ErtsMonitor *, void *),
+			       void *context)
 {
     ErtsMonitor *tstack[STACK_NEED];
     int tpos = 0;
@@ -913,6 +1115,14 @@ static void erts_dump_monitors(ErtsMonitor *root, int indent)
 {
     if (root == NULL)
 	return;
+    if (IS_MON_HASH(root)) {
+	ErtsMonitorHash *mh = (ErtsMonitorHash *) root;
+	Uint i;
+	erts_printf("%*s[hash:%bpu:%bpu]\n", indent, "", mh->size, mh->count);
+	for (i = 0; i < mh->size; i++)
+	    erts_dump_monitors(mh->bucket[i], indent+2);
+	return;
+    }
     erts_dump_monitors(root->right,indent+2);
     erts_printf("%*s[%b16d:%b16u:%T:%T:%T]\n", indent, "", root->balance,
 		root->type, root->ref, root->pid, root->name);
@@ -20,7 +20,8 @@
 
 /**********************************************************************
  * Header for monitors and links data structures.
- * Monitors are kept in an AVL tree and the data structures for
+ * Monitors are kept in an AVL tree, which is split into a hash table
+ * of trees when it grows large, and the data structures for
  * the four different types of monitors are like this:
  **********************************************************************
  * Local monitor by pid/port: 
@@ -151,6 +152,9 @@ ErtsMonitor *erts_lookup_monitor(ErtsMonitor *root, Eterm ref);
 void erts_sweep_monitors(ErtsMonitor *root, 
 			 void (*doit)(ErtsMonitor *, void *),
 			 void *context);
+void erts_sweep_detached_monitors(ErtsMonitor *root,
+				  void (*doit)(ErtsMonitor *, void *),
+				  void *context);
 
 void erts_destroy_link(ErtsLink *lnk);
 /* Returns 0 if OK, < 0 if already present */
@@ -1338,7 +1338,7 @@ setup_reference_table(void)
 	    ErtsMessage *msg_list[] = {
 		proc->msg.first,
 #ifdef ERTS_SMP
-		proc->msg_inq.first,
+		erts_msg_inq_peek(&proc->msg_inq),
 #endif
 		proc->msg_frag};
 
@@ -1362,6 +1362,9 @@ setup_reference_table(void)
 			    heap_frag = &msg->hfrag;
 			else if (is_value(ERL_MESSAGE_TERM(msg)))
 			    heap_frag = msg->data.heap_frag;
+			else if (ERTS_MSG_IS_SHARED(msg)) {
+			    /* Shared payloads hold no external identifiers */
+			}
 			else {
 			    if (msg->data.dist_ext->dep)
 				insert_dist_entry(msg->data.dist_ext->dep,
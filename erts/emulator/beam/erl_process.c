@@ -571,6 +571,11 @@ static int execute_sys_tasks(Process *c_p,
 static int cleanup_sys_tasks(Process *c_p,
 			     erts_aint32_t in_state,
 			     int in_reds);
+#ifdef ERTS_DIRTY_SCHEDULERS
+static int execute_dirty_sys_tasks(Process *c_p,
+				   erts_aint32_t *statep,
+				   int in_reds);
+#endif
 
 
 #if defined(DEBUG) || 0
@@ -600,6 +605,10 @@ dbg_chk_aux_work_val(erts_aint32_t value)
 #endif
 #if HAVE_ERTS_MSEG
     valid |= ERTS_SSI_AUX_WORK_MSEG_CACHE_CHECK;
+#endif
+    valid |= ERTS_SSI_AUX_WORK_ALCU_DISCARD;
+#ifdef ERTS_SMP
+    valid |= ERTS_SSI_AUX_WORK_ALCU_DEFRAG;
 #endif
 #ifdef ERTS_SSI_AUX_WORK_REAP_PORTS
     valid |= ERTS_SSI_AUX_WORK_REAP_PORTS;
@@ -693,6 +702,10 @@ erts_pre_init_process(void)
 	= "SET_TMO";
     erts_aux_work_flag_descr[ERTS_SSI_AUX_WORK_MSEG_CACHE_CHECK_IX]
 	= "MSEG_CACHE_CHECK";
+    erts_aux_work_flag_descr[ERTS_SSI_AUX_WORK_ALCU_DISCARD_IX]
+	= "ALCU_DISCARD";
+    erts_aux_work_flag_descr[ERTS_SSI_AUX_WORK_ALCU_DEFRAG_IX]
+	= "ALCU_DEFRAG";
     erts_aux_work_flag_descr[ERTS_SSI_AUX_WORK_REAP_PORTS_IX]
 	= "REAP_PORTS";
     erts_aux_work_flag_descr[ERTS_SSI_AUX_WORK_DEBUG_WAIT_COMPLETED_IX]
@@ -2346,6 +2359,44 @@ handle_mseg_cache_check(ErtsAuxWorkData *awdp, erts_aint32_t aux_work, int waiti
 
 #endif
 
+static ERTS_INLINE erts_aint32_t
+handle_alcu_discard(ErtsAuxWorkData *awdp, erts_aint32_t aux_work, int waiting)
+{
+#ifdef ERTS_DIRTY_SCHEDULERS
+    ASSERT(!awdp->esdp || !ERTS_SCHEDULER_IS_DIRTY(awdp->esdp));
+#endif
+    unset_aux_work_flags(awdp->ssi, ERTS_SSI_AUX_WORK_ALCU_DISCARD);
+    erts_alloc_discard_free_memory(awdp->sched_id);
+    return aux_work & ~ERTS_SSI_AUX_WORK_ALCU_DISCARD;
+}
+
+#ifdef ERTS_SMP
+
+static ERTS_INLINE erts_aint32_t
+handle_alcu_defrag(ErtsAuxWorkData *awdp, erts_aint32_t aux_work, int waiting)
+{
+#ifdef ERTS_DIRTY_SCHEDULERS
+    ASSERT(!awdp->esdp || !ERTS_SCHEDULER_IS_DIRTY(awdp->esdp));
+#endif
+    unset_aux_work_flags(awdp->ssi, ERTS_SSI_AUX_WORK_ALCU_DEFRAG);
+    /*
+     * Allocators are looked at when the aux work timer fires; a pass
+     * over the ETS tables is continued as ordinary aux work until it
+     * completes.
+     */
+    if (!awdp->alcu_defrag.ets)
+	erts_alloc_defrag(awdp->sched_id);
+    awdp->alcu_defrag.ets = (erts_alloc_is_defragmenting(ERTS_ALC_A_ETS)
+			     && erts_db_defrag());
+    if (awdp->alcu_defrag.ets) {
+	set_aux_work_flags(awdp->ssi, ERTS_SSI_AUX_WORK_ALCU_DEFRAG);
+	return aux_work;
+    }
+    return aux_work & ~ERTS_SSI_AUX_WORK_ALCU_DEFRAG;
+}
+
+#endif
+
 #ifdef ERTS_SMP
 
 static ERTS_INLINE erts_aint32_t
@@ -2474,6 +2525,14 @@ handle_aux_work(ErtsAuxWorkData *awdp, erts_aint32_t orig_aux_work, int waiting)
 		    handle_mseg_cache_check);
 #endif
 
+    HANDLE_AUX_WORK(ERTS_SSI_AUX_WORK_ALCU_DISCARD,
+		    handle_alcu_discard);
+
+#ifdef ERTS_SMP
+    HANDLE_AUX_WORK(ERTS_SSI_AUX_WORK_ALCU_DEFRAG,
+		    handle_alcu_defrag);
+#endif
+
     HANDLE_AUX_WORK(ERTS_SSI_AUX_WORK_REAP_PORTS,
 		    handle_reap_ports);
 
@@ -5663,6 +5722,7 @@ init_aux_work_data(ErtsAuxWorkData *awdp, ErtsSchedulerData *esdp, char *dawwp)
     awdp->later_op.size = 0;
     awdp->later_op.first = NULL;
     awdp->later_op.last = NULL;
+    awdp->alcu_defrag.ets = 0;
 #endif
 #ifdef ERTS_USE_ASYNC_READY_Q
 #ifdef ERTS_SMP
@@ -9417,14 +9477,17 @@ erts_time2reds(ErtsMonotonicTime start, ErtsMonotonicTime end)
 #endif
 
 static int
-scheduler_gc_proc(Process *c_p, int reds_left)
+scheduler_gc_proc(Process *c_p, int reds_left, int direct)
 {
     int fcalls, reds;
     if (!ERTS_PROC_GET_SAVED_CALLS_BUF(c_p))
 	fcalls = reds_left;
     else
 	fcalls = reds_left - CONTEXT_REDS;
-    reds = erts_garbage_collect_nobump(c_p, 0, c_p->arg_reg, c_p->arity, fcalls);
+    if (direct)
+	reds = erts_garbage_collect_direct(c_p, 0, c_p->arg_reg, c_p->arity, fcalls);
+    else
+	reds = erts_garbage_collect_nobump(c_p, 0, c_p->arg_reg, c_p->arity, fcalls);
     ASSERT(reds_left >= reds);
     return reds;
 }
@@ -10097,6 +10160,14 @@ Process *erts_schedule(ErtsSchedulerData *esdp, Process *p, int calls)
 	     * prim_eval:'receive'. If GC is delayed we are
 	     * not allowed to execute system tasks.
 	     */
+#ifdef ERTS_DIRTY_SCHEDULERS
+	    if (!is_normal_sched) {
+		int cost = execute_dirty_sys_tasks(p, &state, reds);
+		calls += cost;
+		reds -= cost;
+		goto sched_out_proc;
+	    }
+#endif
 	    if (!(p->flags & F_DELAY_GC)) {
 		int cost = execute_sys_tasks(p, &state, reds);
 		calls += cost;
@@ -10140,7 +10211,7 @@ Process *erts_schedule(ErtsSchedulerData *esdp, Process *p, int calls)
 
 	if (ERTS_IS_GC_DESIRED(p) && !ERTS_SCHEDULER_IS_DIRTY_IO(esdp)) {
 	    if (!(state & ERTS_PSFLG_EXITING) && !(p->flags & (F_DELAY_GC|F_DISABLE_GC))) {
-		int cost = scheduler_gc_proc(p, reds);
+		int cost = scheduler_gc_proc(p, reds, 0);
 		calls += cost;
 		reds -= cost;
 		if (reds <= 0)
@@ -10423,7 +10494,7 @@ execute_sys_tasks(Process *c_p, erts_aint32_t *statep, int in_reds)
 	    else {
 		if (!garbage_collected) {
 		    FLAGS(c_p) |= F_NEED_FULLSWEEP;
-		    reds -= scheduler_gc_proc(c_p, reds);
+		    reds -= scheduler_gc_proc(c_p, reds, 1);
 		    garbage_collected = 1;
 		}
 		st_res = am_true;
@@ -10499,6 +10570,46 @@ execute_sys_tasks(Process *c_p, erts_aint32_t *statep, int in_reds)
     return in_reds - reds;
 }
 
+#ifdef ERTS_DIRTY_SCHEDULERS
+
+/*
+ * Execute system work flagged by ERTS_PSFLG_DIRTY_ACTIVE_SYS.
+ * Currently the only such work is garbage collections moved
+ * to a dirty cpu scheduler (F_DIRTY_GC).
+ */
+static int
+execute_dirty_sys_tasks(Process *c_p, erts_aint32_t *statep, int in_reds)
+{
+    int reds = 0;
+
+    ERTS_SMP_LC_ASSERT(erts_proc_lc_my_proc_locks(c_p) == ERTS_PROC_LOCK_MAIN);
+
+    if (c_p->flags & F_DIRTY_GC) {
+	int fcalls;
+	if (!ERTS_PROC_GET_SAVED_CALLS_BUF(c_p))
+	    fcalls = in_reds;
+	else
+	    fcalls = in_reds - CONTEXT_REDS;
+	reds = erts_execute_dirty_gc(c_p, fcalls);
+	c_p->flags &= ~F_DIRTY_GC;
+    }
+
+    /*
+     * Only the dirty scheduler executing the process clears
+     * this flag; the process will then be enqueued in a normal
+     * run queue when scheduled out...
+     */
+    *statep = erts_smp_atomic32_read_band_mb(&c_p->state,
+					     ~ERTS_PSFLG_DIRTY_ACTIVE_SYS);
+    *statep &= ~ERTS_PSFLG_DIRTY_ACTIVE_SYS;
+
+    if (reds > in_reds)
+	return in_reds;
+    return reds;
+}
+
+#endif
+
 static int
 cleanup_sys_tasks(Process *c_p, erts_aint32_t in_state, int in_reds)
 {
@@ -11370,6 +11481,9 @@ erl_create_process(Process* parent, /* Parent of process (default group leader).
     Process *p;
     Sint arity;			/* Number of arguments. */
     Uint arg_size;		/* Size of arguments. */
+#ifndef SHCOPY_SPAWN
+    ErlHeapFragment *arg_frags = NULL;
+#endif
     Uint sz;			/* Needed words on heap. */
     Uint heap_need;		/* Size needed on heap. */
     Eterm res = THE_NON_VALUE;
@@ -11437,7 +11551,15 @@ erl_create_process(Process* parent, /* Parent of process (default group leader).
 #ifdef SHCOPY_SPAWN
     arg_size = copy_shared_calculate(args, &info);
 #else
-    arg_size = size_object(args);
+    arg_size = size_object_x(args, ERTS_COPY_SHARED_LIMIT());
+    if (arg_size > ERTS_COPY_SHARED_LIMIT()) {
+	/*
+	 * Large arguments are copied preserving sharing into
+	 * fragments first, since their size on the heap is not
+	 * known until they have been copied...
+	 */
+	arg_frags = erts_copy_shared_to_frags(&args, arg_size, &arg_size, 0);
+    }
 #endif
     heap_need = arg_size;
 
@@ -11452,11 +11574,13 @@ erl_create_process(Process* parent, /* Parent of process (default group leader).
 	p->max_gen_gcs    = so->max_gen_gcs;
         MAX_HEAP_SIZE_SET(p, so->max_heap_size);
         MAX_HEAP_SIZE_FLAGS_SET(p, so->max_heap_flags);
+        MAX_MSGQ_LEN_SET(p, so->max_msgq_len, so->max_msgq_action);
     } else {
 	p->min_heap_size  = H_MIN_SIZE;
 	p->min_vheap_size = BIN_VH_MIN_SIZE;
         MAX_HEAP_SIZE_SET(p, H_MAX_SIZE);
         MAX_HEAP_SIZE_FLAGS_SET(p, H_MAX_FLAGS);
+        MAX_MSGQ_LEN_SET(p, 0, MAX_MSGQ_LEN_DROP);
 	p->max_gen_gcs    = (Uint16) erts_smp_atomic32_read_nob(&erts_max_gen_gcs);
     }
     p->schedule_count = 0;
@@ -11481,6 +11605,18 @@ erl_create_process(Process* parent, /* Parent of process (default group leader).
 	sz = erts_next_heap_size(heap_need, 0);
     }
 
+    p->heap_pred = NULL;
+    if (so->flags & SPO_ADAPTIVE_HEAP) {
+	/*
+	 * Start out with the heap size that processes spawned
+	 * from the same MFA previously ended up with...
+	 */
+	Uint pred_sz = erts_heap_prediction(p, mod, func, args);
+	if (pred_sz > sz
+	    && (!MAX_HEAP_SIZE_GET(p) || pred_sz < MAX_HEAP_SIZE_GET(p)))
+	    sz = erts_next_heap_size(pred_sz, 0);
+    }
+
 #ifdef HIPE
     hipe_init_process(&p->hipe);
 #ifdef ERTS_SMP
@@ -11491,6 +11627,7 @@ erl_create_process(Process* parent, /* Parent of process (default group leader).
     p->old_hend = p->old_htop = p->old_heap = NULL;
     p->high_water = p->heap;
     p->gen_gcs = 0;
+    sys_memzero(&p->gc_stats, sizeof(p->gc_stats));
     p->stop = p->hend = p->heap + sz;
     p->htop = p->heap;
     p->heap_sz = sz;
@@ -11519,7 +11656,14 @@ erl_create_process(Process* parent, /* Parent of process (default group leader).
     p->arg_reg[2] = copy_shared_perform(args, arg_size, &info, &p->htop, &p->off_heap);
     DESTROY_SHCOPY(info);
 #else
-    p->arg_reg[2] = copy_struct(args, arg_size, &p->htop, &p->off_heap);
+    if (arg_frags) {
+	p->arg_reg[2] = args;
+	erts_move_multi_frags(&p->htop, &p->off_heap, arg_frags,
+			      &p->arg_reg[2], 1, 0);
+	free_message_buffer(arg_frags);
+    }
+    else
+	p->arg_reg[2] = copy_struct(args, arg_size, &p->htop, &p->off_heap);
 #endif
     p->arity = 3;
 
@@ -11554,10 +11698,10 @@ erl_create_process(Process* parent, /* Parent of process (default group leader).
     p->msg.last = &p->msg.first;
     p->msg.save = &p->msg.first;
     p->msg.len = 0;
+    p->msg.index = NULL;
+    p->msgq_blocked = NULL;
 #ifdef ERTS_SMP
-    p->msg_inq.first = NULL;
-    p->msg_inq.last = &p->msg_inq.first;
-    p->msg_inq.len = 0;
+    erts_msg_inq_init(&p->msg_inq);
 #endif
     p->bif_timers = NULL;
 #ifdef ERTS_BTM_ACCESSOR_SUPPORT
@@ -11719,6 +11863,8 @@ void erts_init_empty_process(Process *p)
     p->live_hf_end = ERTS_INVALID_HFRAG_PTR;
     p->gen_gcs = 0;
     p->max_gen_gcs = 0;
+    p->heap_pred = NULL;
+    sys_memzero(&p->gc_stats, sizeof(p->gc_stats));
     p->min_heap_size = 0;
     p->min_vheap_size = 0;
     p->rcount = 0;
@@ -11759,6 +11905,8 @@ void erts_init_empty_process(Process *p)
     p->msg.last = &p->msg.first;
     p->msg.save = &p->msg.first;
     p->msg.len = 0;
+    p->msg.index = NULL;
+    p->msgq_blocked = NULL;
     p->bif_timers = NULL;
 #ifdef ERTS_BTM_ACCESSOR_SUPPORT
     p->accessor_bif_timers = NULL;
@@ -11813,9 +11961,7 @@ void erts_init_empty_process(Process *p)
 
 #ifdef ERTS_SMP
     p->scheduler_data = NULL;
-    p->msg_inq.first = NULL;
-    p->msg_inq.last = &p->msg_inq.first;
-    p->msg_inq.len = 0;
+    erts_msg_inq_init(&p->msg_inq);
     p->suspendee = NIL;
     p->pending_suspenders = NULL;
     p->pending_exit.reason = THE_NON_VALUE;
@@ -11874,8 +12020,8 @@ erts_debug_verify_clean_empty_process(Process* p)
     ASSERT(p->parent == NIL);
 
 #ifdef ERTS_SMP
-    ASSERT(p->msg_inq.first == NULL);
-    ASSERT(p->msg_inq.len == 0);
+    ASSERT(erts_msg_inq_peek(&p->msg_inq) == NULL);
+    ASSERT(erts_msg_inq_len(&p->msg_inq) == 0);
     ASSERT(p->suspendee == NIL);
     ASSERT(p->pending_suspenders == NULL);
     ASSERT(p->pending_exit.reason == THE_NON_VALUE);
@@ -12002,6 +12148,8 @@ delete_process(Process* p)
     erts_erase_dicts(p);
 
     /* free all pending messages */
+    if (p->msg.index)
+	erts_msgq_index_destroy(&p->msg);
     erts_cleanup_messages(p->msg.first);
     p->msg.first = NULL;
 
@@ -12816,6 +12964,9 @@ erts_do_exit_process(Process* p, Eterm reason)
 	erts_exit(ERTS_DUMP_EXIT, "System process %T terminated: %T\n",
                  p->common.id, reason);
 
+    if (p->heap_pred)
+	erts_update_heap_prediction(p);
+
 #ifdef ERTS_SMP
     ERTS_SMP_CHK_HAVE_ONLY_MAIN_PROC_LOCK(p);
     /* By locking all locks (main lock is already locked) when going
@@ -12839,7 +12990,8 @@ erts_do_exit_process(Process* p, Eterm reason)
 
     cancel_suspend_of_suspendee(p, ERTS_PROC_LOCKS_ALL); 
 
-    ERTS_SMP_MSGQ_MV_INQ2PRIVQ(p);
+    /* Senders that missed the exiting flag will see the queue closed */
+    ERTS_SMP_MSGQ_CLOSE_INQ2PRIVQ(p);
 #endif
 
     if (IS_TRACED(p)) {
@@ -12861,6 +13013,9 @@ erts_do_exit_process(Process* p, Eterm reason)
 
     erts_smp_proc_unlock(p, ERTS_PROC_LOCKS_ALL_MINOR);
 
+    if (p->msgq_blocked)
+	erts_msgq_resume_senders(p, ERTS_PROC_LOCK_MAIN, 1);
+
     if (IS_TRACED_FL(p,F_TRACE_PROCS))
         trace_proc(p, ERTS_PROC_LOCK_MAIN, p, am_exit, reason);
 
@@ -13122,7 +13277,7 @@ erts_continue_exit_process(Process *p)
 
     {
 	ExitMonitorContext context = {reason, p};
-	erts_sweep_monitors(mon,&doit_exit_monitor,&context); /* Allocates TmpHeap, but we
+	erts_sweep_detached_monitors(mon,&doit_exit_monitor,&context); /* Allocates TmpHeap, but we
 								 have none here */
     }
 
@@ -307,6 +307,8 @@ typedef enum {
     ERTS_SSI_AUX_WORK_PENDING_EXITERS_IX,
     ERTS_SSI_AUX_WORK_SET_TMO_IX,
     ERTS_SSI_AUX_WORK_MSEG_CACHE_CHECK_IX,
+    ERTS_SSI_AUX_WORK_ALCU_DISCARD_IX,
+    ERTS_SSI_AUX_WORK_ALCU_DEFRAG_IX,
     ERTS_SSI_AUX_WORK_REAP_PORTS_IX,
     ERTS_SSI_AUX_WORK_DEBUG_WAIT_COMPLETED_IX, /* SHOULD be last flag index */
 
@@ -343,6 +345,10 @@ typedef enum {
     (((erts_aint32_t) 1) << ERTS_SSI_AUX_WORK_SET_TMO_IX)
 #define ERTS_SSI_AUX_WORK_MSEG_CACHE_CHECK \
     (((erts_aint32_t) 1) << ERTS_SSI_AUX_WORK_MSEG_CACHE_CHECK_IX)
+#define ERTS_SSI_AUX_WORK_ALCU_DISCARD \
+    (((erts_aint32_t) 1) << ERTS_SSI_AUX_WORK_ALCU_DISCARD_IX)
+#define ERTS_SSI_AUX_WORK_ALCU_DEFRAG \
+    (((erts_aint32_t) 1) << ERTS_SSI_AUX_WORK_ALCU_DEFRAG_IX)
 #define ERTS_SSI_AUX_WORK_REAP_PORTS \
     (((erts_aint32_t) 1) << ERTS_SSI_AUX_WORK_REAP_PORTS_IX)
 #define ERTS_SSI_AUX_WORK_DEBUG_WAIT_COMPLETED \
@@ -582,6 +588,9 @@ typedef struct {
 	ErtsThrPrgrLaterOp *first;
 	ErtsThrPrgrLaterOp *last;
     } later_op;
+    struct {
+	int ets;
+    } alcu_defrag;
 #endif
 #ifdef ERTS_USE_ASYNC_READY_Q
     struct {
@@ -674,6 +683,7 @@ struct ErtsSchedulerData_ {
     Uint64 reductions;
     ErtsSchedWallTime sched_wall_time;
     ErtsGCInfo gc_info;
+    erts_smp_atomic_t gc_pause_hist[ERTS_GC_PAUSE_HIST_SIZE];
     ErtsPortTaskHandle nosuspend_port_task_handle;
 
 #ifdef ERTS_DO_VERIFY_UNUSED_TEMP_ALLOC
@@ -931,6 +941,19 @@ struct ErtsPendingSuspend_ {
 #  define MAX_HEAP_SIZE_KILL 1
 #  define MAX_HEAP_SIZE_LOG  2
 
+/*
+ * Message queue length limit, process_flag(max_message_queue_len, ...).
+ * The action taken when a send finds the queue full is kept in the
+ * two lowest bits.
+ */
+#  define MAX_MSGQ_LEN_GET(p)         ((p)->max_msgq_len >> 2)
+#  define MAX_MSGQ_LEN_ACTION_GET(p)  ((p)->max_msgq_len & 0x3)
+#  define MAX_MSGQ_LEN_SET(p, len, action) \
+    ((p)->max_msgq_len = ((len) << 2) | (action))
+#  define MAX_MSGQ_LEN_DROP    0
+#  define MAX_MSGQ_LEN_KILL    1
+#  define MAX_MSGQ_LEN_SUSPEND 2
+
 struct process {
     ErtsPTabElementCommon common; /* *Need* to be first in struct */
 
@@ -1048,8 +1071,13 @@ struct process {
     Eterm *old_htop;
     Eterm *old_heap;
     Uint max_heap_size;         /* Maximum size of heap (in words). */
+    Uint max_msgq_len;          /* Maximum message queue length and action */
+    ErtsProcList *msgq_blocked; /* Senders suspended on the full message
+				   queue, protected by the msgq lock */
     Uint16 gen_gcs;		/* Number of (minor) generational GCs. */
     Uint16 max_gen_gcs;		/* Max minor gen GCs before fullsweep. */
+    struct erts_heap_pred *heap_pred; /* Heap size prediction of spawn site. */
+    ErtsProcGCStats gc_stats;	/* Cumulative garbage collection statistics */
     ErlOffHeap off_heap;	/* Off-heap data updated by copy_struct(). */
     ErlHeapFragment* mbuf;	/* Pointer to heap fragment list */
     ErlHeapFragment* live_hf_end;
@@ -1291,6 +1319,7 @@ void erts_check_for_holes(Process* p);
 #define SPO_SYSTEM_PROC 8
 #define SPO_OFF_HEAP_MSGQ 16
 #define SPO_ON_HEAP_MSGQ 32
+#define SPO_ADAPTIVE_HEAP 64
 
 extern int erts_default_spo_flags;
 
@@ -1312,6 +1341,8 @@ typedef struct {
     Uint16 max_gen_gcs;		/* Maximum number of gen GCs before fullsweep. */
     Uint max_heap_size;         /* Maximum heap size in words */
     Uint max_heap_flags;        /* Maximum heap flags (kill | log) */
+    Uint max_msgq_len;          /* Maximum message queue length */
+    Uint max_msgq_action;       /* Action when message queue is full */
     int scheduler;
 } ErlSpawnOpts;
 
@@ -1394,6 +1425,7 @@ extern int erts_system_profile_ts_type;
 #define F_HAVE_BLCKD_NMSCHED (1 << 18) /* Process has blocked normal multi-scheduling */
 #define F_HIPE_MODE          (1 << 19)
 #define F_DELAYED_DEL_PROC   (1 << 20) /* Delay delete process (dirty proc exit case) */
+#define F_DIRTY_GC           (1 << 21) /* Garbage collection moved to dirty scheduler */
 
 /*
  * F_DISABLE_GC and F_DELAY_GC are similar. Both will prevent
@@ -1923,15 +1955,36 @@ ErtsSchedulerData *erts_get_scheduler_data(void)
 void erts_schedule_process(Process *, erts_aint32_t, ErtsProcLocks);
 
 ERTS_GLB_INLINE void erts_proc_notify_new_message(Process *p, ErtsProcLocks locks);
+ERTS_GLB_INLINE void erts_proc_wait_inactivate(Process *c_p, ErtsProcLocks locks);
 #if ERTS_GLB_INLINE_INCL_FUNC_DEF
 ERTS_GLB_INLINE void
 erts_proc_notify_new_message(Process *p, ErtsProcLocks locks)
 {
-    /* No barrier needed, due to msg lock */
+    /*
+     * No barrier needed; the message was enqueued either under
+     * the msg lock or by a full barrier compare and swap.
+     */
     erts_aint32_t state = erts_smp_atomic32_read_nob(&p->state);
     if (!(state & ERTS_PSFLG_ACTIVE))
 	erts_schedule_process(p, state, locks);
 }
+
+/*
+ * Clear the active flag of a process that is about to wait for
+ * messages. Senders do not take the msg lock, so one may have
+ * enqueued a message after the 'in queue' was inspected while
+ * still seeing the process as active. The full barrier pairs
+ * with the one made by the sender when it enqueued the message.
+ */
+ERTS_GLB_INLINE void
+erts_proc_wait_inactivate(Process *c_p, ErtsProcLocks locks)
+{
+    erts_smp_atomic32_read_band_mb(&c_p->state, ~ERTS_PSFLG_ACTIVE);
+#ifdef ERTS_SMP
+    if (erts_smp_atomic_read_nob(&c_p->msg_inq.head) != (erts_aint_t) NULL)
+	erts_proc_notify_new_message(c_p, locks);
+#endif
+}
 #endif
 
 #if defined(ERTS_SMP) && defined(ERTS_ENABLE_LOCK_CHECK)
@@ -131,6 +131,8 @@ dump_process_info(int to, void *to_arg, Process *p)
 	    Eterm mesg = ERL_MESSAGE_TERM(mp);
 	    if (is_value(mesg))
 		dump_element(to, to_arg, mesg);
+	    else if (ERTS_MSG_IS_SHARED(mp))
+		dump_element(to, to_arg, ERTS_MSG_SHARED_PAYLOAD(mp)->term);
 	    else
 		dump_dist_ext(to, to_arg, mp->data.dist_ext);
 	    mesg = ERL_MESSAGE_TOKEN(mp);
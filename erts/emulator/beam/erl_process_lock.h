@@ -122,8 +122,9 @@ typedef struct erts_proc_lock_t_ {
 
 /*
  * Message queue lock:
- *   Protects the following fields in the process structure:
- *   * msg_inq
+ *   Serializes fetching of msg_inq by the receiver with receive
+ *   tracing and the closing of msg_inq at exit. Senders normally
+ *   push onto msg_inq without taking it.
  */
 #define ERTS_PROC_LOCK_MSGQ		(((ErtsProcLocks) 1) << 2)
 
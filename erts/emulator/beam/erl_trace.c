@@ -1433,7 +1433,7 @@ void save_calls(Process *p, Export *e)
  * are all small (atomic) integers.
  */
 void
-trace_gc(Process *p, Eterm what, Uint size, Eterm msg)
+trace_gc(Process *p, Eterm what, Uint size, Eterm msg, Uint pause_time)
 {
     ErtsTracerNif *tnif = NULL;
     Eterm* hp;
@@ -1444,11 +1444,22 @@ trace_gc(Process *p, Eterm what, Uint size, Eterm msg)
                           TRACE_FUN_E_GC, what)) {
 
         if (is_non_value(msg)) {
+            /* Pause time (in microseconds) is only reported on gc end */
+            int end = (what == am_gc_minor_end || what == am_gc_major_end);
 
             (void) erts_process_gc_info(p, &sz, NULL, 0, 0);
+            if (end) {
+                sz += 3 + 2;
+                (void) erts_bld_uint(NULL, &sz, pause_time);
+            }
             hp = HAlloc(p, sz + 3 + 2);
 
             msg = erts_process_gc_info(p, NULL, &hp, 0, 0);
+            if (end) {
+                Eterm ptime = erts_bld_uint(&hp, NULL, pause_time);
+                tup = TUPLE2(hp, am_pause_time, ptime); hp += 3;
+                msg = CONS(hp, tup, msg); hp += 2;
+            }
             tup = TUPLE2(hp, am_wordsize, make_small(size)); hp += 3;
             msg = CONS(hp, tup, msg); hp += 2;
         }
@@ -51,6 +51,10 @@
 #define H_DEFAULT_SIZE  233        /* default (heap + stack) min size */
 #define VH_DEFAULT_SIZE  32768     /* default virtual (bin) heap min size (words) */
 #define H_DEFAULT_MAX_SIZE 0       /* default max heap size is off */
+#define H_DEFAULT_DIRTY_GC_LIMIT (2*1024*1024) /* default heap size for dirty gc (words) */
+#define H_DEFAULT_PARALLEL_GC_LIMIT (32*1024*1024) /* default heap size for parallel gc (words) */
+#define H_DEFAULT_PARALLEL_GC_THREADS 4 /* default max threads in a parallel gc */
+#define H_MAX_PARALLEL_GC_THREADS 64
 
 #define CP_SIZE 1
 
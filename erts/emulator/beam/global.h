@@ -1049,6 +1049,7 @@ Eterm erts_preload_module(Process *c_p, ErtsProcLocks c_p_locks,
 			  Eterm group_leader, Eterm* mod, byte* code, Uint size);
 void init_load(void);
 BeamInstr* find_function_from_pc(BeamInstr* pc);
+BeamInstr* erts_find_running_function(Process* p);
 Eterm* erts_build_mfa_item(FunctionInfo* fi, Eterm* hp,
 			   Eterm args, Eterm* mfa_p);
 void erts_set_current_function(FunctionInfo* fi, BeamInstr* current);
@@ -1142,16 +1143,43 @@ do {                                                                    \
 Eterm copy_object_x(Eterm, Process*, Uint);
 #define copy_object(Term, Proc) copy_object_x(Term,Proc,0)
 
-Uint size_object(Eterm);
+Uint size_object_x(Eterm, Uint);
+#define size_object(Obj) size_object_x(Obj, ~((Uint) 0))
+
+/*
+ * Terms with a flat size above this (in words) are copied preserving
+ * sharing when erts_preserve_sharing is set, which it is by default.
+ * Smaller terms cannot blow up much when flattened and are copied
+ * flat. Messages this large are also copied in a single pass.
+ */
+#define ERTS_COPY_FLAT_LIMIT 4096
+extern int erts_preserve_sharing;
+#define ERTS_COPY_SHARED_LIMIT()				\
+    (erts_preserve_sharing ? ERTS_COPY_FLAT_LIMIT : ~((Uint) 0))
+
 Uint copy_shared_calculate(Eterm, erts_shcopy_t*);
 Eterm copy_shared_perform(Eterm, Uint, erts_shcopy_t*, Eterm**, ErlOffHeap*);
 
 Uint size_shared(Eterm);
 
-Eterm copy_struct_x(Eterm, Uint, Eterm**, ErlOffHeap*, Uint* bsz);
+/*
+ * Refc binaries in a message being sent that refer to at most
+ * 1/erts_bin_compact_ratio of their binary are copied into binaries
+ * of their own (+hsbc), so that the receiver does not keep the rest
+ * of the binary alive. Zero disables this.
+ */
+extern Uint erts_bin_compact_ratio;
+#define ERTS_COPY_COMPACT_BINS (1 << 0)
+
+Eterm copy_struct_x(Eterm, Uint, Eterm**, ErlOffHeap*, Uint* bsz, Uint32 flags);
 #define copy_struct(Obj,Sz,HPP,OH) \
-    copy_struct_x(Obj,Sz,HPP,OH,NULL)
+    copy_struct_x(Obj,Sz,HPP,OH,NULL,0)
+#define copy_struct_send(Obj,Sz,HPP,OH) \
+    copy_struct_x(Obj,Sz,HPP,OH,NULL,ERTS_COPY_COMPACT_BINS)
 Eterm copy_shallow(Eterm*, Uint, Eterm**, ErlOffHeap*);
+Eterm copy_struct_factory(Eterm, ErtsHeapFactory*, Uint32 flags);
+Eterm copy_shared_factory(Eterm, ErtsHeapFactory*, Uint32 flags);
+ErlHeapFragment *erts_copy_shared_to_frags(Eterm *, Uint, Uint *, Uint32);
 
 void erts_move_multi_frags(Eterm** hpp, ErlOffHeap*, ErlHeapFragment* first,
 			   Eterm* refs, unsigned nrefs, int literals);
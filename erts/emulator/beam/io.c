@@ -4405,7 +4405,7 @@ erts_deliver_port_exit(Port *prt, Eterm from, Eterm reason, int send_closed,
        SweepContext ctx = {prt, modified_reason};
        ErtsMonitor *moni = ERTS_P_MONITORS(prt);
        ERTS_P_MONITORS(prt) = NULL;
-       erts_sweep_monitors(moni, &sweep_one_monitor, &ctx);
+       erts_sweep_detached_monitors(moni, &sweep_one_monitor, &ctx);
    } 
    DRV_MONITOR_UNLOCK_PDL(prt);
 
@@ -29,10 +29,6 @@
 
 #include "safe_hash.h"
 
-/* Currently only used by erl_check_io on Windows */
-#ifndef ERTS_SYS_CONTINOUS_FD_NUMBERS
-
-
 static ERTS_INLINE void set_size(SafeHash* h, int size)
 {
     ASSERT(size % SAFE_HASH_LOCK_CNT == 0);
@@ -273,5 +269,3 @@ void safe_hash_for_each(SafeHash* h, void (*func)(void *, void *), void *func_ar
     }
 }
 
-#endif /* !ERTS_SYS_CONTINOUS_FD_NUMBERS */
-
@@ -163,6 +163,8 @@ void hipe_select_msg(Process *p)
     UNLINK_MESSAGE(p, msgp);	/* decrements global 'erts_proc_tot_mem' variable */
     JOIN_MESSAGE(p);
     CANCEL_TIMER(p);		/* calls erts_cancel_proc_timer() */
+    if (MAX_MSGQ_LEN_ACTION_GET(p) == MAX_MSGQ_LEN_SUSPEND)
+	erts_msgq_resume_senders(p, ERTS_PROC_LOCK_MAIN, 0);
     erts_save_message_in_proc(p, msgp);
     p->flags &= ~F_DELAY_GC;
     if (ERTS_IS_GC_DESIRED(p)) {
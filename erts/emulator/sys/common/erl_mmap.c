@@ -2108,6 +2108,34 @@ int erts_mmap_in_supercarrier(ErtsMemMapper* mm, void *ptr)
     return ERTS_MMAP_IN_SUPERCARRIER(ptr);
 }
 
+/*
+ * Ask the OS to back a mapped segment with (transparent) huge pages
+ * when possible. Only huge page aligned parts of the segment can be
+ * backed by huge pages; whether they are is up to the kernel.
+ */
+void erts_mmap_advise_huge(void *ptr, UWord size)
+{
+#ifdef ERTS_HAVE_OS_HUGE_PAGE_ADVICE
+    ERTS_MMAP_ASSERT(ERTS_IS_PAGEALIGNED(ptr));
+    (void) madvise(ptr, (size_t) ERTS_PAGEALIGNED_CEILING(size),
+		   MADV_HUGEPAGE);
+#endif
+}
+
+/*
+ * Give the physical memory of a page aligned range back to the OS
+ * while keeping the range mapped. The contents of the range are
+ * lost.
+ */
+void erts_mmap_discard(void *ptr, UWord size)
+{
+#ifdef ERTS_HAVE_OS_MEMORY_DISCARD
+    ERTS_MMAP_ASSERT(ERTS_IS_PAGEALIGNED(ptr));
+    ERTS_MMAP_ASSERT(ERTS_IS_PAGEALIGNED(size));
+    (void) madvise(ptr, (size_t) size, MADV_DONTNEED);
+#endif
+}
+
 static struct {
     Eterm options;
     Eterm total;
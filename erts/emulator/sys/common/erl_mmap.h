@@ -51,6 +51,12 @@
 #  if defined(MAP_FIXED) && (defined(MAP_NORESERVE) || defined(__FreeBSD__))
 #    define ERTS_HAVE_OS_PHYSICAL_MEMORY_RESERVATION 1
 #  endif
+#  if defined(MADV_HUGEPAGE)
+#    define ERTS_HAVE_OS_HUGE_PAGE_ADVICE 1
+#  endif
+#  if defined(MADV_DONTNEED)
+#    define ERTS_HAVE_OS_MEMORY_DISCARD 1
+#  endif
 #endif
 
 #ifndef HAVE_VIRTUALALLOC
@@ -139,6 +145,8 @@ void *erts_mmap(ErtsMemMapper*, Uint32 flags, UWord *sizep);
 void erts_munmap(ErtsMemMapper*, Uint32 flags, void *ptr, UWord size);
 void *erts_mremap(ErtsMemMapper*, Uint32 flags, void *ptr, UWord old_size, UWord *sizep);
 int erts_mmap_in_supercarrier(ErtsMemMapper*, void *ptr);
+void erts_mmap_advise_huge(void *ptr, UWord size);
+void erts_mmap_discard(void *ptr, UWord size);
 void erts_mmap_init(ErtsMemMapper*, ErtsMMapInit*, int executable);
 struct erts_mmap_info_struct
 {
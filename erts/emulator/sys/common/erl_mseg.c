@@ -92,6 +92,10 @@ static const int debruijn[32] = {
 
 #define MSEG_FLG_IS_2POW(X)    ((X) & ERTS_MSEG_FLG_2POW)
 
+/* Internal flag: the segment is advised to use huge pages (+M<S>hp) */
+#define MSEG_FLG_HUGE          ((Uint)(1 << 1))
+#define MSEG_FLG_IS_HUGE(X)    ((X) & MSEG_FLG_HUGE)
+
 #ifdef DEBUG
 #define DBG(F,...) fprintf(stderr, (F), __VA_ARGS__ )
 #else
@@ -105,7 +109,8 @@ const ErtsMsegOpt_t erts_mseg_default_opt = {
     1,			/* Preserv data		     */
     0,			/* Absolute shrink threshold */
     0,			/* Relative shrink threshold */
-    0			/* Scheduler specific        */
+    0,			/* Scheduler specific        */
+    0			/* Huge pages                */
 };
 
 
@@ -131,6 +136,7 @@ typedef struct cache_t_ cache_t;
 struct cache_t_ {
     UWord size;
     void *seg;
+    Uint flags;
     cache_t *next;
     cache_t *prev;
 };
@@ -147,13 +153,15 @@ struct ErtsMsegAllctr_t_ {
 
     int is_cache_check_scheduled;
 
-    cache_t cache[MAX_CACHE_SIZE];
+    cache_t *cache;
     cache_t cache_unpowered_node;
     cache_t cache_powered_node[CACHE_AREAS];
     cache_t cache_free;
 
     Sint cache_size;
     Uint cache_hits;
+    Uint cache_target;
+    Uint cache_churn;
 
     struct {
 	struct {
@@ -172,6 +180,7 @@ struct ErtsMsegAllctr_t_ {
     } segments;
 
     Uint max_cache_size;
+    Uint cache_slots;
     Uint abs_max_cache_bad_fit;
     Uint rel_max_cache_bad_fit;
 
@@ -367,6 +376,7 @@ do {									\
 static ERTS_INLINE void mseg_cache_clear_node(cache_t *c) {
     c->seg = NULL;
     c->size = 0;
+    c->flags = 0;
     c->next = c;
     c->prev = c;
 }
@@ -390,8 +400,9 @@ static ERTS_INLINE int cache_bless_segment(ErtsMsegAllctr_t *ma, void *seg, UWor
 	c = erts_circleq_head(&(ma->cache_free));
 	erts_circleq_remove(c);
 
-	c->seg  = seg;
-	c->size = size;
+	c->seg   = seg;
+	c->size  = size;
+	c->flags = flags & MSEG_FLG_HUGE;
 
 	if (MSEG_FLG_IS_2POW(flags)) {
 	    int ix = SIZE_TO_CACHE_AREA_IDX(size);
@@ -417,8 +428,9 @@ static ERTS_INLINE int cache_bless_segment(ErtsMsegAllctr_t *ma, void *seg, UWor
 	mseg_destroy(ma, ERTS_MSEG_FLG_NONE, c->seg, c->size);
 	mseg_cache_clear_node(c);
 
-	c->seg  = seg;
-	c->size = size;
+	c->seg   = seg;
+	c->size  = size;
+	c->flags = flags & MSEG_FLG_HUGE;
 
 	erts_circleq_push_head(&(ma->cache_unpowered_node), c);
 
@@ -444,8 +456,9 @@ static ERTS_INLINE int cache_bless_segment(ErtsMsegAllctr_t *ma, void *seg, UWor
 
 	    mseg_cache_clear_node(c);
 
-	    c->seg  = seg;
-	    c->size = size;
+	    c->seg   = seg;
+	    c->size  = size;
+	    c->flags = flags & MSEG_FLG_HUGE;
 
 	    erts_circleq_push_head(&(ma->cache_unpowered_node), c);
 
@@ -472,11 +485,18 @@ static ERTS_INLINE void *cache_get_segment(ErtsMsegAllctr_t *ma, UWord *size_p,
 	ASSERT(IS_2POW(size));
 
 	for( i = ix; i < CACHE_AREAS; i++) {
+	    cache_t *found = NULL;
 
-	    if (erts_circleq_is_empty(&(ma->cache_powered_node[i])))
+	    erts_circleq_foreach(c, &(ma->cache_powered_node[i])) {
+		if (MSEG_FLG_IS_HUGE(c->flags) == MSEG_FLG_IS_HUGE(flags)) {
+		    found = c;
+		    break;
+		}
+	    }
+	    if (!found)
 		continue;
 
-	    c = erts_circleq_head(&(ma->cache_powered_node[i]));
+	    c = found;
 	    erts_circleq_remove(c);
 
 	    ASSERT(IS_2POW(c->size));
@@ -511,6 +531,8 @@ static ERTS_INLINE void *cache_get_segment(ErtsMsegAllctr_t *ma, UWord *size_p,
 
 	erts_circleq_foreach(c, &(ma->cache_unpowered_node)) {
 	    csize = c->size;
+	    if (MSEG_FLG_IS_HUGE(c->flags) != MSEG_FLG_IS_HUGE(flags))
+		continue;
 	    if (csize >= size) {
 		if (((csize - size)*100 < bad_max_rel*size) && (csize - size) < bad_max_abs ) {
 
@@ -582,7 +604,8 @@ static ERTS_INLINE Uint mseg_drop_one_cache_size(ErtsMsegAllctr_t *ma, Uint flag
     mseg_cache_clear_node(c);
     erts_circleq_push_head(&(ma->cache_free), c);
 
-    ma->segments.current.watermark--;
+    if (ma->segments.current.watermark)
+	ma->segments.current.watermark--;
     ma->cache_size--;
 
     ASSERT(ma->cache_size >= 0);
@@ -606,7 +629,8 @@ static ERTS_INLINE Uint mseg_drop_cache_size(ErtsMsegAllctr_t *ma, Uint flags, c
 	mseg_cache_clear_node(c);
 	erts_circleq_push_head(&(ma->cache_free), c);
 
-	ma->segments.current.watermark--;
+	if (ma->segments.current.watermark)
+	    ma->segments.current.watermark--;
 	ma->cache_size--;
     }
 
@@ -636,6 +660,35 @@ static Uint mseg_check_cache(ErtsMsegAllctr_t *ma) {
     return 0;
 }
 
+/* mseg_cache_churn
+ * - Count a cacheable segment deallocated since the last check. The
+ *   target follows a burst up at once, on the deallocation itself, up
+ *   to the number of cache slots.
+ */
+
+static ERTS_INLINE void mseg_cache_churn(ErtsMsegAllctr_t *ma) {
+    ERTS_DBG_MA_CHK_THR_ACCESS(ma);
+
+    if (++ma->cache_churn > ma->cache_target)
+	ma->cache_target = MIN(ma->cache_churn, ma->cache_slots);
+    schedule_cache_check(ma);
+}
+
+/* mseg_cache_adapt
+ * - The target is halved for each check period with less churn than
+ *   the target, so that an idle allocator ends up keeping nothing.
+ */
+
+static void mseg_cache_adapt(ErtsMsegAllctr_t *ma) {
+    Uint churn = ma->cache_churn;
+
+    ERTS_DBG_MA_CHK_THR_ACCESS(ma);
+
+    ma->cache_churn = 0;
+    if (churn < ma->cache_target)
+	ma->cache_target = (ma->cache_target + churn) / 2;
+}
+
 /* mseg_cache_check
  * - Check if we have some cache we can purge
  */
@@ -645,11 +698,16 @@ static void mseg_cache_check(ErtsMsegAllctr_t *ma) {
 
     ERTS_MSEG_LOCK(ma);
 
-    if (mseg_check_cache(ma))
+    mseg_cache_adapt(ma);
+
+    while (ma->cache_size > ma->cache_target && mseg_check_cache(ma))
+	;
+
+    if (ma->cache_size || ma->cache_target)
         empty_cache = 0;
 
-    /* If all MemKinds caches are empty,
-     * remove aux-work callback
+    /* If all MemKinds caches are empty and there has been no churn
+     * for a while, remove aux-work callback
      */
     if (empty_cache) {
 	ma->is_cache_check_scheduled = 0;
@@ -708,6 +766,64 @@ void erts_mseg_clear_cache(void) {
     mseg_clear_cache(ERTS_MSEG_ALLCTR_IX(0));
 }
 
+/* Shared cache
+ * - Scheduler specific instances only keep as many segments as their
+ *   own churn calls for. Segments beyond that are handed to the cache
+ *   of instance 0, which all instances fall back on when their own
+ *   cache misses. This way a burst on one scheduler can be served by
+ *   segments freed on another, and idle schedulers hold no memory.
+ *   Instance 0 has +MMmcs slots per instance, and its target follows
+ *   the churn of all instances handing segments to it.
+ * - Cached segments are keyed on their huge page advice (see
+ *   cache_get_segment()), so a segment advised by an allocator with
+ *   +M<S>hp is never handed to an allocator without it through here.
+ */
+
+static ERTS_INLINE ErtsMsegAllctr_t *shared_allctr(ErtsMsegAllctr_t *ma)
+{
+    ErtsMsegAllctr_t *sma = ERTS_MSEG_ALLCTR_IX(0);
+    return sma == ma ? NULL : sma;
+}
+
+static void *shared_cache_get_segment(ErtsMsegAllctr_t *ma, UWord *size_p, Uint flags)
+{
+    ErtsMsegAllctr_t *sma = shared_allctr(ma);
+    void *seg = NULL;
+
+    /* Unlocked peek; a stale value only costs a miss or a lock */
+    if (!sma || *((volatile Sint *) &sma->cache_size) <= 0)
+	return NULL;
+
+    ERTS_MSEG_LOCK(sma);
+    if (sma->cache_size > 0)
+	seg = cache_get_segment(sma, size_p, flags);
+    ERTS_MSEG_UNLOCK(sma);
+
+    return seg;
+}
+
+static int shared_cache_bless_segment(ErtsMsegAllctr_t *ma, void *seg, UWord size, Uint flags)
+{
+    ErtsMsegAllctr_t *sma = shared_allctr(ma);
+    int res;
+
+    if (!sma)
+	return 0;
+
+    ERTS_MSEG_LOCK(sma);
+    res = cache_bless_segment(sma, seg, size, flags);
+    if (res) {
+	/* The segment now counts towards the watermark of the shared cache */
+	if (ma->segments.current.watermark)
+	    ma->segments.current.watermark--;
+	sma->segments.current.watermark++;
+	mseg_cache_churn(sma);
+    }
+    ERTS_MSEG_UNLOCK(sma);
+
+    return res;
+}
+
 static void *
 mseg_alloc(ErtsMsegAllctr_t *ma, ErtsAlcType_t atype, UWord *size_p,
 	   Uint flags, const ErtsMsegOpt_t *opt)
@@ -727,8 +843,15 @@ mseg_alloc(ErtsMsegAllctr_t *ma, ErtsAlcType_t atype, UWord *size_p,
 	}
     }
 
-    if (opt->cache && ma->cache_size > 0 && (seg = cache_get_segment(ma, &size, flags)) != NULL)
-	goto done;
+    if (opt->huge_pages)
+	flags |= MSEG_FLG_HUGE;
+
+    if (opt->cache) {
+	if (ma->cache_size > 0 && (seg = cache_get_segment(ma, &size, flags)) != NULL)
+	    goto done;
+	if ((seg = shared_cache_get_segment(ma, &size, flags)) != NULL)
+	    goto done;
+    }
 
     seg = mseg_create(ma, flags, &size);
 
@@ -737,6 +860,8 @@ mseg_alloc(ErtsMsegAllctr_t *ma, ErtsAlcType_t atype, UWord *size_p,
     else {
 done:
 	*size_p = size;
+	if (opt->huge_pages)
+	    erts_mmap_advise_huge(seg, size);
 	if (erts_mtrace_enabled)
 	    erts_mtrace_crr_alloc(seg, atype, ERTS_MTRACE_SEGMENT_ID, size);
 
@@ -753,9 +878,17 @@ mseg_dealloc(ErtsMsegAllctr_t *ma, ErtsAlcType_t atype, void *seg, UWord size,
 {
     ERTS_MSEG_DEALLOC_STAT(ma,size);
 
-    if (opt->cache && cache_bless_segment(ma, seg, size, flags)) {
-	schedule_cache_check(ma);
-	goto done;
+    if (opt->huge_pages)
+	flags |= MSEG_FLG_HUGE;
+
+    if (opt->cache) {
+	mseg_cache_churn(ma);
+	if (!shared_allctr(ma) || ma->cache_size < ma->cache_target) {
+	    if (cache_bless_segment(ma, seg, size, flags))
+		goto done;
+	}
+	else if (shared_cache_bless_segment(ma, seg, size, flags))
+	    goto done;
     }
 
     if (erts_mtrace_enabled)
@@ -830,6 +963,9 @@ mseg_realloc(ErtsMsegAllctr_t *ma, ErtsAlcType_t atype, void *seg,
 	}
     }
 
+    if (opt->huge_pages && new_seg && (new_seg != seg || new_size > old_size))
+	erts_mmap_advise_huge(new_seg, new_size);
+
     if (erts_mtrace_enabled)
 	erts_mtrace_crr_realloc(new_seg, atype, SEGTYPE, seg, new_size);
 
@@ -857,6 +993,7 @@ static struct {
     Eterm name;
     Eterm status;
     Eterm cached_segments;
+    Eterm cache_target;
     Eterm cache_hits;
     Eterm segments;
     Eterm segments_size;
@@ -911,6 +1048,7 @@ init_atoms(ErtsMsegAllctr_t *ma)
 
 	AM_INIT(status);
 	AM_INIT(cached_segments);
+	AM_INIT(cache_target);
 	AM_INIT(cache_hits);
 	AM_INIT(segments);
 	AM_INIT(segments_size);
@@ -1122,6 +1260,7 @@ info_status(ErtsMsegAllctr_t *ma, int *print_to_p, void *print_to_arg,
 
         if (!only_sz) {
             erts_print(to, arg, "cached_segments: %beu\n", ma->cache_size);
+            erts_print(to, arg, "cache_target: %beu\n", ma->cache_target);
             erts_print(to, arg, "cache_hits: %beu\n", ma->cache_hits);
             erts_print(to, arg, "segments: %beu %beu %beu\n",
                        ma->segments.current.no, ma->segments.max.no, ma->segments.max_ever.no);
@@ -1151,6 +1290,9 @@ info_status(ErtsMsegAllctr_t *ma, int *print_to_p, void *print_to_arg,
             add_2tup(hpp, szp, &res,
                      am.cache_hits,
                      bld_unstable_uint(hpp, szp, ma->cache_hits));
+            add_2tup(hpp, szp, &res,
+                     am.cache_target,
+                     bld_unstable_uint(hpp, szp, ma->cache_target));
             add_2tup(hpp, szp, &res,
                      am.cached_segments,
                      bld_unstable_uint(hpp, szp, ma->cache_size));
@@ -1274,6 +1416,28 @@ erts_mseg_info(int ix,
     return res;
 }
 
+/*
+ * Read the statistics of instance 'ix' without taking its lock. Each
+ * counter is a single word, so no value is torn, but the values may be
+ * from slightly different points in time. Returns 0 if there is no
+ * such instance.
+ */
+int
+erts_mseg_stats(int ix, ErtsMsegStats_t *stats)
+{
+    ErtsMsegAllctr_t *ma;
+
+    if (ix < 0 || no_mseg_allocators <= ix)
+	return 0;
+
+    ma = ERTS_MSEG_ALLCTR_IX(ix);
+    stats->segments = *((volatile Uint *) &ma->segments.current.no);
+    stats->segments_size = *((volatile Uint *) &ma->segments.current.sz);
+    stats->cached_segments = (UWord) *((volatile Sint *) &ma->cache_size);
+    stats->cache_hits = *((volatile Uint *) &ma->cache_hits);
+    return 1;
+}
+
 void *
 erts_mseg_alloc_opt(ErtsAlcType_t atype, UWord *size_p, Uint flags, const ErtsMsegOpt_t *opt)
 {
@@ -1371,15 +1535,15 @@ static void mem_cache_init(ErtsMsegAllctr_t *ma)
 
     /* Populate cache free list */
 
-    ASSERT(ma->max_cache_size <= MAX_CACHE_SIZE);
-
-    for (i = 0; i < ma->max_cache_size; i++) {
+    for (i = 0; i < ma->cache_slots; i++) {
 	mseg_cache_clear_node(&(ma->cache[i]));
 	erts_circleq_push_head(&(ma->cache_free), &(ma->cache[i]));
     }
 
     ma->cache_size = 0;
     ma->cache_hits = 0;
+    ma->cache_target = ma->cache_slots;
+    ma->cache_churn = 0;
 
     ma->segments.current.watermark = 0;
     ma->segments.current.no = 0;
@@ -1455,6 +1619,14 @@ erts_mseg_init(ErtsMsegInit_t *init)
 	if (ma->max_cache_size > MAX_CACHE_SIZE)
 	    ma->max_cache_size = MAX_CACHE_SIZE;
 
+	/* Instance 0 also holds the shared cache */
+	ma->cache_slots = ma->max_cache_size;
+	if (i == 0)
+	    ma->cache_slots *= no_mseg_allocators;
+	ma->cache = (cache_t *) malloc(sizeof(cache_t)*(ma->cache_slots + 1));
+	if (!ma->cache)
+	    erts_exit(ERTS_ABORT_EXIT, "erts_mseg: Failed to allocate segment cache\n");
+
 	mem_cache_init(ma);
 
 	sys_memzero((void *) &ma->calls, sizeof(ErtsMsegCalls));
@@ -81,10 +81,18 @@ typedef struct {
     UWord abs_shrink_th;
     UWord rel_shrink_th;
     int sched_spec;
+    int huge_pages;
 } ErtsMsegOpt_t;
 
 extern const ErtsMsegOpt_t erts_mseg_default_opt;
 
+typedef struct {
+    UWord segments;
+    UWord segments_size;
+    UWord cached_segments;
+    UWord cache_hits;
+} ErtsMsegStats_t;
+
 void *erts_mseg_alloc(ErtsAlcType_t, UWord *, Uint);
 void *erts_mseg_alloc_opt(ErtsAlcType_t, UWord *, Uint, const ErtsMsegOpt_t *);
 void  erts_mseg_dealloc(ErtsAlcType_t, void *, UWord, Uint);
@@ -100,6 +108,7 @@ void  erts_mseg_late_init(void); /* Have to be called after all allocators,
 				   threads and timers have been initialized. */
 Eterm erts_mseg_info_options(int, int *, void*, Uint **, Uint *);
 Eterm erts_mseg_info(int, int *, void*, int, int, Uint **, Uint *);
+int   erts_mseg_stats(int, ErtsMsegStats_t *);
 
 #endif /* #if HAVE_ERTS_MSEG */
 
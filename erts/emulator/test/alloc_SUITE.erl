@@ -31,7 +31,13 @@
 	 mseg_clear_cache/1,
 	 erts_mmap/1,
 	 cpool/1,
-	 migration/1]).
+	 migration/1,
+	 slab/1,
+	 trace_replay/1,
+	 huge_pages/1,
+	 discard/1,
+	 defrag/1,
+	 mseg_cache/1]).
 
 -include_lib("common_test/include/ct.hrl").
 
@@ -41,7 +47,8 @@ suite() ->
 
 all() -> 
     [basic, coalesce, threads, realloc_copy, bucket_index,
-     bucket_mask, rbtree, mseg_clear_cache, erts_mmap, cpool, migration].
+     bucket_mask, rbtree, mseg_clear_cache, erts_mmap, cpool, migration,
+     slab, trace_replay, huge_pages, discard, defrag, mseg_cache].
 
 init_per_testcase(Case, Config) when is_list(Config) ->
     [{testcase, Case},{debug,false}|Config].
@@ -63,6 +70,8 @@ bucket_mask(Cfg) -> drv_case(Cfg).
 rbtree(Cfg) -> drv_case(Cfg).
 mseg_clear_cache(Cfg) -> drv_case(Cfg).
 cpool(Cfg) -> drv_case(Cfg).
+slab(Cfg) -> drv_case(Cfg).
+trace_replay(Cfg) -> drv_case(Cfg).
 
 migration(Cfg) ->
     case erlang:system_info(smp_support) of
@@ -85,6 +94,120 @@ erts_mmap(Config) when is_list(Config) ->
 				  | io_lib:format("~p",[SkipOs])])}
     end.
 
+%% Check that +M<S>hp is reported per allocator, and that carriers of
+%% the allocator are usable.
+huge_pages(Config) when is_list(Config) ->
+    Expect = case os:type() of
+                 {unix, linux} -> true;
+                 _ -> false
+             end,
+    node_case(Config, "+MHhp true +MEhp true",
+              fun () ->
+                      T = ets:new(?MODULE, []),
+                      ets:insert(T, [{I, lists:seq(1, 100)}
+                                     || I <- lists:seq(1, 10000)]),
+                      10000 = ets:info(T, size),
+                      [Expect] = lists:usort(alloc_info(eheap_alloc, [options, hp])),
+                      [Expect] = lists:usort(alloc_info(ets_alloc, [options, hp])),
+                      [false] = lists:usort(alloc_info(binary_alloc, [options, hp])),
+                      ok
+              end).
+
+%% Check that free memory in multiblock carriers is discarded by
+%% +M<S>dt once the blocks have been free for a while.
+discard(Config) when is_list(Config) ->
+    node_case(Config, "+MBdt 64 +MBacul 0",
+              fun () ->
+                      case lists:usort(alloc_info(binary_alloc, [options, dt])) of
+                          [0] ->
+                              {skipped, "Not supported on this system"};
+                          [65536] ->
+                              Bins = [binary:copy(<<I>>, 100000)
+                                      || I <- lists:seq(1, 255)],
+                              Keep = [B || {I, B} <- lists:zip(lists:seq(1, 255), Bins),
+                                           I rem 50 =:= 0],
+                              erlang:garbage_collect(),
+                              ok = wait_until(fun () ->
+                                                      alloc_sum(binary_alloc, [discarded, size]) > 0
+                                              end, nothing_discarded),
+                              %% Keep the carriers from being released meanwhile
+                              5 = length(Keep),
+                              ok
+                      end
+              end).
+
+%% Check that sparse ets_alloc carriers are evacuated, and on builds
+%% without debug wrappers around blocks, that ETS objects are moved out
+%% of them so that the carriers are released.
+defrag(Config) when is_list(Config) ->
+    node_case(Config, "+MEdcul 50 +MEacul 0",
+              fun () ->
+                      case alloc_info(ets_alloc, [defrag]) of
+                          [undefined|_] ->
+                              {skipped, "Not supported on this system"};
+                          _ ->
+                              T = ets:new(defrag, [set, public]),
+                              N = 100000,
+                              ets:insert(T, [{I} || I <- lists:seq(1, N)]),
+                              [ets:insert(T, {I, erlang:make_tuple(50, I)})
+                               || I <- lists:seq(1, N)],
+                              [ets:delete(T, I) || I <- lists:seq(1, N),
+                                                   I rem 10 =/= 0],
+                              ok = wait_until(fun () ->
+                                                      alloc_sum(ets_alloc, [defrag, evacuated]) > 0
+                                              end, nothing_evacuated),
+                              case erlang:system_info(build_type) of
+                                  opt ->
+                                      ok = wait_until(fun () ->
+                                                              alloc_sum(ets_alloc, [defrag, carriers]) > 0
+                                                      end, no_carriers_released);
+                                  _ ->
+                                      ok
+                              end,
+                              Size = N div 10,
+                              Size = ets:info(T, size),
+                              ok
+                      end
+              end).
+
+%% Check that segments freed on one scheduler beyond what its mseg_alloc
+%% instance keeps are shared with other schedulers through instance 0,
+%% and that the caches are emptied once the churn stops.
+mseg_cache(Config) when is_list(Config) ->
+    node_case(Config, "+S 3:3 +MMmcs 10",
+              fun () ->
+                      case erlang:system_info({allocator, mseg_alloc}) of
+                          false ->
+                              {skipped, "No mseg_alloc"};
+                          _ ->
+                              %% Instance 0 is listed first
+                              Status = [memkind, status],
+                              Shared = fun (Key) ->
+                                               hd(alloc_info(mseg_alloc, Status ++ [Key]))
+                                       end,
+                              %% The 'DOWN' message may arrive before the
+                              %% binaries of the process are freed
+                              sbc_burst(2, 20),
+                              ok = wait_until(fun () ->
+                                                      Shared(cached_segments) > 0
+                                              end, nothing_shared),
+                              Hits = Shared(cache_hits),
+                              sbc_burst(3, 20),
+                              true = Shared(cache_hits) > Hits,
+                              wait_until(fun () ->
+                                                 alloc_sum(mseg_alloc, Status ++ [cached_segments]) =:= 0
+                                         end, mseg_cache_not_emptied)
+                      end
+              end).
+
+sbc_burst(Sched, N) ->
+    {Pid, Mon} = spawn_opt(fun () ->
+                                   Bins = [binary:copy(<<I>>, 1024*1024)
+                                           || I <- lists:seq(1, N)],
+                                   N = length(Bins)
+                           end, [{scheduler, Sched}, monitor]),
+    receive {'DOWN', Mon, process, Pid, normal} -> ok end.
+
 %% Check if there are ERL_FLAGS set that will mess up this test case
 mmsc_flags() ->
     case mmsc_flags("ERL_FLAGS") of
@@ -149,6 +272,47 @@ erts_mmap_do(Config, SCO, SCRPM, SCRFSD) ->
 %% Internal functions                                                     %%
 %%                                                                        %%
 
+%% Run Fun on a node started with NodeOpts. Fun returns ok, or
+%% {skipped, Reason} if the node lacks what the test case needs.
+node_case(Config, NodeOpts, Fun) ->
+    {ok, Node} = start_node(Config, NodeOpts),
+    Res = rpc:call(Node, erlang, apply, [Fun, []]),
+    stop_node(Node),
+    case Res of
+        ok -> ok;
+        {skipped, _} -> Res;
+        _ -> ct:fail(Res)
+    end.
+
+%% The value at Path in the info of each instance of Alloc, where Path
+%% is a list of keys, e.g. [options, hp]. Missing keys give undefined.
+alloc_info(Alloc, Path) ->
+    [lists:foldl(fun (Key, List) when is_list(List) ->
+                         proplists:get_value(Key, List);
+                     (_, _) ->
+                         undefined
+                 end, Info, Path)
+     || {instance, _, Info} <- erlang:system_info({allocator, Alloc})].
+
+alloc_sum(Alloc, Path) ->
+    lists:sum([V || V <- alloc_info(Alloc, Path), is_integer(V)]).
+
+%% Poll Check every 500 ms until it returns true, and fail with Reason
+%% after 10 seconds.
+wait_until(Check, Reason) ->
+    wait_until(Check, Reason, 20).
+
+wait_until(_Check, Reason, 0) ->
+    ct:fail(Reason);
+wait_until(Check, Reason, N) ->
+    case Check() of
+        true ->
+            ok;
+        false ->
+            receive after 500 -> ok end,
+            wait_until(Check, Reason, N-1)
+    end.
+
 drv_case(Config) ->
     drv_case(Config, one_shot, "").
 
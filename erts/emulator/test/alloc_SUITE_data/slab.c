@@ -0,0 +1,161 @@
+/*
+ * %CopyrightBegin%
+ *
+ * Copyright Ericsson AB 2016. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * %CopyrightEnd%
+ */
+
+/*
+ * Tests size class slabs (+M<S>as slab).
+ */
+
+#include "testcase_driver.h"
+#include "allocator_test.h"
+
+#define NO_BLOCKS 10000
+#define MAX_SLAB_SZ 256
+
+typedef struct {
+    Allctr_t *a;
+    unsigned char **blks;
+    Ulong *szs;
+} SlabTest_t;
+
+static unsigned int rnd_state;
+
+static Ulong
+rnd(Ulong max)
+{
+    rnd_state = rnd_state * 1103515245 + 12345;
+    return ((rnd_state >> 16) % max) + 1;
+}
+
+static void
+fill(unsigned char *p, Ulong sz, Ulong i)
+{
+    Ulong j;
+    for (j = 0; j < sz; j++)
+	p[j] = (unsigned char) (i + j);
+}
+
+static int
+check(unsigned char *p, Ulong sz, Ulong i)
+{
+    Ulong j;
+    for (j = 0; j < sz; j++)
+	if (p[j] != (unsigned char) (i + j))
+	    return 0;
+    return 1;
+}
+
+char *
+testcase_name(void)
+{
+    return "slab";
+}
+
+void
+testcase_run(TestCaseState_t *tcs)
+{
+    char *argv[] = {"-tasslab", NULL};
+    SlabTest_t *st;
+    Allctr_t *a;
+    Carrier_t *c;
+    Block_t *blk;
+    unsigned char *p, *q;
+    Ulong i;
+
+    st = testcase_alloc(sizeof(SlabTest_t));
+    ASSERT(tcs, st);
+    st->a = NULL;
+    st->blks = testcase_alloc(NO_BLOCKS*sizeof(unsigned char *));
+    st->szs = testcase_alloc(NO_BLOCKS*sizeof(Ulong));
+    tcs->extra = (void *) st;
+    ASSERT(tcs, st->blks && st->szs);
+
+    a = st->a = START_ALC("slab_", 0, argv);
+    ASSERT(tcs, a);
+
+    /* A freed small block stays in its slab and is handed out again */
+    p = ALLOC(a, 24);
+    ASSERT(tcs, p);
+    FREE(a, p);
+    c = FIRST_MBC(a);
+    blk = MBC_TO_FIRST_BLK(a, c);
+    ASSERT(tcs, !IS_FREE_BLK(blk));
+    q = ALLOC(a, 24);
+    ASSERT(tcs, q == p);
+    FREE(a, q);
+
+    /* Blocks above the slab limit go to the strategy */
+    p = ALLOC(a, 2*MAX_SLAB_SZ);
+    ASSERT(tcs, p);
+    ASSERT(tcs, !IS_SBC_BLK(UMEM2BLK(p)));
+    FREE(a, p);
+
+    /* Mixed sizes around the slab limit, reallocated across it */
+    rnd_state = 4711;
+    for (i = 0; i < NO_BLOCKS; i++) {
+	st->szs[i] = rnd(MAX_SLAB_SZ + MAX_SLAB_SZ/2);
+	st->blks[i] = ALLOC(a, st->szs[i]);
+	ASSERT(tcs, st->blks[i]);
+	ASSERT(tcs, UMEM_SZ(UMEM2BLK(st->blks[i])) >= st->szs[i]);
+	fill(st->blks[i], st->szs[i], i);
+    }
+    for (i = 0; i < NO_BLOCKS; i += 2) {
+	ASSERT(tcs, check(st->blks[i], st->szs[i], i));
+	FREE(a, st->blks[i]);
+	st->szs[i] = rnd(MAX_SLAB_SZ/4);
+	st->blks[i] = ALLOC(a, st->szs[i]);
+	ASSERT(tcs, st->blks[i]);
+	fill(st->blks[i], st->szs[i], i);
+    }
+    for (i = 1; i < NO_BLOCKS; i += 2) {
+	Ulong sz = rnd(2*MAX_SLAB_SZ);
+	ASSERT(tcs, check(st->blks[i], st->szs[i], i));
+	st->blks[i] = REALLOC(a, st->blks[i], sz);
+	ASSERT(tcs, st->blks[i]);
+	ASSERT(tcs, check(st->blks[i], sz < st->szs[i] ? sz : st->szs[i], i));
+	st->szs[i] = sz;
+	fill(st->blks[i], sz, i);
+    }
+    for (i = 0; i < NO_BLOCKS; i++) {
+	ASSERT(tcs, check(st->blks[i], st->szs[i], i));
+	FREE(a, st->blks[i]);
+    }
+
+    STOP_ALC(st->a);
+    st->a = NULL;
+}
+
+void
+testcase_cleanup(TestCaseState_t *tcs)
+{
+    SlabTest_t *st = (SlabTest_t *) tcs->extra;
+    if (st) {
+	if (st->a)
+	    STOP_ALC(st->a);
+	if (st->blks)
+	    testcase_free(st->blks);
+	if (st->szs)
+	    testcase_free(st->szs);
+	testcase_free(st);
+	tcs->extra = NULL;
+    }
+}
+
+ERL_NIF_INIT(slab, testcase_nif_funcs, testcase_nif_init,
+	     NULL, NULL, NULL);
@@ -0,0 +1,573 @@
+/*
+ * %CopyrightBegin%
+ *
+ * Copyright Ericsson AB 2016. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * %CopyrightEnd%
+ */
+
+/*
+ * Replays allocation traces against every allocation strategy with
+ * default and small carriers, and reports throughput, peak carrier
+ * footprint and how much of that peak is not covered by the peak
+ * amount of live data, i.e. fragmentation and carrier overhead.
+ *
+ * The built in traces are synthesized to resemble process heaps,
+ * ETS tables, binaries and message passing. A recorded trace can be
+ * replayed as well by pointing ERTS_ALLOC_TRACE at a text file with
+ * one operation per line:
+ *
+ *   a <id> <size>	allocate block <id>
+ *   r <id> <size>	reallocate block <id>
+ *   f <id>		free block <id>
+ *
+ * which is what an erl_mtrace stream reduces to once carrier
+ * operations are dropped and addresses are mapped to ids.
+ */
+
+#include "testcase_driver.h"
+#include "allocator_test.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define TRACE_OPS 200000
+#define FOOTPRINT_INTERVAL 256
+
+#define OP_ALLOC	0
+#define OP_REALLOC	1
+#define OP_FREE		2
+
+typedef struct {
+    unsigned char op;
+    Ulong id;
+    Ulong size;
+} TraceOp_t;
+
+typedef struct {
+    char *name;
+    TraceOp_t *ops;
+    Ulong no_ops;
+    Ulong max_ops;
+    Ulong no_ids;
+    /* Used while building */
+    Ulong *sizes;
+    Ulong *live;
+    Ulong *live_ix;
+    Ulong no_live;
+    Ulong *free_ids;
+    Ulong no_free_ids;
+} Trace_t;
+
+typedef struct {
+    Allctr_t *a;
+    Trace_t *traces[5];
+    int no_traces;
+    void **blks;
+    Ulong *szs;
+    Ulong no_blks;
+} ReplayTest_t;
+
+static char *strategies[] = {
+    "bf", "aobf", "aoff", "aoffcbf", "aoffcaobf", "gf", "af", "slab", NULL
+};
+
+static struct {
+    char *name;
+    char *argv[4];
+} carriers[] = {
+    {"default", {NULL}},
+    {"small", {"-tsmbcs64", "-tlmbcs512", "-tsbct128", NULL}},
+    {NULL, {NULL}}
+};
+
+static unsigned int rnd_state;
+
+static Ulong
+rnd(Ulong max)
+{
+    rnd_state = rnd_state * 1103515245 + 12345;
+    return (((Ulong) rnd_state >> 8) % max);
+}
+
+static Ulong
+rnd_range(Ulong min, Ulong max)
+{
+    return min + rnd(max - min + 1);
+}
+
+static Trace_t *
+trace_new(char *name, Ulong max_ops, Ulong max_ids)
+{
+    Trace_t *t = testcase_alloc(sizeof(Trace_t));
+    if (!t)
+	return NULL;
+    memset((void *) t, 0, sizeof(Trace_t));
+    t->name = name;
+    t->max_ops = max_ops;
+    t->ops = testcase_alloc(max_ops*sizeof(TraceOp_t));
+    t->sizes = testcase_alloc(max_ids*sizeof(Ulong));
+    t->live = testcase_alloc(max_ids*sizeof(Ulong));
+    t->live_ix = testcase_alloc(max_ids*sizeof(Ulong));
+    t->free_ids = testcase_alloc(max_ids*sizeof(Ulong));
+    if (!t->ops || !t->sizes || !t->live || !t->live_ix || !t->free_ids)
+	return NULL;
+    return t;
+}
+
+static void
+trace_free(Trace_t *t)
+{
+    if (t->ops)
+	testcase_free(t->ops);
+    if (t->sizes)
+	testcase_free(t->sizes);
+    if (t->live)
+	testcase_free(t->live);
+    if (t->live_ix)
+	testcase_free(t->live_ix);
+    if (t->free_ids)
+	testcase_free(t->free_ids);
+    testcase_free(t);
+}
+
+static void
+trace_op(Trace_t *t, int op, Ulong id, Ulong size)
+{
+    TraceOp_t *top = &t->ops[t->no_ops++];
+    top->op = (unsigned char) op;
+    top->id = id;
+    top->size = size;
+}
+
+static int
+trace_full(Trace_t *t)
+{
+    /*
+     * Leave room for one more allocation and for freeing everything
+     * still alive.
+     */
+    return t->no_ops + t->no_live + 2 > t->max_ops;
+}
+
+static Ulong
+trace_alloc(Trace_t *t, Ulong size)
+{
+    Ulong id;
+    if (t->no_free_ids)
+	id = t->free_ids[--t->no_free_ids];
+    else
+	id = t->no_ids++;
+    t->sizes[id] = size;
+    t->live_ix[id] = t->no_live;
+    t->live[t->no_live++] = id;
+    trace_op(t, OP_ALLOC, id, size);
+    return id;
+}
+
+/* 'ix' is an index into the live array, not an id */
+static void
+trace_realloc(Trace_t *t, Ulong ix, Ulong size)
+{
+    Ulong id = t->live[ix];
+    t->sizes[id] = size;
+    trace_op(t, OP_REALLOC, id, size);
+}
+
+static void
+trace_free_ix(Trace_t *t, Ulong ix)
+{
+    Ulong id = t->live[ix];
+    t->live[ix] = t->live[--t->no_live];
+    t->live_ix[t->live[ix]] = ix;
+    t->free_ids[t->no_free_ids++] = id;
+    trace_op(t, OP_FREE, id, 0);
+}
+
+static void
+trace_finish(Trace_t *t)
+{
+    while (t->no_live)
+	trace_free_ix(t, t->no_live - 1);
+    testcase_free(t->sizes);
+    testcase_free(t->live);
+    testcase_free(t->live_ix);
+    testcase_free(t->free_ids);
+    t->sizes = t->live = t->live_ix = t->free_ids = NULL;
+}
+
+/*
+ * Process heaps: spawned at 233 words, grown by reallocation in
+ * roughly Fibonacci steps, and freed when the process dies.
+ */
+static Trace_t *
+heap_trace(Ulong max_ops)
+{
+    Trace_t *t = trace_new("heaps", max_ops, 2000);
+    if (!t)
+	return NULL;
+    rnd_state = 17;
+    while (!trace_full(t)) {
+	Ulong r = rnd(100);
+	if (t->no_live < 50 || (r < 30 && t->no_live < 2000))
+	    trace_alloc(t, 233*8);
+	else if (r < 70) {
+	    Ulong ix = rnd(t->no_live);
+	    Ulong sz = t->sizes[t->live[ix]];
+	    if (sz < 4*1024*1024)
+		trace_realloc(t, ix, sz + sz/2 + sz/8);
+	    else
+		trace_realloc(t, ix, 233*8);
+	}
+	else
+	    trace_free_ix(t, rnd(t->no_live));
+    }
+    trace_finish(t);
+    return t;
+}
+
+/*
+ * ETS table: small long lived objects inserted and deleted at random,
+ * with the table occasionally cleared down to a fraction of its size.
+ */
+static Trace_t *
+ets_trace(Ulong max_ops)
+{
+    Trace_t *t = trace_new("ets", max_ops, 20000);
+    if (!t)
+	return NULL;
+    rnd_state = 4711;
+    while (!trace_full(t)) {
+	Ulong r = rnd(20000);
+	if (r == 0) {
+	    while (t->no_live > 1000 && !trace_full(t))
+		trace_free_ix(t, rnd(t->no_live));
+	}
+	else if (t->no_live < 20000 && r < 11000)
+	    trace_alloc(t, rnd_range(40, 400));
+	else if (t->no_live)
+	    trace_free_ix(t, rnd(t->no_live));
+    }
+    trace_finish(t);
+    return t;
+}
+
+/*
+ * Binaries: mostly small, some heap sized, a few large enough for
+ * single block carriers, and a share appended to in place.
+ */
+static Trace_t *
+binary_trace(Ulong max_ops)
+{
+    Trace_t *t = trace_new("binaries", max_ops, 2000);
+    if (!t)
+	return NULL;
+    rnd_state = 1234;
+    while (!trace_full(t)) {
+	Ulong r = rnd(100);
+	if (t->no_live < 2000 && r < 45) {
+	    Ulong k = rnd(100);
+	    if (k < 70)
+		trace_alloc(t, rnd_range(64, 1024));
+	    else if (k < 97)
+		trace_alloc(t, rnd_range(1024, 64*1024));
+	    else
+		trace_alloc(t, rnd_range(128*1024, 1024*1024));
+	}
+	else if (t->no_live && r < 55) {
+	    Ulong ix = rnd(t->no_live);
+	    Ulong sz = t->sizes[t->live[ix]];
+	    if (sz < 2*1024*1024)
+		trace_realloc(t, ix, 2*sz);
+	}
+	else if (t->no_live)
+	    trace_free_ix(t, rnd(t->no_live));
+    }
+    trace_finish(t);
+    return t;
+}
+
+/*
+ * Message passing: small messages freed in the order they were sent,
+ * with a queue length that drifts between short and long.
+ */
+static Trace_t *
+message_trace(Ulong max_ops)
+{
+    Trace_t *t = trace_new("messages", max_ops, 5000);
+    Ulong head = 0, qlen = 0, target = 10;
+    Ulong *queue;
+    if (!t)
+	return NULL;
+    queue = testcase_alloc(5000*sizeof(Ulong));
+    if (!queue) {
+	trace_free(t);
+	return NULL;
+    }
+    rnd_state = 99;
+    while (!trace_full(t)) {
+	if (rnd(10000) == 0)
+	    target = rnd_range(1, 5000);
+	if (qlen < target && rnd(2)) {
+	    Ulong id = trace_alloc(t, rnd_range(16, 256));
+	    queue[(head + qlen++) % 5000] = id;
+	}
+	else if (qlen) {
+	    Ulong id = queue[head];
+	    head = (head + 1) % 5000;
+	    qlen--;
+	    trace_free_ix(t, t->live_ix[id]);
+	}
+    }
+    testcase_free(queue);
+    trace_finish(t);
+    return t;
+}
+
+static Trace_t *
+file_trace(TestCaseState_t *tcs, char *path)
+{
+    FILE *f = fopen(path, "r");
+    Trace_t *t;
+    char op;
+    unsigned long id, size;
+    Ulong max_ops = 1024;
+
+    if (!f) {
+	testcase_printf(tcs, "Cannot open trace file %s\n", path);
+	return NULL;
+    }
+    t = testcase_alloc(sizeof(Trace_t));
+    ASSERT(tcs, t);
+    memset((void *) t, 0, sizeof(Trace_t));
+    t->name = "file";
+    t->ops = testcase_alloc(max_ops*sizeof(TraceOp_t));
+    ASSERT(tcs, t->ops);
+    while (fscanf(f, " %c %lu", &op, &id) == 2) {
+	size = 0;
+	if (op != 'f' && fscanf(f, " %lu", &size) != 1)
+	    break;
+	if (t->no_ops == max_ops) {
+	    max_ops *= 2;
+	    t->ops = testcase_realloc(t->ops, max_ops*sizeof(TraceOp_t));
+	    ASSERT(tcs, t->ops);
+	}
+	trace_op(t,
+		 op == 'a' ? OP_ALLOC : op == 'r' ? OP_REALLOC : OP_FREE,
+		 (Ulong) id, (Ulong) size);
+	if (id >= t->no_ids)
+	    t->no_ids = id + 1;
+    }
+    fclose(f);
+    t->max_ops = max_ops;
+    testcase_printf(tcs, "Read %lu operations from %s\n",
+		    (unsigned long) t->no_ops, path);
+    return t;
+}
+
+static Ulong
+footprint(Allctr_t *a)
+{
+    Carrier_t *c;
+    Ulong sz = 0;
+    for (c = FIRST_MBC(a); c; c = NEXT_C(c))
+	sz += C_SZ(c);
+    for (c = FIRST_SBC(a); c; c = NEXT_C(c))
+	sz += C_SZ(c);
+    return sz;
+}
+
+/*
+ * Replays the trace once. When 'peak' is set the carrier footprint is
+ * sampled along the way and the largest one seen is returned together
+ * with the largest live size; this is kept out of timed runs.
+ */
+static void
+replay(TestCaseState_t *tcs, ReplayTest_t *rt, Trace_t *t,
+       Ulong *peak, Ulong *peak_live)
+{
+    Allctr_t *a = rt->a;
+    Ulong i, live = 0;
+
+    for (i = 0; i < t->no_ops; i++) {
+	TraceOp_t *op = &t->ops[i];
+	Ulong id = op->id;
+	switch (op->op) {
+	case OP_ALLOC:
+	    if (rt->blks[id]) {
+		live -= rt->szs[id];
+		FREE(a, rt->blks[id]);
+	    }
+	    rt->blks[id] = ALLOC(a, op->size);
+	    ASSERT(tcs, rt->blks[id]);
+	    rt->szs[id] = op->size;
+	    live += op->size;
+	    if (op->size)
+		((unsigned char *) rt->blks[id])[op->size - 1] = (unsigned char) id;
+	    break;
+	case OP_REALLOC:
+	    live -= rt->szs[id];
+	    rt->blks[id] = REALLOC(a, rt->blks[id], op->size);
+	    ASSERT(tcs, rt->blks[id]);
+	    /* The old contents must survive a growing reallocation */
+	    if (rt->szs[id] && op->size >= rt->szs[id])
+		ASSERT(tcs, (((unsigned char *) rt->blks[id])[rt->szs[id] - 1]
+			     == (unsigned char) id));
+	    rt->szs[id] = op->size;
+	    live += op->size;
+	    if (op->size)
+		((unsigned char *) rt->blks[id])[op->size - 1] = (unsigned char) id;
+	    break;
+	default:
+	    if (rt->blks[id]) {
+		FREE(a, rt->blks[id]);
+		rt->blks[id] = NULL;
+		live -= rt->szs[id];
+		rt->szs[id] = 0;
+	    }
+	    break;
+	}
+	if (peak && (live > *peak_live || i % FOOTPRINT_INTERVAL == 0)) {
+	    Ulong fp = footprint(a);
+	    if (fp > *peak)
+		*peak = fp;
+	    if (live > *peak_live)
+		*peak_live = live;
+	}
+    }
+
+    /* Recorded traces need not free everything they allocate */
+    for (i = 0; i < t->no_ids; i++) {
+	if (rt->blks[i]) {
+	    FREE(a, rt->blks[i]);
+	    rt->blks[i] = NULL;
+	    rt->szs[i] = 0;
+	}
+    }
+}
+
+char *
+testcase_name(void)
+{
+    return "trace_replay";
+}
+
+void
+testcase_run(TestCaseState_t *tcs)
+{
+    ReplayTest_t *rt;
+    char *path;
+    Ulong max_ops = TRACE_OPS;
+    int i, s, c;
+
+    if (!enif_is_identical(tcs->build_type,
+			   enif_make_atom(tcs->curr_env, "opt")))
+	max_ops /= 10;
+
+    rt = testcase_alloc(sizeof(ReplayTest_t));
+    ASSERT(tcs, rt);
+    memset((void *) rt, 0, sizeof(ReplayTest_t));
+    tcs->extra = (void *) rt;
+
+    rt->traces[rt->no_traces++] = heap_trace(max_ops);
+    rt->traces[rt->no_traces++] = ets_trace(max_ops);
+    rt->traces[rt->no_traces++] = binary_trace(max_ops);
+    rt->traces[rt->no_traces++] = message_trace(max_ops);
+    path = getenv("ERTS_ALLOC_TRACE");
+    if (path)
+	rt->traces[rt->no_traces++] = file_trace(tcs, path);
+
+    for (i = 0; i < rt->no_traces; i++) {
+	ASSERT(tcs, rt->traces[i]);
+	if (rt->traces[i]->no_ids > rt->no_blks)
+	    rt->no_blks = rt->traces[i]->no_ids;
+    }
+    rt->blks = testcase_alloc(rt->no_blks*sizeof(void *));
+    rt->szs = testcase_alloc(rt->no_blks*sizeof(Ulong));
+    ASSERT(tcs, rt->blks && rt->szs);
+    memset((void *) rt->blks, 0, rt->no_blks*sizeof(void *));
+    memset((void *) rt->szs, 0, rt->no_blks*sizeof(Ulong));
+
+    testcase_printf(tcs, "%-9s %-10s %-8s %12s %10s %7s\n",
+		    "trace", "strategy", "carriers",
+		    "ops/s", "peak kB", "frag %");
+
+    for (i = 0; i < rt->no_traces; i++) {
+	Trace_t *t = rt->traces[i];
+	for (s = 0; strategies[s]; s++) {
+	    for (c = 0; carriers[c].name; c++) {
+		char *argv[7];
+		char as[32];
+		Ulong peak = 0, peak_live = 0;
+		clock_t start;
+		double secs;
+		int j;
+
+		/*
+		 * No main carrier; it would be large enough to hide the
+		 * footprint of the smaller traces under every strategy.
+		 */
+		sprintf(as, "-tas%s", strategies[s]);
+		argv[0] = as;
+		argv[1] = "-tmmbcs0";
+		for (j = 0; carriers[c].argv[j]; j++)
+		    argv[j+2] = carriers[c].argv[j];
+		argv[j+2] = NULL;
+
+		rt->a = START_ALC("trace_replay_", 0, argv);
+		ASSERT(tcs, rt->a);
+
+		start = clock();
+		replay(tcs, rt, t, NULL, NULL);
+		secs = ((double) (clock() - start)) / CLOCKS_PER_SEC;
+
+		replay(tcs, rt, t, &peak, &peak_live);
+		ASSERT(tcs, !FIRST_SBC(rt->a));
+
+		testcase_printf(tcs, "%-9s %-10s %-8s %12.0f %10lu %7.1f\n",
+				t->name, strategies[s], carriers[c].name,
+				secs > 0 ? (double) t->no_ops / secs : 0.0,
+				(unsigned long) (peak / 1024),
+				peak ? 100.0*(1.0 - (double) peak_live / peak) : 0.0);
+
+		STOP_ALC(rt->a);
+		rt->a = NULL;
+	    }
+	}
+    }
+}
+
+void
+testcase_cleanup(TestCaseState_t *tcs)
+{
+    ReplayTest_t *rt = (ReplayTest_t *) tcs->extra;
+    if (rt) {
+	int i;
+	if (rt->a)
+	    STOP_ALC(rt->a);
+	for (i = 0; i < rt->no_traces; i++)
+	    if (rt->traces[i])
+		trace_free(rt->traces[i]);
+	if (rt->blks)
+	    testcase_free(rt->blks);
+	if (rt->szs)
+	    testcase_free(rt->szs);
+	testcase_free(rt);
+	tcs->extra = NULL;
+    }
+}
+
+ERL_NIF_INIT(trace_replay, testcase_nif_funcs, testcase_nif_init,
+	     NULL, NULL, NULL);
@@ -0,0 +1,40 @@
+%%
+%% %CopyrightBegin%
+%%
+%% Copyright Ericsson AB 2016. All Rights Reserved.
+%%
+%% Licensed under the Apache License, Version 2.0 (the "License");
+%% you may not use this file except in compliance with the License.
+%% You may obtain a copy of the License at
+%%
+%%     http://www.apache.org/licenses/LICENSE-2.0
+%%
+%% Unless required by applicable law or agreed to in writing, software
+%% distributed under the License is distributed on an "AS IS" BASIS,
+%% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+%% See the License for the specific language governing permissions and
+%% limitations under the License.
+%%
+%% %CopyrightEnd%
+
+-module(bench_report).
+
+%% Reporting of benchmark results, shared by the *_bench_SUITE
+%% suites. A result is reported as a benchmark_data event in suite
+%% Prefix_Bench, and a list of results is returned as a comment.
+
+-export([report/4, format_result/1]).
+
+-include_lib("common_test/include/ct_event.hrl").
+
+report(Prefix, Bench, Name, Value) ->
+    ct_event:notify(
+      #event{name = benchmark_data,
+             data = [{suite, atom_to_list(Prefix) ++ "_" ++
+                          atom_to_list(Bench)},
+                     {name, Name},
+                     {value, Value}]}).
+
+format_result(Result) ->
+    string:join([Name ++ ": " ++ integer_to_list(Value) || {Name, Value} <- Result],
+                ", ").
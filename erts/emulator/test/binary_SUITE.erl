@@ -60,10 +60,10 @@
 	 bit_sized_binary_sizes/1,
 	 otp_6817/1,deep/1,obsolete_funs/1,robustness/1,otp_8117/1,
 	 otp_8180/1, trapping/1, large/1,
-	 error_after_yield/1, cmp_old_impl/1]).
+	 error_after_yield/1, cmp_old_impl/1, compact_sent_binaries/1]).
 
 %% Internal exports.
--export([sleeper/0,trapping_loop/4]).
+-export([sleeper/0,trapping_loop/4,sent_binary_sizes/0]).
 
 suite() -> [{ct_hooks,[ts_install_cth]},
 	    {timetrap,{minutes,4}}].
@@ -79,7 +79,7 @@ all() ->
      ordering, unaligned_order, gc_test,
      bit_sized_binary_sizes, otp_6817, otp_8117, deep,
      obsolete_funs, robustness, otp_8180, trapping, large,
-     error_after_yield, cmp_old_impl].
+     error_after_yield, cmp_old_impl, compact_sent_binaries].
 
 groups() -> 
     [].
@@ -1723,3 +1723,37 @@ list2bitstrlist([X0, X1, X2, X3, X4, X5 | Xs], Acc) when is_integer(X0), 0 =< X0
     list2bitstrlist(Xs, NewAcc);
 list2bitstrlist([X | Xs], Acc) ->
     list2bitstrlist(Xs, [Acc,X]).
+
+%% Test that +hsbc makes sent binaries referring to a small part of a
+%% large binary get binaries of their own.
+compact_sent_binaries(Config) when is_list(Config) ->
+    Big = 100000,
+    [Big, Big, Big, Big] = sent_binary_sizes(),
+    {ok, Node} = test_server:start_node(compact_sent_binaries, slave,
+                                        [{args, "+hsbc 4"}]),
+    [100, Big, 100, Big] = rpc:call(Node, ?MODULE, sent_binary_sizes, []),
+    test_server:stop_node(Node),
+    ok.
+
+%% Referenced byte sizes of a small slice of a large binary and of
+%% the large binary itself, as seen by receivers with on and off heap
+%% message queues.
+sent_binary_sizes() ->
+    Bin = binary:copy(<<"abcdefghij">>, 10000),
+    <<Slice:100/binary, _/binary>> = Bin,
+    Msg = {Slice, Bin},
+    Self = self(),
+    lists:append(
+      [begin
+           Pid = spawn_opt(fun () ->
+                                   receive
+                                       {Self, {S, B} = M} ->
+                                           M = {Slice, Bin},
+                                           Self ! {self(),
+                                                   [binary:referenced_byte_size(S),
+                                                    binary:referenced_byte_size(B)]}
+                                   end
+                           end, [link, {message_queue_data, Mqd}]),
+           Pid ! {Self, Msg},
+           receive {Pid, Sizes} -> Sizes end
+       end || Mqd <- [on_heap, off_heap]]).
@@ -29,7 +29,8 @@
 	 mem_leak/1, coerce_to_float/1, bjorn/1,
 	 huge_float_field/1, huge_binary/1, system_limit/1, badarg/1,
 	 copy_writable_binary/1, kostis/1, dynamic/1, bs_add/1,
-	 otp_7422/1, zero_width/1, bad_append/1, bs_add_overflow/1]).
+	 otp_7422/1, zero_width/1, bad_append/1, append_large/1,
+	 bs_add_overflow/1]).
 
 -include_lib("common_test/include/ct.hrl").
 
@@ -42,7 +43,7 @@ all() ->
      in_guard, mem_leak, coerce_to_float, bjorn,
      huge_float_field, huge_binary, system_limit, badarg,
      copy_writable_binary, kostis, dynamic, bs_add, otp_7422, zero_width,
-     bad_append, bs_add_overflow].
+     bad_append, append_large, bs_add_overflow].
 
 init_per_suite(Config) ->
     Config.
@@ -887,6 +888,37 @@ append_unit_8(Bin) ->
 append_unit_16(Bin) ->
     <<Bin/binary-unit:16,0:1>>.
 
+%% Grow a binary well past the single-block carrier threshold while
+%% moving between schedulers, so that it is reallocated both by the
+%% allocator instance that created it and by others.
+append_large(_Config) ->
+    Chunk = << <<I:8>> || I <- lists:seq(0, 255) >>,
+    Parts = 8*1024,
+    Scheds = erlang:system_info(schedulers_online),
+    {Pid,Ref} = spawn_monitor(fun() ->
+				      Bin = append_large(<<>>, Chunk, 0,
+							 Parts, Scheds),
+				      exit({done,Bin})
+			      end),
+    receive
+	{'DOWN',Ref,process,Pid,{done,Bin}} ->
+	    true = byte_size(Bin) =:= Parts*byte_size(Chunk),
+	    Bin = binary:copy(Chunk, Parts),
+	    ok
+    end.
+
+append_large(Bin, _Chunk, Parts, Parts, _Scheds) ->
+    Bin;
+append_large(Bin, Chunk, N, Parts, Scheds) ->
+    case N rem 256 of
+	0 ->
+	    process_flag(scheduler, 1 + (N div 256) rem Scheds),
+	    erlang:yield();
+	_ ->
+	    ok
+    end,
+    append_large(<<Bin/binary,Chunk/binary>>, Chunk, N+1, Parts, Scheds).
+
 %% Produce a large result of bs_add that, if cast to signed int, would overflow
 %% into a negative number that fits a smallnum.
 bs_add_overflow(_Config) ->
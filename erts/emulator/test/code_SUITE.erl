@@ -26,6 +26,7 @@
          t_check_process_code_ets/1,
          external_fun/1,get_chunk/1,module_md5/1,make_stub/1,
          make_stub_many_funs/1,constant_pools/1,constant_refc_binaries/1,
+         constant_pools_no_fullsweep/1,
          false_dependency/1,coverage/1,fun_confusion/1,
          t_copy_literals/1, t_copy_literals_frags/1]).
 
@@ -39,7 +40,8 @@ all() ->
      call_purged_fun_code_reload, call_purged_fun_code_there, t_check_process_code,
      t_check_process_code_ets, t_check_old_code, external_fun, get_chunk,
      module_md5, make_stub, make_stub_many_funs,
-     constant_pools, constant_refc_binaries, false_dependency,
+     constant_pools, constant_pools_no_fullsweep,
+     constant_refc_binaries, false_dependency,
      coverage, fun_confusion, t_copy_literals, t_copy_literals_frags].
 
 init_per_suite(Config) ->
@@ -678,6 +680,48 @@ create_old_heap() ->
             create_old_heap()
     end.
 
+%% Getting rid of literals should not force a fullsweep of processes
+%% referencing them; the old heap should be kept.
+constant_pools_no_fullsweep(Config) when is_list(Config) ->
+    Data = proplists:get_value(data_dir, Config),
+    File = filename:join(Data, "literals"),
+    {ok,literals,Code} = compile:file(File, [report,binary]),
+    {module,literals} = erlang:load_module(literals, Code),
+
+    A = literals:a(),
+    B = literals:b(),
+    C = literals:huge_bignum(),
+    process_flag(trap_exit, true),
+    Self = self(),
+
+    Holder = spawn_opt(fun() -> literal_holder(Self) end,
+                       [link,{fullsweep_after,1000}]),
+    MinorGCs = receive {Holder,go,N} -> N end,
+    true = MinorGCs > 0,
+    true = erlang:delete_module(literals),
+    false = erlang:check_process_code(Holder, literals),
+    true = erlang:purge_module(literals),
+    {garbage_collection,GC} = process_info(Holder, garbage_collection),
+    true = proplists:get_value(minor_gcs, GC) >= MinorGCs,
+    Holder ! done,
+    receive
+        {'EXIT',Holder,{A,B,C,Seq}} when length(Seq) =:= 1000 ->
+            ok;
+        Other ->
+            ct:fail({unexpected,Other})
+    end.
+
+literal_holder(Parent) ->
+    Res = {literals:a(),literals:b(),literals:huge_bignum(),
+           lists:seq(1, 1000)},
+    create_old_heap(),
+    {garbage_collection,GC} = process_info(self(), garbage_collection),
+    Parent ! {self(),go,proplists:get_value(minor_gcs, GC)},
+    receive
+        done ->
+            exit(Res)
+    end.
+
 constant_refc_binaries(Config) when is_list(Config) ->
     wait_for_memory_deallocations(),
     Bef = memory_binary(),
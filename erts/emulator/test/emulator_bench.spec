@@ -1 +1,3 @@
 {groups,"../emulator_test",estone_SUITE,[estone_bench]}.
+{suites,"../emulator_test",[message_bench_SUITE,
+                            process_bench_SUITE]}.
@@ -25,13 +25,16 @@
 -include_lib("common_test/include/ct.hrl").
 -export([all/0, suite/0]).
 
--export([grow_heap/1, grow_stack/1, grow_stack_heap/1, max_heap_size/1]).
+-export([dirty_gc_test/0, parallel_gc_test/0]).
+-export([grow_heap/1, grow_stack/1, grow_stack_heap/1, max_heap_size/1,
+         dirty_gc/1, parallel_gc/1, gc_stats/1]).
 
 suite() ->
     [{ct_hooks,[ts_install_cth]}].
 
 all() -> 
-    [grow_heap, grow_stack, grow_stack_heap, max_heap_size].
+    [grow_heap, grow_stack, grow_stack_heap, max_heap_size, dirty_gc,
+     parallel_gc, gc_stats].
 
 
 %% Produce a growing list of elements,
@@ -190,3 +193,128 @@ long_receive() ->
     after 10000 ->
             ok
     end.
+
+%% Test that garbage collections moved to dirty schedulers
+%% (+hdgc) preserve the heap of the collected processes.
+dirty_gc(Config) when is_list(Config) ->
+    try erlang:system_info(dirty_cpu_schedulers) of
+        N when is_integer(N), N > 0 ->
+            {ok, Node} = start_node(Config, "+hdgc 1000"),
+            Res = rpc:call(Node, ?MODULE, dirty_gc_test, []),
+            test_server:stop_node(Node),
+            ok = Res
+    catch
+        error:badarg ->
+            {skipped, "No dirty scheduler support"}
+    end.
+
+dirty_gc_test() ->
+    Parent = self(),
+    Pids = [spawn_link(fun () ->
+                               Parent ! {self(), dirty_gc_build(20000*I)}
+                       end) || I <- lists:seq(1, 8)],
+    Sums = [receive {Pid, Sum} -> Sum end || Pid <- Pids],
+    Sums = [dirty_gc_sum(20000*I) || I <- lists:seq(1, 8)],
+    %% An explicit collection should not return until the
+    %% collection on the dirty scheduler is done...
+    List = lists:seq(1, 100000),
+    true = garbage_collect(),
+    100000 = length(List),
+    ok.
+
+dirty_gc_build(N) ->
+    T = lists:foldl(fun (I, Acc) -> [{I, integer_to_list(I)} | Acc] end,
+                    [], lists:seq(1, N)),
+    garbage_collect(),
+    lists:sum([I || {I, S} <- T, list_to_integer(S) =:= I]).
+
+dirty_gc_sum(N) ->
+    N*(N+1) div 2.
+
+%% Test that parallel fullsweeps (+hpgc) preserve the heap, including
+%% shared subterms, and that gc end trace events report pause time.
+parallel_gc(Config) when is_list(Config) ->
+    {ok, Node} = start_node(Config, "+hpgc 1000 +hpgct 4"),
+    Res = rpc:call(Node, ?MODULE, parallel_gc_test, []),
+    test_server:stop_node(Node),
+    ok = Res.
+
+parallel_gc_test() ->
+    Parent = self(),
+    Pids = [spawn_link(fun () ->
+                               erlang:trace(self(), true,
+                                            [garbage_collection,
+                                             {tracer, Parent}]),
+                               Parent ! {self(), parallel_gc_build(10000*I)}
+                       end) || I <- lists:seq(1, 4)],
+    [ok = receive {Pid, Res} -> Res end || Pid <- Pids],
+    {trace, _, gc_major_end, Info} = receive
+                                         {trace, _, gc_major_end, _} = T -> T
+                                     end,
+    {pause_time, Time} = lists:keyfind(pause_time, 1, Info),
+    true = is_integer(Time) andalso Time >= 0,
+    ok.
+
+parallel_gc_build(N) ->
+    Tuple = list_to_tuple(lists:seq(1, 5000)),
+    Shared = {shared, lists:seq(1, 10)},
+    Bin = <<0:80000>>,
+    L = [{I, integer_to_list(I), <<I:64>>, #{I => [I]},
+          fun () -> I end, I*(1 bsl 80), Shared, binary:part(Bin, 1, 10)}
+         || I <- lists:seq(1, N)],
+    T = {L, Tuple, L, maps:from_list([{I, I} || I <- lists:seq(1, 1000)])},
+    Hash = erlang:phash2(T),
+    [begin
+         true = garbage_collect(),
+         Hash = erlang:phash2(T)
+     end || _ <- lists:seq(1, 3)],
+    %% Sharing is preserved...
+    {L1, _, L2, _} = T,
+    true = erts_debug:same(L1, L2),
+    ok.
+
+%% Test the per process gc statistics and the global pause histogram.
+gc_stats(Config) when is_list(Config) ->
+    Pauses0 = gc_pauses(),
+    Self = self(),
+    Pid = spawn_link(fun () ->
+                             L = lists:seq(1, 100000),
+                             Self ! {self(), built},
+                             receive stop -> length(L) end
+                     end),
+    receive {Pid, built} -> ok end,
+    {garbage_collection_stats, Stats0} =
+        process_info(Pid, garbage_collection_stats),
+    [Minor0, Major0, Copied0, Promoted0, Grows0] =
+        [proplists:get_value(K, Stats0)
+         || K <- [minor_gcs, major_gcs, words_copied, words_promoted,
+                  heap_grows]],
+    true = Minor0 + Major0 > 0,
+    true = Copied0 >= Promoted0,
+    true = Grows0 > 0,
+    true = garbage_collect(Pid),
+    {garbage_collection_stats, Stats1} =
+        process_info(Pid, garbage_collection_stats),
+    Major1 = proplists:get_value(major_gcs, Stats1),
+    Major1 = Major0 + 1,
+    Minor0 = proplists:get_value(minor_gcs, Stats1),
+    true = proplists:get_value(words_copied, Stats1) >= Copied0 + 100000*2,
+    true = proplists:get_value(major_gc_time, Stats1) >=
+        proplists:get_value(major_gc_time, Stats0),
+    Pid ! stop,
+    true = gc_pauses() >= Pauses0 + Minor0 + Major1,
+    [{1,_}, {2,_} | _] = Hist = statistics(garbage_collection_pauses),
+    {infinity, _} = lists:last(Hist),
+    ok.
+
+gc_pauses() ->
+    lists:sum([C || {_, C} <- statistics(garbage_collection_pauses)]).
+
+start_node(Config, Args) ->
+    Pa = filename:dirname(code:which(?MODULE)),
+    Name = list_to_atom(atom_to_list(?MODULE)
+                        ++ "-"
+                        ++ atom_to_list(proplists:get_value(testcase, Config))
+                        ++ "-"
+                        ++ integer_to_list(erlang:unique_integer([positive]))),
+    test_server:start_node(Name, slave, [{args, "-pa "++Pa++" "++Args}]).
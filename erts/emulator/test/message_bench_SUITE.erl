@@ -0,0 +1,329 @@
+%%
+%% %CopyrightBegin%
+%%
+%% Copyright Ericsson AB 2016. All Rights Reserved.
+%%
+%% Licensed under the Apache License, Version 2.0 (the "License");
+%% you may not use this file except in compliance with the License.
+%% You may obtain a copy of the License at
+%%
+%%     http://www.apache.org/licenses/LICENSE-2.0
+%%
+%% Unless required by applicable law or agreed to in writing, software
+%% distributed under the License is distributed on an "AS IS" BASIS,
+%% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+%% See the License for the specific language governing permissions and
+%% limitations under the License.
+%%
+%% %CopyrightEnd%
+
+-module(message_bench_SUITE).
+
+%% Benchmarks of message passing. Each benchmark reports its result
+%% as benchmark_data events and returns it as a comment.
+
+-export([all/0, suite/0,
+         init_per_suite/1, end_per_suite/1]).
+-export([send_copy/1, send_shared/1, send_fan_in/1, send_multi/1,
+         send_off_heap/1, send_scaling/1, receive_selective/1]).
+
+-include_lib("common_test/include/ct.hrl").
+
+%% Emit recv_index hints for receive_selective/1.
+-compile(recv_index).
+
+-define(SEND_TIME, 1000). %% ms per measurement
+
+suite() ->
+    [{ct_hooks,[ts_install_cth]},
+     {timetrap, {minutes, 10}}].
+
+all() ->
+    [send_copy, send_shared, send_fan_in, send_multi, send_off_heap,
+     send_scaling, receive_selective].
+
+init_per_suite(Config) ->
+    erts_debug:set_internal_state(available_internal_state, true),
+    Config.
+
+end_per_suite(_Config) ->
+    erts_debug:set_internal_state(available_internal_state, false),
+    ok.
+
+%% Send throughput for terms of different shapes, copied either in
+%% a single pass or sized before they are copied.
+send_copy(Config) when is_list(Config) ->
+    Terms = [{small, {self(), make_ref(), hello, 17}},
+             {medium, [{I, <<I:32>>, [I]} || I <- lists:seq(1, 100)]},
+             {large, lists:seq(1, 100000)},
+             {deep, lists:foldl(fun (I, Acc) -> {I, Acc} end, [],
+                                lists:seq(1, 20000))}],
+    Result =
+        try
+            [begin
+                 erts_debug:set_internal_state(single_pass_send, SinglePass),
+                 Name = atom_to_list(TName) ++ "_" ++ copy_name(SinglePass),
+                 Sends = send_rate(Term),
+                 bench_report:report(message_bench, send_copy, Name, Sends),
+                 {Name, Sends}
+             end || {TName, Term} <- Terms, SinglePass <- [false, true]]
+        after
+            erts_debug:set_internal_state(single_pass_send, true)
+        end,
+    {comment, bench_report:format_result(Result)}.
+
+copy_name(true) -> "single_pass";
+copy_name(false) -> "two_pass".
+
+%% Send throughput for large terms with and without shared subterms,
+%% copied either preserving sharing or flat.
+send_shared(Config) when is_list(Config) ->
+    Leaf = [{I, <<I:32>>} || I <- lists:seq(1, 100)],
+    Terms = [{unshared, lists:seq(1, 100000)},
+             {shared_leaf, lists:duplicate(1000, Leaf)},
+             {shared_tree, lists:foldl(fun (I, Acc) -> {I, Acc, Acc} end,
+                                       [], lists:seq(1, 12))}],
+    Result =
+        try
+            [begin
+                 erts_debug:set_internal_state(preserve_sharing, Preserve),
+                 Name = atom_to_list(TName) ++ "_" ++ sharing_name(Preserve),
+                 Sends = send_rate(Term),
+                 bench_report:report(message_bench, send_shared, Name, Sends),
+                 {Name, Sends}
+             end || {TName, Term} <- Terms, Preserve <- [false, true]]
+        after
+            erts_debug:set_internal_state(preserve_sharing, true)
+        end,
+    {comment, bench_report:format_result(Result)}.
+
+sharing_name(true) -> "preserved";
+sharing_name(false) -> "flat".
+
+%% Send throughput from many senders into one receiver, with the
+%% number of senders going up to twice the number of schedulers.
+send_fan_in(Config) when is_list(Config) ->
+    Schedulers = erlang:system_info(schedulers_online),
+    Senders = lists:usort([1, 2, Schedulers, 2*Schedulers]),
+    Result = [begin
+                  Name = integer_to_list(N) ++ "_senders",
+                  Sends = fan_in_rate(N, {self(), make_ref(), hello}),
+                  bench_report:report(message_bench, send_fan_in, Name, Sends),
+                  {Name, Sends}
+              end || N <- Senders],
+    {comment, bench_report:format_result(Result)}.
+
+%% Total sends per second from N processes to a receiver that drops
+%% the messages.
+fan_in_rate(N, Term) ->
+    Self = self(),
+    Receiver = spawn_link(fun () -> drop_loop(Self) end),
+    Go = make_ref(),
+    Pids = [spawn_link(fun () -> fan_in_sender(Self, Go, Receiver, Term) end)
+            || _ <- lists:seq(1, N)],
+    Start = erlang:monotonic_time(),
+    End = Start + erlang:convert_time_unit(?SEND_TIME, milli_seconds, native),
+    [Pid ! {Go, End} || Pid <- Pids],
+    Total = lists:sum([receive {Pid, Go, Sends} -> Sends end || Pid <- Pids]),
+    Time = erlang:monotonic_time() - Start,
+    Receiver ! {Self, done},
+    receive {Receiver, done} -> ok end,
+    [unlink(Pid) || Pid <- [Receiver | Pids]],
+    Total * erlang:convert_time_unit(1, seconds, native) div Time.
+
+fan_in_sender(Parent, Go, Receiver, Term) ->
+    receive
+        {Go, End} ->
+            Parent ! {self(), Go, send_loop(Receiver, Term, End, 0)}
+    end.
+
+%% Send throughput of small messages to a receiver with an off heap
+%% message queue, with messages allocated from blocks preallocated per
+%% scheduler or from the allocator.
+send_off_heap(Config) when is_list(Config) ->
+    Terms = [{small, {self(), make_ref(), hello}},
+             {medium, {self(), make_ref(), lists:seq(1, 10)}}],
+    Result =
+        try
+            [begin
+                 erts_debug:set_internal_state(small_message_pool, Pool),
+                 Name = atom_to_list(TName) ++ "_" ++ pool_name(Pool),
+                 Sends = send_rate(Term, [{message_queue_data, off_heap}]),
+                 bench_report:report(message_bench, send_off_heap, Name, Sends),
+                 {Name, Sends}
+             end || {TName, Term} <- Terms, Pool <- [false, true]]
+        after
+            erts_debug:set_internal_state(small_message_pool, true)
+        end,
+    {comment, bench_report:format_result(Result)}.
+
+pool_name(true) -> "pool";
+pool_name(false) -> "alloc".
+
+%% Deliveries per second of the same message to many receivers, sent
+%% either one receiver at a time or with erlang:multi_send/2.
+send_multi(Config) when is_list(Config) ->
+    Term = {update, lists:seq(1, 100), list_to_binary(lists:seq(1, 255))},
+    Result = [begin
+                  Name = integer_to_list(N) ++ "_" ++ atom_to_list(How),
+                  Sends = multi_rate(How, N, Term),
+                  bench_report:report(message_bench, send_multi, Name, Sends),
+                  {Name, Sends}
+              end || N <- [10, 1000], How <- [loop, multi_send]],
+    {comment, bench_report:format_result(Result)}.
+
+%% The time includes receiving all messages, since receivers of
+%% erlang:multi_send/2 copy the message when they receive it.
+multi_rate(How, N, Term) ->
+    Self = self(),
+    Receivers = [spawn_link(fun () -> drop_loop(Self) end)
+                 || _ <- lists:seq(1, N)],
+    Start = erlang:monotonic_time(),
+    End = Start + erlang:convert_time_unit(?SEND_TIME, milli_seconds, native),
+    Rounds = multi_loop(How, Receivers, Term, End, 0),
+    [Receiver ! {Self, done} || Receiver <- Receivers],
+    [receive {Receiver, done} -> ok end || Receiver <- Receivers],
+    Time = erlang:monotonic_time() - Start,
+    [unlink(Receiver) || Receiver <- Receivers],
+    Rounds * N * erlang:convert_time_unit(1, seconds, native) div Time.
+
+multi_loop(How, Pids, Term, End, Rounds) ->
+    case erlang:monotonic_time() >= End of
+        true ->
+            Rounds;
+        false ->
+            multi_send_n(How, Pids, Term, 10),
+            multi_loop(How, Pids, Term, End, Rounds+10)
+    end.
+
+multi_send_n(_How, _Pids, _Term, 0) ->
+    ok;
+multi_send_n(loop, Pids, Term, N) ->
+    [Pid ! Term || Pid <- Pids],
+    multi_send_n(loop, Pids, Term, N-1);
+multi_send_n(multi_send, Pids, Term, N) ->
+    ok = erlang:multi_send(Pids, Term),
+    multi_send_n(multi_send, Pids, Term, N-1).
+
+%% Total sends per second of messages of different sizes between
+%% independent sender and receiver pairs, one pair per scheduler, with
+%% 1, 2, 4, ... schedulers online.
+send_scaling(Config) when is_list(Config) ->
+    Online = erlang:system_info(schedulers_online),
+    Counts = lists:usort([Online | [S || S <- [1 bsl I || I <- lists:seq(0, 10)],
+                                        S < Online]]),
+    Sizes = [1, 10, 100, 1000],
+    Result =
+        try
+            [begin
+                 erlang:system_flag(schedulers_online, S),
+                 Name = integer_to_list(S) ++ "_schedulers_" ++
+                     integer_to_list(Size) ++ "_words",
+                 Sends = pairs_rate(S, lists:seq(1, Size)),
+                 bench_report:report(message_bench, send_scaling, Name, Sends),
+                 {Name, Sends}
+             end || S <- Counts, Size <- Sizes]
+        after
+            erlang:system_flag(schedulers_online, Online)
+        end,
+    {comment, bench_report:format_result(Result)}.
+
+pairs_rate(N, Term) ->
+    Self = self(),
+    Go = make_ref(),
+    Pairs = [begin
+                 Receiver = spawn_link(fun () -> drop_loop(Self) end),
+                 Sender = spawn_link(fun () ->
+                                             fan_in_sender(Self, Go, Receiver,
+                                                           Term)
+                                     end),
+                 {Sender, Receiver}
+             end || _ <- lists:seq(1, N)],
+    Start = erlang:monotonic_time(),
+    End = Start + erlang:convert_time_unit(?SEND_TIME, milli_seconds, native),
+    [Sender ! {Go, End} || {Sender, _} <- Pairs],
+    Total = lists:sum([receive {Sender, Go, Sends} -> Sends end
+                       || {Sender, _} <- Pairs]),
+    Time = erlang:monotonic_time() - Start,
+    [Receiver ! {Self, done} || {_, Receiver} <- Pairs],
+    [receive {Receiver, done} -> ok end || {_, Receiver} <- Pairs],
+    [unlink(Pid) || {Sender, Receiver} <- Pairs, Pid <- [Sender, Receiver]],
+    Total * erlang:convert_time_unit(1, seconds, native) div Time.
+
+%% Selective receives per second of replies tagged with references,
+%% taken from message queues of different lengths in the reverse
+%% order of their arrival, with and without the message queue index.
+receive_selective(Config) when is_list(Config) ->
+    Result =
+        try
+            [begin
+                 erts_debug:set_internal_state(msgq_index, Index),
+                 Name = integer_to_list(N) ++ "_" ++ index_name(Index),
+                 Receives = selective_rate(N),
+                 bench_report:report(message_bench, receive_selective,
+                                     Name, Receives),
+                 {Name, Receives}
+             end || N <- [100, 1000, 10000], Index <- [false, true]]
+        after
+            erts_debug:set_internal_state(msgq_index, true)
+        end,
+    {comment, bench_report:format_result(Result)}.
+
+index_name(true) -> "indexed";
+index_name(false) -> "scanned".
+
+selective_rate(N) ->
+    Self = self(),
+    {Pid, Mref} = spawn_monitor(fun () -> Self ! selective_loop(N, 0, 0) end),
+    receive
+        {'DOWN', Mref, process, Pid, normal} ->
+            receive Receives -> Receives end
+    end.
+
+selective_loop(_N, Receives, Time) when Time >= ?SEND_TIME * 1000 ->
+    Receives * 1000000 div Time;
+selective_loop(N, Receives, Time) ->
+    Refs = [make_ref() || _ <- lists:seq(1, N)],
+    [self() ! {R, reply} || R <- Refs],
+    {T, ok} = timer:tc(fun () -> selective_receive(lists:reverse(Refs)) end),
+    selective_loop(N, Receives + N, Time + T).
+
+selective_receive([R | Refs]) ->
+    receive {R, reply} -> selective_receive(Refs) end;
+selective_receive([]) ->
+    ok.
+
+%% Sends per second from one process to a receiver that drops the
+%% messages.
+send_rate(Term) ->
+    send_rate(Term, []).
+
+send_rate(Term, Opts) ->
+    Self = self(),
+    Receiver = spawn_opt(fun () -> drop_loop(Self) end, [link | Opts]),
+    Start = erlang:monotonic_time(),
+    End = Start + erlang:convert_time_unit(?SEND_TIME, milli_seconds, native),
+    N = send_loop(Receiver, Term, End, 0),
+    Time = erlang:monotonic_time() - Start,
+    Receiver ! {Self, done},
+    receive {Receiver, done} -> ok end,
+    unlink(Receiver),
+    N * erlang:convert_time_unit(1, seconds, native) div Time.
+
+send_loop(To, Term, End, N) ->
+    case erlang:monotonic_time() >= End of
+        true ->
+            N;
+        false ->
+            send_n(To, Term, 100),
+            send_loop(To, Term, End, N+100)
+    end.
+
+send_n(_To, _Term, 0) -> ok;
+send_n(To, Term, N) -> To ! Term, send_n(To, Term, N-1).
+
+drop_loop(From) ->
+    receive
+        {From, done} -> From ! {self(), done};
+        _ -> drop_loop(From)
+    end.
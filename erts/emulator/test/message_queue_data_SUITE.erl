@@ -21,7 +21,9 @@
 -module(message_queue_data_SUITE).
 
 -export([all/0, suite/0]).
--export([basic/1, process_info_messages/1, total_heap_size/1]).
+-export([basic/1, process_info_messages/1, total_heap_size/1,
+         large_messages/1, shared_messages/1, small_messages/1,
+         multi_send/1, multi_send_trap/1, multi_send_trace/1]).
 
 -export([basic_test/1]).
 
@@ -32,7 +34,9 @@ suite() ->
      {timetrap, {minutes, 2}}].
 
 all() -> 
-    [basic, process_info_messages, total_heap_size].
+    [basic, process_info_messages, total_heap_size, large_messages,
+     shared_messages, small_messages, multi_send, multi_send_trap,
+     multi_send_trace].
 
 %%
 %%
@@ -186,6 +190,242 @@ total_heap_size(_Config) ->
     ct:log("OffSize = ~p, OffSizeAfter = ~p",[OffSize, OffSizeAfter]),
     true = OffSize == OffSizeAfter.
 
+%% Large messages are copied in a single pass into heap fragments
+%% allocated on demand; check that all kinds of terms survive that,
+%% both when queued on and off heap.
+large_messages(_Config) ->
+    erts_debug:set_internal_state(available_internal_state, true),
+    try
+        true = erts_debug:set_internal_state(single_pass_send, true),
+        large_messages_test(on_heap),
+        large_messages_test(off_heap),
+        true = erts_debug:set_internal_state(preserve_sharing, false),
+        large_messages_test(on_heap),
+        large_messages_test(off_heap),
+        true = erts_debug:set_internal_state(single_pass_send, false),
+        large_messages_test(on_heap),
+        large_messages_test(off_heap)
+    after
+        erts_debug:set_internal_state(single_pass_send, true),
+        erts_debug:set_internal_state(preserve_sharing, true),
+        erts_debug:set_internal_state(available_internal_state, false)
+    end,
+    ok.
+
+large_messages_test(Mqd) ->
+    Terms = large_terms(),
+    Self = self(),
+    Echo = fun Echo() ->
+                   receive
+                       {Self, stop} -> ok;
+                       Msg -> Self ! {self(), Msg}, Echo()
+                   end
+           end,
+    %% Queue everything while the receiver is suspended so that the
+    %% messages end up in heap fragments, then echo them back.
+    Pid = spawn_opt(Echo, [link, {message_queue_data, Mqd}]),
+    erlang:suspend_process(Pid),
+    [Pid ! T || T <- Terms],
+    erlang:resume_process(Pid),
+    true = erlang:garbage_collect(Pid),
+    [receive {Pid, Msg} -> Msg = T end || T <- Terms],
+    Pid ! {Self, stop},
+    ok.
+
+%% Subterms shared within a large message stay shared in the copy,
+%% also when sent with erlang:multi_send/2; this term would not fit in
+%% memory if flattened.
+shared_messages(_Config) ->
+    Term = shared_term(40),
+    Size = erts_debug:size_shared(Term),
+    Self = self(),
+    Spawn = fun (Mqd) ->
+                    spawn_opt(fun () ->
+                                      receive
+                                          Msg ->
+                                              Self ! {self(), erts_debug:size_shared(Msg)}
+                                      end
+                              end, [link, {message_queue_data, Mqd}])
+            end,
+    [begin
+         Pid = Spawn(Mqd),
+         Pid ! Term,
+         receive {Pid, Size} -> ok end
+     end || Mqd <- [on_heap, off_heap]],
+    Pids = [Spawn(Mqd) || Mqd <- [on_heap, off_heap]],
+    ok = erlang:multi_send(Pids, Term),
+    [receive {Pid, Size} -> ok end || Pid <- Pids],
+    ok.
+
+%% Small messages queued off heap are allocated from blocks that are
+%% preallocated per scheduler; send messages on both sides of the size
+%% limit from several senders, with and without the preallocated blocks.
+small_messages(_Config) ->
+    erts_debug:set_internal_state(available_internal_state, true),
+    try
+        small_messages_test(),
+        true = erts_debug:set_internal_state(small_message_pool, false),
+        small_messages_test()
+    after
+        erts_debug:set_internal_state(small_message_pool, true),
+        erts_debug:set_internal_state(available_internal_state, false)
+    end,
+    ok.
+
+small_messages_test() ->
+    Terms = [{I, lists:seq(1, I)} || I <- lists:seq(0, 5)]
+        ++ [<<1,2,3>>, make_ref(), 1 bsl 100, {self(), 1.5}],
+    Self = self(),
+    Senders = 4,
+    Rounds = 200,
+    N = Senders * Rounds * length(Terms),
+    Receiver = spawn_opt(fun () -> small_receiver(Self, Terms, N) end,
+                         [link, {message_queue_data, off_heap}]),
+    [spawn_link(fun () -> [Receiver ! T || _ <- lists:seq(1, Rounds),
+                                           T <- Terms] end)
+     || _ <- lists:seq(1, Senders)],
+    receive {Receiver, done} -> ok end.
+
+small_receiver(Parent, _Terms, 0) ->
+    Parent ! {self(), done};
+small_receiver(Parent, Terms, N) ->
+    receive
+        Msg ->
+            true = lists:member(Msg, Terms),
+            N rem 100 =:= 0 andalso erlang:garbage_collect(),
+            small_receiver(Parent, Terms, N-1)
+    end.
+
+%% erlang:multi_send/2 copies the message once into a payload that
+%% the receivers copy onto their heaps when they look at it.
+multi_send(_Config) ->
+    Terms = large_terms(),
+    Self = self(),
+    Echo = fun Echo() ->
+                   receive
+                       {Self, stop} -> ok;
+                       Msg -> Self ! {self(), Msg}, Echo()
+                   end
+           end,
+    Pids = [spawn_opt(Echo, [link, {message_queue_data, Mqd}])
+            || Mqd <- [on_heap, off_heap, on_heap, off_heap]],
+    [P1, P2 | _] = Pids,
+    {Dead, Mref} = spawn_monitor(fun () -> ok end),
+    receive {'DOWN', Mref, process, Dead, normal} -> ok end,
+
+    %% Queue the messages while the receivers are suspended, and
+    %% look at them both from another process and through a GC
+    [erlang:suspend_process(P) || P <- Pids],
+    [ok = erlang:multi_send([Dead | Pids], T) || T <- Terms],
+    {messages, Terms} = process_info(P1, messages),
+    true = erlang:garbage_collect(P2),
+    [erlang:resume_process(P) || P <- Pids],
+    [[receive {P, Msg} -> Msg = T end || P <- Pids] || T <- Terms],
+
+    %% Messages still queued when the receiver exits are dropped
+    Sleeper = fun () -> receive after infinity -> ok end end,
+    Victims = [spawn_opt(Sleeper, [{message_queue_data, Mqd}])
+               || Mqd <- [on_heap, off_heap]],
+    Msg = {Self, Terms},
+    ok = erlang:multi_send(Victims ++ [Self | Victims], Msg),
+    [exit(V, kill) || V <- Victims],
+    receive Msg -> ok end,
+
+    ok = erlang:multi_send([], hello),
+    ok = erlang:multi_send([P1], hello),
+    receive {P1, hello} -> ok end,
+
+    {'EXIT', {badarg, _}} = (catch erlang:multi_send(Self, hello)),
+    {'EXIT', {badarg, _}} = (catch erlang:multi_send([Self | Self], hello)),
+    {'EXIT', {badarg, _}} = (catch erlang:multi_send([Self, P1, x], hello)),
+    receive
+        hello -> ct:fail(sent_on_badarg);
+        {P1, hello} -> ct:fail(sent_on_badarg)
+    after 100 -> ok
+    end,
+
+    [P ! {Self, stop} || P <- Pids],
+    ok.
+
+%% erlang:multi_send/2 costs a reduction per receiver and traps when
+%% the sender runs out of reductions, keeping the shared payload.
+multi_send_trap(_Config) ->
+    N = 20000,
+    Self = self(),
+    Msg = {Self, lists:seq(1, 100)},
+    Count = fun Count(I) ->
+                    receive
+                        Msg -> Count(I+1);
+                        {Self, stop} -> Self ! {self(), I}
+                    end
+            end,
+    Pids = [spawn_link(fun () -> Count(0) end) || _ <- lists:seq(1, 4)],
+    Receivers = lists:append(lists:duplicate(N div 4, Pids)),
+    Tracer = spawn_link(fun () -> tracer(Self, []) end),
+    1 = erlang:trace(Self, true, [running, {tracer, Tracer}]),
+    {reductions, R0} = process_info(Self, reductions),
+    ok = erlang:multi_send(Receivers, Msg),
+    {reductions, R1} = process_info(Self, reductions),
+    1 = erlang:trace(Self, false, [running]),
+    true = R1 - R0 >= N,
+    Tracer ! {Self, get},
+    Trace = receive {Tracer, T} -> T end,
+    true = lists:member({trace, Self, out,
+                         {erts_internal, multi_send_continue_trap, 3}},
+                        Trace),
+    [P ! {Self, stop} || P <- Pids],
+    [receive {P, Got} -> Got = N div 4 end || P <- Pids],
+    ok.
+
+%% Send and receive tracing see the message of erlang:multi_send/2.
+multi_send_trace(_Config) ->
+    Self = self(),
+    Msg = {traced, list_to_binary(lists:duplicate(1000, $a)), lists:seq(1, 100)},
+    Fun = fun () -> receive Msg -> Self ! {self(), done} end end,
+    Pids = [spawn_link(Fun) || _ <- lists:seq(1, 3)],
+    [P1, P2, P3] = Pids,
+    Tracer = spawn_link(fun () -> tracer(Self, []) end),
+    1 = erlang:trace(P1, true, ['receive', {tracer, Tracer}]),
+    1 = erlang:trace(Self, true, [send, {tracer, Tracer}]),
+    ok = erlang:multi_send(Pids, Msg),
+    1 = erlang:trace(Self, false, [send]),
+    [receive {P, done} -> ok end || P <- Pids],
+    Tracer ! {Self, get},
+    Trace = receive {Tracer, T} -> T end,
+    true = lists:member({trace, P1, 'receive', Msg}, Trace),
+    [true = lists:member({trace, Self, send, Msg, P}, Trace)
+     || P <- [P1, P2, P3]],
+    ok.
+
+tracer(Parent, Acc) ->
+    receive
+        {Parent, get} -> Parent ! {self(), lists:reverse(Acc)};
+        T -> tracer(Parent, [T | Acc])
+    end.
+
+shared_term(Depth) ->
+    lists:foldl(fun (I, Acc) ->
+                        Map = maps:from_list([{a, Acc}, {b, I}, {c, [I]}]),
+                        {I, Acc, [Acc | Acc], Map}
+                end, [], lists:seq(1, Depth)).
+
+large_terms() ->
+    Bin = list_to_binary(lists:duplicate(1000, $a)),
+    <<_:3, SubBin:800/bits, _/bits>> = Bin,
+    <<_:8, HeapBin:60/binary, _/binary>> = Bin,
+    Seq = lists:seq(1, 10000),
+    Fun = fun (X) -> {X, Seq, Bin} end,
+    Big = 1 bsl 300,
+    HashMap = maps:from_list([{I, {I, [I]}} || I <- lists:seq(1, 200)]),
+    FlatMap = #{a => Seq, b => Bin, c => SubBin, d => HeapBin},
+    Deep = lists:foldl(fun (I, Acc) -> {I, Acc} end, [], Seq),
+    [Seq, list_to_tuple(Seq), Deep,
+     [Bin, SubBin, HeapBin, Fun, Big, 1.5, make_ref(), self(),
+      HashMap, FlatMap | Seq],
+     [a | {improper, Seq}],
+     lists:duplicate(200, {SubBin, HeapBin, Fun}),
+     {HashMap, FlatMap, Deep}].
+
 %%
 %%
 %% helpers
@@ -28,7 +28,7 @@
          demon_2/1, demon_3/1, demonitor_flush/1,
          local_remove_monitor/1, remote_remove_monitor/1, mon_1/1, mon_2/1,
          large_exit/1, list_cleanup/1, mixer/1, named_down/1, otp_5827/1,
-         monitor_time_offset/1]).
+         monitor_time_offset/1, many_monitors/1]).
 
 -export([y2/1, g/1, g0/0, g1/0, large_exit_sub/1]).
 
@@ -41,7 +41,7 @@ all() ->
      demon_1, mon_1, mon_2, demon_2, demon_3,
      demonitor_flush, {group, remove_monitor}, large_exit,
      list_cleanup, mixer, named_down, otp_5827,
-     monitor_time_offset].
+     monitor_time_offset, many_monitors].
 
 groups() -> 
     [{remove_monitor, [],
@@ -768,6 +768,55 @@ otp_5827(Config) when is_list(Config) ->
               ct:fail("erlang:monitor/2 hangs")
     end.
 
+%% Large numbers of monitors are kept in a hash table of trees;
+%% test that it grows, shrinks and is torn down on exit.
+many_monitors(Config) when is_list(Config) ->
+    N = 100000,
+    Target = spawn(fun () -> receive stop -> ok end end),
+    Refs = [erlang:monitor(process, Target) || _ <- lists:seq(1, N)],
+    {monitors, Ms} = process_info(self(), monitors),
+    N = length(Ms),
+    {monitored_by, MBs} = process_info(Target, monitored_by),
+    N = length(MBs),
+    {Removed, Kept} = lists:split(N - 10, Refs),
+    [true = erlang:demonitor(R, [info]) || R <- Removed],
+    [false = erlang:demonitor(R, [info]) || R <- Removed],
+    {monitors, Ms1} = process_info(self(), monitors),
+    10 = length(Ms1),
+    _ = [erlang:monitor(process, Target) || _ <- lists:seq(1, N)],
+    Target ! stop,
+    [receive {'DOWN', R, process, Target, normal} -> ok end
+     || R <- Kept],
+    wait_for_downs(Target, N),
+    {monitors, []} = process_info(self(), monitors),
+
+    %% The monitoring process exits with many monitors
+    Self = self(),
+    Target2 = spawn(fun () -> receive stop -> ok end end),
+    {Owner, OwnerMon} =
+        spawn_monitor(fun () ->
+                              _ = [erlang:monitor(process, Target2)
+                                   || _ <- lists:seq(1, N)],
+                              Self ! {self(), monitoring},
+                              receive die -> exit(die) end
+                      end),
+    receive {Owner, monitoring} -> ok end,
+    {monitored_by, MBs2} = process_info(Target2, monitored_by),
+    N = length(MBs2),
+    Owner ! die,
+    receive {'DOWN', OwnerMon, process, Owner, die} -> ok end,
+    {monitored_by, []} = process_info(Target2, monitored_by),
+    Target2 ! stop,
+    ok.
+
+wait_for_downs(_Target, 0) ->
+    ok;
+wait_for_downs(Target, N) ->
+    receive
+        {'DOWN', _, process, Target, normal} ->
+            wait_for_downs(Target, N-1)
+    end.
+
 monitor_time_offset(Config) when is_list(Config) ->
     {ok, Node} = start_node(Config, "+C single_time_warp"),
     Me = self(),
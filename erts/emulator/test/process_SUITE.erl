@@ -32,6 +32,7 @@
 
 -export([all/0, suite/0,groups/0,init_per_suite/1, end_per_suite/1, 
 	 init_per_group/2,end_per_group/2, spawn_with_binaries/1,
+	 spawn_with_shared_args/1,
 	 t_exit_1/1, t_exit_2_other/1, t_exit_2_other_normal/1,
 	 self_exit/1, normal_suicide_exit/1, abnormal_suicide_exit/1,
 	 t_exit_2_catch/1, trap_exit_badarg/1, trap_exit_badarg_in_bif/1,
@@ -47,6 +48,7 @@
 	 otp_4725/1, bad_register/1, garbage_collect/1, otp_6237/1,
 	 process_info_messages/1, process_flag_badarg/1, process_flag_heap_size/1,
 	 spawn_opt_heap_size/1, spawn_opt_max_heap_size/1,
+	 spawn_opt_adaptive_heap_size/1, spawn_opt_max_message_queue_len/1,
 	 processes_large_tab/1, processes_default_tab/1, processes_small_tab/1,
 	 processes_this_tab/1, processes_apply_trap/1,
 	 processes_last_call_trap/1, processes_gc_trap/1,
@@ -65,14 +67,14 @@
 -export([init_per_testcase/2, end_per_testcase/2]).
 
 -export([hangaround/2, processes_bif_test/0, do_processes/1,
-	 processes_term_proc_list_test/1]).
+	 processes_term_proc_list_test/1, shared_args_owner/2]).
 
 suite() ->
     [{ct_hooks,[ts_install_cth]},
      {timetrap, {minutes, 9}}].
 
 all() -> 
-    [spawn_with_binaries, t_exit_1, {group, t_exit_2},
+    [spawn_with_binaries, spawn_with_shared_args, t_exit_1, {group, t_exit_2},
      trap_exit_badarg, trap_exit_badarg_in_bif,
      t_process_info, process_info_other, process_info_other_msg,
      process_info_other_dist_msg, process_info_2_list,
@@ -84,7 +86,9 @@ all() ->
      bump_reductions, low_prio, yield, yield2, otp_4725,
      bad_register, garbage_collect, process_info_messages,
      process_flag_badarg, process_flag_heap_size,
-     spawn_opt_heap_size, spawn_opt_max_heap_size, otp_6237,
+     spawn_opt_heap_size, spawn_opt_max_heap_size,
+     spawn_opt_adaptive_heap_size, spawn_opt_max_message_queue_len,
+     otp_6237,
      {group, processes_bif},
      {group, otp_7738}, garb_other_running,
      {group, system_task}].
@@ -153,6 +157,22 @@ spawn_with_binaries(Config) when is_list(Config) ->
 binary_owner(Bin) when is_binary(Bin) ->
     ok.
 
+%% Tests that subterms shared within the arguments of a new process
+%% stay shared. The arguments would not fit in memory if flattened.
+spawn_with_shared_args(Config) when is_list(Config) ->
+    Term = lists:foldl(fun(I, Acc) -> {I, Acc, [Acc | Acc], self()} end,
+		       [], lists:seq(1, 40)),
+    Size = erts_debug:size_shared(Term),
+    Self = self(),
+    Pid1 = spawn_link(?MODULE, shared_args_owner, [Self, Term]),
+    receive {Pid1, Size} -> ok end,
+    Pid2 = spawn_link(fun() -> shared_args_owner(Self, Term) end),
+    receive {Pid2, Size} -> ok end,
+    ok.
+
+shared_args_owner(Parent, Term) ->
+    Parent ! {self(), erts_debug:size_shared(Term)}.
+
 %% Tests exit/1 with a big message.
 t_exit_1(Config) when is_list(Config) ->
     ct:timetrap({seconds, 20}),
@@ -1971,6 +1991,128 @@ spawn_opt_heap_size(Config) when is_list(Config) ->
     Pid ! stop,
     ok.
 
+spawn_opt_adaptive_heap_size(Config) when is_list(Config) ->
+    Fun = fun () ->
+		  receive go -> ok end,
+		  L = lists:seq(1, 50000),
+		  receive stop -> length(L) end
+	  end,
+    Adaptive = [monitor, {adaptive_heap_size, true}],
+
+    {heap_size, Small} = run_adaptive(Fun, [monitor]),
+
+    %% The exit heap size of an adaptive process is learned and
+    %% used for the next one spawned from the same fun.
+    run_adaptive(Fun, Adaptive),
+    {heap_size, Big} = run_adaptive(Fun, Adaptive),
+    true = Big > Small,
+
+    %% Only adaptive processes are pre-sized.
+    {heap_size, Small} = run_adaptive(Fun, [monitor]),
+    {heap_size, Small} = run_adaptive(Fun, [monitor,
+					    {adaptive_heap_size, false}]),
+
+    {'EXIT', {badarg, _}} = (catch spawn_opt(Fun, [{adaptive_heap_size,
+						    maybe}])),
+    ok.
+
+run_adaptive(Fun, Opts) ->
+    {Pid, Mon} = spawn_opt(Fun, Opts),
+    HeapSize = process_info(Pid, heap_size),
+    Pid ! go,
+    Pid ! stop,
+    receive {'DOWN', Mon, process, Pid, normal} -> ok end,
+    HeapSize.
+
+spawn_opt_max_message_queue_len(Config) when is_list(Config) ->
+    Off = #{len => 0, action => drop},
+    Off = process_flag(max_message_queue_len, 5),
+    #{len := 5, action := drop} =
+	process_flag(max_message_queue_len, #{len => 0}),
+    {max_message_queue_len, Off} = process_info(self(), max_message_queue_len),
+    [{'EXIT', {badarg, _}} = (catch process_flag(max_message_queue_len, Bad))
+     || Bad <- [-1, #{action => drop}, #{len => 1, action => block}, x]],
+    {'EXIT', {badarg, _}} =
+	(catch spawn_opt(fun () -> ok end, [{max_message_queue_len, -1}])),
+
+    %% Messages beyond the limit are dropped.
+    {Drop, DropGate} = msgq_limit_receiver(#{len => 10}),
+    {max_message_queue_len, #{len := 10, action := drop}} =
+	process_info(Drop, max_message_queue_len),
+    [Drop ! {msg, I} || I <- lists:seq(1, 20)],
+    ok = erlang:multi_send([Drop], {msg, 21}),
+    {message_queue_len, 10} = process_info(Drop, message_queue_len),
+    DropGate ! go,
+    DropMsgs = [{msg, I} || I <- lists:seq(1, 10)],
+    receive {Drop, DropMsgs} -> ok end,
+
+    %% The receiver is killed when its queue is full.
+    {Kill, _} = msgq_limit_receiver(#{len => 10, action => kill}),
+    Mon = monitor(process, Kill),
+    [Kill ! {msg, I} || I <- lists:seq(1, 11)],
+    receive {'DOWN', Mon, process, Kill, killed} -> ok end,
+
+    %% The sender is suspended until the receiver makes room.
+    {Susp, SuspGate} = msgq_limit_receiver(#{len => 10, action => suspend}),
+    Self = self(),
+    Sender = spawn_link(fun () ->
+				[Susp ! {msg, I} || I <- lists:seq(1, 20)],
+				Self ! {self(), sent}
+			end),
+    wait_until_suspended(Sender),
+    {message_queue_len, 10} = process_info(Susp, message_queue_len),
+    nosuspend = erlang:send(Susp, {msg, 0}, [nosuspend]),
+    ok = erlang:multi_send([Susp], {msg, 0}),
+    {message_queue_len, 10} = process_info(Susp, message_queue_len),
+    {status, suspended} = process_info(Sender, status),
+    receive {Sender, sent} -> ct:fail(sender_not_suspended)
+    after 0 -> ok
+    end,
+    SuspGate ! go,
+    receive {Sender, sent} -> ok end,
+    SuspMsgs = [{msg, I} || I <- lists:seq(1, 20)],
+    receive {Susp, SuspMsgs} -> ok end,
+
+    %% Blocked senders are resumed when the receiver exits.
+    {Exiting, _} = msgq_limit_receiver(#{len => 1, action => suspend}),
+    Exiting ! {msg, 1},
+    Blocked = spawn_link(fun () ->
+				 Exiting ! {msg, 2},
+				 Self ! {self(), sent}
+			 end),
+    wait_until_suspended(Blocked),
+    exit(Exiting, kill),
+    receive {Blocked, sent} -> ok end,
+    ok.
+
+wait_until_suspended(Pid) ->
+    wait_until(fun () ->
+		       process_info(Pid, status) =:= {status, suspended}
+	       end).
+
+%% Spawns a process with a limited message queue, which does not
+%% receive any messages until the gate process is told to go. Monitor
+%% messages are not limited, so the 'DOWN' message of the gate gets
+%% through also when the queue is full.
+msgq_limit_receiver(MaxLen) ->
+    Self = self(),
+    Gate = spawn(fun () -> receive go -> ok end end),
+    Pid = spawn_opt(fun () ->
+			    Mon = monitor(process, Gate),
+			    Self ! {self(), monitoring},
+			    receive {'DOWN', Mon, process, Gate, _} -> ok end,
+			    Self ! {self(), msgq_limit_drain([])}
+		    end, [{max_message_queue_len, MaxLen}]),
+    receive {Pid, monitoring} -> ok end,
+    {Pid, Gate}.
+
+msgq_limit_drain(Acc) ->
+    receive
+	{msg, _} = Msg -> msgq_limit_drain([Msg | Acc])
+    after 500 ->
+	    lists:reverse(Acc)
+    end.
+
 spawn_opt_max_heap_size(_Config) ->
 
     error_logger:add_report_handler(?MODULE, self()),
@@ -0,0 +1,211 @@
+%%
+%% %CopyrightBegin%
+%%
+%% Copyright Ericsson AB 2016. All Rights Reserved.
+%%
+%% Licensed under the Apache License, Version 2.0 (the "License");
+%% you may not use this file except in compliance with the License.
+%% You may obtain a copy of the License at
+%%
+%%     http://www.apache.org/licenses/LICENSE-2.0
+%%
+%% Unless required by applicable law or agreed to in writing, software
+%% distributed under the License is distributed on an "AS IS" BASIS,
+%% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+%% See the License for the specific language governing permissions and
+%% limitations under the License.
+%%
+%% %CopyrightEnd%
+
+-module(process_bench_SUITE).
+
+%% Benchmarks of process primitives: spawn, links, monitors and
+%% process exit. Each benchmark is run with an increasing number of
+%% schedulers online, with one worker process per scheduler, and
+%% reports its result as benchmark_data events and returns it as a
+%% comment.
+
+-export([all/0, suite/0,
+         init_per_suite/1, end_per_suite/1]).
+-export([spawn_exit/1, link_unlink/1, monitor_demonitor/1,
+         exit_links/1]).
+
+-include_lib("common_test/include/ct.hrl").
+
+-define(RUN_TIME, 1000). %% ms per measurement
+
+suite() ->
+    [{ct_hooks,[ts_install_cth]},
+     {timetrap, {minutes, 10}}].
+
+all() ->
+    [spawn_exit, link_unlink, monitor_demonitor, exit_links].
+
+init_per_suite(Config) ->
+    [{schedulers_online, erlang:system_info(schedulers_online)} | Config].
+
+end_per_suite(Config) ->
+    Online = proplists:get_value(schedulers_online, Config),
+    erlang:system_flag(schedulers_online, Online),
+    ok.
+
+%% Processes spawned per second, waiting for each to exit before
+%% spawning the next.
+spawn_exit(Config) when is_list(Config) ->
+    scaling(Config, spawn_exit,
+            fun (End) -> spawn_loop(End, 0) end).
+
+spawn_loop(End, N) ->
+    case erlang:monotonic_time() >= End of
+        true ->
+            N;
+        false ->
+            spawn_n(100),
+            spawn_loop(End, N+100)
+    end.
+
+spawn_n(0) ->
+    ok;
+spawn_n(N) ->
+    {Pid, Mon} = spawn_monitor(fun () -> ok end),
+    receive {'DOWN', Mon, process, Pid, _} -> ok end,
+    spawn_n(N-1).
+
+%% Link and unlink pairs per second, on a set of 100 processes.
+link_unlink(Config) when is_list(Config) ->
+    scaling(Config, link_unlink,
+            fun (End) ->
+                    with_peers(100, fun (Pids) ->
+                                            link_loop(Pids, End, 0)
+                                    end)
+            end).
+
+link_loop(Pids, End, N) ->
+    case erlang:monotonic_time() >= End of
+        true ->
+            N;
+        false ->
+            [begin link(Pid), unlink(Pid) end || Pid <- Pids],
+            link_loop(Pids, End, N + length(Pids))
+    end.
+
+%% Monitor and demonitor pairs per second, on a set of 100 processes.
+monitor_demonitor(Config) when is_list(Config) ->
+    scaling(Config, monitor_demonitor,
+            fun (End) ->
+                    with_peers(100, fun (Pids) ->
+                                            monitor_loop(Pids, End, 0)
+                                    end)
+            end).
+
+monitor_loop(Pids, End, N) ->
+    case erlang:monotonic_time() >= End of
+        true ->
+            N;
+        false ->
+            [demonitor(monitor(process, Pid)) || Pid <- Pids],
+            monitor_loop(Pids, End, N + length(Pids))
+    end.
+
+%% Exit signals delivered per second by processes exiting with 100
+%% links each, to processes trapping exits.
+exit_links(Config) when is_list(Config) ->
+    scaling(Config, exit_links,
+            fun (End) ->
+                    process_flag(trap_exit, true),
+                    with_peers(100, fun (Pids) ->
+                                            exit_loop(Pids, End, 0)
+                                    end)
+            end).
+
+exit_loop(Pids, End, N) ->
+    case erlang:monotonic_time() >= End of
+        true ->
+            N;
+        false ->
+            Self = self(),
+            Pid = spawn(fun () ->
+                                [link(P) || P <- Pids],
+                                Self ! {self(), linked},
+                                receive go -> exit(bench) end
+                        end),
+            receive {Pid, linked} -> ok end,
+            [P ! {wait_exit, Pid, Self} || P <- Pids],
+            Pid ! go,
+            [receive {P, got_exit} -> ok end || P <- Pids],
+            exit_loop(Pids, End, N + length(Pids))
+    end.
+
+%%
+%% Utilities
+%%
+
+%% Runs the benchmark with 1, 2, 4, ... schedulers online up to the
+%% number that was online when the suite started. For each scheduler
+%% count, one worker per scheduler runs Fun(EndTime), which returns
+%% the number of operations done. The result is the total number of
+%% operations per second.
+scaling(Config, Bench, Fun) ->
+    Online = proplists:get_value(schedulers_online, Config),
+    Result =
+        try
+            [begin
+                 erlang:system_flag(schedulers_online, S),
+                 Name = integer_to_list(S) ++ "_schedulers",
+                 Ops = workers_rate(S, Fun),
+                 bench_report:report(process_bench, Bench, Name, Ops),
+                 {Name, Ops}
+             end || S <- scheduler_counts(Online)]
+        after
+            erlang:system_flag(schedulers_online, Online)
+        end,
+    {comment, bench_report:format_result(Result)}.
+
+scheduler_counts(Online) ->
+    lists:usort([Online | [S || S <- [1 bsl I || I <- lists:seq(0, 10)],
+                                S < Online]]).
+
+workers_rate(N, Fun) ->
+    Self = self(),
+    Go = make_ref(),
+    Workers = [spawn_monitor(fun () ->
+                                     receive
+                                         {Go, End} ->
+                                             Self ! {self(), Go, Fun(End)}
+                                     end
+                             end) || _ <- lists:seq(1, N)],
+    Start = erlang:monotonic_time(),
+    End = Start + erlang:convert_time_unit(?RUN_TIME, milli_seconds, native),
+    [Pid ! {Go, End} || {Pid, _} <- Workers],
+    Total = lists:sum([receive
+                           {Pid, Go, Ops} -> Ops;
+                           {'DOWN', Mon, process, Pid, Reason} ->
+                               ct:fail({worker_died, Reason})
+                       end || {Pid, Mon} <- Workers]),
+    Time = erlang:monotonic_time() - Start,
+    [demonitor(Mon, [flush]) || {_, Mon} <- Workers],
+    Total * erlang:convert_time_unit(1, seconds, native) div Time.
+
+%% Runs Fun with a list of N peer processes that acknowledge exit
+%% signals they are told to wait for, and stops them afterwards.
+with_peers(N, Fun) ->
+    Pids = [spawn_link(fun peer/0) || _ <- lists:seq(1, N)],
+    try
+        Fun(Pids)
+    after
+        [begin unlink(Pid), exit(Pid, kill) end || Pid <- Pids]
+    end.
+
+peer() ->
+    process_flag(trap_exit, true),
+    peer_loop().
+
+peer_loop() ->
+    receive
+        {wait_exit, From, Reply} ->
+            receive {'EXIT', From, _} -> Reply ! {self(), got_exit} end,
+            peer_loop();
+        _ ->
+            peer_loop()
+    end.
+
@@ -24,15 +24,19 @@
 
 -include_lib("common_test/include/ct.hrl").
 
+%% Emit recv_index hints for receive_index/1.
+-compile(recv_index).
+
 -export([all/0, suite/0,
-	 call_with_huge_message_queue/1,receive_in_between/1]).
+	 call_with_huge_message_queue/1,receive_in_between/1,
+	 receive_index/1]).
 
 suite() ->
     [{ct_hooks,[ts_install_cth]},
      {timetrap, {minutes, 3}}].
 
 all() -> 
-    [call_with_huge_message_queue, receive_in_between].
+    [call_with_huge_message_queue, receive_in_between, receive_index].
 
 groups() -> 
     [].
@@ -98,6 +102,101 @@ receive_one() ->
 	dummy -> ok
     end.
 
+%% Selective receives of references in long message queues, which
+%% look up the messages in an index of the message queue.
+receive_index(Config) when is_list(Config) ->
+    erts_debug:set_internal_state(available_internal_state, true),
+    try
+	[ok = receive_index_in_proc(Data, Index) ||
+	    Data <- [on_heap, off_heap], Index <- [true, false]]
+    after
+	erts_debug:set_internal_state(msgq_index, true),
+	erts_debug:set_internal_state(available_internal_state, false)
+    end,
+    ok.
+
+receive_index_in_proc(Data, Index) ->
+    erts_debug:set_internal_state(msgq_index, Index),
+    {Pid,Mref} = spawn_opt(fun() -> receive_index_1() end,
+			   [monitor,{message_queue_data,Data}]),
+    receive
+	{'DOWN',Mref,process,Pid,Reason} ->
+	    normal = Reason,
+	    ok
+    end.
+
+receive_index_1() ->
+    N = 2000,
+    Refs = [make_ref() || _ <- lists:seq(1, N)],
+    [begin
+	 self() ! {R,1},
+	 self() ! {noise,I},
+	 self() ! {tag,R,2},
+	 self() ! R
+     end || {I,R} <- lists:zip(lists:seq(1, N), Refs)],
+
+    %% Look the messages up in reverse order.
+    [begin
+	 2 = receive_tagged(R),
+	 ok = receive_bare(R),
+	 1 = receive_reply(R)
+     end || R <- lists:reverse(Refs)],
+    [{noise,I} = receive_any() || I <- lists:seq(1, N)],
+    {messages,[]} = process_info(self(), messages),
+
+    %% Messages for the same reference are received in order,
+    %% also when a guard fails.
+    Ref = make_ref(),
+    [self() ! {noise,I} || I <- lists:seq(1, N)],
+    [self() ! {Ref,I} || I <- lists:seq(1, 10)],
+    7 = receive_reply_above(Ref, 6),
+    erlang:garbage_collect(),
+    [1,2,3,4,5,6,8,9,10] = [receive_reply(Ref) || _ <- lists:seq(1, 9)],
+    timeout = receive_reply_timeout(Ref),
+
+    %% Messages arriving while waiting.
+    Self = self(),
+    Late = make_ref(),
+    spawn_link(fun() ->
+		       receive after 10 -> ok end,
+		       [Self ! {noise,late} || _ <- lists:seq(1, 100)],
+		       Self ! {Late,late}
+	       end),
+    late = receive_reply(Late),
+    timeout = receive_reply_timeout(Late),
+
+    %% Messages from a process that has monitored us.
+    Monitored = [spawn_monitor(fun() -> exit(I) end) ||
+		    I <- lists:seq(1, 10)],
+    [I = receive_down(M) || {I,{_,M}} <- lists:zip(lists:seq(1, 10),
+						    Monitored)],
+
+    [{noise,I} = receive_any() || I <- lists:seq(1, N)],
+    [{noise,late} = receive_any() || _ <- lists:seq(1, 100)],
+    {messages,[]} = process_info(self(), messages),
+    ok.
+
+receive_reply(Ref) ->
+    receive {Ref,Reply} -> Reply end.
+
+receive_reply_above(Ref, Min) ->
+    receive {Ref,Reply} when Reply > Min -> Reply end.
+
+receive_reply_timeout(Ref) ->
+    receive {Ref,Reply} -> Reply after 0 -> timeout end.
+
+receive_tagged(Ref) ->
+    receive {tag,Ref,Reply} -> Reply end.
+
+receive_bare(Ref) ->
+    receive Ref -> ok end.
+
+receive_down(Mref) ->
+    receive {'DOWN',Mref,process,_,Reason} -> Reason end.
+
+receive_any() ->
+    receive Msg -> Msg end.
+
 %%%
 %%% Common helpers.
 %%%
@@ -36,7 +36,8 @@
 -export([all/0, suite/0]).
 
 -export([process_count/1, system_version/1, misc_smoke_tests/1,
-         heap_size/1, wordsize/1, memory/1, ets_limit/1]).
+         heap_size/1, wordsize/1, memory/1, ets_limit/1,
+         allocator_stats/1]).
 
 suite() ->
     [{ct_hooks,[ts_install_cth]},
@@ -44,7 +45,7 @@ suite() ->
 
 all() -> 
     [process_count, system_version, misc_smoke_tests,
-     heap_size, wordsize, memory, ets_limit].
+     heap_size, wordsize, memory, ets_limit, allocator_stats].
 
 %%%
 %%% The test cases -------------------------------------------------------------
@@ -479,6 +480,71 @@ ets_limit(Config0) when is_list(Config0) ->
     12345 = get_ets_limit(Config, 12345),
     ok.
 
+%% Verify that system_info({allocator_stats, Alloc}) reports the same
+%% instances as system_info({allocator, Alloc}) and follows the carriers
+%% of a large binary.
+allocator_stats(Config) when is_list(Config) ->
+    AlcuKeys = [mbcs_blocks, mbcs_blocks_size, mbcs_carriers,
+                mbcs_carriers_size, sbcs_blocks, sbcs_blocks_size,
+                sbcs_carriers, sbcs_carriers_size],
+    PoolKeys = [mbcs_pool_blocks, mbcs_pool_blocks_size,
+                mbcs_pool_carriers, mbcs_pool_carriers_size],
+    lists:foreach(
+      fun (Alloc) ->
+              case erlang:system_info({allocator_stats, Alloc}) of
+                  false ->
+                      false = erlang:system_info({allocator, Alloc});
+                  Stats ->
+                      Ixs = [Ix || {instance, Ix, _} <- Stats],
+                      Ixs = [Ix || {instance, Ix, _}
+                                       <- erlang:system_info({allocator,
+                                                              Alloc})],
+                      lists:foreach(
+                        fun ({instance, _, KVs}) ->
+                                true = lists:all(fun ({_, V}) ->
+                                                         is_integer(V)
+                                                             andalso V >= 0
+                                                 end, KVs),
+                                Keys = [K || {K, _} <- KVs],
+                                true = (Keys =:= AlcuKeys
+                                        orelse Keys =:= AlcuKeys ++ PoolKeys)
+                        end, Stats)
+              end
+      end, erlang:system_info(alloc_util_allocators)),
+
+    case erlang:system_info({allocator_stats, mseg_alloc}) of
+        false ->
+            ok;
+        MsegStats ->
+            lists:foreach(
+              fun ({instance, _, KVs}) ->
+                      [segments, segments_size, cached_segments,
+                       cache_hits] = [K || {K, _} <- KVs]
+              end, MsegStats)
+    end,
+
+    {'EXIT', {badarg, _}} = (catch erlang:system_info({allocator_stats,
+                                                        no_such_alloc})),
+    false = erlang:system_info({allocator_stats, sys_alloc}),
+
+    %% A binary above the singleblock carrier threshold of
+    %% binary_alloc gets a singleblock carrier of its own.
+    case erlang:system_info({allocator_stats, binary_alloc}) of
+        false ->
+            {comment, "binary_alloc disabled"};
+        _ ->
+            Before = sbcs_carriers(binary_alloc),
+            Bin = binary:copy(<<0>>, 16*1024*1024),
+            true = sbcs_carriers(binary_alloc) > Before,
+            16777216 = byte_size(Bin),
+            ok
+    end.
+
+sbcs_carriers(Alloc) ->
+    lists:sum([proplists:get_value(sbcs_carriers, KVs)
+               || {instance, _, KVs}
+                      <- erlang:system_info({allocator_stats, Alloc})]).
+
 get_ets_limit(Config) ->
     get_ets_limit(Config, 0).
 get_ets_limit(Config, EtsMax) ->
@@ -25,7 +25,8 @@
 %%%
 
 -export([all/0, suite/0, link_receive_call_correlation/0,
-         receive_trace/1, link_receive_call_correlation/1, self_send/1,
+         receive_trace/1, receive_trace_burst/1,
+         link_receive_call_correlation/1, self_send/1,
 	 timeout_trace/1, send_trace/1,
 	 procs_trace/1, dist_procs_trace/1, procs_new_trace/1,
 	 suspend/1, mutual_suspend/1, suspend_exit/1, suspender_exit/1,
@@ -49,7 +50,8 @@ suite() ->
      {timetrap, {seconds, 5}}].
 
 all() -> 
-    [cpu_timestamp, receive_trace, link_receive_call_correlation,
+    [cpu_timestamp, receive_trace, receive_trace_burst,
+     link_receive_call_correlation,
      self_send, timeout_trace,
      send_trace, procs_trace, dist_procs_trace, suspend,
      mutual_suspend, suspend_exit, suspender_exit,
@@ -207,6 +209,22 @@ receive_trace(Config) when is_list(Config) ->
 
     ok.
 
+%% Tests that a burst of messages gives exactly one 'receive' event
+%% per message, in send order. The trace messages to Tracer are sent
+%% by the tracer module and may be queued several at a time.
+
+receive_trace_burst(Config) when is_list(Config) ->
+    N = 1000,
+    Tracer = fun_spawn(fun receiver/0),
+    Receiver = fun_spawn(fun receiver/0),
+    1 = erlang:trace(Tracer, true, ['receive']),
+    1 = erlang:trace(Receiver, true, ['receive', {tracer, Tracer}]),
+    [Receiver ! {msg, I} || I <- lists:seq(1, N)],
+    [{trace, Tracer, 'receive', {trace, Receiver, 'receive', {msg, I}}}
+     = receive_first_trace() || I <- lists:seq(1, N)],
+    receive_nothing(),
+    ok.
+
 %% Tests that receive of a message always happens before a call with
 %% that message and that links/unlinks are ordered together with the
 %% 'receive'.
@@ -154,6 +154,10 @@ static char *plush_val_switches[] = {
     "maxk",
     "maxel",
     "mqd",
+    "dgc",
+    "pgc",
+    "pgct",
+    "ahs",
     "",
     NULL
 };
@@ -128,7 +128,8 @@
 -export([localtime/0, make_ref/0]).
 -export([map_size/1, match_spec_test/3, md5/1, md5_final/1]).
 -export([md5_init/0, md5_update/2, module_loaded/1, monitor/2]).
--export([monitor_node/2, monitor_node/3, nif_error/1, nif_error/2]).
+-export([monitor_node/2, monitor_node/3, multi_send/2,
+	 nif_error/1, nif_error/2]).
 -export([node/0, node/1, now/0, phash/2, phash2/1, phash2/2]).
 -export([pid_to_list/1, port_close/1, port_command/2, port_command/3]).
 -export([port_connect/2, port_control/3, port_get_data/1]).
@@ -1247,6 +1248,13 @@ monitor_node(_Node, _Flag) ->
 monitor_node(_Node, _Flag, _Options) ->
     erlang:nif_error(undefined).
 
+%% multi_send/2
+-spec erlang:multi_send(Pids, Msg) -> ok when
+      Pids :: [pid()],
+      Msg :: term().
+multi_send(_Pids, _Msg) ->
+    erlang:nif_error(undefined).
+
 %% nif_error/1
 %% Shadowed by erl_bif_types: erlang:nif_error/1
 -spec erlang:nif_error(Reason) -> no_return() when
@@ -2101,6 +2109,9 @@ open_port(PortName, PortSettings) ->
                   (max_heap_size, MaxHeapSize) -> OldMaxHeapSize when
       MaxHeapSize :: max_heap_size(),
       OldMaxHeapSize :: max_heap_size();
+                  (max_message_queue_len, MaxLen) -> OldMaxLen when
+      MaxLen :: max_message_queue_len(),
+      OldMaxLen :: max_message_queue_len();
                   (message_queue_data, MQD) -> OldMQD when
       MQD :: message_queue_data(),
       OldMQD :: message_queue_data();
@@ -2131,11 +2142,13 @@ process_flag(_Flag, _Value) ->
       error_handler |
       garbage_collection |
       garbage_collection_info |
+      garbage_collection_stats |
       group_leader |
       heap_size |
       initial_call |
       links |
       last_calls |
+      max_message_queue_len |
       memory |
       message_queue_len |
       messages |
@@ -2172,6 +2185,7 @@ process_flag(_Flag, _Value) ->
       {error_handler, Module :: module()} |
       {garbage_collection, GCInfo :: [{atom(),non_neg_integer()}]} |
       {garbage_collection_info, GCInfo :: [{atom(),non_neg_integer()}]} |
+      {garbage_collection_stats, GCStats :: [{atom(),non_neg_integer()}]} |
       {group_leader, GroupLeader :: pid()} |
       {heap_size, Size :: non_neg_integer()} |
       {initial_call, mfa()} |
@@ -2183,6 +2197,7 @@ process_flag(_Flag, _Value) ->
       {min_heap_size, MinHeapSize :: non_neg_integer()} |
       {min_bin_vheap_size, MinBinVHeapSize :: non_neg_integer()} |
       {max_heap_size, MaxHeapSize :: max_heap_size()} |
+      {max_message_queue_len, MaxLen :: max_message_queue_len()} |
       {monitored_by, Pids :: [pid()]} |
       {monitors,
        Monitors :: [{process | port, Pid :: pid() | port() |
@@ -2268,6 +2283,7 @@ setelement(_Index, _Tuple1, _Value) ->
               | {fullsweep_after, Number :: non_neg_integer()}
               | {min_heap_size, Size :: non_neg_integer()}
               | {max_heap_size, Size :: max_heap_size()}
+              | {max_message_queue_len, MaxLen :: max_message_queue_len()}
               | {min_bin_vheap_size, VSize :: non_neg_integer()}.
 spawn_opt(_Tuple) ->
    erlang:nif_error(undefined).
@@ -2283,6 +2299,9 @@ spawn_opt(_Tuple) ->
                 (garbage_collection) -> {Number_of_GCs, Words_Reclaimed, 0} when
       Number_of_GCs :: non_neg_integer(),
       Words_Reclaimed :: non_neg_integer();
+                (garbage_collection_pauses) -> [{Limit, Count}] when
+      Limit :: pos_integer() | infinity,
+      Count :: non_neg_integer();
                 (io) -> {{input, Input}, {output, Output}} when
       Input :: non_neg_integer(),
       Output :: non_neg_integer();
@@ -2507,6 +2526,8 @@ tuple_to_list(_Tuple) ->
          ({allocator, Alloc}) -> [_] when %% More or less anything
       Alloc :: atom();
          ({allocator_sizes, Alloc}) -> [_] when %% More or less anything
+      Alloc :: atom();
+         ({allocator_stats, Alloc}) -> [_] | false when
       Alloc :: atom();
          (build_type) -> opt | debug | purify | quantify | purecov |
                          gcov | valgrind | gprof | lcnt | frmptr;
@@ -2690,6 +2711,11 @@ spawn_monitor(M, F, A) ->
            kill => boolean(),
            error_logger => boolean() }.
 
+-type max_message_queue_len() ::
+        Len :: non_neg_integer()
+      | #{ len => non_neg_integer(),
+           action => drop | kill | suspend }.
+
 -type spawn_opt_option() ::
 	link
       | monitor
@@ -2698,6 +2724,8 @@ spawn_monitor(M, F, A) ->
       | {min_heap_size, Size :: non_neg_integer()}
       | {min_bin_vheap_size, VSize :: non_neg_integer()}
       | {max_heap_size, Size :: max_heap_size()}
+      | {adaptive_heap_size, boolean()}
+      | {max_message_queue_len, MaxLen :: max_message_queue_len()}
       | {message_queue_data, MQD :: message_queue_data()}.
 
 -spec spawn_opt(Fun, Options) -> pid() | {pid(), reference()} when
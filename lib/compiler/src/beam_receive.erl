@@ -20,7 +20,7 @@
 
 -module(beam_receive).
 -export([module/2]).
--import(lists, [foldl/3,reverse/1,reverse/2]).
+-import(lists, [foldl/3,member/2,reverse/1,reverse/2]).
 
 %%%
 %%% In code such as:
@@ -64,9 +64,26 @@
 %%% We use a reference to a label (i.e. a position in the loaded code)
 %%% as the SomeUniqInteger.
 %%%
+%%% Independently of where the reference was created, a receive whose
+%%% every clause compares a reference held in a Y register with the
+%%% message itself or with one of its first four tuple elements, as in
+%%%
+%%%    receive
+%%%       {Ref,Reply} -> Reply;
+%%%       {'DOWN',Ref,process,_,Reason} -> exit(Reason)
+%%%    end.
+%%%
+%%% is preceded by a recv_index instruction naming the Y register
+%%% when the recv_index option is given. The runtime system may then
+%%% look up the messages containing the reference in an index of the
+%%% message queue rather than examining every message in a long queue.
+%%% The option is off by default, since runtime systems that do not
+%%% know the instruction refuse to load the module.
+%%%
 
-module({Mod,Exp,Attr,Fs0,Lc}, _Opts) ->
-    Fs = [function(F) || F <- Fs0],
+module({Mod,Exp,Attr,Fs0,Lc}, Opts) ->
+    Index = proplists:get_bool(recv_index, Opts),
+    Fs = [function(F, Index) || F <- Fs0],
     Code = {Mod,Exp,Attr,Fs,Lc},
     {ok,Code}.
 
@@ -74,10 +91,14 @@ module({Mod,Exp,Attr,Fs0,Lc}, _Opts) ->
 %%% Local functions.
 %%%
 
-function({function,Name,Arity,Entry,Is}) ->
+function({function,Name,Arity,Entry,Is0}, Index) ->
     try
-	D = beam_utils:index_labels(Is),
-	{function,Name,Arity,Entry,opt(Is, D, [])}
+	D = beam_utils:index_labels(Is0),
+	Is = case Index of
+		 true -> index(opt(Is0, D, []), D, []);
+		 false -> opt(Is0, D, [])
+	     end,
+	{function,Name,Arity,Entry,Is}
     catch
 	Class:Error ->
 	    Stack = erlang:get_stacktrace(),
@@ -341,6 +362,162 @@ opt_ref_used_bl([{set,Ds,Ss,_}|Is], Regs0) ->
     end;
 opt_ref_used_bl([], Regs) -> Regs.
 
+%%%
+%%% Insertion of recv_index instructions.
+%%%
+
+index([{label,_}=Lbl,{loop_rec,{f,Fail},{x,0}}=Loop|Is], D, Acc0) ->
+    case index_reg(Is, Fail, D) of
+	none ->
+	    index(Is, D, [Loop,Lbl|Acc0]);
+	Reg ->
+	    Acc = case Acc0 of
+		      [{recv_set,_}=RecvSet|Acc1] ->
+			  [RecvSet,{recv_index,Reg}|Acc1];
+		      _ ->
+			  [{recv_index,Reg}|Acc0]
+		  end,
+	    index(Is, D, [Loop,Lbl|Acc])
+    end;
+index([I|Is], D, Acc) ->
+    index(Is, D, [I|Acc]);
+index([], _, Acc) ->
+    reverse(Acc).
+
+%% index_reg([Instruction], FailLabel, LabelIndex) -> none|{y,N}
+%%  Find a Y register holding a value that every message matched out
+%%  by the receive statement starting at the instructions must contain,
+%%  either as the message itself or as one of its first four tuple
+%%  elements. The register must not be changed while the message
+%%  queue is scanned.
+
+index_reg(Is, Fail, D) ->
+    Cands = ordsets:from_list([Y || {test,is_eq_exact,_,Args} <- Is,
+				    {y,_}=Y <- Args]),
+    index_reg_1(Cands, Is, Fail, D).
+
+index_reg_1([Y|Ys], Is, Fail, D) ->
+    Done = gb_sets:singleton(Fail),
+    try
+	_ = index_used_1(Is, Y, D, Done, index_regs_init()),
+	Y
+    catch
+	throw:not_used ->
+	    index_reg_1(Ys, Is, Fail, D)
+    end;
+index_reg_1([], _, _, _) -> none.
+
+%% Like opt_ref_used_1/5, this function only returns if all paths
+%% through the receive statement are safe. Regs is either 'none' if
+%% the message is known to contain the value in Y, or a pair of the
+%% register sets holding the message and holding an indexed element
+%% of it (or the message).
+index_used_1([{block,Bl}|Is], Y, D, Done, Regs0) ->
+    case index_used_bl(Bl, Y, Regs0) of
+	removed -> Done;
+	Regs -> index_used_1(Is, Y, D, Done, Regs)
+    end;
+index_used_1([{test,is_eq_exact,{f,Fail},Args}|Is], Y, D, Done0, Regs) ->
+    Done = index_used_at(Fail, Y, D, Done0, Regs),
+    case is_index_comparison(Args, Y, Regs) of
+	false -> index_used_1(Is, Y, D, Done, Regs);
+	true -> index_used_1(Is, Y, D, Done, none)
+    end;
+index_used_1([{test,_,{f,Fail},_}|Is], Y, D, Done0, Regs) ->
+    Done = index_used_at(Fail, Y, D, Done0, Regs),
+    index_used_1(Is, Y, D, Done, Regs);
+index_used_1([{bif,_,{f,Fail},_,Dst}|Is], Y, D, Done0, Regs)
+  when Fail =/= 0, Dst =/= Y ->
+    Done = index_used_at(Fail, Y, D, Done0, Regs),
+    index_used_1(Is, Y, D, Done, index_update_regs([Dst], [], bif, Regs));
+index_used_1([{gc_bif,_,{f,Fail},Live,_,Dst}|Is], Y, D, Done0, Regs0)
+  when Fail =/= 0, Dst =/= Y ->
+    Done = index_used_at(Fail, Y, D, Done0, Regs0),
+    Regs1 = index_kill_not_live(Live, Regs0),
+    Regs = index_update_regs([Dst], [], bif, Regs1),
+    index_used_1(Is, Y, D, Done, Regs);
+index_used_1([{select,_,_,{f,Fail},List}|_], Y, D, Done, Regs) ->
+    Lbls = [F || {f,F} <- List] ++ [Fail],
+    foldl(fun(L, A) -> index_used_at(L, Y, D, A, Regs) end, Done, Lbls);
+index_used_1([{label,Lbl}|Is], Y, D, Done, Regs) ->
+    case index_is_done(Lbl, Regs, Done) of
+	true -> Done;
+	false -> index_used_1(Is, Y, D, Done, Regs)
+    end;
+index_used_1([{loop_rec_end,_}|_], _, _, Done, _) ->
+    Done;
+index_used_1([_I|_], _, _, _, _) ->
+    %% The index may be unsafe to use.
+    throw(not_used).
+
+index_used_at(Fail, Y, D, Done0, Regs) ->
+    case index_is_done(Fail, Regs, Done0) of
+	true ->
+	    Done0;
+	false ->
+	    Is = beam_utils:code_at(Fail, D),
+	    Done = index_used_1(Is, Y, D, Done0, Regs),
+	    gb_sets:add({Fail,Regs}, Done)
+    end.
+
+%% The label of the wait instruction is done in any state.
+index_is_done(Lbl, Regs, Done) ->
+    gb_sets:is_member(Lbl, Done) orelse gb_sets:is_member({Lbl,Regs}, Done).
+
+is_index_comparison(_, _, none) ->
+    false;
+is_index_comparison([R1,R2], Y, {_,ElemRegs}) ->
+    (R1 =:= Y andalso regs_is_member(R2, ElemRegs)) orelse
+    (R2 =:= Y andalso regs_is_member(R1, ElemRegs)).
+
+index_used_bl([{set,[],[],remove_message}|_], _, none) ->
+    removed;
+index_used_bl([{set,[],[],remove_message}|_], _, _) ->
+    throw(not_used);
+index_used_bl([{set,Ds,Ss,Op}|Is], Y, Regs0) ->
+    case member(Y, Ds) of
+	true -> throw(not_used);
+	false -> ok
+    end,
+    Regs = index_update_regs(Ds, Ss, Op, Regs0),
+    index_used_bl(Is, Y, Regs);
+index_used_bl([], _, Regs) -> Regs.
+
+index_update_regs(_, _, _, none) ->
+    none;
+index_update_regs([Dst]=Ds, [Src], move, {MsgRegs0,ElemRegs0}) ->
+    MsgRegs1 = regs_kill(Ds, MsgRegs0),
+    ElemRegs1 = regs_kill(Ds, ElemRegs0),
+    MsgRegs = index_regs_copy(Src, Dst, MsgRegs0, MsgRegs1),
+    ElemRegs = index_regs_copy(Src, Dst, ElemRegs0, ElemRegs1),
+    {MsgRegs,ElemRegs};
+index_update_regs([Dst]=Ds, [Src], {get_tuple_element,N},
+		  {MsgRegs0,ElemRegs0}) ->
+    MsgRegs = regs_kill(Ds, MsgRegs0),
+    ElemRegs1 = regs_kill(Ds, ElemRegs0),
+    ElemRegs = case N < 4 andalso regs_is_member(Src, MsgRegs0) of
+		   true -> regs_add(Dst, ElemRegs1);
+		   false -> ElemRegs1
+	       end,
+    {MsgRegs,ElemRegs};
+index_update_regs(Ds, _, _, {MsgRegs,ElemRegs}) ->
+    {regs_kill(Ds, MsgRegs),regs_kill(Ds, ElemRegs)}.
+
+index_kill_not_live(_, none) ->
+    none;
+index_kill_not_live(Live, {MsgRegs,ElemRegs}) ->
+    {regs_kill_not_live(Live, MsgRegs),regs_kill_not_live(Live, ElemRegs)}.
+
+index_regs_copy(Src, Dst, Regs0, Regs) ->
+    case regs_is_member(Src, Regs0) of
+	true -> regs_add(Dst, Regs);
+	false -> Regs
+    end.
+
+%% The message in {x,0} is both the message and an indexed value.
+index_regs_init() ->
+    {regs_init_x0(),regs_init_x0()}.
+
 %%%
 %%% Functions for keeping track of a set of registers.
 %%%
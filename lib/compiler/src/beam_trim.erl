@@ -187,6 +187,8 @@ remap([{bs_put=Op,Fail,Info,Ss}|Is], Map, Acc) ->
     remap(Is, Map, [I|Acc]);
 remap([{kill,Y}|T], Map, Acc) ->
     remap(T, Map, [{kill,Map(Y)}|Acc]);
+remap([{recv_index,Y}|T], Map, Acc) ->
+    remap(T, Map, [{recv_index,Map(Y)}|Acc]);
 remap([{make_fun2,_,_,_,_}=I|T], Map, Acc) ->
     remap(T, Map, [I|Acc]);
 remap([{deallocate,N}|Is], Map, Acc) ->
@@ -280,6 +282,8 @@ frame_size([{kill,_}|Is], Safe) ->
     frame_size(Is, Safe);
 frame_size([{make_fun2,_,_,_,_}|Is], Safe) ->
     frame_size(Is, Safe);
+frame_size([{recv_index,_}|Is], Safe) ->
+    frame_size(Is, Safe);
 frame_size([{get_map_elements,{f,L},_,_}|Is], Safe) ->
     frame_size_branch(L, Is, Safe);
 frame_size([{deallocate,N}|_], _) -> N;
@@ -345,6 +345,9 @@ valfun_1({recv_mark,{f,Fail}}, Vst) when is_integer(Fail) ->
     Vst;
 valfun_1({recv_set,{f,Fail}}, Vst) when is_integer(Fail) ->
     Vst;
+valfun_1({recv_index,Reg}, Vst) ->
+    assert_term(Reg, Vst),
+    Vst;
 %% Misc.
 valfun_1(remove_message, Vst) ->
     Vst;
@@ -25,10 +25,12 @@
 	 init_per_group/2,end_per_group/2,
 	 init_per_testcase/2,end_per_testcase/2,
 	 export/1,recv/1,coverage/1,otp_7980/1,ref_opt/1,
-	 wait/1]).
+	 wait/1,index/1]).
 
 -include_lib("common_test/include/ct.hrl").
 
+-compile(recv_index).
+
 init_per_testcase(_Case, Config) ->
     Config.
 
@@ -45,7 +47,7 @@ all() ->
 
 groups() -> 
     [{p,test_lib:parallel(),
-      [recv,coverage,otp_7980,ref_opt,export,wait]}].
+      [recv,coverage,otp_7980,ref_opt,export,wait,index]}].
 
 
 init_per_suite(Config) ->
@@ -260,6 +262,85 @@ cover_recv_instructions() ->
 	Ref -> ok
     end.
 
+index(Config) when is_list(Config) ->
+    case ?MODULE of
+	receive_SUITE -> index_1();
+	_ -> {skip,"Enough to run this case once."}
+    end.
+
+index_1() ->
+    Ref = make_ref(),
+    Msgs = [{Ref,1},{tag,Ref,2},Ref,{other,{Ref,3}},{other,a,b,c,Ref},
+	    {Ref,4},stop],
+    [self() ! M || M <- Msgs],
+    {other,a,b,c,Ref} = index_no_fifth(Ref),
+    {other,{Ref,3}} = index_no_nested(Ref),
+    2 = index_yes_tagged(Ref),
+    ok = index_yes_bare(Ref),
+    1 = index_yes_reply(Ref),
+    4 = index_yes_guard(Ref, 3),
+    stop = index_no_mixed(Ref),
+    timeout = index_yes_reply_timeout(Ref),
+
+    %% Only receives where every matched message must contain
+    %% the reference should be marked with recv_index.
+    {beam_file,?MODULE,_,_,_,Code} = beam_disasm:file(code:which(?MODULE)),
+    Marked = [Name || {function,Name,_,_,Is} <- Code,
+		      lists:keymember(recv_index, 1, Is)],
+    [index_yes_bare,index_yes_guard,index_yes_reply,
+     index_yes_reply_timeout,index_yes_tagged] =
+	lists:sort([Name || Name <- Marked,
+			    lists:prefix("index_", atom_to_list(Name))]),
+
+    %% The hints are only emitted when asked for, since runtime
+    %% systems that do not know the instruction cannot load them.
+    Src = ["-module(index_opt).",
+	   "-export([f/1]).",
+	   "f(Ref) -> receive {Ref,Reply} -> Reply end."],
+    Forms = [begin
+		 {ok,Ts,_} = erl_scan:string(S),
+		 {ok,F} = erl_parse:parse_form(Ts),
+		 F
+	     end || S <- Src],
+    {ok,index_opt,Plain} = compile:forms(Forms, []),
+    false = has_recv_index(Plain),
+    {ok,index_opt,Hinted} = compile:forms(Forms, [recv_index]),
+    true = has_recv_index(Hinted),
+    ok.
+
+has_recv_index(Beam) ->
+    {beam_file,_,_,_,_,Code} = beam_disasm:file(Beam),
+    lists:any(fun({function,_,_,_,Is}) ->
+		      lists:keymember(recv_index, 1, Is)
+	      end, Code).
+
+index_yes_reply(Ref) ->
+    receive {Ref,Reply} -> Reply end.
+
+index_yes_reply_timeout(Ref) ->
+    receive {Ref,Reply} -> Reply after 0 -> timeout end.
+
+index_yes_guard(Ref, Min) ->
+    receive {Ref,Reply} when Reply > Min -> Reply end.
+
+index_yes_tagged(Ref) ->
+    receive {tag,Ref,Reply} -> Reply end.
+
+index_yes_bare(Ref) ->
+    receive Ref -> ok end.
+
+index_no_nested(Ref) ->
+    receive {other,{Ref,_}}=Msg -> Msg end.
+
+index_no_fifth(Ref) ->
+    receive {other,_,_,_,Ref}=Msg -> Msg end.
+
+index_no_mixed(Ref) ->
+    receive
+	{Ref,Reply} -> Reply;
+	stop -> stop
+    end.
+
 export(Config) when is_list(Config) ->
     Ref = make_ref(),
     self() ! {result,Ref,42},
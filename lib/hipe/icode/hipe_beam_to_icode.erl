@@ -417,6 +417,9 @@ trans_fun([{recv_mark,{f,_}}|Instructions], Env) ->
   trans_fun(Instructions,Env);
 trans_fun([{recv_set,{f,_}}|Instructions], Env) ->
   trans_fun(Instructions,Env);
+%%--- recv_index/1 ---
+trans_fun([{recv_index,_}|Instructions], Env) ->
+  trans_fun(Instructions,Env);
 %%--------------------------------------------------------------------
 %%--- Translation of arithmetics {bif,ArithOp, ...} ---
 %%--------------------------------------------------------------------
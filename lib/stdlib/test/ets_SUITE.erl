@@ -77,6 +77,7 @@
 -export([otp_9423/1]).
 -export([otp_10182/1]).
 -export([ets_all/1]).
+-export([shared_terms/1]).
 -export([memory_check_summary/1]).
 -export([take/1]).
 
@@ -158,6 +159,7 @@ all() ->
      otp_9423,
      ets_all,
      take,
+     shared_terms,
 
      memory_check_summary]. % MUST BE LAST
 
@@ -5588,6 +5590,39 @@ take(Config) when is_list(Config) ->
     ets:delete(T3),
     ok.
 
+%% Test that subterms shared within a large object stay shared when
+%% stored in and read from uncompressed tables. The object would not
+%% fit in memory if flattened.
+shared_terms(Config) when is_list(Config) ->
+    EtsMem = etsmem(),
+    repeat_for_opts(shared_terms_do, [[set,ordered_set]]),
+    verify_etsmem(EtsMem).
+
+shared_terms_do(Opts) ->
+    Term = lists:foldl(fun (I, Acc) ->
+                               {I, Acc, [Acc | Acc], list_to_binary([I])}
+                       end, [], lists:seq(1, 40)),
+    TermSize = erts_debug:size_shared(Term),
+    Size = TermSize + erts_debug:flat_size({key,a,1.5}),
+    T = ets_new(shared, Opts),
+    true = ets:insert(T, {key, Term, 1.5}),
+    [{key,_,1.5}=Obj1] = ets:lookup(T, key),
+    Size = erts_debug:size_shared(Obj1),
+    [Obj2] = ets:select(T, [{{key,'_','_'},[],['$_']}]),
+    Size = erts_debug:size_shared(Obj2),
+    %% Update in place, then with a resize of the object.
+    true = ets:update_element(T, key, {3, 2.5}),
+    [{key,_,2.5}=Obj3] = ets:lookup(T, key),
+    Size = erts_debug:size_shared(Obj3),
+    true = ets:update_element(T, key, {3, [Term]}),
+    Size4 = Size + TermSize,
+    [{key,_,[_]}=Obj4] = ets:lookup(T, key),
+    Size4 = erts_debug:size_shared(Obj4),
+    [Obj5] = ets:tab2list(T),
+    Size4 = erts_debug:size_shared(Obj5),
+    true = ets:delete(T),
+    ok.
+
 
 %%
 %% Utility functions:
@@ -23,7 +23,8 @@
 	 sort/1, store_memory_data/1, sum_blocks/1,
 	 descr/1, type_descr/2, allocator_descr/2, class_descr/2,
 	 type_no_range/1, block_header_size/1, store_memory_status/1,
-	 read_memory_status/1, memory_status/1]).
+	 read_memory_status/1, memory_status/1, allocation_samples/0,
+	 memory_attribution/0]).
 
 
 -define(OLD_INFO_SIZE, 32). %% (sizeof(mem_link) in pre R9C utils.c)
@@ -68,6 +69,26 @@ memory_status(Type) when is_atom(Type) ->
 memory_status(Type) ->
     erlang:error(badarg, [Type]).
 
+allocation_samples() ->
+    case catch erlang:system_info({allocated, samples}) of
+	{'EXIT',{Error,_}} ->
+	    erlang:error(Error, []);
+	{'EXIT',Error} ->
+	    erlang:error(Error, []);
+	Res ->
+	    Res
+    end.
+
+memory_attribution() ->
+    case catch erlang:system_info({allocated, attribution}) of
+	{'EXIT',{Error,_}} ->
+	    erlang:error(Error, []);
+	{'EXIT',Error} ->
+	    erlang:error(Error, []);
+	Res ->
+	    Res
+    end.
+
 store_memory_status(File) when is_list(File) ->
     case catch erlang:system_info({allocated, status, File}) of
 	{'EXIT',{Error,_}} ->
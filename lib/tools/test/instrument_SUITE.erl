@@ -20,7 +20,7 @@
 -module(instrument_SUITE).
 
 -export([all/0, suite/0]).
--export(['+Mim true'/1, '+Mis true'/1]).
+-export(['+Mim true'/1, '+Mis true'/1, '+Mip 1024'/1, '+Mia true'/1]).
 
 -include_lib("common_test/include/ct.hrl").
 
@@ -29,7 +29,7 @@ suite() ->
      {timetrap,{seconds,10}}].
 
 all() -> 
-    ['+Mim true', '+Mis true'].
+    ['+Mim true', '+Mis true', '+Mip 1024', '+Mia true'].
 
 
 %% Check that memory data can be read and processed
@@ -103,6 +103,54 @@ all() ->
     true = is_list(rpc:call(Node,instrument,memory_status,[types])),
     ok.
 
+%% Check that allocation samples can be read
+'+Mip 1024'(Config) when is_list(Config) ->
+    Node = start_slave("+Mip 1024"),
+    {1024, Samples} = rpc:call(Node, instrument, allocation_samples, []),
+    false = rpc:call(Node, instrument, memory_status, [total]),
+    stop_slave(Node),
+    true = length(Samples) > 0,
+    lists:foreach(
+      fun ({Type,Size,Proc,MFA}) ->
+              true = is_atom(Type),
+              true = is_integer(Size) andalso Size > 0,
+              true = is_pid(Proc) orelse Proc == undefined,
+              case MFA of
+                  {M,F,A} when is_atom(M), is_atom(F), is_integer(A) ->
+                      ok;
+                  undefined ->
+                      ok;
+                  BadMFA ->
+                      ct:fail({badmfa, BadMFA})
+              end
+      end, Samples),
+    ok.
+
+%% Check that binaries and tables are attributed to their creators
+'+Mia true'(Config) when is_list(Config) ->
+    Node = start_slave("+Mia true"),
+    Pid = spawn(Node, fun attribution_creator/0),
+    Pid ! {self(), create},
+    receive {Pid, created} -> ok end,
+    Attr = rpc:call(Node, instrument, memory_attribution, []),
+    Pid ! {self(), stop},
+    stop_slave(Node),
+    Mine = [{Kind, MFA, Count, Bytes} || {Kind, P, MFA, Count, Bytes} <- Attr,
+                                         P =:= Pid],
+    {binary, {?MODULE,_,_}, 100, BinBytes} = lists:keyfind(binary, 1, Mine),
+    true = BinBytes >= 100*1024,
+    {ets, {?MODULE,_,_}, 3, _} = lists:keyfind(ets, 1, Mine),
+    ok.
+
+attribution_creator() ->
+    receive
+        {From, create} ->
+            Bins = [binary:copy(<<I:8>>, 1024) || I <- lists:seq(1, 100)],
+            Tabs = [ets:new(attribution, []) || _ <- lists:seq(1, 3)],
+            From ! {self(), created},
+            receive {From, stop} -> {Bins, Tabs} end
+    end.
+
 start_slave(Args) ->
     MicroSecs = erlang:monotonic_time(),
     Name = "instr" ++ integer_to_list(MicroSecs),